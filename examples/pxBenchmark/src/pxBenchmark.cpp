@@ -9,6 +9,7 @@
 
 #include "pxScene2d.h"
 #include "pxContext.h"
+#include "pxUtil.h"
 #include "rtSettings.h"
 #include "pxEventLoop.h"
 
@@ -262,6 +263,9 @@ void benchmarkWindow::reset()
         case pxApiFixture::type::xDrawImagePNG:
             mGroupName = "DrawImagePNG";
             break;
+        case pxApiFixture::type::xResampleImage:
+            mGroupName = "ResampleImage";
+            break;
         case pxApiFixture::type::xDrawImageBorder9:
             mGroupName = "DrawImageBorder9";
             break;
@@ -508,7 +512,7 @@ uint64_t pxApiFixture::run(const uint64_t threads, const uint64_t iterations, co
         
         gOtherStart = celero::timer::GetSystemTime();
         
-        if (mExperimentValue.Value == xDrawImageJPG || mExperimentValue.Value == xDrawImagePNG)
+        if (mExperimentValue.Value == xDrawImageJPG || mExperimentValue.Value == xDrawImagePNG || mExperimentValue.Value == xResampleImage)
             gCPU += totalTime;
         else
             gGPU += totalTime;
@@ -661,6 +665,18 @@ void pxApiFixture::TestDrawImagePNG ()
     context.drawImage(mCurrentX, mCurrentY, mUnitWidth, mUnitHeight, mTextureRef, mTextureMaskRef, false, NULL, ((int)mCurrentX) % 2 == 0 ? pxConstantsStretch::STRETCH : pxConstantsStretch::REPEAT, ((int)mCurrentX) % 2 == 0 ? pxConstantsStretch::STRETCH : ((int)mCurrentY) % 2 == 0 ? pxConstantsStretch::REPEAT : pxConstantsStretch::NONE, true, ((int)mCurrentX) % 2 == 0 ? pxConstantsMaskOperation::NORMAL : pxConstantsMaskOperation::INVERT);
 }
 
+void pxApiFixture::TestResampleImage ()
+{
+    // area average down to the unit size, then bilinear back up
+    pxOffscreen scaled;
+    scaled.init(mUnitWidth, mUnitHeight);
+    pxResampleImage(mResampleSource, scaled, PX_RESAMPLE_AREA);
+    
+    pxOffscreen enlarged;
+    enlarged.init(mUnitWidth * 2, mUnitHeight * 2);
+    pxResampleImage(scaled, enlarged, PX_RESAMPLE_BILINEAR);
+}
+
 void pxApiFixture::TestDrawAll ()
 {
     TestDrawRect();
@@ -759,6 +775,9 @@ void pxApiFixture::onExperimentStart(const celero::TestFixture::ExperimentValue&
         case xDrawImagePNG:
             TestDrawImagePNG();
             break;
+        case xResampleImage:
+            TestResampleImage();
+            break;
         case xDrawImageBorder9:
             TestDrawImage9Border();
             break;
@@ -942,6 +961,12 @@ void pxApiFixture::setUp(const celero::TestFixture::ExperimentValue& experimentV
         mTextureRef = NULL;
     }
     
+    if (mExperimentValue.Value == xResampleImage && mResampleSource.base() == NULL)
+    {
+        mResampleSource.init(4096, 4096);
+        random(mResampleSource, -3, 2, -2.5, 2.5, 18);
+    }
+    
     if (mExperimentValue.Value != xDrawImagePNG && mExperimentValue.Value != xDrawImageJPG)
         mTextureRef = mDoCreateTexture ? CreateTexture() : GetImageTexture ("jpg");
     
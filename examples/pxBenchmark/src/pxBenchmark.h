@@ -109,6 +109,7 @@ class pxApiFixture : public celero::TestFixture
     void TestDrawImageMasked ();
     void TestDrawTextureQuads ();
     void TestDrawOffscreen ();
+    void TestResampleImage ();
     
     void TestDrawImageRan ();
     void TestDrawImage9Ran ();
@@ -118,6 +119,8 @@ class pxApiFixture : public celero::TestFixture
     pxTextureRef GetImageTexture (const std::string& format);
     
     pxTextureRef CreateTexture ();
+    
+    pxOffscreen                               mResampleSource;
 public:
     enum type
     {
@@ -137,6 +140,7 @@ public:
         xDrawTextureQuadsRan,*/
         xDrawImageJPG,
         xDrawImagePNG,
+        xResampleImage,
         xDrawAll,
         xEnd
     };
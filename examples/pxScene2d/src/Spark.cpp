@@ -106,6 +106,7 @@ extern bool gApplicationIsClosing;
 extern int pxObjectCount;
 
 #include "pxFont.h"
+#include "pxImageCache.h"
 
 #ifdef PXSCENE_FONT_ATLAS
 extern pxFontAtlas gFontAtlas;
@@ -442,6 +443,9 @@ protected:
     ENTERSCENELOCK()
     if (mView)
       mView->onDraw();
+#if defined(PX_PLATFORM_WAYLAND_EGL) && !defined(PX_PLATFORM_ESSOS)
+    setPresentDamage(context.damage());
+#endif
     EXITSCENELOCK()
   }
 
@@ -754,6 +758,34 @@ if (s && (strcmp(s,"1") == 0))
 
   rtLogInfo("dirty rectangles enabled: %s", gDirtyRectsEnabled ? "true":"false");
 
+  extern bool gLayerCachingEnabled;
+  extern uint32_t gLayerCachingFrames;
+  rtValue layerCachingSetting;
+  if (RT_OK == rtSettings::instance()->value("enableLayerCaching", layerCachingSetting))
+    gLayerCachingEnabled = layerCachingSetting.toString().compare("true") == 0;
+  rtValue layerCachingFramesSetting;
+  if (RT_OK == rtSettings::instance()->value("layerCachingFrames", layerCachingFramesSetting))
+    gLayerCachingFrames = layerCachingFramesSetting.toUInt32();
+
+  rtLogInfo("layer caching enabled: %s", gLayerCachingEnabled ? "true":"false");
+
+  extern bool gTextKerningEnabled;
+  rtValue textKerningSetting;
+  if (RT_OK == rtSettings::instance()->value("enableTextKerning", textKerningSetting))
+    gTextKerningEnabled = textKerningSetting.toString().compare("true") == 0;
+
+  extern bool gTextDistanceFieldEnabled;
+  rtValue textDistanceFieldSetting;
+  if (RT_OK == rtSettings::instance()->value("enableTextDistanceField", textDistanceFieldSetting))
+    gTextDistanceFieldEnabled = textDistanceFieldSetting.toString().compare("true") == 0;
+
+  rtValue imageCacheSizeSetting;
+  if (RT_OK == rtSettings::instance()->value("imageCacheSizeInMb", imageCacheSizeSetting))
+    pxImageCache::instance()->setMaxSize((int64_t)imageCacheSizeSetting.toInt32() * 1024 * 1024);
+  rtValue imageCacheCompressionSetting;
+  if (RT_OK == rtSettings::instance()->value("enableImageCacheCompression", imageCacheCompressionSetting))
+    pxImageCache::instance()->setCompressionEnabled(imageCacheCompressionSetting.toString().compare("true") == 0);
+
   rtValue optimizedUpdateSetting;
   if (RT_OK == rtSettings::instance()->value("enableOptimizedUpdate", optimizedUpdateSetting))
   {
@@ -0,0 +1,253 @@
+/*
+
+ pxCore Copyright 2005-2018 John Robinson
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+// pxAnimationEngine.cpp
+
+#include "pxAnimationEngine.h"
+#include "pxObject.h"
+#include "pxScene2d.h"
+
+#include <math.h>
+
+extern bool gDirtyRectsEnabled;
+
+pxAnimationEngine* pxAnimationEngine::instance()
+{
+  static pxAnimationEngine engine;
+  return &engine;
+}
+
+pxAnimationEngine::pxAnimationEngine(): mLanes(), mLocations(1), mFreeHandles(),
+  mScheduledObjects(), mSize(0), mTime(-1), mUpdating(false)
+{
+}
+
+uint32_t pxAnimationEngine::add(pxObject* o, const animation& a)
+{
+  if (a.property == PX_ANIMATED_PROPERTY_CUSTOM ||
+      (a.options & pxConstantsAnimation::OPTION_OSCILLATE))
+  {
+    return 0;
+  }
+
+  uint32_t laneIndex = 0;
+  while (laneIndex < mLanes.size() && mLanes[laneIndex].interp != a.interpFunc)
+    laneIndex++;
+  if (laneIndex == mLanes.size())
+  {
+    mLanes.push_back(lane());
+    mLanes.back().interp = a.interpFunc;
+  }
+
+  uint32_t handle;
+  if (mFreeHandles.empty())
+  {
+    handle = static_cast<uint32_t>(mLocations.size());
+    mLocations.push_back(location());
+  }
+  else
+  {
+    handle = mFreeHandles.back();
+    mFreeHandles.pop_back();
+  }
+
+  lane& l = mLanes[laneIndex];
+  mLocations[handle].lane = laneIndex;
+  mLocations[handle].index = static_cast<uint32_t>(l.object.size());
+
+  l.start.push_back(a.start);
+  l.duration.push_back(a.duration);
+  l.from.push_back(a.from);
+  l.to.push_back(a.to);
+  l.repeat.push_back(a.count == pxConstantsAnimation::COUNT_FOREVER);
+  l.property.push_back(static_cast<uint8_t>(a.property));
+  l.object.push_back(o);
+  l.handle.push_back(handle);
+  l.phase.push_back(0);
+  l.applied.push_back(0);
+  mSize++;
+
+  return handle;
+}
+
+void pxAnimationEngine::remove(uint32_t handle)
+{
+  location loc = mLocations[handle];
+  lane& l = mLanes[loc.lane];
+
+  // a setter run by update() is removing it, keep the slot so the tweens
+  // not yet applied stay in place and drop it once the frame is done
+  if (mUpdating)
+  {
+    l.object[loc.index] = NULL;
+    l.applied[loc.index] = 0;
+  }
+  else
+  {
+    removeAt(l, loc.index);
+  }
+
+  mFreeHandles.push_back(handle);
+  mSize--;
+}
+
+void pxAnimationEngine::removeAt(lane& l, uint32_t index)
+{
+  uint32_t last = static_cast<uint32_t>(l.object.size()) - 1;
+
+  // move the last tween of the lane into the hole
+  if (index != last)
+  {
+    l.start[index] = l.start[last];
+    l.duration[index] = l.duration[last];
+    l.from[index] = l.from[last];
+    l.to[index] = l.to[last];
+    l.repeat[index] = l.repeat[last];
+    l.property[index] = l.property[last];
+    l.object[index] = l.object[last];
+    l.handle[index] = l.handle[last];
+    l.phase[index] = l.phase[last];
+    l.applied[index] = l.applied[last];
+    mLocations[l.handle[index]].index = index;
+  }
+
+  l.start.pop_back();
+  l.duration.pop_back();
+  l.from.pop_back();
+  l.to.pop_back();
+  l.repeat.pop_back();
+  l.property.pop_back();
+  l.object.pop_back();
+  l.handle.pop_back();
+  l.phase.pop_back();
+  l.applied.pop_back();
+}
+
+double pxAnimationEngine::start(uint32_t handle) const
+{
+  const location& loc = mLocations[handle];
+  return mLanes[loc.lane].start[loc.index];
+}
+
+void pxAnimationEngine::setStart(uint32_t handle, double start)
+{
+  const location& loc = mLocations[handle];
+  mLanes[loc.lane].start[loc.index] = start;
+}
+
+bool pxAnimationEngine::wasApplied(uint32_t handle, double t) const
+{
+  const location& loc = mLocations[handle];
+  return mTime == t && mLanes[loc.lane].applied[loc.index] != 0;
+}
+
+void pxAnimationEngine::update(double t)
+{
+  mTime = t;
+  mScheduledObjects.clear();
+
+  mUpdating = true;
+  for (uint32_t i = 0; i < mLanes.size(); i++)
+  {
+    updateLane(i, t);
+  }
+  mUpdating = false;
+
+  // drop the tweens removed while the setters ran, from the back so the
+  // tween moved into a hole has already been looked at
+  for (uint32_t i = 0; i < mLanes.size(); i++)
+  {
+    lane& l = mLanes[i];
+    for (uint32_t j = static_cast<uint32_t>(l.object.size()); j > 0; j--)
+    {
+      if (l.object[j - 1] == NULL)
+        removeAt(l, j - 1);
+    }
+  }
+
+  // Objects with a tween that ended or has to repeat, and with dirty
+  // rectangles every object that moved, still go through pxObject::update()
+  for (uint32_t i = 0; i < mScheduledObjects.size(); i++)
+  {
+    mScheduledObjects[i]->triggerUpdate();
+  }
+}
+
+void pxAnimationEngine::updateLane(uint32_t laneIndex, double t)
+{
+  lane& l = mLanes[laneIndex];
+  uint32_t n = static_cast<uint32_t>(l.object.size());
+  if (n == 0)
+    return;
+
+  double* start = &l.start[0];
+  const double* duration = &l.duration[0];
+  const uint8_t* repeat = &l.repeat[0];
+  double* phase = &l.phase[0];
+  uint8_t* applied = &l.applied[0];
+
+  // tweens added since the last frame start now, unless their object
+  // isn't part of a scene yet
+  for (uint32_t i = 0; i < n; i++)
+  {
+    if (start[i] < 0 && l.object[i] != NULL && l.object[i]->parent() != NULL)
+      start[i] = t;
+  }
+
+  for (uint32_t i = 0; i < n; i++)
+  {
+    double t1 = (t - start[i]) / duration[i];
+    phase[i] = t1 - floor(t1);
+    applied[i] = start[i] >= 0 && (repeat[i] || t < start[i] + duration[i]);
+  }
+
+  pxInterpBatch(l.interp, phase, n);
+
+  const float* from = &l.from[0];
+  const float* to = &l.to[0];
+  for (uint32_t i = 0; i < n; i++)
+  {
+    phase[i] = from[i] + (to[i] - from[i]) * phase[i];
+  }
+
+  // A setter can run script that starts animations, which may add a lane
+  // and move the lanes, or append to this one. Removed tweens are only
+  // marked, see remove(). So look the lane up again for every tween.
+  for (uint32_t i = 0; i < mLanes[laneIndex].object.size(); i++)
+  {
+    lane& cur = mLanes[laneIndex];
+    pxObject* o = cur.object[i];
+    if (o == NULL)
+      continue;
+    if (o->parent() == NULL)
+    {
+      cur.applied[i] = 0;
+      continue;
+    }
+    if (!cur.applied[i])
+    {
+      mScheduledObjects.push_back(o);
+      continue;
+    }
+    o->mCancelInSet = false;
+    o->setAnimatedValue(static_cast<pxAnimatedProperty>(cur.property[i]), static_cast<float>(cur.phase[i]));
+    o->mCancelInSet = true;
+    if (gDirtyRectsEnabled)
+      mScheduledObjects.push_back(o);
+  }
+}
@@ -0,0 +1,102 @@
+/*
+
+ pxCore Copyright 2005-2018 John Robinson
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+// pxAnimationEngine.h
+
+#ifndef PX_ANIMATION_ENGINE_H
+#define PX_ANIMATION_ENGINE_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "pxInterpolators.h"
+
+class pxObject;
+struct animation;
+
+// Evaluates the running tweens of every scene in one pass per frame.
+//
+// The animation records in pxObject::mAnimations stay the owners of an
+// animation's promise, pxAnimate object and repeat count.  Tweens that write
+// to one of the core properties are also added here, where their timing and
+// end points are kept in contiguous arrays, one set of arrays per
+// interpolator so that the easing can run over a whole array at once.  The
+// results are written straight to the objects' setters.
+//
+// A tween whose duration has elapsed is left alone for that frame and its
+// object is scheduled for pxObject::update(), which ends or repeats it the
+// same way as an animation that isn't batched.
+class pxAnimationEngine
+{
+public:
+  static pxAnimationEngine* instance();
+
+  // returns the handle stored in a.engineId, 0 if a can't be batched
+  uint32_t add(pxObject* o, const animation& a);
+  void remove(uint32_t handle);
+
+  double start(uint32_t handle) const;
+  void setStart(uint32_t handle, double start);
+
+  // true if update(t) has already written this tween's value for time t
+  bool wasApplied(uint32_t handle, double t) const;
+
+  void update(double t);
+
+  uint32_t size() const { return mSize; }
+
+private:
+  pxAnimationEngine();
+
+  struct lane
+  {
+    pxInterp interp;
+
+    std::vector<double> start;
+    std::vector<double> duration;
+    std::vector<float> from;
+    std::vector<float> to;
+    std::vector<uint8_t> repeat;   // COUNT_FOREVER, never ends
+    std::vector<uint8_t> property; // pxAnimatedProperty
+    std::vector<pxObject*> object;
+    std::vector<uint32_t> handle;
+
+    // per frame
+    std::vector<double> phase;
+    std::vector<uint8_t> applied;
+  };
+
+  struct location
+  {
+    uint32_t lane;
+    uint32_t index;
+  };
+
+  void updateLane(uint32_t laneIndex, double t);
+  void removeAt(lane& l, uint32_t index);
+
+  std::vector<lane> mLanes;
+  std::vector<location> mLocations; // by handle, 0 is unused
+  std::vector<uint32_t> mFreeHandles;
+  std::vector<pxObject*> mScheduledObjects;
+  uint32_t mSize;
+  double mTime;
+  bool mUpdating;
+};
+
+#endif // PX_ANIMATION_ENGINE_H
@@ -20,13 +20,16 @@ limitations under the License.
 #include "rtPathUtils.h"
 #include "rtThreadQueue.h"
 
+#include <algorithm>
+#include <vector>
+
 extern rtThreadQueue* gUIThreadQueue;
 
 #include "rtFileDownloader.h"
 
 pxArchive::pxArchive(): mIsFile(true),mDownloadRequest(NULL), mZip(),
                         mDownloadStatusCode(0), mHttpStatusCode(0), mArchiveData(NULL), mArchiveDataSize(0),
-                        mUseDownloadedData(false), mArchiveDataMutex()
+                        mUseDownloadedData(false), mArchiveDataMutex(), mPreloaded(), mPreloadedMutex()
 {
 }
 
@@ -71,7 +74,9 @@ void pxArchive::setupArchive()
       // this scenario of mismatch is very rare and can happen only if heap object is destroyed before we access
       if ((NULL != mArchiveData) && (mArchiveDataSize > 0))
       {
-        mData.init((uint8_t *) mArchiveData, mArchiveDataSize);
+        mData.attach((uint8_t *) mArchiveData, mArchiveDataSize);
+        mArchiveData = NULL;
+        mArchiveDataSize = 0;
         process(mData.data(), mData.length());
       }
     }
@@ -83,7 +88,7 @@ void pxArchive::setupArchive()
   mArchiveDataMutex.unlock();
 }
 
-void pxArchive::setArchiveData(int downloadStatusCode, uint32_t httpStatusCode, const char* data, const size_t dataSize, const rtString& errorString)
+void pxArchive::setArchiveData(int downloadStatusCode, uint32_t httpStatusCode, char* data, const size_t dataSize, const rtString& errorString)
 {
   mArchiveDataMutex.lock();
   mDownloadStatusCode = downloadStatusCode;
@@ -101,9 +106,8 @@ void pxArchive::setArchiveData(int downloadStatusCode, uint32_t httpStatusCode,
   }
   else
   {
-    mArchiveData = new char[dataSize];
+    mArchiveData = data;
     mArchiveDataSize = dataSize;
-    memcpy(mArchiveData, data, mArchiveDataSize);
   }
   mArchiveDataMutex.unlock();
 }
@@ -228,7 +232,17 @@ rtError pxArchive::getFileData(const char* fileName, rtData& d)
     }
     else
     {
-      if (mZip.getFileData(fileName,d)==RT_OK)
+      mPreloadedMutex.lock();
+      std::map<std::string, rtData>::iterator it = mPreloaded.find(fileName);
+      if (it != mPreloaded.end())
+      {
+        uint32_t length = it->second.length();
+        e = d.attach(it->second.detach(), length);
+        mPreloaded.erase(it);
+      }
+      mPreloadedMutex.unlock();
+
+      if (e != RT_OK && mZip.getFileData(fileName,d)==RT_OK)
       {
         e = RT_OK;
       }
@@ -290,9 +304,11 @@ void pxArchive::onDownloadComplete(rtFileDownloadRequest* downloadRequest)
 
   if (a != NULL)
   {
+    char* data = NULL;
+    size_t dataSize = 0;
+    downloadRequest->takeDownloadedData(data, dataSize);
     a->setArchiveData(downloadRequest->downloadStatusCode(), (uint32_t)downloadRequest->httpStatusCode(),
-                      downloadRequest->downloadedData(), downloadRequest->downloadedDataSize(),
-                      downloadRequest->errorString());
+                      data, dataSize, downloadRequest->errorString());
 
     if (gUIThreadQueue)
     {
@@ -336,6 +352,10 @@ void pxArchive::process(void* data, size_t dataSize)
     {
       rtLogWarn("error initializing zip data from buffer");
     }
+    else
+    {
+      preloadImages();
+    }
   }
   else
   {
@@ -359,3 +379,54 @@ rtDefineProperty(pxArchive,ready);
 rtDefineProperty(pxArchive,loadStatus);
 rtDefineMethod(pxArchive,getFileAsString);
 rtDefineProperty(pxArchive,fileNames);
+
+static bool pxArchiveIsImagePath(const rtString& filePath)
+{
+  rtString path = filePath;
+  path.toLowerAscii();
+  return path.endsWith(".png") || path.endsWith(".jpg") || path.endsWith(".jpeg") ||
+         path.endsWith(".gif") || path.endsWith(".svg") || path.endsWith(".webp");
+}
+
+// Images are loaded out of an archive one getFileData call at a time, so
+// inflate them here in batches, which getFilesData spreads over the thread
+// pool, and keep them until they're asked for.
+void pxArchive::preloadImages()
+{
+  std::vector<rtString> imagePaths;
+  uint32_t fileCount = mZip.fileCount();
+  for (uint32_t i = 0; i < fileCount; i++)
+  {
+    rtString filePath;
+    if (mZip.getFilePathAtIndex(i,filePath) == RT_OK && pxArchiveIsImagePath(filePath))
+    {
+      imagePaths.push_back(filePath);
+    }
+  }
+
+  uint32_t preloadedCount = 0;
+  size_t preloadedBytes = 0;
+  for (size_t first = 0; first < imagePaths.size() && preloadedBytes < PX_ARCHIVE_PRELOAD_BYTES;
+       first += PX_ARCHIVE_PRELOAD_BATCH)
+  {
+    uint32_t count = (uint32_t)std::min(imagePaths.size() - first, (size_t)PX_ARCHIVE_PRELOAD_BATCH);
+    std::vector<rtData> data(count);
+    std::vector<rtError> results(count);
+    mZip.getFilesData(&imagePaths[first], count, &data[0], &results[0]);
+
+    mPreloadedMutex.lock();
+    for (uint32_t i = 0; i < count; i++)
+    {
+      if (results[i] == RT_OK)
+      {
+        uint32_t length = data[i].length();
+        preloadedCount++;
+        preloadedBytes += length;
+        mPreloaded[imagePaths[first + i].cString()].attach(data[i].detach(), length);
+      }
+    }
+    mPreloadedMutex.unlock();
+  }
+  rtLogDebug("preloaded %u images (%u bytes) from %s", preloadedCount,
+             (uint32_t)preloadedBytes, mUrl.cString());
+}
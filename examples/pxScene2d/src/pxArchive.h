@@ -35,6 +35,13 @@
 #include "rtZip.h"
 #include "rtCORS.h"
 
+#include <map>
+#include <string>
+
+// bytes of images inflated up front when a zip archive is opened
+#define PX_ARCHIVE_PRELOAD_BYTES (8 * 1024 * 1024)
+#define PX_ARCHIVE_PRELOAD_BATCH 32
+
 class pxArchive: public rtObject
 {
 public:
@@ -56,7 +63,8 @@ public:
   rtError getFileData(const char* fileName, rtData& d);
   rtError fileNames(rtObjectRef& names) const;
 
-  void setArchiveData(int downloadStatusCode, uint32_t httpStatusCode, const char* data, const size_t dataSize, const rtString& errorString);
+  // takes ownership of data, which must be allocated with new[]
+  void setArchiveData(int downloadStatusCode, uint32_t httpStatusCode, char* data, const size_t dataSize, const rtString& errorString);
   void setupArchive();
 
   bool isFile();
@@ -66,6 +74,7 @@ protected:
   static void onDownloadComplete(rtFileDownloadRequest* downloadRequest);
   static void onDownloadCompleteUI(void* context, void* data);
   void process(void* data, size_t dataSize);
+  void preloadImages();
   void clearDownloadedData();
 
   bool mIsFile;
@@ -85,6 +94,9 @@ protected:
   bool mUseDownloadedData;
   rtMutex mArchiveDataMutex;
   rtString mErrorString;
+  // images read by preloadImages, each handed out once by getFileData
+  std::map<std::string, rtData> mPreloaded;
+  rtMutex mPreloadedMutex;
 };
 
 #endif
@@ -24,6 +24,8 @@
 #include "rtCore.h"
 #include "rtRef.h"
 
+#include <vector>
+
 #include "pxCore.h"
 #include "pxOffscreen.h"
 #include "pxMatrix4T.h"
@@ -34,6 +36,8 @@
 
 #ifdef ENABLE_DFB
 #include "pxContextDescDFB.h"
+#elif defined(ENABLE_SW_CONTEXT)
+#include "pxContextDescSW.h"
 #else
 #include "pxContextDescGL.h"
 #endif //ENABLE_DFB
@@ -70,6 +74,8 @@ class pxContext {
   , mEjectTextureAge(DEFAULT_EJECT_TEXTURE_AGE)
   , mTargetTextureMemoryAfterCleanupInBytes(0)
   , mFreeAllOffscreenTextureMemoryOnCleanup(false)
+  , mCulledObjectCount(0)
+  , mDamage()
   {}
   ~pxContext();
 
@@ -102,13 +108,33 @@ class pxContext {
 
   void mapToScreenCoordinates(float inX, float inY, int &outX, int &outY);
   void mapToScreenCoordinates(pxMatrix4f& m, float inX, float inY, int &outX, int &outY);
+  // false if the rectangle, transformed by the current matrix, lies outside
+  // of the current framebuffer and its dirty rectangle
   bool isObjectOnScreen(float x, float y, float width, float height);
 
+  // objects that weren't drawn because they were off screen, see
+  // pxObject::drawInternal
+  void addCulledObject() { mCulledObjectCount++; }
+  uint32_t culledObjectCount() { return mCulledObjectCount; }
+
+  // Screen rectangles of the default framebuffer the current frame redrew,
+  // for windows that can present part of a frame.  Empty if the whole frame
+  // has to be presented.
+  void clearDamage() { mDamage.clear(); }
+  void addDamage(const pxRect& r) { mDamage.push_back(r); }
+  const std::vector<pxRect>& damage() const { return mDamage; }
+
   pxTextureRef createTexture(); // default to use before image load is complete
   pxTextureRef createTexture(pxOffscreen& o);
   pxTextureRef createTexture(float w, float h, float iw, float ih, void* buffer = NULL);
   pxSharedContextRef createSharedContext();
 
+  // submits draws that were batched but not yet sent to the GPU, done for
+  // every operation that depends on them and once a frame has been drawn
+  void flush();
+  void enableDrawBatching(bool enable);
+  bool isDrawBatchingEnabled();
+
   void snapshot(pxOffscreen& o);
 
   void drawRect(float w, float h, float lineWidth, float* fillColor, float* lineColor);
@@ -130,8 +156,11 @@ class pxContext {
   // vertices and uvs for the quads are passed in as if the quads will be rendered
   // using GL_TRIANGLES in an optimal way.  quad oriented backends can skip vertices appropriately
   // 6 vertices (12 floats) and 6 uvs (12 floats) per quad
+  // With a distanceFieldSpread the texture holds a signed distance field
+  // with the outline at half intensity and the given spread in texels on
+  // either side of it, its edges are kept about a pixel wide at any scale.
   void drawTexturedQuads(int numQuads, const void *verts, const void* uvs,
-                          pxTextureRef t, float* color);
+                          pxTextureRef t, float* color, float distanceFieldSpread = 0);
 #endif                          
 
   void drawImage9(float w, float h, float x1, float y1,
@@ -155,6 +184,9 @@ class pxContext {
   void adjustCurrentTextureMemorySize(int64_t changeInBytes, bool allowGarbageCollect=true);
   void setTextureMemoryLimit(int64_t textureMemoryLimitInBytes);
   bool isTextureSpaceAvailable(pxTextureRef texture, bool allowGarbageCollect=true, int32_t bytesPerPixel=4);
+  // the same check for memory that is optional, like cached layers, it never
+  // ejects textures or collects garbage to make room
+  bool isTextureSpaceAvailable(int64_t sizeInBytes);
   int64_t currentTextureMemoryUsageInBytes();
   int64_t textureMemoryOverflow(pxTextureRef texture);
   int64_t ejectTextureMemory(int64_t bytesRequested, bool forceEject=false);
@@ -171,6 +203,8 @@ private:
   uint32_t mEjectTextureAge;
   int64_t mTargetTextureMemoryAfterCleanupInBytes;
   bool mFreeAllOffscreenTextureMemoryOnCleanup;
+  uint32_t mCulledObjectCount;
+  std::vector<pxRect> mDamage;
 };
 
 
@@ -823,7 +823,7 @@ private:
     rtThreadPool *mainThreadPool = rtThreadPool::globalInstance();
     
     DecodeImageData *imageData = new DecodeImageData(this);
-    rtThreadTask         *task = new rtThreadTask(cleanupOffscreen, imageData, "");
+    rtThreadTask         *task = new rtThreadTask(cleanupOffscreen, imageData, "", RT_THREAD_TASK_PRIORITY_BACKGROUND);
     
     mainThreadPool->executeTask(task);
   }
@@ -2775,6 +2775,20 @@ void pxContext::popState()
   }
 }
 
+void pxContext::flush()
+{
+  // draws are not batched
+}
+
+void pxContext::enableDrawBatching(bool /*enable*/)
+{
+}
+
+bool pxContext::isDrawBatchingEnabled()
+{
+  return false;
+}
+
 void pxContext::snapshot(pxOffscreen& o)
 {
   if(boundFramebuffer == NULL)
@@ -2842,30 +2856,28 @@ void pxContext::mapToScreenCoordinates(pxMatrix4f& m, float inX, float inY, int
   }
 }
 
-bool pxContext::isObjectOnScreen(float /*x*/, float /*y*/, float /*width*/, float /*height*/)
+bool pxContext::isObjectOnScreen(float x, float y, float width, float height)
 {
-#if 1
-  return true;
-#else
-  int outX1, outX2, outY1, outY2;
-  mapToScreenCoordinates(width,height,outX2, outY2);
-  mapToScreenCoordinates(x,y,outX1, outY1);
-  int fboWidth = currentFramebuffer->width();
-  int fboHeight = currentFramebuffer->height();
-  if (currentFramebuffer == defaultFramebuffer)
+  // screen aligned bounds of the transformed corners
+  const float cornerX[4] = { x, x + width, x, x + width };
+  const float cornerY[4] = { y, y, y + height, y + height };
+  float left = 0, top = 0, right = 0, bottom = 0;
+  for (int i = 0; i < 4; i++)
   {
-    fboWidth = gResW;
-    fboHeight = gResH;
-  }
-  if ((outX1 < 0 && outX2 < 0) ||
-      (outX1 > fboWidth && outX2 > fboWidth) ||
-      (outY1 < 0 && outY2 < 0) ||
-      (outY1 > fboHeight && outY2 > fboHeight))
-  {
-    return false;
+    pxVector4f positionCoords = gMatrix.multiply(pxVector4f(cornerX[i], cornerY[i], 0, 1));
+    if (positionCoords.w() <= 0)
+    {
+      return true;
+    }
+    float screenX = positionCoords.x() / positionCoords.w();
+    float screenY = positionCoords.y() / positionCoords.w();
+    if (i == 0 || screenX < left)   left = screenX;
+    if (i == 0 || screenX > right)  right = screenX;
+    if (i == 0 || screenY < top)    top = screenY;
+    if (i == 0 || screenY > bottom) bottom = screenY;
   }
-  return true;
-#endif
+
+  return !(right < 0 || left > gResW || bottom < 0 || top > gResH);
 }
 
 void pxContext::adjustCurrentTextureMemorySize(int64_t changeInBytes, bool allowGarbageCollect)
@@ -2934,6 +2946,14 @@ bool pxContext::isTextureSpaceAvailable(pxTextureRef texture, bool allowGarbageC
   return true;
 }
 
+bool pxContext::isTextureSpaceAvailable(int64_t sizeInBytes)
+{
+  if (!mEnableTextureMemoryMonitoring)
+    return true;
+
+  return (sizeInBytes + mCurrentTextureMemorySizeInBytes) <= mTextureMemoryLimitInBytes;
+}
+
 int64_t pxContext::currentTextureMemoryUsageInBytes()
 {
   return mCurrentTextureMemorySizeInBytes;
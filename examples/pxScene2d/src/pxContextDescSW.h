@@ -0,0 +1,35 @@
+/*
+
+ pxCore Copyright 2005-2018 John Robinson
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+// pxContextDescSW.h
+
+#ifndef PX_CONTEXT_DESC_H
+#define PX_CONTEXT_DESC_H
+
+#include <stddef.h>
+
+typedef struct _pxContextSurfaceNativeDesc
+{
+    _pxContextSurfaceNativeDesc() : width(0), height(0), previousContextSurface(NULL) {}
+  int width;
+  int height;
+  _pxContextSurfaceNativeDesc* previousContextSurface;
+}
+pxContextSurfaceNativeDesc;
+
+#endif //PX_CONTEXT_DESC_H
@@ -126,7 +126,7 @@ double lastContextGarbageCollectTime = 0;
 double garbageCollectThrottleInSeconds = CONTEXT_GC_THROTTLE_SECS_DEFAULT;
 
 enum pxCurrentGLProgram { PROGRAM_UNKNOWN = 0, PROGRAM_SOLID_SHADER,  PROGRAM_A_TEXTURE_SHADER, PROGRAM_TEXTURE_SHADER,
-    PROGRAM_TEXTURE_MASKED_SHADER, PROGRAM_TEXTURE_BORDER_SHADER};
+    PROGRAM_TEXTURE_MASKED_SHADER, PROGRAM_TEXTURE_BORDER_SHADER, PROGRAM_DISTANCE_FIELD_SHADER};
 
 pxCurrentGLProgram currentGLProgram = PROGRAM_UNKNOWN;
 
@@ -319,6 +319,24 @@ static const char *fATextureShaderText =
   "  gl_FragColor = a_color*a;"
   "}";
 
+// assume premultiplied, the texture holds a distance field with the
+// outline at 0.5, u_smoothing is half a pixel in distance field units
+static const char *fDistanceFieldShaderText =
+  "#ifdef GL_ES \n"
+  "  precision mediump float; \n"
+  "#endif \n"
+  "uniform sampler2D s_texture;"
+  "uniform float u_alpha;"
+  "uniform float u_smoothing;"
+  "uniform vec4 a_color;"
+  "varying vec2 v_uv;"
+  "void main()"
+  "{"
+  "  float d = texture2D(s_texture, v_uv).a;"
+  "  float a = u_alpha * smoothstep(0.5 - u_smoothing, 0.5 + u_smoothing, d);"
+  "  gl_FragColor = a_color*a;"
+  "}";
+
 static const char *vShaderText =
   "uniform vec2 u_resolution;"
   "uniform mat4 amymatrix;"
@@ -690,15 +708,7 @@ public:
     {
        mOffscreen.init(newTextureWidth, newTextureHeight);
        mOffscreen.setUpsideDown(true);
-       int y = 0;
-       for (int j = 0; j < srcTextureHeight-1; j += verticalScale, y++ )
-       {
-          int x = 0;
-          for (int k = 0; k < srcTextureWidth-1; k += horizontalScale, x++)
-          {
-             o.blit(mOffscreen, x, y, 1,1,k,j);
-          }
-       }
+       pxResampleImage(o, mOffscreen, PX_RESAMPLE_AREA);
     }
     else
     {
@@ -798,6 +808,61 @@ public:
     return result;
   }
 
+  // Replaces the w x h pixels at x, y.  buffer holds them top row first and
+  // not premultiplied, like the offscreen the texture was created from.
+  virtual pxError updateTexture(int x, int y, int w, int h, void* buffer)
+  {
+    if (!mInitialized)
+    {
+      return PX_NOTINITIALIZED;
+    }
+    if (x < 0 || y < 0 || w <= 0 || h <= 0 || x + w > mWidth || y + h > mHeight)
+    {
+      return PX_FAIL;
+    }
+#ifdef ENABLE_MAX_TEXTURE_SIZE
+    if (mWidth > MAX_TEXTURE_WIDTH || mHeight > MAX_TEXTURE_HEIGHT)
+    {
+      // the texture was scaled down when it was created
+      return PX_FAIL;
+    }
+#endif //ENABLE_MAX_TEXTURE_SIZE
+
+    const pxPixel* pixels = (const pxPixel*)buffer;
+    if (!mTextureUploaded)
+    {
+      rtMutexLockGuard offscreenGuard(mOffscreenMutex);
+      if (mOffscreen.base() == NULL || mOffscreen.width() != mWidth || mOffscreen.height() != mHeight)
+      {
+        return PX_FAIL;
+      }
+      for (int j = 0; j < h; j++)
+      {
+        premultiplyRow(mOffscreen.scanline(y + j) + x, pixels + j * w, w);
+      }
+      return PX_OK;
+    }
+
+    // the texture is flipped to match the GL FBO layout
+    std::vector<pxPixel> flipped(w * h);
+    for (int j = 0; j < h; j++)
+    {
+      premultiplyRow(&flipped[(h - j - 1) * w], pixels + j * w, w);
+    }
+
+    // batched draws may still use the current pixels
+    context.flush();
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, mTextureName);   TRACK_TEX_CALLS();
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, mHeight - y - h, w, h, GL_RGBA, GL_UNSIGNED_BYTE, &flipped[0]);
+    if (mMipmapCreated)
+    {
+      glGenerateMipmap(GL_TEXTURE_2D);
+    }
+    return PX_OK;
+  }
+
   virtual pxError deleteTexture()
   {
     rtLogDebug("pxTextureOffscreen::deleteTexture()");
@@ -1014,6 +1079,17 @@ public:
 
 private:
 
+  static void premultiplyRow(pxPixel* d, const pxPixel* s, int w)
+  {
+    for (const pxPixel* se = s + w; s < se; s++, d++)
+    {
+      d->r = (s->r * s->a)/255;
+      d->g = (s->g * s->a)/255;
+      d->b = (s->b * s->a)/255;
+      d->a = s->a;
+    }
+  }
+
   void freeOffscreenDataInBackground()
   {
     mOffscreenMutex.lock();
@@ -1022,7 +1098,7 @@ private:
     rtLogDebug("request to free offscreen data");
     rtThreadPool *mainThreadPool = rtThreadPool::globalInstance();
     DecodeImageData *imageData = new DecodeImageData(this);
-    rtThreadTask *task = new rtThreadTask(cleanupOffscreen, imageData, "");
+    rtThreadTask *task = new rtThreadTask(cleanupOffscreen, imageData, "", RT_THREAD_TASK_PRIORITY_BACKGROUND);
     mainThreadPool->executeTask(task);
   }
 
@@ -1514,6 +1590,83 @@ aTextureShaderProgram *gATextureShader = NULL;
 
 //====================================================================================================================================================================================
 
+class distanceFieldShaderProgram: public shaderProgram
+{
+protected:
+  virtual void prelink()
+  {
+    mPosLoc = 0;
+    mUVLoc = 1;
+    glBindAttribLocation(mProgram, mPosLoc, "pos");
+    glBindAttribLocation(mProgram, mUVLoc,  "uv");
+  }
+
+  virtual void postlink()
+  {
+    mResolutionLoc = getUniformLocation("u_resolution");
+    mMatrixLoc     = getUniformLocation("amymatrix");
+    mColorLoc      = getUniformLocation("a_color");
+    mAlphaLoc      = getUniformLocation("u_alpha");
+    mSmoothingLoc  = getUniformLocation("u_smoothing");
+    mTextureLoc    = getUniformLocation("s_texture");
+  }
+
+public:
+  pxError draw(int resW, int resH, float* matrix, float alpha,
+            GLenum mode,
+            int count,
+            const void* pos,
+            const void* uv,
+            pxTextureRef texture,
+            const float* color,
+            float smoothing)
+  {
+    if (currentGLProgram != PROGRAM_DISTANCE_FIELD_SHADER)
+    {
+      use();
+      currentGLProgram = PROGRAM_DISTANCE_FIELD_SHADER;
+    }
+    glUniform2f(mResolutionLoc, static_cast<GLfloat>(resW), static_cast<GLfloat>(resH));
+    glUniformMatrix4fv(mMatrixLoc, 1, GL_FALSE, matrix);
+    glUniform1f(mAlphaLoc, alpha);
+    glUniform1f(mSmoothingLoc, smoothing);
+    glUniform4fv(mColorLoc, 1, color);
+
+    if (texture->bindGLTexture(mTextureLoc) != PX_OK)
+    {
+      return PX_FAIL;
+    }
+
+    glVertexAttribPointer(mPosLoc, 2, GL_FLOAT, GL_FALSE, 0, pos);
+    glVertexAttribPointer(mUVLoc, 2, GL_FLOAT, GL_FALSE, 0, uv);
+    glEnableVertexAttribArray(mPosLoc);
+    glEnableVertexAttribArray(mUVLoc);
+    glDrawArrays(mode, 0, count);  TRACK_DRAW_CALLS();
+    glDisableVertexAttribArray(mPosLoc);
+    glDisableVertexAttribArray(mUVLoc);
+
+    return PX_OK;
+  }
+
+private:
+  GLint mResolutionLoc;
+  GLint mMatrixLoc;
+
+  GLint mPosLoc;
+  GLint mUVLoc;
+
+  GLint mColorLoc;
+  GLint mAlphaLoc;
+  GLint mSmoothingLoc;
+
+  GLint mTextureLoc;
+
+}; //CLASS - distanceFieldShaderProgram
+
+distanceFieldShaderProgram *gDistanceFieldShader = NULL;
+
+//====================================================================================================================================================================================
+
 class textureShaderProgram: public shaderProgram
 {
 protected:
@@ -1538,7 +1691,8 @@ public:
             int count,
             const void* pos, const void* uv,
             pxTextureRef texture,
-            int32_t stretchX, int32_t stretchY)
+            int32_t stretchX, int32_t stretchY,
+            GLenum mode = GL_TRIANGLE_STRIP)
   {
     if (currentGLProgram != PROGRAM_TEXTURE_SHADER)
     {
@@ -1563,7 +1717,7 @@ public:
     glVertexAttribPointer(mUVLoc, 2, GL_FLOAT, GL_FALSE, 0, uv);
     glEnableVertexAttribArray(mPosLoc);
     glEnableVertexAttribArray(mUVLoc);
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, count);  TRACK_DRAW_CALLS();
+    glDrawArrays(mode, 0, count);  TRACK_DRAW_CALLS();
     glDisableVertexAttribArray(mPosLoc);
     glDisableVertexAttribArray(mUVLoc);
 
@@ -1754,6 +1908,165 @@ textureMaskedShaderProgram *gTextureMaskedShader = NULL;
 
 //====================================================================================================================================================================================
 
+// Collects consecutive draws that share a shader, texture, alpha and color
+// and submits them with a single glDrawArrays.  Vertices are transformed by
+// the current matrix on the CPU, so quads drawn with different matrices can
+// share a draw call, and the batch is drawn with an identity matrix.  Draws
+// are never reordered; anything that can't be added flushes the batch first.
+class pxDrawBatch
+{
+public:
+  // BATCH_TEXTURED_QUADS uses the alpha texture shader like BATCH_A_TEXTURE
+  // but isn't replaced by a black rectangle when the texture can't be bound,
+  // neither is BATCH_DISTANCE_FIELD
+  enum batchType { BATCH_NONE = 0, BATCH_SOLID, BATCH_TEXTURE, BATCH_A_TEXTURE, BATCH_TEXTURED_QUADS,
+                   BATCH_DISTANCE_FIELD };
+
+  pxDrawBatch(): mEnabled(true), mType(BATCH_NONE), mTexture(), mAlpha(1.0),
+                 mStretchX(0), mStretchY(0), mSmoothing(0), mPositions(), mUVs()
+  {
+    memset(mColor, 0, sizeof(mColor));
+  }
+
+  bool isEnabled() { return mEnabled; }
+
+  void setEnabled(bool enabled)
+  {
+    flush();
+    mEnabled = enabled;
+  }
+
+  // Adds a GL_TRIANGLE_STRIP or GL_TRIANGLES draw.  Returns false, with the
+  // batch flushed, when the caller has to draw it immediately instead.
+  bool add(batchType type, GLenum mode, const float* pos, const float* uv, int count,
+           pxTexture* texture, const float* color,
+           int32_t stretchX = pxConstantsStretch::NONE, int32_t stretchY = pxConstantsStretch::NONE,
+           float smoothing = 0)
+  {
+    if (!mEnabled)
+    {
+      return false;
+    }
+
+    // the vertex shader divides z by the resolution and uses it as w, only
+    // matrices that keep vertices in the z = 0 plane can be applied up front
+    const float* m = gMatrix.data();
+    if (m[2] != 0 || m[6] != 0 || m[14] != 0)
+    {
+      flush();
+      return false;
+    }
+
+    if (type != mType || texture != mTexture.getPtr() || gAlpha != mAlpha ||
+        stretchX != mStretchX || stretchY != mStretchY || smoothing != mSmoothing ||
+        (color != NULL && memcmp(color, mColor, sizeof(mColor)) != 0))
+    {
+      flush();
+      mType = type;
+      mTexture = texture;
+      mAlpha = gAlpha;
+      mStretchX = stretchX;
+      mStretchY = stretchY;
+      mSmoothing = smoothing;
+      if (color != NULL)
+      {
+        memcpy(mColor, color, sizeof(mColor));
+      }
+    }
+
+    if (mode == GL_TRIANGLES)
+    {
+      for (int i = 0; i < count; i++)
+      {
+        addVertex(m, pos, uv, i);
+      }
+    }
+    else // GL_TRIANGLE_STRIP
+    {
+      for (int i = 2; i < count; i++)
+      {
+        addVertex(m, pos, uv, i-2);
+        addVertex(m, pos, uv, i-1);
+        addVertex(m, pos, uv, i);
+      }
+    }
+    return true;
+  }
+
+  void flush()
+  {
+    if (mType == BATCH_NONE)
+    {
+      return;
+    }
+
+    static pxMatrix4f identity;
+    static float blackColor[4] = {0.0, 0.0, 0.0, 1.0};
+
+    int count = static_cast<int>(mPositions.size()/2);
+    pxError result = PX_OK;
+    switch(mType)
+    {
+      case BATCH_SOLID:
+        result = gSolidShader->draw(gResW,gResH,identity.data(),mAlpha,GL_TRIANGLES,&mPositions[0],count,mColor);
+        break;
+      case BATCH_TEXTURE:
+        result = gTextureShader->draw(gResW,gResH,identity.data(),mAlpha,count,&mPositions[0],&mUVs[0],mTexture,
+                                      mStretchX,mStretchY,GL_TRIANGLES);
+        break;
+      case BATCH_A_TEXTURE:
+      case BATCH_TEXTURED_QUADS:
+        result = gATextureShader->draw(gResW,gResH,identity.data(),mAlpha,GL_TRIANGLES,count,&mPositions[0],&mUVs[0],
+                                       mTexture,mColor);
+        break;
+      case BATCH_DISTANCE_FIELD:
+        result = gDistanceFieldShader->draw(gResW,gResH,identity.data(),mAlpha,GL_TRIANGLES,count,&mPositions[0],&mUVs[0],
+                                            mTexture,mColor,mSmoothing);
+        break;
+      default:
+        break;
+    }
+    if (result != PX_OK && mType != BATCH_TEXTURED_QUADS && mType != BATCH_DISTANCE_FIELD)
+    {
+      gSolidShader->draw(gResW,gResH,identity.data(),mAlpha,GL_TRIANGLES,&mPositions[0],count,blackColor); // DEFAULT - "Missing" - BLACK RECTANGLE
+    }
+
+    mType = BATCH_NONE;
+    mTexture = NULL;
+    mPositions.clear();
+    mUVs.clear();
+  }
+
+private:
+  inline void addVertex(const float* m, const float* pos, const float* uv, int i)
+  {
+    float x = pos[i*2];
+    float y = pos[i*2+1];
+    mPositions.push_back(m[0]*x + m[4]*y + m[12]);
+    mPositions.push_back(m[1]*x + m[5]*y + m[13]);
+    if (uv != NULL)
+    {
+      mUVs.push_back(uv[i*2]);
+      mUVs.push_back(uv[i*2+1]);
+    }
+  }
+
+  bool mEnabled;
+  batchType mType;
+  pxTextureRef mTexture;
+  float mAlpha;
+  float mColor[4];
+  int32_t mStretchX;
+  int32_t mStretchY;
+  float mSmoothing;
+  std::vector<float> mPositions;
+  std::vector<float> mUVs;
+}; // CLASS - pxDrawBatch
+
+static pxDrawBatch gDrawBatch;
+
+//====================================================================================================================================================================================
+
 static void drawRect2(GLfloat x, GLfloat y, GLfloat w, GLfloat h, const float* c)
 {
   // args are tested at call site...
@@ -1769,7 +2082,10 @@ static void drawRect2(GLfloat x, GLfloat y, GLfloat w, GLfloat h, const float* c
   float colorPM[4];
   premultiply(colorPM,c);
 
-  gSolidShader->draw(gResW,gResH,gMatrix.data(),gAlpha,GL_TRIANGLE_STRIP,verts,4,colorPM);
+  if (!gDrawBatch.add(pxDrawBatch::BATCH_SOLID,GL_TRIANGLE_STRIP,&verts[0][0],NULL,4,NULL,colorPM))
+  {
+    gSolidShader->draw(gResW,gResH,gMatrix.data(),gAlpha,GL_TRIANGLE_STRIP,verts,4,colorPM);
+  }
 }
 
 
@@ -1803,7 +2119,10 @@ static void drawRectOutline(GLfloat x, GLfloat y, GLfloat w, GLfloat h, GLfloat
   float colorPM[4];
   premultiply(colorPM,c);
 
-  gSolidShader->draw(gResW,gResH,gMatrix.data(),gAlpha,GL_TRIANGLE_STRIP,verts,10,colorPM);
+  if (!gDrawBatch.add(pxDrawBatch::BATCH_SOLID,GL_TRIANGLE_STRIP,&verts[0][0],NULL,10,NULL,colorPM))
+  {
+    gSolidShader->draw(gResW,gResH,gMatrix.data(),gAlpha,GL_TRIANGLE_STRIP,verts,10,colorPM);
+  }
 }
 
 static void drawImageTexture(float x, float y, float w, float h, pxTextureRef texture,
@@ -1887,6 +2206,7 @@ static void drawImageTexture(float x, float y, float w, float h, pxTextureRef te
 
   if (mask.getPtr() != NULL)
   {
+    gDrawBatch.flush();
     if (gTextureMaskedShader->draw(gResW,gResH,gMatrix.data(),gAlpha,4,verts,uv,texture,mask, maskOp) != PX_OK)
     {
       drawRect2(0, 0, iw, ih, blackColor); // DEFAULT - "Missing" - BLACK RECTANGLE
@@ -1895,6 +2215,10 @@ static void drawImageTexture(float x, float y, float w, float h, pxTextureRef te
   else
   if (texture->getType() != PX_TEXTURE_ALPHA)
   {
+    if (gDrawBatch.add(pxDrawBatch::BATCH_TEXTURE,GL_TRIANGLE_STRIP,&verts[0][0],&uv[0][0],4,texture.getPtr(),NULL,xStretch,yStretch))
+    {
+      return;
+    }
     if (gTextureShader->draw(gResW,gResH,gMatrix.data(),gAlpha,4,verts,uv,texture,xStretch,yStretch) != PX_OK)
     {
       drawRect2(0, 0, iw, ih, blackColor); // DEFAULT - "Missing" - BLACK RECTANGLE
@@ -1905,6 +2229,10 @@ static void drawImageTexture(float x, float y, float w, float h, pxTextureRef te
     float colorPM[4];
     premultiply(colorPM,color);
 
+    if (gDrawBatch.add(pxDrawBatch::BATCH_A_TEXTURE,GL_TRIANGLE_STRIP,&verts[0][0],&uv[0][0],4,texture.getPtr(),colorPM))
+    {
+      return;
+    }
     if (gATextureShader->draw(gResW,gResH,gMatrix.data(),gAlpha,GL_TRIANGLE_STRIP,4,verts,uv,texture,colorPM) != PX_OK)
     {
       drawRect2(0, 0, iw, ih, blackColor); // DEFAULT - "Missing" - BLACK RECTANGLE
@@ -2150,6 +2478,7 @@ pxContext::~pxContext()
 {
   SAFE_DELETE(gSolidShader);
   SAFE_DELETE(gATextureShader);
+  SAFE_DELETE(gDistanceFieldShader);
   SAFE_DELETE(gTextureShader);
   SAFE_DELETE(gTextureBorderShader);
   SAFE_DELETE(gTextureMaskedShader);
@@ -2168,6 +2497,7 @@ void pxContext::init()
 
   SAFE_DELETE(gSolidShader);
   SAFE_DELETE(gATextureShader);
+  SAFE_DELETE(gDistanceFieldShader);
   SAFE_DELETE(gTextureShader);
   SAFE_DELETE(gTextureBorderShader);
   SAFE_DELETE(gTextureMaskedShader);
@@ -2178,6 +2508,9 @@ void pxContext::init()
   gATextureShader = new aTextureShaderProgram();
   gATextureShader->init(vShaderText,fATextureShaderText);
 
+  gDistanceFieldShader = new distanceFieldShaderProgram();
+  gDistanceFieldShader->init(vShaderText,fDistanceFieldShaderText);
+
   gTextureShader = new textureShaderProgram();
   gTextureShader->init(vShaderText,fTextureShaderText);
 
@@ -2236,6 +2569,10 @@ void pxContext::init()
   {
     mFreeAllOffscreenTextureMemoryOnCleanup = val.toString().compare("true") == 0;
   }
+  if (RT_OK == rtSettings::instance()->value("enableDrawBatching", val))
+  {
+    enableDrawBatching(val.toString().compare("true") == 0);
+  }
 
   char const* textureLimitSetting = getenv("SPARK_TEXTURE_LIMIT_MB");
   if (textureLimitSetting)
@@ -2279,6 +2616,13 @@ void pxContext::init()
     }
   }
 
+  char const* drawBatchingSetting = getenv("SPARK_ENABLE_DRAW_BATCHING");
+  if (drawBatchingSetting)
+  {
+    enableDrawBatching(atoi(drawBatchingSetting) > 0);
+  }
+  rtLogInfo("draw call batching: %s", isDrawBatchingEnabled() ? "enabled" : "disabled");
+
   rtLogInfo("texture memory target after cleanup: %" PRId64 " bytes.  Free all offscreen memory on cleanup: %s.  Eject texture age: %u",
             mTargetTextureMemoryAfterCleanupInBytes,
             mFreeAllOffscreenTextureMemoryOnCleanup ? "true":"false", mEjectTextureAge);
@@ -2311,6 +2655,7 @@ void pxContext::term()  // clean up statics
 
 void pxContext::setSize(int w, int h)
 {
+  gDrawBatch.flush();
   glViewport(0, 0, (GLint)w, (GLint)h);
   gResW = w;
   gResH = h;
@@ -2332,11 +2677,14 @@ void pxContext::getSize(int& w, int& h)
 
 void pxContext::clear(int /*w*/, int /*h*/)
 {
+  gDrawBatch.flush();
   glClear(GL_COLOR_BUFFER_BIT);
 }
 
 void pxContext::clear(int /*w*/, int /*h*/, float *fillColor )
 {
+  gDrawBatch.flush();
+
   float color[4];
 
   glGetFloatv( GL_COLOR_CLEAR_VALUE, color );
@@ -2348,6 +2696,8 @@ void pxContext::clear(int /*w*/, int /*h*/, float *fillColor )
 
 void pxContext::clear(int left, int top, int width, int height)
 {
+  gDrawBatch.flush();
+
   if (left < 0)
   {
     left = 0;
@@ -2378,6 +2728,7 @@ void pxContext::clear(int left, int top, int width, int height)
 
 void pxContext::enableClipping(bool enable)
 {
+  gDrawBatch.flush();
   if (enable)
   {
     glEnable(GL_SCISSOR_TEST);
@@ -2428,6 +2779,7 @@ pxError pxContext::updateFramebuffer(pxContextFramebufferRef fbo, int width, int
     return PX_FAIL;
   }
 
+  gDrawBatch.flush();
   return fbo->getTexture()->resizeTexture(width, height);
 }
 
@@ -2438,6 +2790,7 @@ pxContextFramebufferRef pxContext::getCurrentFramebuffer()
 
 pxError pxContext::setFramebuffer(pxContextFramebufferRef fbo)
 {
+  gDrawBatch.flush();
   currentGLProgram = PROGRAM_UNKNOWN;
   if (fbo.getPtr() == NULL || fbo->getTexture().getPtr() == NULL)
   {
@@ -2500,12 +2853,15 @@ pxError pxContext::deleteContextSurface(pxTextureRef texture)
   {
     return PX_FAIL;
   }
+  // batched quads may still sample it
+  gDrawBatch.flush();
   return texture->deleteTexture();
 }
 #endif
 
 void pxContext::enableDirtyRectangles(bool enable)
 {
+  gDrawBatch.flush();
   currentFramebuffer->enableDirtyRectangles(enable);
   if (enable)
   {
@@ -2576,6 +2932,7 @@ void pxContext::drawImage9(float w, float h, float x1, float y1,
 
   texture->setLastRenderTick(gRenderTick);
 
+  gDrawBatch.flush();
   drawImage92(0, 0, w, h, x1, y1, x2, y2, texture);
 }
 
@@ -2599,6 +2956,7 @@ void pxContext::drawImage9Border(float w, float h,
 
   texture->setLastRenderTick(gRenderTick);
 
+  gDrawBatch.flush();
   drawImage9Border2(0, 0, w, h, bx1, by1, bx2, by2, ix1, iy1, ix2, iy2, drawCenter, color, texture);
 }
 
@@ -2666,8 +3024,24 @@ void pxContext::drawImage(float x, float y, float w, float h,
 }
 
 #ifdef PXSCENE_FONT_ATLAS
+// Half a pixel in the units of a distance field that spans twice spread
+// texels, measured on the first quad.  Glyph quads are all drawn at the
+// same scale.
+static float distanceFieldSmoothing(const float* verts, const float* uvs, pxTextureRef t, float spread)
+{
+  const float* m = gMatrix.data();
+  float scale = sqrt(m[0]*m[0] + m[1]*m[1]);
+  float pixels = fabs(verts[2] - verts[0]) * scale;
+  float texels = fabs(uvs[2] - uvs[0]) * t->width();
+  if (pixels <= 0 || texels <= 0)
+  {
+    return 0.5f;
+  }
+  return std::min(0.5f, texels / pixels / (4 * spread));
+}
+
 void pxContext::drawTexturedQuads(int numQuads, const void *verts, const void* uvs,
-                          pxTextureRef t, float* color)
+                          pxTextureRef t, float* color, float distanceFieldSpread)
 {
 #ifdef DEBUG_SKIP_IMAGE
 #warning "DEBUG_SKIP_IMAGE enabled ... Skipping "
@@ -2690,7 +3064,22 @@ void pxContext::drawTexturedQuads(int numQuads, const void *verts, const void* u
 
   float colorPM[4];
   premultiply(colorPM,color);
-  gATextureShader->draw(gResW,gResH,gMatrix.data(),gAlpha,GL_TRIANGLES,6*numQuads,verts,uvs,t,colorPM);
+
+  if (distanceFieldSpread > 0)
+  {
+    float smoothing = distanceFieldSmoothing((const float*)verts, (const float*)uvs, t, distanceFieldSpread);
+    if (!gDrawBatch.add(pxDrawBatch::BATCH_DISTANCE_FIELD,GL_TRIANGLES,(const float*)verts,(const float*)uvs,6*numQuads,t.getPtr(),colorPM,
+                        pxConstantsStretch::NONE,pxConstantsStretch::NONE,smoothing))
+    {
+      gDistanceFieldShader->draw(gResW,gResH,gMatrix.data(),gAlpha,GL_TRIANGLES,6*numQuads,verts,uvs,t,colorPM,smoothing);
+    }
+    return;
+  }
+
+  if (!gDrawBatch.add(pxDrawBatch::BATCH_TEXTURED_QUADS,GL_TRIANGLES,(const float*)verts,(const float*)uvs,6*numQuads,t.getPtr(),colorPM))
+  {
+    gATextureShader->draw(gResW,gResH,gMatrix.data(),gAlpha,GL_TRIANGLES,6*numQuads,verts,uvs,t,colorPM);
+  }
 }
 #endif
 
@@ -2729,6 +3118,7 @@ void pxContext::drawDiagRect(float x, float y, float w, float h, float* color)
   float colorPM[4];
   premultiply(colorPM,color);
 
+  gDrawBatch.flush();
   gSolidShader->draw(gResW,gResH,gMatrix.data(),gAlpha,GL_LINE_LOOP,verts,4,colorPM);
 }
 
@@ -2760,6 +3150,7 @@ void pxContext::drawDiagLine(float x1, float y1, float x2, float y2, float* colo
   float colorPM[4];
   premultiply(colorPM,color);
 
+  gDrawBatch.flush();
   gSolidShader->draw(gResW,gResH,gMatrix.data(),gAlpha,GL_LINES,verts,2,colorPM);
 }
 
@@ -2806,8 +3197,24 @@ void pxContext::popState()
   }
 }
 
+void pxContext::flush()
+{
+  gDrawBatch.flush();
+}
+
+void pxContext::enableDrawBatching(bool enable)
+{
+  gDrawBatch.setEnabled(enable);
+}
+
+bool pxContext::isDrawBatchingEnabled()
+{
+  return gDrawBatch.isEnabled();
+}
+
 void pxContext::snapshot(pxOffscreen& o)
 {
+  gDrawBatch.flush();
   o.init(gResW,gResH);
   glReadPixels(0,0,gResW,gResH,GL_RGBA,GL_UNSIGNED_BYTE,(void*)o.base());
 
@@ -2848,30 +3255,42 @@ void pxContext::mapToScreenCoordinates(pxMatrix4f& m, float inX, float inY, int
   }
 }
 
-bool pxContext::isObjectOnScreen(float /*x*/, float /*y*/, float /*width*/, float /*height*/)
+bool pxContext::isObjectOnScreen(float x, float y, float width, float height)
 {
-#if 1
-  return true;
-#else
-  int outX1, outX2, outY1, outY2;
-  mapToScreenCoordinates(width,height,outX2, outY2);
-  mapToScreenCoordinates(x,y,outX1, outY1);
-  int fboWidth = currentFramebuffer->width();
-  int fboHeight = currentFramebuffer->height();
-  if (currentFramebuffer == defaultFramebuffer)
+  // screen aligned bounds of the transformed corners, so rotated and
+  // scaled objects are tested by the area they actually cover
+  const float cornerX[4] = { x, x + width, x, x + width };
+  const float cornerY[4] = { y, y, y + height, y + height };
+  float left = 0, top = 0, right = 0, bottom = 0;
+  for (int i = 0; i < 4; i++)
   {
-    fboWidth = gResW;
-    fboHeight = gResH;
+    pxVector4f positionCoords = gMatrix.multiply(pxVector4f(cornerX[i], cornerY[i], 0, 1));
+    if (positionCoords.w() <= 0)
+    {
+      // behind the viewer, don't guess
+      return true;
+    }
+    float screenX = positionCoords.x() / positionCoords.w();
+    float screenY = positionCoords.y() / positionCoords.w();
+    if (i == 0 || screenX < left)   left = screenX;
+    if (i == 0 || screenX > right)  right = screenX;
+    if (i == 0 || screenY < top)    top = screenY;
+    if (i == 0 || screenY > bottom) bottom = screenY;
   }
-  if ((outX1 < 0 && outX2 < 0) ||
-      (outX1 > fboWidth && outX2 > fboWidth) ||
-      (outY1 < 0 && outY2 < 0) ||
-      (outY1 > fboHeight && outY2 > fboHeight))
+
+  float clipLeft = 0, clipTop = 0;
+  float clipRight = static_cast<float>(gResW), clipBottom = static_cast<float>(gResH);
+  if (currentFramebuffer.getPtr() != NULL && currentFramebuffer->isDirtyRectanglesEnabled())
   {
-    return false;
+    // see clear(), the dirty rectangle is stored as the scissor box
+    pxRect dirtyRect = currentFramebuffer->dirtyRectangle();
+    clipLeft = pxMax<float>(clipLeft, dirtyRect.left());
+    clipRight = pxMin<float>(clipRight, dirtyRect.left() + dirtyRect.right());
+    clipTop = pxMax<float>(clipTop, gResH - dirtyRect.top() - dirtyRect.bottom());
+    clipBottom = pxMin<float>(clipBottom, gResH - dirtyRect.top());
   }
-  return true;
-#endif
+
+  return !(right < clipLeft || left > clipRight || bottom < clipTop || top > clipBottom);
 }
 
 void pxContext::adjustCurrentTextureMemorySize(int64_t changeInBytes, bool allowGarbageCollect)
@@ -2971,6 +3390,17 @@ bool pxContext::isTextureSpaceAvailable(pxTextureRef texture, bool allowGarbageC
   return true;
 }
 
+bool pxContext::isTextureSpaceAvailable(int64_t sizeInBytes)
+{
+  if (!mEnableTextureMemoryMonitoring)
+    return true;
+
+  lockContext();
+  int64_t currentTextureMemorySize = mCurrentTextureMemorySizeInBytes;
+  unlockContext();
+  return (sizeInBytes + currentTextureMemorySize) <= mTextureMemoryLimitInBytes;
+}
+
 int64_t pxContext::currentTextureMemoryUsageInBytes()
 {
   return mCurrentTextureMemorySizeInBytes;
@@ -2997,6 +3427,9 @@ int64_t pxContext::ejectTextureMemory(int64_t bytesRequested, bool forceEject)
   if (!mEnableTextureMemoryMonitoring)
     return 0;
 
+  // pending draws may still use the textures that get ejected
+  gDrawBatch.flush();
+
   int64_t beforeTextureMemoryUsage = context.currentTextureMemoryUsageInBytes();
   if (!forceEject)
   {
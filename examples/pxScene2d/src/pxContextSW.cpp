@@ -0,0 +1,3012 @@
+/*
+
+ pxCore Copyright 2005-2018 John Robinson
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+// pxContextSW.cpp
+//
+// pxContext that rasterizes into memory, for rendering without a GPU.  Draws
+// are recorded and rasterized when the context is flushed, in bands of rows
+// that are spread over the thread pool.  The pixels end up the same as with
+// pxContextGL.cpp: bilinear filtering, premultiplied alpha blended with
+// ONE, ONE_MINUS_SRC_ALPHA and pixel centers sampled like a GL rasterizer.
+
+#include "rtCore.h"
+#include "rtLog.h"
+#include "rtThreadTask.h"
+#include "rtThreadPool.h"
+#include "rtThreadQueue.h"
+#include "rtMutex.h"
+#include "rtAtomic.h"
+#include "rtScript.h"
+#include "rtSettings.h"
+
+#include "pxContext.h"
+#include "pxUtil.h"
+#include <algorithm>
+#include <ctime>
+#include <cstdlib>
+#include <math.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "pxContextUtils.h"
+#include "pxTimer.h"
+
+#define CONTEXT_GC_THROTTLE_SECS_DEFAULT 5
+
+// flushes that cover at least this many pixels are rasterized on the thread pool
+#define PX_SW_THREADED_PIXELS (256 * 256)
+// rows in each of the bands the threads take turns rasterizing
+#define PX_SW_BAND_ROWS 32
+// pixels shaded at a time before they are blended into the framebuffer
+#define PX_SW_SPAN_PIXELS 64
+
+// alpha is the most significant byte of pxPixel::u in every pixel layout
+#define PX_SW_ALPHA_SHIFT 24
+
+////////////////////////////////////////////////////////////////
+//
+// Debug macros...
+
+// NOTE:  Comment out these defines for 'normal' operation.
+//
+// #define DEBUG_SKIP_RECT
+// #define DEBUG_SKIP_IMAGE
+// #define DEBUG_SKIP_IMAGE9
+
+// #define DEBUG_SKIP_DIAG_RECT
+// #define DEBUG_SKIP_DIAG_LINE
+
+////////////////////////////////////////////////////////////////
+//
+// Debug Statistics
+#ifdef USE_RENDER_STATS
+  extern uint32_t gDrawCalls;
+  extern uint32_t gTexBindCalls;
+  extern uint32_t gFboBindCalls;
+
+  #define TRACK_DRAW_CALLS()   { gDrawCalls++;    }
+  #define TRACK_TEX_CALLS()    { gTexBindCalls++; }
+  #define TRACK_FBO_CALLS()    { gFboBindCalls++; }
+#else
+  #define TRACK_DRAW_CALLS()
+  #define TRACK_TEX_CALLS()
+  #define TRACK_FBO_CALLS()
+#endif
+
+////////////////////////////////////////////////////////////////
+
+// Pixels a draw reads or writes.  Rows run bottom to top like they do in a GL
+// framebuffer, so surfaces rendered here are laid out like the textures made
+// from images and the vertices and uvs match the ones in pxContextGL.cpp.
+struct pxSWSurface
+{
+  pxSWSurface() : base(NULL), stride(0), width(0), height(0), alphaOnly(false) {}
+
+  uint8_t* base;
+  int32_t stride;
+  int32_t width;
+  int32_t height;
+  bool alphaOnly; // one byte per pixel
+};
+
+static pxSWSurface surfaceOf(pxBuffer& b)
+{
+  pxSWSurface s;
+  s.base = (uint8_t*)b.base();
+  s.stride = b.stride();
+  s.width = b.width();
+  s.height = b.height();
+  return s;
+}
+
+// a vertex in window coordinates with its uv divided by w, so that it can be
+// interpolated linearly across the screen
+struct pxSWVertex
+{
+  float x;
+  float y;
+  float u; // u/w
+  float v; // v/w
+  float q; // 1/w
+};
+
+struct pxSWTriangle
+{
+  // pixel centers with a*x + b*y + c >= 0 for all three edges are covered,
+  // the ones right on an edge only if it is inclusive
+  double a[3], b[3], c[3];
+  bool inclusive[3];
+  // u/w, v/w and 1/w at x, y are p[0]*x + p[1]*y + p[2]
+  double u[3], v[3], q[3];
+  // pixels that can be covered, clipped to the draw
+  int32_t left, top, right, bottom;
+};
+
+struct pxSWDraw
+{
+  enum shaderType { CLEAR, SOLID, TEXTURE, A_TEXTURE, TEXTURE_MASKED, DISTANCE_FIELD };
+
+  pxSWDraw(): shader(SOLID), color(0), alpha(256), fieldLow(0), fieldScale(256), modulate(false), invertMask(false),
+              repeatX(false), repeatY(false), perspective(false), texture(), mask(),
+              textureRef(), maskRef(), clip(), firstTriangle(0), numTriangles(0) {}
+
+  shaderType shader;
+  uint32_t color;       // premultiplied and times the context alpha, CLEAR writes it as is
+  uint32_t alpha;       // 0..256
+  int32_t fieldLow;     // DISTANCE_FIELD coverage goes from 0 at fieldLow
+  int32_t fieldScale;   // to 256 at fieldLow + 65536 / fieldScale
+  bool modulate;        // TEXTURE is multiplied by color instead of alpha
+  bool invertMask;
+  bool repeatX;
+  bool repeatY;
+  bool perspective;     // w isn't 1 everywhere
+  pxSWSurface texture;
+  pxSWSurface mask;
+  pxTextureRef textureRef; // keep the pixels around until the draw is flushed
+  pxTextureRef maskRef;
+  pxRect clip;          // framebuffer and scissor box, rows counted from the bottom
+  size_t firstTriangle;
+  size_t numTriangles;
+};
+
+// draws recorded for boundFramebuffer since the last flush
+static std::vector<pxSWDraw> gDraws;
+static std::vector<pxSWTriangle> gTriangles;
+static int64_t gDrawPixels = 0;
+static bool gDrawBatchingEnabled = true;
+
+pxContextSurfaceNativeDesc  defaultContextSurface;
+pxContextSurfaceNativeDesc* currentContextSurface = &defaultContextSurface;
+
+pxContextFramebufferRef defaultFramebuffer(new pxContextFramebuffer());
+pxContextFramebufferRef currentFramebuffer = defaultFramebuffer;
+
+
+#ifdef RUNINMAIN
+extern rtScript script;
+#else
+extern uv_async_t gcTrigger;
+#endif
+extern pxContext context;
+rtThreadQueue* gUIThreadQueue = new rtThreadQueue();
+double lastContextGarbageCollectTime = 0;
+double garbageCollectThrottleInSeconds = CONTEXT_GC_THROTTLE_SECS_DEFAULT;
+
+static int gResW, gResH;
+static pxMatrix4f gMatrix;
+static float gAlpha = 1.0;
+uint32_t gRenderTick = 0;
+rtMutex gRenderTickMutex;
+std::vector<pxTexture*> textureList;
+rtMutex textureListMutex;
+#ifdef ENABLE_BACKGROUND_TEXTURE_CREATION
+rtMutex contextLock;
+#endif //ENABLE_BACKGROUND_TEXTURE_CREATION
+
+// the pixels of the default framebuffer
+static pxOffscreen gScreen;
+
+// set by bindGLTexture() and bindGLTextureAsMask() like the GL texture units
+static pxSWSurface boundTexture;
+static pxSWSurface boundTextureMask;
+static pxSWSurface boundFramebuffer;
+
+// scissor box in window coordinates, see pxContext::clear()
+static bool gScissorEnabled = false;
+static pxRect gScissor;
+
+pxError lockContext()
+{
+#ifdef ENABLE_BACKGROUND_TEXTURE_CREATION
+  contextLock.lock();
+#endif //ENABLE_BACKGROUND_TEXTURE_CREATION
+  return PX_OK;
+}
+
+pxError unlockContext()
+{
+#ifdef ENABLE_BACKGROUND_TEXTURE_CREATION
+  contextLock.unlock();
+#endif //ENABLE_BACKGROUND_TEXTURE_CREATION
+  return PX_OK;
+}
+
+pxError addToTextureList(pxTexture* texture)
+{
+  textureListMutex.lock();
+  textureList.push_back(texture);
+  textureListMutex.unlock();
+  return PX_OK;
+}
+
+pxError removeFromTextureList(pxTexture* texture)
+{
+  textureListMutex.lock();
+  for(std::vector<pxTexture*>::iterator it = textureList.begin(); it != textureList.end(); ++it)
+  {
+    if ((*it) == texture)
+    {
+      textureList.erase(it);
+      break;
+    }
+  }
+  textureListMutex.unlock();
+  return PX_OK;
+}
+
+pxError ejectNotRecentlyUsedTextureMemory(int64_t bytesNeeded, int64_t targetMemoryAmount,
+                                          bool clearAllOffscreen, uint32_t maxAge=5)
+{
+  //rtLogDebug("attempting to eject %" PRId64 " bytes of texture memory with max age %u", bytesNeeded, maxAge);
+#if !defined(DISABLE_TEXTURE_EJECTION)
+  int numberEjected = 0;
+  int64_t beforeTextureMemoryUsage = 0;
+  lockContext();
+  beforeTextureMemoryUsage = context.currentTextureMemoryUsageInBytes();
+  unlockContext();
+
+  uint32_t currentRenderTick = 0;
+  {
+    rtMutexLockGuard renderTickMutexGuard(gRenderTickMutex);
+    currentRenderTick = gRenderTick;
+  }
+
+  textureListMutex.lock();
+  for(std::vector<pxTexture*>::iterator it = textureList.begin(); it != textureList.end(); ++it)
+  {
+    pxTexture* texture = (*it);
+    uint32_t lastRenderTickAge = currentRenderTick - texture->lastRenderTick();
+    bool textureIsSetupForRendering = texture->setupForRendering();
+    if (lastRenderTickAge > maxAge && textureIsSetupForRendering)
+    {
+      numberEjected++;
+      texture->unloadTextureData();
+      int64_t currentTextureMemory = 0;
+      lockContext();
+      currentTextureMemory = context.currentTextureMemoryUsageInBytes();
+      unlockContext();
+      if (!clearAllOffscreen && (currentTextureMemory <= targetMemoryAmount) &&
+          (beforeTextureMemoryUsage - currentTextureMemory) > bytesNeeded)
+      {
+        break;
+      }
+    }
+  }
+  textureListMutex.unlock();
+
+  if (numberEjected > 0)
+  {
+    int64_t afterTextureMemoryUsage = 0;
+    lockContext();
+    afterTextureMemoryUsage = context.currentTextureMemoryUsageInBytes();
+    unlockContext();
+    rtLogWarn("%d textures have been ejected and %" PRId64 " bytes of texture memory has been freed",
+        numberEjected, (beforeTextureMemoryUsage - afterTextureMemoryUsage));
+  }
+#else
+  (void)bytesNeeded;
+  (void)targetMemoryAmount;
+  (void)clearAllOffscreen;
+  (void)maxAge;
+#endif //!DISABLE_TEXTURE_EJECTION
+  return PX_OK;
+}
+
+// assume premultiplied
+
+//====================================================================================================================================================================================
+
+inline void premultiply(float* d, const float* s)
+{
+  d[0] = s[0]*s[3];
+  d[1] = s[1]*s[3];
+  d[2] = s[2]*s[3];
+  d[3] = s[3];
+}
+
+//====================================================================================================================================================================================
+// Pixel arithmetic.  The scalar versions work on two channels at a time, the
+// red/blue and alpha/green pairs of a pixel each fit in one 32 bit multiply.
+
+static inline uint8_t toByte(float f)
+{
+  f = f * 255.0f + 0.5f;
+  return f <= 0.0f ? 0 : (f >= 255.0f ? 255 : (uint8_t)f);
+}
+
+// c times alpha as a pixel
+static uint32_t toPixel(const float* c, float alpha)
+{
+  pxPixel p(toByte(c[0]*alpha), toByte(c[1]*alpha), toByte(c[2]*alpha), toByte(c[3]*alpha));
+  return p.u;
+}
+
+static inline uint32_t toScale(float alpha)
+{
+  float s = alpha * 256.0f + 0.5f;
+  return s <= 0.0f ? 0 : (s >= 256.0f ? 256 : (uint32_t)s);
+}
+
+static inline uint32_t alphaOf(uint32_t p)
+{
+  return p >> PX_SW_ALPHA_SHIFT;
+}
+
+// every channel of p times s/256, s is 0..256
+static inline uint32_t scalePixel(uint32_t p, uint32_t s)
+{
+  uint32_t rb = ((p & 0xff00ff) * s) >> 8;
+  uint32_t ag = ((p >> 8) & 0xff00ff) * s;
+  return (rb & 0xff00ff) | (ag & 0xff00ff00);
+}
+
+// channel by channel product of p and c
+static inline uint32_t modulatePixel(uint32_t p, uint32_t c)
+{
+  pxPixel s(p), m(c), r;
+  for (int i = 0; i < 4; i++)
+  {
+    r.bytes[i] = (uint8_t)((s.bytes[i] * (m.bytes[i] + (m.bytes[i] >> 7))) >> 8);
+  }
+  return r.u;
+}
+
+// a + (b - a) * f/256, f is 0..256
+static inline uint32_t lerpPixel(uint32_t a, uint32_t b, uint32_t f)
+{
+  // summed before the shift so equal pixels come back unchanged
+  uint32_t rb = (((a & 0xff00ff) * (256 - f) + (b & 0xff00ff) * f) >> 8) & 0xff00ff;
+  uint32_t ag = (((a >> 8) & 0xff00ff) * (256 - f) + ((b >> 8) & 0xff00ff) * f) & 0xff00ff00;
+  return rb | ag;
+}
+
+// premultiplied s over d
+static inline uint32_t blendPixel(uint32_t d, uint32_t s)
+{
+  uint32_t ia = 255 - alphaOf(s);
+  if (ia == 0)
+  {
+    return s;
+  }
+  if (s == 0)
+  {
+    return d;
+  }
+
+  // d * ia / 255, rounded
+  uint32_t rb = (d & 0xff00ff) * ia + 0x800080;
+  rb = ((rb + ((rb >> 8) & 0xff00ff)) >> 8) & 0xff00ff;
+  uint32_t ag = ((d >> 8) & 0xff00ff) * ia + 0x800080;
+  ag = ((ag + ((ag >> 8) & 0xff00ff)) >> 8) & 0xff00ff;
+
+  // saturating add, sources that aren't really premultiplied can overflow
+  rb += s & 0xff00ff;
+  ag += (s >> 8) & 0xff00ff;
+  rb |= ((rb >> 8) & 0x10001) * 0xff;
+  ag |= ((ag >> 8) & 0x10001) * 0xff;
+  return (rb & 0xff00ff) | ((ag & 0xff00ff) << 8);
+}
+
+#ifdef __SSE2__
+// v * f / 255 for 16 bit lanes, rounded
+static inline __m128i mulDiv255(__m128i v, __m128i f)
+{
+  __m128i t = _mm_add_epi16(_mm_mullo_epi16(v, f), _mm_set1_epi16(128));
+  return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+// four premultiplied pixels over four others
+static inline __m128i blendPixels(__m128i d, __m128i s, __m128i inverseAlpha)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i lo = mulDiv255(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi32(inverseAlpha, inverseAlpha));
+  __m128i hi = mulDiv255(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi32(inverseAlpha, inverseAlpha));
+  return _mm_adds_epu8(s, _mm_packus_epi16(lo, hi));
+}
+#endif //__SSE2__
+
+// blends n premultiplied pixels over d
+static void blendSpan(uint32_t* d, const uint32_t* s, int32_t n)
+{
+  int32_t i = 0;
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i opaque = _mm_set1_epi32(255);
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128i src = _mm_loadu_si128((const __m128i*)(s + i));
+    __m128i alpha = _mm_srli_epi32(src, PX_SW_ALPHA_SHIFT);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, opaque)) == 0xffff)
+    {
+      _mm_storeu_si128((__m128i*)(d + i), src);
+      continue;
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(src, zero)) == 0xffff)
+    {
+      continue;
+    }
+    // 255 - alpha in both 16 bit halves of each pixel
+    __m128i inverseAlpha = _mm_sub_epi16(_mm_set1_epi16(255), _mm_or_si128(alpha, _mm_slli_epi32(alpha, 16)));
+    __m128i dst = _mm_loadu_si128((const __m128i*)(d + i));
+    _mm_storeu_si128((__m128i*)(d + i), blendPixels(dst, src, inverseAlpha));
+  }
+#endif //__SSE2__
+  for (; i < n; i++)
+  {
+    d[i] = blendPixel(d[i], s[i]);
+  }
+}
+
+// blends n pixels of color c over d
+static void fillSpan(uint32_t* d, uint32_t c, int32_t n)
+{
+  if (alphaOf(c) == 255)
+  {
+    std::fill(d, d + n, c);
+    return;
+  }
+  if (c == 0)
+  {
+    return;
+  }
+
+  int32_t i = 0;
+#ifdef __SSE2__
+  const __m128i src = _mm_set1_epi32((int)c);
+  const __m128i inverseAlpha = _mm_set1_epi16((short)(255 - alphaOf(c)));
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128i dst = _mm_loadu_si128((const __m128i*)(d + i));
+    _mm_storeu_si128((__m128i*)(d + i), blendPixels(dst, src, inverseAlpha));
+  }
+#endif //__SSE2__
+  for (; i < n; i++)
+  {
+    d[i] = blendPixel(d[i], c);
+  }
+}
+
+//====================================================================================================================================================================================
+// Texture sampling, GL_LINEAR with GL_REPEAT or GL_CLAMP_TO_EDGE.  Coordinates
+// are texels in 16.16 fixed point, already moved by half a texel so that the
+// integer part is the first of the two texels that get blended.
+
+static inline int64_t toFixed(double texel)
+{
+  // far enough out that nothing overflows and clamping still works
+  const double limit = 1e9;
+  texel = texel < -limit ? -limit : (texel > limit ? limit : texel);
+  return (int64_t)floor(texel * 65536.0 + 0.5);
+}
+
+static inline int32_t wrapTexel(int32_t i, int32_t size, bool repeat)
+{
+  if (repeat)
+  {
+    i %= size;
+    return i < 0 ? i + size : i;
+  }
+  return i < 0 ? 0 : (i >= size ? size - 1 : i);
+}
+
+static inline uint32_t texel(const pxSWSurface& s, int32_t x, int32_t y)
+{
+  if (s.alphaOnly)
+  {
+    return (uint32_t)s.base[y * s.stride + x] << PX_SW_ALPHA_SHIFT;
+  }
+  return ((const uint32_t*)(s.base + y * s.stride))[x];
+}
+
+static inline uint32_t sampleTexture(const pxSWSurface& s, int64_t fx, int64_t fy, bool repeatX, bool repeatY)
+{
+  int32_t x = (int32_t)(fx >> 16);
+  int32_t y = (int32_t)(fy >> 16);
+  uint32_t wx = (uint32_t)(fx >> 8) & 0xff;
+  uint32_t wy = (uint32_t)(fy >> 8) & 0xff;
+  int32_t x0 = wrapTexel(x, s.width, repeatX);
+  int32_t y0 = wrapTexel(y, s.height, repeatY);
+
+  uint32_t p = texel(s, x0, y0);
+  if (wx != 0)
+  {
+    p = lerpPixel(p, texel(s, wrapTexel(x + 1, s.width, repeatX), y0), wx);
+  }
+  if (wy != 0)
+  {
+    int32_t y1 = wrapTexel(y + 1, s.height, repeatY);
+    uint32_t p1 = texel(s, x0, y1);
+    if (wx != 0)
+    {
+      p1 = lerpPixel(p1, texel(s, wrapTexel(x + 1, s.width, repeatX), y1), wx);
+    }
+    p = lerpPixel(p, p1, wy);
+  }
+  return p;
+}
+
+//====================================================================================================================================================================================
+// Triangle setup
+
+// Computed from the same end point whichever way the edge runs, so the two
+// triangles sharing an edge get exactly opposite equations and a pixel center
+// on the edge is drawn by one of them only.
+static void setupEdge(const pxSWVertex& p0, const pxSWVertex& p1, double& a, double& b, double& c)
+{
+  bool swap = (p1.x < p0.x) || (p1.x == p0.x && p1.y < p0.y);
+  const pxSWVertex& s = swap ? p1 : p0;
+  const pxSWVertex& e = swap ? p0 : p1;
+  a = -((double)e.y - s.y);
+  b = (double)e.x - s.x;
+  c = -(a * s.x + b * s.y);
+  if (swap)
+  {
+    a = -a;
+    b = -b;
+    c = -c;
+  }
+}
+
+static void setupPlane(const pxSWVertex& p0, const pxSWVertex& p1, const pxSWVertex& p2,
+                       double f0, double f1, double f2, double area, double* plane)
+{
+  double x1 = (double)p1.x - p0.x, y1 = (double)p1.y - p0.y;
+  double x2 = (double)p2.x - p0.x, y2 = (double)p2.y - p0.y;
+  plane[0] = ((f1 - f0) * y2 - (f2 - f0) * y1) / area;
+  plane[1] = ((f2 - f0) * x1 - (f1 - f0) * x2) / area;
+  plane[2] = f0 - plane[0] * p0.x - plane[1] * p0.y;
+}
+
+static void addTriangle(pxSWDraw& d, const pxSWVertex& p0, const pxSWVertex& p1, const pxSWVertex& p2)
+{
+  double area = ((double)p1.x - p0.x) * ((double)p2.y - p0.y) - ((double)p2.x - p0.x) * ((double)p1.y - p0.y);
+  if (area == 0 || area != area)
+  {
+    return; // degenerate or not a number
+  }
+
+  double minX = std::min(p0.x, std::min(p1.x, p2.x));
+  double maxX = std::max(p0.x, std::max(p1.x, p2.x));
+  double minY = std::min(p0.y, std::min(p1.y, p2.y));
+  double maxY = std::max(p0.y, std::max(p1.y, p2.y));
+  pxSWTriangle t;
+  t.left   = (int32_t)std::max<double>(d.clip.left(),   floor(std::max<double>(minX, d.clip.left())));
+  t.top    = (int32_t)std::max<double>(d.clip.top(),    floor(std::max<double>(minY, d.clip.top())));
+  t.right  = (int32_t)std::min<double>(d.clip.right(),  ceil(std::min<double>(maxX, d.clip.right())));
+  t.bottom = (int32_t)std::min<double>(d.clip.bottom(), ceil(std::min<double>(maxY, d.clip.bottom())));
+  if (t.left >= t.right || t.top >= t.bottom)
+  {
+    return;
+  }
+
+  const pxSWVertex* p[3] = { &p0, &p1, &p2 };
+  for (int i = 0; i < 3; i++)
+  {
+    setupEdge(*p[i], *p[(i + 1) % 3], t.a[i], t.b[i], t.c[i]);
+    if (area < 0)
+    {
+      // clockwise, the inside is to the right of every edge
+      t.a[i] = -t.a[i];
+      t.b[i] = -t.b[i];
+      t.c[i] = -t.c[i];
+    }
+    t.inclusive[i] = t.a[i] > 0 || (t.a[i] == 0 && t.b[i] > 0);
+  }
+
+  if (d.shader != pxSWDraw::SOLID)
+  {
+    setupPlane(p0, p1, p2, p0.u, p1.u, p2.u, area, t.u);
+    setupPlane(p0, p1, p2, p0.v, p1.v, p2.v, area, t.v);
+    setupPlane(p0, p1, p2, p0.q, p1.q, p2.q, area, t.q);
+  }
+
+  gTriangles.push_back(t);
+  d.numTriangles++;
+  gDrawPixels += (int64_t)(t.right - t.left) * (t.bottom - t.top);
+}
+
+// the pixels of row y whose centers are inside t, x0 up to but not including x1
+static bool triangleSpan(const pxSWTriangle& t, int32_t y, int32_t& x0, int32_t& x1)
+{
+  double yc = y + 0.5;
+  double left = t.left;
+  double right = t.right;
+  for (int i = 0; i < 3; i++)
+  {
+    double k = t.b[i] * yc + t.c[i];
+    if (t.a[i] == 0)
+    {
+      if (k < 0 || (k == 0 && !t.inclusive[i]))
+      {
+        return false;
+      }
+      continue;
+    }
+
+    // the pixel whose center is on the edge
+    double edge = -k / t.a[i] - 0.5;
+    if (t.a[i] > 0)
+    {
+      left = std::max(left, t.inclusive[i] ? ceil(edge) : floor(edge) + 1);
+    }
+    else
+    {
+      right = std::min(right, t.inclusive[i] ? floor(edge) + 1 : ceil(edge));
+    }
+  }
+  if (left >= right)
+  {
+    return false;
+  }
+  x0 = (int32_t)left;
+  x1 = (int32_t)right;
+  return true;
+}
+
+//====================================================================================================================================================================================
+// Shading
+
+static inline uint32_t shadePixel(const pxSWDraw& d, int64_t s, int64_t t, int64_t ms, int64_t mt)
+{
+  switch (d.shader)
+  {
+    case pxSWDraw::TEXTURE:
+    {
+      uint32_t p = sampleTexture(d.texture, s, t, d.repeatX, d.repeatY);
+      if (d.modulate)
+      {
+        return modulatePixel(p, d.color);
+      }
+      return d.alpha == 256 ? p : scalePixel(p, d.alpha);
+    }
+    case pxSWDraw::A_TEXTURE:
+    {
+      uint32_t a = alphaOf(sampleTexture(d.texture, s, t, false, false));
+      return scalePixel(d.color, a + (a >> 7));
+    }
+    case pxSWDraw::DISTANCE_FIELD:
+    {
+      int32_t c = ((int32_t)alphaOf(sampleTexture(d.texture, s, t, false, false)) - d.fieldLow) * d.fieldScale >> 8;
+      c = std::max(0, std::min(c, 256));
+      // smoothstep
+      return scalePixel(d.color, (uint32_t)((c * c * (768 - 2 * c)) >> 16));
+    }
+    case pxSWDraw::TEXTURE_MASKED:
+    {
+      uint32_t p = sampleTexture(d.texture, s, t, false, false);
+      uint32_t m = alphaOf(sampleTexture(d.mask, ms, mt, false, false));
+      if (d.invertMask)
+      {
+        m = 255 - m;
+      }
+      return scalePixel(p, (d.alpha * (m + (m >> 7))) >> 8);
+    }
+    default:
+      return 0;
+  }
+}
+
+static void shadeSpan(const pxSWDraw& d, const pxSWTriangle& tri, int32_t x, int32_t y, int32_t n, uint32_t* dst)
+{
+  const pxSWSurface& tex = d.texture;
+  const pxSWSurface& mask = d.mask;
+  double xc = x + 0.5;
+  double yc = y + 0.5;
+  double u = tri.u[0] * xc + tri.u[1] * yc + tri.u[2];
+  double v = tri.v[0] * xc + tri.v[1] * yc + tri.v[2];
+  double q = tri.q[0] * xc + tri.q[1] * yc + tri.q[2];
+  uint32_t src[PX_SW_SPAN_PIXELS];
+
+  if (d.perspective)
+  {
+    for (int32_t i = 0; i < n; i += PX_SW_SPAN_PIXELS)
+    {
+      int32_t count = std::min(n - i, PX_SW_SPAN_PIXELS);
+      for (int32_t j = 0; j < count; j++)
+      {
+        double w = 1.0 / (q + tri.q[0] * (i + j));
+        double pu = (u + tri.u[0] * (i + j)) * w;
+        double pv = (v + tri.v[0] * (i + j)) * w;
+        src[j] = shadePixel(d, toFixed(pu * tex.width - 0.5), toFixed(pv * tex.height - 0.5),
+                            toFixed(pu * mask.width - 0.5), toFixed(pv * mask.height - 0.5));
+      }
+      blendSpan(dst + i, src, count);
+    }
+    return;
+  }
+
+  // w is 1 everywhere, uvs step linearly along the row
+  int64_t s = toFixed(u * tex.width - 0.5), ds = toFixed(tri.u[0] * tex.width);
+  int64_t t = toFixed(v * tex.height - 0.5), dt = toFixed(tri.v[0] * tex.height);
+  int64_t ms = toFixed(u * mask.width - 0.5), dms = toFixed(tri.u[0] * mask.width);
+  int64_t mt = toFixed(v * mask.height - 0.5), dmt = toFixed(tri.v[0] * mask.height);
+
+  if (d.shader == pxSWDraw::TEXTURE && !tex.alphaOnly && ds == 65536 && dt == 0 &&
+      (s & 0xffff) == 0 && (t & 0xffff) == 0)
+  {
+    // drawn texel for pixel, nothing to filter
+    int32_t tx = (int32_t)(s >> 16);
+    int32_t ty = (int32_t)(t >> 16);
+    if (tx >= 0 && tx + n <= tex.width && ty >= 0 && ty < tex.height)
+    {
+      const uint32_t* row = (const uint32_t*)(tex.base + ty * tex.stride) + tx;
+      if (!d.modulate && d.alpha == 256)
+      {
+        blendSpan(dst, row, n);
+        return;
+      }
+      for (int32_t i = 0; i < n; i += PX_SW_SPAN_PIXELS)
+      {
+        int32_t count = std::min(n - i, PX_SW_SPAN_PIXELS);
+        for (int32_t j = 0; j < count; j++)
+        {
+          src[j] = d.modulate ? modulatePixel(row[i + j], d.color) : scalePixel(row[i + j], d.alpha);
+        }
+        blendSpan(dst + i, src, count);
+      }
+      return;
+    }
+  }
+
+  for (int32_t i = 0; i < n; i += PX_SW_SPAN_PIXELS)
+  {
+    int32_t count = std::min(n - i, PX_SW_SPAN_PIXELS);
+    for (int32_t j = 0; j < count; j++)
+    {
+      src[j] = shadePixel(d, s, t, ms, mt);
+      s += ds;
+      t += dt;
+      ms += dms;
+      mt += dmt;
+    }
+    blendSpan(dst + i, src, count);
+  }
+}
+
+// draws the part of d that falls into rows top up to bottom of target
+static void rasterizeDraw(const pxSWDraw& d, const pxSWSurface& target, int32_t top, int32_t bottom)
+{
+  if (d.shader == pxSWDraw::CLEAR)
+  {
+    int32_t y0 = std::max(top, d.clip.top());
+    int32_t y1 = std::min(bottom, d.clip.bottom());
+    for (int32_t y = y0; y < y1; y++)
+    {
+      uint32_t* row = (uint32_t*)(target.base + y * target.stride);
+      std::fill(row + d.clip.left(), row + d.clip.right(), d.color);
+    }
+    return;
+  }
+
+  for (size_t i = d.firstTriangle; i < d.firstTriangle + d.numTriangles; i++)
+  {
+    const pxSWTriangle& t = gTriangles[i];
+    int32_t y0 = std::max(top, t.top);
+    int32_t y1 = std::min(bottom, t.bottom);
+    for (int32_t y = y0; y < y1; y++)
+    {
+      int32_t x0, x1;
+      if (!triangleSpan(t, y, x0, x1))
+      {
+        continue;
+      }
+      uint32_t* dst = (uint32_t*)(target.base + y * target.stride) + x0;
+      if (d.shader == pxSWDraw::SOLID)
+      {
+        fillSpan(dst, d.color, x1 - x0);
+      }
+      else
+      {
+        shadeSpan(d, t, x0, y, x1 - x0, dst);
+      }
+    }
+  }
+}
+
+// Rasterizes the recorded draws band by band.  Bands are taken in turn by the
+// thread pool and the thread that flushes, which waits until all are done.
+class pxSWRasterJob
+{
+public:
+  pxSWRasterJob(const pxSWSurface& target, int32_t numBands)
+    : mRefCount(1), mTarget(target), mNumBands(numBands), mNextBand(0), mBandsDone(0),
+      mMutex(), mCondition()
+  {
+  }
+
+  void AddRef()
+  {
+    rtAtomicInc(&mRefCount);
+  }
+
+  void Release()
+  {
+    if (rtAtomicDec(&mRefCount) == 0)
+    {
+      delete this;
+    }
+  }
+
+  static void rasterizeTask(void* data)
+  {
+    pxSWRasterJob* job = (pxSWRasterJob*)data;
+    job->rasterizeBands();
+    job->Release();
+  }
+
+  void rasterizeBands()
+  {
+    int32_t band;
+    while ((band = rtAtomicInc(&mNextBand) - 1) < mNumBands)
+    {
+      int32_t height = mTarget.height;
+      int32_t top = band * height / mNumBands;
+      int32_t bottom = (band + 1) * height / mNumBands;
+      for (size_t i = 0; i < gDraws.size(); i++)
+      {
+        rasterizeDraw(gDraws[i], mTarget, top, bottom);
+      }
+
+      rtMutexLockGuard guard(mMutex);
+      if (++mBandsDone == mNumBands)
+      {
+        mCondition.broadcast();
+      }
+    }
+  }
+
+  void wait()
+  {
+    mMutex.lock();
+    while (mBandsDone < mNumBands)
+    {
+      mCondition.wait(mMutex.getNativeMutexDescription());
+    }
+    mMutex.unlock();
+  }
+
+private:
+  rtAtomic mRefCount;
+  pxSWSurface mTarget;
+  int32_t mNumBands;
+  rtAtomic mNextBand;
+  int32_t mBandsDone;
+  rtMutex mMutex;
+  rtThreadCondition mCondition;
+};
+
+static void flushDraws()
+{
+  if (gDraws.empty())
+  {
+    return;
+  }
+
+  if (boundFramebuffer.base != NULL)
+  {
+    int32_t numBands = 1;
+    int32_t numThreads = 0;
+    if (gDrawPixels >= PX_SW_THREADED_PIXELS)
+    {
+      numBands = std::max(boundFramebuffer.height / PX_SW_BAND_ROWS, 1);
+      numThreads = std::min(rtThreadPool::globalInstance()->numberOfThreadsInPool(), numBands - 1);
+    }
+
+    pxSWRasterJob* job = new pxSWRasterJob(boundFramebuffer, numBands);
+    for (int32_t i = 0; i < numThreads; i++)
+    {
+      job->AddRef();
+      rtThreadPool::globalInstance()->executeTask(new rtThreadTask(pxSWRasterJob::rasterizeTask, job, "",
+                                                                   RT_THREAD_TASK_PRIORITY_VISIBLE));
+    }
+    job->rasterizeBands();
+    job->wait();
+    job->Release();
+  }
+
+  gDraws.clear();
+  gTriangles.clear();
+  gDrawPixels = 0;
+}
+
+//====================================================================================================================================================================================
+// Recording draws
+
+static pxSWDraw& beginDraw(pxSWDraw::shaderType shader)
+{
+  gDraws.push_back(pxSWDraw());
+  pxSWDraw& d = gDraws.back();
+  d.shader = shader;
+  d.firstTriangle = gTriangles.size();
+  d.clip.setLTRB(0, 0, boundFramebuffer.width, boundFramebuffer.height);
+  if (gScissorEnabled)
+  {
+    d.clip.setLTRB(std::max(d.clip.left(), gScissor.left()), std::max(d.clip.top(), gScissor.top()),
+                   std::min(d.clip.right(), gScissor.right()), std::min(d.clip.bottom(), gScissor.bottom()));
+  }
+  if (d.clip.width() < 0 || d.clip.height() < 0)
+  {
+    d.clip.setEmpty();
+  }
+  TRACK_DRAW_CALLS();
+  return d;
+}
+
+static void endDraw()
+{
+  if (!gDrawBatchingEnabled)
+  {
+    flushDraws();
+  }
+}
+
+// Maps x, y to window coordinates like the vertex shader in pxContextGL.cpp,
+// the matrix is applied and z is turned into w.  False if the vertex ends up
+// behind the viewer.
+static bool transformVertex(float x, float y, float u, float v, pxSWVertex& out, bool& perspective)
+{
+  const float* m = gMatrix.data();
+  float px = m[0]*x + m[4]*y + m[12];
+  float py = m[1]*x + m[5]*y + m[13];
+  float pz = m[2]*x + m[6]*y + m[14];
+  if (pz == 0)
+  {
+    out.x = px;
+    out.y = gResH - py;
+    out.u = u;
+    out.v = v;
+    out.q = 1;
+    return true;
+  }
+
+  float w = 1 + pz / gResW;
+  if (w <= 0)
+  {
+    return false;
+  }
+  out.x = ((2 * px / gResW - 1) / w + 1) * gResW / 2;
+  out.y = (-(2 * py / gResH - 1) / w + 1) * gResH / 2;
+  out.q = 1 / w;
+  out.u = u * out.q;
+  out.v = v * out.q;
+  perspective = true;
+  return true;
+}
+
+// GPUs snap vertices to a grid of subpixels before they rasterize, doing the
+// same decides pixel centers that are within rounding of an edge like they do
+static inline void snapVertex(pxSWVertex& p)
+{
+  p.x = floorf(p.x * 256.0f + 0.5f) / 256.0f;
+  p.y = floorf(p.y * 256.0f + 0.5f) / 256.0f;
+}
+
+// adds count vertices as a GL_TRIANGLE_STRIP or as GL_TRIANGLES
+static void addVertices(pxSWDraw& d, const float* pos, const float* uv, int count, bool strip)
+{
+  std::vector<pxSWVertex> verts(count);
+  std::vector<bool> visible(count);
+  for (int i = 0; i < count; i++)
+  {
+    bool perspective = false;
+    visible[i] = transformVertex(pos[i*2], pos[i*2+1], uv ? uv[i*2] : 0, uv ? uv[i*2+1] : 0, verts[i], perspective);
+    snapVertex(verts[i]);
+    d.perspective = d.perspective || perspective;
+  }
+
+  // triangles that are partly behind the viewer are left out rather than clipped
+  int step = strip ? 1 : 3;
+  for (int i = 2; i < count; i += step)
+  {
+    if (visible[i-2] && visible[i-1] && visible[i])
+    {
+      addTriangle(d, verts[i-2], verts[i-1], verts[i]);
+    }
+  }
+}
+
+// a one pixel wide line as a quad in window coordinates
+static void addLine(pxSWDraw& d, float x1, float y1, float x2, float y2)
+{
+  pxSWVertex p1, p2;
+  bool perspective = false;
+  if (!transformVertex(x1, y1, 0, 0, p1, perspective) || !transformVertex(x2, y2, 0, 0, p2, perspective))
+  {
+    return;
+  }
+  float dx = p2.x - p1.x;
+  float dy = p2.y - p1.y;
+  float length = sqrtf(dx*dx + dy*dy);
+  if (length == 0)
+  {
+    return;
+  }
+  float nx = -dy / length * 0.5f;
+  float ny = dx / length * 0.5f;
+
+  pxSWVertex quad[4] = { p1, p1, p2, p2 };
+  quad[0].x += nx; quad[0].y += ny;
+  quad[1].x -= nx; quad[1].y -= ny;
+  quad[2].x += nx; quad[2].y += ny;
+  quad[3].x -= nx; quad[3].y -= ny;
+  addTriangle(d, quad[0], quad[1], quad[2]);
+  addTriangle(d, quad[1], quad[2], quad[3]);
+}
+
+//====================================================================================================================================================================================
+
+class pxFBOTexture : public pxTexture
+{
+public:
+  pxFBOTexture(bool antiAliasing, bool alphaOnly) : mOffscreen(), mWidth(0), mHeight(0), mInitialized(false)
+  {
+    // neither is needed in memory, alpha only framebuffers fall back to RGBA like they do in GL
+    UNUSED_PARAM(antiAliasing);
+    UNUSED_PARAM(alphaOnly);
+
+    mTextureType = PX_TEXTURE_FRAME_BUFFER;
+  }
+
+  ~pxFBOTexture() { deleteTexture(); }
+
+  void createFboTexture(int w, int h)
+  {
+    if (mInitialized)
+    {
+      deleteTexture();
+    }
+
+    mWidth  = w;
+    mHeight = h;
+    if (!context.isTextureSpaceAvailable(this, true, 4))
+    {
+      rtLogDebug("Not enough texture memory to create FBO");
+      return;
+    }
+    if (mWidth <= 0 || mHeight <= 0)
+    {
+      return;
+    }
+
+    mOffscreen.init(mWidth, mHeight);
+    memset(mOffscreen.base(), 0, mOffscreen.sizeInBytes());
+    context.adjustCurrentTextureMemorySize(mWidth*mHeight*4);
+    mInitialized = true;
+  }
+
+  pxError resizeTexture(int w, int h)
+  {
+    if (mWidth != w || mHeight != h || !mInitialized)
+    {
+      createFboTexture(w, h);
+    }
+    return PX_OK;
+  }
+
+  virtual pxError deleteTexture()
+  {
+    if (mInitialized)
+    {
+      // pending draws may render into or read from the pixels
+      context.flush();
+      mOffscreen.term();
+      mInitialized = false;
+      context.adjustCurrentTextureMemorySize(-1*mWidth*mHeight*4);
+    }
+
+    return PX_OK;
+  }
+
+  virtual pxError prepareForRendering()
+  {
+    if (!mInitialized)
+    {
+      return PX_FAIL;
+    }
+    TRACK_FBO_CALLS();
+    boundFramebuffer = surfaceOf(mOffscreen);
+    gResW = mWidth;
+    gResH = mHeight;
+
+    return PX_OK;
+  }
+
+  virtual pxError bindGLTexture(int /*tLoc*/)
+  {
+    if (!mInitialized)
+      return PX_NOTINITIALIZED;
+
+    TRACK_TEX_CALLS();
+    boundTexture = surfaceOf(mOffscreen);
+    return PX_OK;
+  }
+
+  virtual pxError bindGLTextureAsMask(int /*mLoc*/)
+  {
+    if (!mInitialized)
+    {
+      return PX_NOTINITIALIZED;
+    }
+
+    TRACK_TEX_CALLS();
+    boundTextureMask = surfaceOf(mOffscreen);
+    return PX_OK;
+  }
+
+  virtual pxError getOffscreen(pxOffscreen& o)
+  {
+    if (!mInitialized)
+    {
+      return PX_NOTINITIALIZED;
+    }
+    context.flush();
+    o.init(mWidth,mHeight);
+    memcpy(o.base(), mOffscreen.base(), mOffscreen.sizeInBytes());
+    o.setUpsideDown(true);
+
+    return PX_OK;
+  }
+
+  virtual int width() { return mWidth; }
+  virtual int height() { return mHeight; }
+
+private:
+  pxOffscreen mOffscreen;
+  int mWidth;
+  int mHeight;
+  bool mInitialized;
+
+};// CLASS - pxFBOTexture
+
+
+//====================================================================================================================================================================================
+
+class pxTextureNone : public pxTexture
+{
+public:
+  pxTextureNone() {}
+
+  virtual int width()                                 { return 0;}
+  virtual int height()                                { return 0;}
+  virtual pxError deleteTexture()                     { return PX_FAIL; }
+  virtual pxError resizeTexture(int /*w*/, int /*h*/) { return PX_FAIL; }
+  virtual pxError getOffscreen(pxOffscreen& /*o*/)    { return PX_FAIL; }
+  virtual pxError bindGLTexture(int /*tLoc*/)         { return PX_FAIL; }
+  virtual pxError bindGLTextureAsMask(int /*mLoc*/)   { return PX_FAIL; }
+
+};// CLASS - pxTextureNone
+
+//====================================================================================================================================================================================
+
+// The premultiplied offscreen is the texture itself, there's no copy to
+// upload and free.  It is counted as texture memory once it is first drawn.
+class pxTextureOffscreen : public pxTexture
+{
+public:
+  pxTextureOffscreen() : mOffscreen(), mInitialized(false),
+                         mTextureUploaded(false), mWidth(0), mHeight(0), mOffscreenMutex(),
+                         mTextureListener(NULL), mTextureListenerMutex(),
+                         mReadyForRendering(false), mRenderingMutex(), mSetupForRendering(false)
+  {
+    mTextureType = PX_TEXTURE_OFFSCREEN;
+    {
+      rtMutexLockGuard renderTickMutexGuard(gRenderTickMutex);
+      mLastRenderTick = gRenderTick;
+    }
+    addToTextureList(this);
+  }
+
+  pxTextureOffscreen(pxOffscreen& o)
+                                     : mOffscreen(), mInitialized(false),
+                                       mTextureUploaded(false), mWidth(0), mHeight(0), mOffscreenMutex(),
+                                       mTextureListener(NULL), mTextureListenerMutex(),
+                                       mReadyForRendering(false), mRenderingMutex(), mSetupForRendering(false)
+  {
+    mTextureType = PX_TEXTURE_OFFSCREEN;
+    createTexture(o);
+    {
+      rtMutexLockGuard renderTickMutexGuard(gRenderTickMutex);
+      mLastRenderTick = gRenderTick;
+    }
+    addToTextureList(this);
+  }
+
+  ~pxTextureOffscreen() { deleteTexture(); removeFromTextureList(this);};
+
+  virtual pxError createTexture(pxOffscreen& o)
+  {
+    mOffscreenMutex.lock();
+#ifdef ENABLE_MAX_TEXTURE_SIZE
+    int srcTextureWidth = o.width();
+    int srcTextureHeight = o.height();
+    int newTextureWidth = srcTextureWidth;
+    int newTextureHeight = srcTextureHeight;
+    while (newTextureWidth > MAX_TEXTURE_WIDTH)
+    {
+      newTextureWidth >>= 1;
+    }
+    while (newTextureHeight > MAX_TEXTURE_HEIGHT)
+    {
+      newTextureHeight >>= 1;
+    }
+    mWidth = srcTextureWidth;
+    mHeight = srcTextureHeight;
+    if (newTextureWidth != srcTextureWidth || newTextureHeight != srcTextureHeight)
+    {
+       mOffscreen.init(newTextureWidth, newTextureHeight);
+       mOffscreen.setUpsideDown(true);
+       pxResampleImage(o, mOffscreen, PX_RESAMPLE_AREA);
+    }
+    else
+    {
+      mOffscreen.init(o.width(), o.height());
+      // Flip the image data here so we match GL FBO layout
+      mOffscreen.setUpsideDown(true);
+      o.blit(mOffscreen);
+    }
+#else
+    mOffscreen.init(o.width(), o.height());
+    // Flip the image data here so we match GL FBO layout
+    mOffscreen.setUpsideDown(true);
+    o.blit(mOffscreen);
+    mWidth = mOffscreen.width();
+    mHeight = mOffscreen.height();
+#endif //ENABLE_MAX_TEXTURE_SIZE
+
+    // premultiply
+    for (int y = 0; y < mOffscreen.height(); y++)
+    {
+      pxPixel* d = mOffscreen.scanline(y);
+      pxPixel* de = d + mOffscreen.width();
+      while (d < de)
+      {
+        d->r = (d->r * d->a)/255;
+        d->g = (d->g * d->a)/255;
+        d->b = (d->b * d->a)/255;
+        d++;
+      }
+    }
+
+    mOffscreenMutex.unlock();
+
+    mInitialized = true;
+
+    mTextureListenerMutex.lock();
+    mRenderingMutex.lock();
+    mReadyForRendering = true;
+    mRenderingMutex.unlock();
+    if (mTextureListener != NULL)
+    {
+      mTextureListener->textureReady();
+    }
+    mTextureListenerMutex.unlock();
+
+    return PX_OK;
+  }
+
+  virtual pxError prepareForRendering()
+  {
+    if (mInitialized && !mTextureUploaded && context.isTextureSpaceAvailable(this, false))
+    {
+      context.adjustCurrentTextureMemorySize(mWidth*mHeight*4, false);
+      mTextureUploaded = true;
+      mRenderingMutex.lock();
+      mSetupForRendering = true;
+      mRenderingMutex.unlock();
+    }
+    return PX_OK;
+  }
+
+  virtual bool initialized()
+  {
+    return mTextureUploaded;
+  }
+
+  virtual bool readyForRendering()
+  {
+    bool result = false;
+    mRenderingMutex.lock();
+    result = mReadyForRendering;
+    mRenderingMutex.unlock();
+    return result;
+  }
+
+  virtual bool setupForRendering()
+  {
+    bool result = false;
+    mRenderingMutex.lock();
+    result = mSetupForRendering;
+    mRenderingMutex.unlock();
+    return result;
+  }
+
+  // Replaces the w x h pixels at x, y.  buffer holds them top row first and
+  // not premultiplied, like the offscreen the texture was created from.
+  virtual pxError updateTexture(int x, int y, int w, int h, void* buffer)
+  {
+    if (!mInitialized)
+    {
+      return PX_NOTINITIALIZED;
+    }
+    if (x < 0 || y < 0 || w <= 0 || h <= 0 || x + w > mWidth || y + h > mHeight)
+    {
+      return PX_FAIL;
+    }
+
+    // pending draws still need the current pixels
+    context.flush();
+    rtMutexLockGuard offscreenGuard(mOffscreenMutex);
+    if (mOffscreen.base() == NULL || mOffscreen.width() != mWidth || mOffscreen.height() != mHeight)
+    {
+      // gone or scaled down when it was created
+      return PX_FAIL;
+    }
+    const pxPixel* pixels = (const pxPixel*)buffer;
+    for (int j = 0; j < h; j++)
+    {
+      premultiplyRow(mOffscreen.scanline(y + j) + x, pixels + j * w, w);
+    }
+    return PX_OK;
+  }
+
+  virtual pxError deleteTexture()
+  {
+    rtLogDebug("pxTextureOffscreen::deleteTexture()");
+
+    unloadTextureData();
+
+    mInitialized = false;
+    mRenderingMutex.lock();
+    mReadyForRendering = false;
+    mRenderingMutex.unlock();
+    return PX_OK;
+  }
+
+  virtual pxError unloadTextureData()
+  {
+    if (mInitialized)
+    {
+      context.flush();
+      if (mTextureUploaded)
+      {
+        context.adjustCurrentTextureMemorySize(-1 * mWidth * mHeight * 4);
+      }
+
+      mInitialized = false;
+      mRenderingMutex.lock();
+      mReadyForRendering = false;
+      mSetupForRendering = false;
+      mRenderingMutex.unlock();
+      mTextureUploaded = false;
+      mOffscreenMutex.lock();
+      mOffscreen.term();
+      mOffscreenMutex.unlock();
+    }
+    return PX_OK;
+  }
+
+  virtual pxError setTextureListener(pxTextureListener* textureListener)
+  {
+    mTextureListenerMutex.lock();
+    mTextureListener = textureListener;
+    mTextureListenerMutex.unlock();
+    return PX_OK;
+  }
+
+  virtual pxError bindGLTexture(int /*tLoc*/)
+  {
+    if (makeResident() != PX_OK)
+    {
+      return mInitialized ? PX_FAIL : PX_NOTINITIALIZED;
+    }
+    TRACK_TEX_CALLS();
+    boundTexture = surfaceOf(mOffscreen);
+    return PX_OK;
+  }
+
+  virtual pxError bindGLTextureAsMask(int /*mLoc*/)
+  {
+    if (makeResident() != PX_OK)
+    {
+      return mInitialized ? PX_FAIL : PX_NOTINITIALIZED;
+    }
+    TRACK_TEX_CALLS();
+    boundTextureMask = surfaceOf(mOffscreen);
+    return PX_OK;
+  }
+
+  virtual pxError getOffscreen(pxOffscreen& /*o*/)
+  {
+    return PX_OK;
+  }
+
+  virtual int width()  { return mWidth;  }
+  virtual int height() { return mHeight; }
+
+private:
+
+  static void premultiplyRow(pxPixel* d, const pxPixel* s, int w)
+  {
+    for (const pxPixel* se = s + w; s < se; s++, d++)
+    {
+      d->r = (s->r * s->a)/255;
+      d->g = (s->g * s->a)/255;
+      d->b = (s->b * s->a)/255;
+      d->a = s->a;
+    }
+  }
+
+  // counts the texture towards the texture memory limit the first time it is
+  // drawn, ejecting others when it doesn't fit, where GL would upload it
+  pxError makeResident()
+  {
+    if (!mInitialized)
+    {
+      return PX_NOTINITIALIZED;
+    }
+
+    if (!mTextureUploaded)
+    {
+      if (!context.isTextureSpaceAvailable(this))
+      {
+        //attempt to free texture memory
+        int64_t textureMemoryNeeded = context.textureMemoryOverflow(this);
+        context.ejectTextureMemory(textureMemoryNeeded);
+        if (!context.isTextureSpaceAvailable(this))
+        {
+          rtLogError("not enough texture memory remaining to create texture");
+          unloadTextureData();
+          return PX_FAIL;
+        }
+        else if (!mInitialized)
+        {
+          return PX_NOTINITIALIZED;
+        }
+      }
+      context.adjustCurrentTextureMemorySize(mWidth*mHeight*4);
+      mTextureUploaded = true;
+      mRenderingMutex.lock();
+      mSetupForRendering = true;
+      mRenderingMutex.unlock();
+    }
+
+    return mOffscreen.base() != NULL ? PX_OK : PX_FAIL;
+  }
+
+  pxOffscreen mOffscreen;
+
+  bool mInitialized;
+  bool mTextureUploaded;
+  int mWidth;
+  int mHeight;
+  rtMutex mOffscreenMutex;
+  pxTextureListener* mTextureListener;
+  rtMutex mTextureListenerMutex;
+  bool mReadyForRendering;
+  rtMutex mRenderingMutex;
+  bool mSetupForRendering;
+
+}; // CLASS - pxTextureOffscreen
+
+//====================================================================================================================================================================================
+
+class pxTextureAlpha : public pxTexture
+{
+public:
+  pxTextureAlpha() : mDrawWidth(0.0), mDrawHeight (0.0), mImageWidth(0.0),
+                     mImageHeight(0.0), mInitialized(false),
+                     mBuffer(NULL)
+  {
+    mTextureType = PX_TEXTURE_ALPHA;
+  }
+
+  pxTextureAlpha(float w, float h, float iw, float ih, void* buffer)
+    : mDrawWidth(w),    mDrawHeight (h),
+      mImageWidth(iw), mImageHeight(ih),
+      mInitialized(false), mBuffer(NULL)
+  {
+    mTextureType = PX_TEXTURE_ALPHA;
+
+
+    // TODO consider iw,ih as ints rather than floats...
+    int32_t bw = (int32_t)iw;
+    int32_t bh = (int32_t)ih;
+
+    if (buffer)
+    {
+      // copy the pixels
+      int bitmapSize = static_cast<int>(ih*iw);
+      mBuffer = malloc(bitmapSize);
+      // Flip here so that we match FBO layout...
+      for (int32_t i = 0; i < bh; i++)
+      {
+        uint8_t *s = (uint8_t*)buffer+(bw*i);
+        uint8_t *d = (uint8_t*)mBuffer+(bw*(bh-i-1));
+        uint8_t *de = d+bw;
+        while(d<de)
+          *d++ = *s++;
+      }
+    }
+    else
+    {
+      int bitmapSize = static_cast<int>(ih*iw);
+      mBuffer = calloc(bitmapSize, sizeof(char));
+    }
+  }
+
+  ~pxTextureAlpha()
+  {
+    deleteTexture();
+    if(mBuffer)
+    {
+      free(mBuffer);
+      mBuffer  = 0;
+    }
+  }
+
+  void createAlphaTexture()
+  {
+    if(mImageWidth == 0 || mImageHeight == 0 || mBuffer == NULL)
+    {
+      rtLogError("pxTextureAlpha::createAlphaTexture() - DIMENSIONLESS ");
+      return; // DIMENSIONLESS
+    }
+    context.adjustCurrentTextureMemorySize(static_cast<int64_t>(mImageWidth*mImageHeight));
+
+    mInitialized = true;
+  }
+
+  // w x h alpha values at x, y in the same rows as the buffer the texture was
+  // created with, which is how a glyph atlas fills itself in
+  virtual pxError updateTexture(int x, int y, int w, int h,  void* buffer)
+  {
+    if (!mInitialized) createAlphaTexture();
+    if (!mInitialized)
+    {
+      return PX_NOTINITIALIZED;
+    }
+
+    int32_t bw = (int32_t)mImageWidth;
+    int32_t bh = (int32_t)mImageHeight;
+    if (x < 0 || y < 0 || w <= 0 || h <= 0 || x + w > bw || y + h > bh)
+    {
+      return PX_FAIL;
+    }
+
+    // pending draws still need the current pixels
+    context.flush();
+    for (int32_t j = 0; j < h; j++)
+    {
+      memcpy((uint8_t*)mBuffer + (y + j) * bw + x, (const uint8_t*)buffer + j * w, w);
+    }
+
+    return PX_OK;
+  }
+
+  virtual pxError deleteTexture()
+  {
+    if (mInitialized)
+    {
+      context.flush();
+      context.adjustCurrentTextureMemorySize(static_cast<int64_t>(-1*mImageWidth*mImageHeight));
+    }
+    mInitialized = false;
+    return PX_OK;
+  }
+
+  virtual pxError bindGLTexture(int /*tLoc*/)
+  {
+    if (!mInitialized) createAlphaTexture();
+    if (!mInitialized)
+    {
+      return PX_NOTINITIALIZED;
+    }
+
+    TRACK_TEX_CALLS();
+    boundTexture = surface();
+    return PX_OK;
+  }
+
+  virtual pxError bindGLTextureAsMask(int /*mLoc*/)
+  {
+    if (!mInitialized)
+    {
+      return PX_NOTINITIALIZED;
+    }
+
+    TRACK_TEX_CALLS();
+    boundTextureMask = surface();
+    return PX_OK;
+  }
+
+  virtual pxError getOffscreen(pxOffscreen& /*o*/)
+  {
+    if (!mInitialized)
+    {
+      return PX_NOTINITIALIZED;
+    }
+    return PX_FAIL;
+  }
+
+  virtual int width()  {return static_cast<int>(mDrawWidth);  }
+  virtual int height() {return static_cast<int>(mDrawHeight); }
+
+private:
+  pxSWSurface surface()
+  {
+    pxSWSurface s;
+    s.base = (uint8_t*)mBuffer;
+    s.width = static_cast<int32_t>(mImageWidth);
+    s.height = static_cast<int32_t>(mImageHeight);
+    s.stride = s.width;
+    s.alphaOnly = true;
+    return s;
+  }
+
+  float mDrawWidth;
+  float mDrawHeight;
+  float mImageWidth;
+  float mImageHeight;
+  bool mInitialized;
+  void* mBuffer;
+
+}; // CLASS - pxTextureAlpha
+
+//====================================================================================================================================================================================
+
+static void drawRect2(float x, float y, float w, float h, const float* c)
+{
+  // args are tested at call site...
+
+  const float verts[4][2] =
+  {
+    { x  , y   },
+    { x+w, y   },
+    { x  , y+h },
+    { x+w, y+h }
+  };
+
+  float colorPM[4];
+  premultiply(colorPM,c);
+
+  pxSWDraw& d = beginDraw(pxSWDraw::SOLID);
+  d.color = toPixel(colorPM, gAlpha);
+  addVertices(d, &verts[0][0], NULL, 4, true);
+  endDraw();
+}
+
+
+static void drawRectOutline(float x, float y, float w, float h, float lw, const float* c)
+{
+  // args are tested at call site...
+
+  float ox1  = x;
+  float ix1  = x+lw;
+  float ox2  = x+w;
+  float ix2  = x+w-lw;
+  float oy1  = y;
+  float iy1  = y+lw;
+  float oy2  = y+h;
+  float iy2  = y+h-lw;
+
+  const float verts[10][2] =
+  {
+    { ox1,oy1 },
+    { ix1,iy1 },
+    { ox2,oy1 },
+    { ix2,iy1 },
+    { ox2,oy2 },
+    { ix2,iy2 },
+    { ox1,oy2 },
+    { ix1,iy2 },
+    { ox1,oy1 },
+    { ix1,iy1 }
+  };
+
+  float colorPM[4];
+  premultiply(colorPM,c);
+
+  pxSWDraw& d = beginDraw(pxSWDraw::SOLID);
+  d.color = toPixel(colorPM, gAlpha);
+  addVertices(d, &verts[0][0], NULL, 10, true);
+  endDraw();
+}
+
+static void drawImageTexture(float x, float y, float w, float h, pxTextureRef texture,
+                             pxTextureRef mask, bool useTextureDimsAlways, float* color, // default: "color = BLACK"
+                             pxConstantsStretch::constants xStretch,
+                             pxConstantsStretch::constants yStretch,
+                             pxConstantsMaskOperation::constants maskOp = pxConstantsMaskOperation::constants::NORMAL)
+{
+  // args are tested at call site...
+
+  float iw = static_cast<float>(texture->width());
+  float ih = static_cast<float>(texture->height());
+
+  if( useTextureDimsAlways)
+  {
+      w = iw;
+      h = ih;
+  }
+  else
+  {
+    if (w == -1)
+      w = iw;
+    if (h == -1)
+      h = ih;
+  }
+
+   const float verts[4][2] =
+   {
+     { x,     y },
+     { x+w,   y },
+     { x,   y+h },
+     { x+w, y+h }
+   };
+
+  float tw;
+  switch(xStretch) {
+  case pxConstantsStretch::NONE:
+    tw = w/iw;
+    break;
+  case pxConstantsStretch::STRETCH:
+    tw = 1.0;
+    break;
+  case pxConstantsStretch::REPEAT:
+  default:
+    tw = w/iw;
+    break;
+  }
+
+  float th;
+  switch(yStretch) {
+  case pxConstantsStretch::NONE:
+    th = h/ih;
+    break;
+  case pxConstantsStretch::STRETCH:
+    th = 1.0;
+    break;
+  case pxConstantsStretch::REPEAT:
+  default:
+    th = h/ih;
+    break;
+  }
+
+  float firstTextureY  = 1.0;
+  float secondTextureY = static_cast<float>(1.0-th);
+
+  const float uv[4][2] =
+  {
+    { 0,  firstTextureY  },
+    { tw, firstTextureY  },
+    { 0,  secondTextureY },
+    { tw, secondTextureY }
+  };
+
+
+  static float blackColor[4] = {0.0, 0.0, 0.0, 1.0};
+
+  if (mask.getPtr() != NULL)
+  {
+    if (texture->bindGLTexture(0) != PX_OK || mask->bindGLTextureAsMask(0) != PX_OK)
+    {
+      drawRect2(0, 0, iw, ih, blackColor); // DEFAULT - "Missing" - BLACK RECTANGLE
+      return;
+    }
+    pxSWDraw& d = beginDraw(pxSWDraw::TEXTURE_MASKED);
+    d.alpha = toScale(gAlpha);
+    d.invertMask = (maskOp != pxConstantsMaskOperation::NORMAL);
+    d.texture = boundTexture;
+    d.mask = boundTextureMask;
+    d.textureRef = texture;
+    d.maskRef = mask;
+    addVertices(d, &verts[0][0], &uv[0][0], 4, true);
+    endDraw();
+  }
+  else
+  if (texture->getType() != PX_TEXTURE_ALPHA)
+  {
+    if (texture->bindGLTexture(0) != PX_OK)
+    {
+      drawRect2(0, 0, iw, ih, blackColor); // DEFAULT - "Missing" - BLACK RECTANGLE
+      return;
+    }
+    pxSWDraw& d = beginDraw(pxSWDraw::TEXTURE);
+    d.alpha = toScale(gAlpha);
+    d.repeatX = (xStretch == pxConstantsStretch::REPEAT);
+    d.repeatY = (yStretch == pxConstantsStretch::REPEAT);
+    d.texture = boundTexture;
+    d.textureRef = texture;
+    addVertices(d, &verts[0][0], &uv[0][0], 4, true);
+    endDraw();
+  }
+  else //PX_TEXTURE_ALPHA
+  {
+    if (texture->bindGLTexture(0) != PX_OK)
+    {
+      drawRect2(0, 0, iw, ih, blackColor); // DEFAULT - "Missing" - BLACK RECTANGLE
+      return;
+    }
+    float colorPM[4];
+    premultiply(colorPM,color);
+
+    pxSWDraw& d = beginDraw(pxSWDraw::A_TEXTURE);
+    d.color = toPixel(colorPM, gAlpha);
+    d.texture = boundTexture;
+    d.textureRef = texture;
+    addVertices(d, &verts[0][0], &uv[0][0], 4, true);
+    endDraw();
+  }
+}
+
+static void drawImage92(float x, float y, float w, float h, float x1, float y1, float x2,
+                        float y2, pxTextureRef texture)
+{
+  // args are tested at call site...
+
+  float ox1 = x;
+  float ix1 = x+x1;
+  float ix2 = x+w-x2;
+  float ox2 = x+w;
+
+  float oy1 = y;
+  float iy1 = y+y1;
+  float iy2 = y+h-y2;
+  float oy2 = y+h;
+
+  float w2 = static_cast<float>(texture->width());
+  float h2 = static_cast<float>(texture->height());
+
+  float ou1 = 0;
+  float iu1 = x1/w2;
+  float iu2 = (w2-x2)/w2;
+  float ou2 = 1;
+
+  float ov2 = 0;
+  float iv2 = y1/h2;
+  float iv1 = (h2-y2)/h2;
+  float ov1 = 1;
+
+#if 1 // sanitize values
+  iu1 = pxClamp<float>(iu1, 0, 1);
+  iu2 = pxClamp<float>(iu2, 0, 1);
+  iv1 = pxClamp<float>(iv1, 0, 1);
+  iv2 = pxClamp<float>(iv2, 0, 1);
+
+  float tmin, tmax;
+
+  tmin = pxMin<float>(iu1, iu2);
+  tmax = pxMax<float>(iu1, iu2);
+  iu1 = tmin;
+  iu2 = tmax;
+
+  tmin = pxMin<float>(iv1, iv2);
+  tmax = pxMax<float>(iv1, iv2);
+  iv1 = tmax;
+  iv2 = tmin;
+
+#endif
+
+  const float verts[22][2] =
+  {
+    { ox1,oy1 },
+    { ix1,oy1 },
+    { ox1,iy1 },
+    { ix1,iy1 },
+    { ox1,iy2 },
+    { ix1,iy2 },
+    { ox1,oy2 },
+    { ix1,oy2 },
+    { ix2,oy2 },
+    { ix1,iy2 },
+    { ix2,iy2 },
+    { ix1,iy1 },
+    { ix2,iy1 },
+    { ix1,oy1 },
+    { ix2,oy1 },
+    { ox2,oy1 },
+    { ix2,iy1 },
+    { ox2,iy1 },
+    { ix2,iy2 },
+    { ox2,iy2 },
+    { ix2,oy2 },
+    { ox2,oy2 }
+  };
+
+  const float uv[22][2] =
+  {
+    { ou1,ov1 },
+    { iu1,ov1 },
+    { ou1,iv1 },
+    { iu1,iv1 },
+    { ou1,iv2 },
+    { iu1,iv2 },
+    { ou1,ov2 },
+    { iu1,ov2 },
+    { iu2,ov2 },
+    { iu1,iv2 },
+    { iu2,iv2 },
+    { iu1,iv1 },
+    { iu2,iv1 },
+    { iu1,ov1 },
+    { iu2,ov1 },
+    { ou2,ov1 },
+    { iu2,iv1 },
+    { ou2,iv1 },
+    { iu2,iv2 },
+    { ou2,iv2 },
+    { iu2,ov2 },
+    { ou2,ov2 }
+  };
+
+  if (texture->bindGLTexture(0) != PX_OK)
+  {
+    return;
+  }
+  pxSWDraw& d = beginDraw(pxSWDraw::TEXTURE);
+  d.alpha = toScale(gAlpha);
+  d.texture = boundTexture;
+  d.textureRef = texture;
+  addVertices(d, &verts[0][0], &uv[0][0], 22, true);
+  endDraw();
+}
+
+static void drawImage9Border2(float x, float y, float w, float h,
+                       float borderX1, float borderY1, float borderX2, float borderY2,
+                       float insetX1, float insetY1, float insetX2, float insetY2,
+                       bool drawCenter, float* color,
+                       pxTextureRef texture)
+{
+  // args are tested at call site...
+
+  float ox1 = x;
+  float ix1 = x+insetX1;
+  float ix2 = x+w-insetX2;
+  float ox2 = x+w;
+
+  float oy1 = y;
+  float iy1 = y+insetY1;
+  float iy2 = y+h-insetY2;
+  float oy2 = y+h;
+
+  float w2 = static_cast<float>(texture->width());
+  float h2 = static_cast<float>(texture->height());
+
+  float ou1 = 0;
+  float iu1 = borderX1/w2;
+  float iu2 = (w2-borderX2)/w2;
+  float ou2 = 1;
+
+  float ov2 = 0;
+  float iv2 = borderY1/h2;
+  float iv1 = (h2-borderY2)/h2;
+  float ov1 = 1;
+
+#if 1 // sanitize values
+  iu1 = pxClamp<float>(iu1, 0, 1);
+  iu2 = pxClamp<float>(iu2, 0, 1);
+  iv1 = pxClamp<float>(iv1, 0, 1);
+  iv2 = pxClamp<float>(iv2, 0, 1);
+
+  float tmin, tmax;
+
+  tmin = pxMin<float>(iu1, iu2);
+  tmax = pxMax<float>(iu1, iu2);
+  iu1 = tmin;
+  iu2 = tmax;
+
+  tmin = pxMin<float>(iv1, iv2);
+  tmax = pxMax<float>(iv1, iv2);
+  iv1 = tmax;
+  iv2 = tmin;
+
+#endif
+
+  const float verts[28][2] =
+      {
+          // border
+          { ox1,oy2 },
+          { ix1,oy2 },
+          { ox1,iy2 },
+          { ix1,iy2 },
+          { ox1,iy1 },
+          { ix1,iy1 },
+          { ox1,oy1 },
+          { ix1,oy1 },
+          { ix1,oy1 },
+          { ix1,iy1 },
+          { ix2,oy1 },
+          { ix2,iy1 },
+          { ox2,oy1 },
+          { ox2,iy1 },
+          { ox2,iy1 },
+          { ix2,iy1 },
+          { ox2,iy2 },
+          { ix2,iy2 },
+          { ox2,oy2 },
+          { ix2,oy2 },
+          { ix2,oy2 },
+          { ix2,iy2 },
+          { ix1,oy2 },
+          { ix1,iy2 },
+
+          // center
+          { ix1,iy2 },
+          { ix2,iy2 },
+          { ix1,iy1 },
+          { ix2,iy1 },
+      };
+
+  // the border shader in pxContextGL.cpp samples at 1 - v
+  const float uv[28][2] =
+      {
+          // border
+          { ou1,1-ov1 },
+          { iu1,1-ov1 },
+          { ou1,1-iv1 },
+          { iu1,1-iv1 },
+          { ou1,1-iv2 },
+          { iu1,1-iv2 },
+          { ou1,1-ov2 },
+          { iu1,1-ov2 },
+          { iu1,1-ov2 },
+          { iu1,1-iv2 },
+          { iu2,1-ov2 },
+          { iu2,1-iv2 },
+          { ou2,1-ov2 },
+          { ou2,1-iv2 },
+          { ou2,1-iv2 },
+          { iu2,1-iv2 },
+          { ou2,1-iv1 },
+          { iu2,1-iv1 },
+          { ou2,1-ov1 },
+          { iu2,1-ov1 },
+          { iu2,1-ov1 },
+          { iu2,1-iv1 },
+          { iu1,1-ov1 },
+          { iu1,1-iv1 },
+
+          // center
+          { iu1,1-iv1 },
+          { iu2,1-iv1 },
+          { iu1,1-iv2 },
+          { iu2,1-iv2 },
+      };
+
+  float colorPM[4];
+  premultiply(colorPM,color);
+
+  if (texture->bindGLTexture(0) != PX_OK)
+  {
+    return;
+  }
+  pxSWDraw& d = beginDraw(pxSWDraw::TEXTURE);
+  d.modulate = true;
+  d.color = toPixel(colorPM, gAlpha);
+  d.texture = boundTexture;
+  d.textureRef = texture;
+  addVertices(d, &verts[0][0], &uv[0][0], drawCenter? 28 : 24, true);
+  endDraw();
+}
+
+static void clearFramebuffer(const float* color)
+{
+  pxSWDraw& d = beginDraw(pxSWDraw::CLEAR);
+  d.color = toPixel(color, 1.0f);
+  gDrawPixels += (int64_t)d.clip.width() * d.clip.height();
+  endDraw();
+}
+
+//====================================================================================================================================================================================
+
+pxContext::~pxContext()
+{
+  gDraws.clear();
+  gTriangles.clear();
+}
+
+void pxContext::init()
+{
+  rtValue val;
+  if (RT_OK == rtSettings::instance()->value("enableTextureMemoryMonitoring", val))
+  {
+    mEnableTextureMemoryMonitoring = val.toString().compare("true") == 0;
+  }
+  if (RT_OK == rtSettings::instance()->value("textureMemoryLimitInMb", val))
+  {
+    setTextureMemoryLimit((int64_t)val.toInt32() * (int64_t)1024 * (int64_t)1024);
+  }
+  if (RT_OK == rtSettings::instance()->value("ejectTextureAge", val))
+  {
+    mEjectTextureAge = val.toUInt32();
+  }
+  if (mEnableTextureMemoryMonitoring)
+  {
+    rtLogDebug("texture memory limit set to %" PRId64 " bytes, threshold padding %" PRId64 " bytes",
+      mTextureMemoryLimitInBytes, mTextureMemoryLimitThresholdPaddingInBytes);
+  }
+
+  if (RT_OK == rtSettings::instance()->value("targetTextureMemoryAfterCleanupInMb", val))
+  {
+    mTargetTextureMemoryAfterCleanupInBytes = (int64_t)val.toInt32() * (int64_t)1024 * (int64_t)1024;
+  }
+  else
+  {
+    mTargetTextureMemoryAfterCleanupInBytes = mTextureMemoryLimitInBytes - (mTextureMemoryLimitInBytes / (int64_t)3);
+  }
+
+  if (mTargetTextureMemoryAfterCleanupInBytes < 0)
+  {
+    mTargetTextureMemoryAfterCleanupInBytes = 0;
+  }
+
+  if (RT_OK == rtSettings::instance()->value("freeAllOffscreenTextureMemoryOnCleanup", val))
+  {
+    mFreeAllOffscreenTextureMemoryOnCleanup = val.toString().compare("true") == 0;
+  }
+  if (RT_OK == rtSettings::instance()->value("enableDrawBatching", val))
+  {
+    enableDrawBatching(val.toString().compare("true") == 0);
+  }
+
+  char const* textureLimitSetting = getenv("SPARK_TEXTURE_LIMIT_MB");
+  if (textureLimitSetting)
+  {
+    int textureLimitInMb = atoi(textureLimitSetting);
+    if (textureLimitInMb >= 0)
+    {
+      setTextureMemoryLimit((int64_t)textureLimitInMb * (int64_t)1024 * (int64_t)1024);
+    }
+  }
+
+  char const* ejectTextureAgeSetting = getenv("SPARK_EJECT_TEXTURE_AGE");
+  if (ejectTextureAgeSetting)
+  {
+    int ejectTextureAge = atoi(ejectTextureAgeSetting);
+    if (ejectTextureAge >= 0)
+    {
+      mEjectTextureAge = (uint32_t)ejectTextureAge;
+    }
+  }
+  char const* ejectTargetSetting = getenv("SPARK_EJECT_TEXTURE_MEMORY_TARGET_MB");
+  if (ejectTargetSetting)
+  {
+    int targetTextureMemoryAfterCleanupInMb = atoi(ejectTargetSetting);
+    if (targetTextureMemoryAfterCleanupInMb >= 0)
+    {
+      mTargetTextureMemoryAfterCleanupInBytes = (int64_t)targetTextureMemoryAfterCleanupInMb * (int64_t)1024 * (int64_t)1024;
+    }
+  }
+  char const* ejectAllSetting = getenv("SPARK_EJECT_ALL_OFFSCREEN_TEXTURES");
+  if (ejectAllSetting)
+  {
+    int ejectAll = atoi(ejectAllSetting);
+    if (ejectAll > 0)
+    {
+      mFreeAllOffscreenTextureMemoryOnCleanup = true;
+    }
+    else
+    {
+      mFreeAllOffscreenTextureMemoryOnCleanup = false;
+    }
+  }
+
+  char const* drawBatchingSetting = getenv("SPARK_ENABLE_DRAW_BATCHING");
+  if (drawBatchingSetting)
+  {
+    enableDrawBatching(atoi(drawBatchingSetting) > 0);
+  }
+  rtLogInfo("software rasterizer, deferred drawing: %s", isDrawBatchingEnabled() ? "enabled" : "disabled");
+
+  rtLogInfo("texture memory target after cleanup: %" PRId64 " bytes.  Free all offscreen memory on cleanup: %s.  Eject texture age: %u",
+            mTargetTextureMemoryAfterCleanupInBytes,
+            mFreeAllOffscreenTextureMemoryOnCleanup ? "true":"false", mEjectTextureAge);
+
+  char const* gcThrottleSetting = getenv("SPARK_GC_THROTTLE_SECS");
+  if (gcThrottleSetting)
+  {
+    int gcThrottle = atoi(gcThrottleSetting);
+    if (gcThrottle >= 0)
+    {
+      garbageCollectThrottleInSeconds = static_cast<double>(gcThrottle);
+    }
+  }
+
+  rtLogInfo("context garbage collect throttle set to %f seconds", garbageCollectThrottleInSeconds);
+
+  std::srand(unsigned (std::time(0)));
+}
+
+void pxContext::term()  // clean up statics
+{
+}
+
+void pxContext::setSize(int w, int h)
+{
+  flushDraws();
+  gResW = w;
+  gResH = h;
+
+  if (currentFramebuffer == defaultFramebuffer)
+  {
+    defaultContextSurface.width = w;
+    defaultContextSurface.height = h;
+    if (gScreen.width() != w || gScreen.height() != h)
+    {
+      gScreen.init(w, h);
+      memset(gScreen.base(), 0, gScreen.sizeInBytes());
+    }
+    boundFramebuffer = surfaceOf(gScreen);
+  }
+}
+
+void pxContext::getSize(int& w, int& h)
+{
+   w = gResW;
+   h = gResH;
+}
+
+void pxContext::clear(int /*w*/, int /*h*/)
+{
+  static float clearColor[4] = {0, 0, 0, 0};
+  clearFramebuffer(clearColor);
+}
+
+void pxContext::clear(int /*w*/, int /*h*/, float *fillColor )
+{
+  clearFramebuffer(fillColor);
+  currentFramebuffer->enableDirtyRectangles(false);
+}
+
+void pxContext::clear(int left, int top, int width, int height)
+{
+  if (left < 0)
+  {
+    left = 0;
+  }
+  if (top < 0)
+  {
+    top = 0;
+  }
+  if ((left+width) > gResW)
+  {
+    width = gResW - left;
+  }
+  if ((top+height) > gResH)
+  {
+    height = gResH - top;
+  }
+  int clearTop = gResH-top-height;
+
+  currentFramebuffer->setDirtyRectangle(left, clearTop, width, height);
+  currentFramebuffer->enableDirtyRectangles(true);
+
+  //map form screen to window coordinates
+  gScissorEnabled = true;
+  gScissor.setLTWH(left, clearTop, width, height);
+  static float clearColor[4] = {0, 0, 0, 0};
+  clearFramebuffer(clearColor);
+}
+
+void pxContext::enableClipping(bool enable)
+{
+  gScissorEnabled = enable;
+}
+
+void pxContext::setMatrix(pxMatrix4f& m)
+{
+  gMatrix.multiply(m);
+}
+
+pxMatrix4f pxContext::getMatrix()
+{
+  return gMatrix;
+}
+
+void pxContext::setAlpha(float a)
+{
+  gAlpha *= a;
+}
+
+float pxContext::getAlpha()
+{
+  return gAlpha;
+}
+
+pxContextFramebufferRef pxContext::createFramebuffer(int width, int height, bool antiAliasing, bool alphaOnly)
+{
+  pxContextFramebuffer* fbo = new pxContextFramebuffer();
+  pxFBOTexture* fboTexture = new pxFBOTexture(antiAliasing, alphaOnly);
+  pxTextureRef texture = fboTexture;
+
+  fboTexture->createFboTexture(width, height);
+
+  fbo->setTexture(texture);
+
+  return fbo;
+}
+
+pxError pxContext::updateFramebuffer(pxContextFramebufferRef fbo, int width, int height)
+{
+  if (fbo.getPtr() == NULL || fbo->getTexture().getPtr() == NULL)
+  {
+    return PX_FAIL;
+  }
+
+  return fbo->getTexture()->resizeTexture(width, height);
+}
+
+pxContextFramebufferRef pxContext::getCurrentFramebuffer()
+{
+  return currentFramebuffer;
+}
+
+pxError pxContext::setFramebuffer(pxContextFramebufferRef fbo)
+{
+  // recorded draws belong to the framebuffer that is being replaced
+  flushDraws();
+  if (fbo.getPtr() == NULL || fbo->getTexture().getPtr() == NULL)
+  {
+    gResW = defaultContextSurface.width;
+    gResH = defaultContextSurface.height;
+
+    TRACK_FBO_CALLS();
+    boundFramebuffer = surfaceOf(gScreen);
+    currentFramebuffer = defaultFramebuffer;
+
+    pxContextState contextState;
+    currentFramebuffer->currentState(contextState);
+
+    gAlpha = contextState.alpha;
+    gMatrix = contextState.matrix;
+
+#ifdef PX_DIRTY_RECTANGLES
+    if (currentFramebuffer->isDirtyRectanglesEnabled())
+    {
+      gScissorEnabled = true;
+      pxRect dirtyRect = currentFramebuffer->dirtyRectangle();
+      gScissor.setLTWH(dirtyRect.left(), dirtyRect.top(), dirtyRect.right(), dirtyRect.bottom());
+    }
+    else
+    {
+      gScissorEnabled = false;
+    }
+#endif //PX_DIRTY_RECTANGLES
+    return PX_OK;
+  }
+
+  currentFramebuffer = fbo;
+  pxContextState contextState;
+  currentFramebuffer->currentState(contextState);
+  gAlpha = contextState.alpha;
+  gMatrix = contextState.matrix;
+
+#ifdef PX_DIRTY_RECTANGLES
+  if (currentFramebuffer->isDirtyRectanglesEnabled())
+  {
+    gScissorEnabled = true;
+    pxRect dirtyRect = currentFramebuffer->dirtyRectangle();
+    gScissor.setLTWH(dirtyRect.left(), dirtyRect.top(), dirtyRect.right(), dirtyRect.bottom());
+  }
+  else
+  {
+    gScissorEnabled = false;
+  }
+#endif //PX_DIRTY_RECTANGLES
+
+  return fbo->getTexture()->prepareForRendering();
+}
+
+void pxContext::enableDirtyRectangles(bool enable)
+{
+  currentFramebuffer->enableDirtyRectangles(enable);
+  gScissorEnabled = enable;
+  if (enable)
+  {
+    pxRect dirtyRect = currentFramebuffer->dirtyRectangle();
+    gScissor.setLTWH(dirtyRect.left(), dirtyRect.top(), dirtyRect.right(), dirtyRect.bottom());
+  }
+}
+
+void pxContext::drawRect(float w, float h, float lineWidth, float* fillColor, float* lineColor)
+{
+#ifdef DEBUG_SKIP_RECT
+#warning "DEBUG_SKIP_RECT enabled ... Skipping "
+  return;
+#endif
+
+  // TRANSPARENT / DIMENSIONLESS
+  if(gAlpha == 0.0 || w <= 0.0 || h <= 0.0)
+  {
+    return;
+  }
+
+  // COLORLESS
+  if(fillColor == NULL && lineColor == NULL)
+  {
+    return;
+  }
+
+  // Fill ...
+  if(fillColor != NULL && fillColor[3] > 0.0) // with non-transparent color
+  {
+    float half = lineWidth/2;
+    drawRect2(half, half, w-lineWidth, h-lineWidth, fillColor);
+  }
+
+  // Frame ...
+  if(lineColor != NULL && lineColor[3] > 0.0 && lineWidth > 0) // with non-transparent color and non-zero stroke
+  {
+    drawRectOutline(0, 0, w, h, lineWidth, lineColor);
+  }
+}
+
+void pxContext::drawImage9(float w, float h, float x1, float y1,
+                           float x2, float y2, pxTextureRef texture)
+{
+#ifdef DEBUG_SKIP_IMAGE9
+#warning "DEBUG_SKIP_IMAGE9 enabled ... Skipping "
+  return;
+#endif
+
+  // TRANSPARENT / DIMENSIONLESS
+  if(gAlpha == 0.0 || w <= 0.0 || h <= 0.0)
+  {
+    return;
+  }
+
+  // TEXTURELESS
+  if (texture.getPtr() == NULL)
+  {
+    return;
+  }
+
+  texture->setLastRenderTick(gRenderTick);
+
+  drawImage92(0, 0, w, h, x1, y1, x2, y2, texture);
+}
+
+void pxContext::drawImage9Border(float w, float h,
+                  float bx1, float by1, float bx2, float by2,
+                  float ix1, float iy1, float ix2, float iy2,
+                  bool drawCenter, float* color,
+                  pxTextureRef texture)
+{
+  // TRANSPARENT / DIMENSIONLESS
+  if(gAlpha == 0.0 || w <= 0.0 || h <= 0.0)
+  {
+    return;
+  }
+
+  // TEXTURELESS
+  if (texture.getPtr() == NULL)
+  {
+    return;
+  }
+
+  texture->setLastRenderTick(gRenderTick);
+
+  drawImage9Border2(0, 0, w, h, bx1, by1, bx2, by2, ix1, iy1, ix2, iy2, drawCenter, color, texture);
+}
+
+// convenience method
+void pxContext::drawImageMasked(float x, float y, float w, float h,
+                                pxConstantsMaskOperation::constants maskOp,
+                                pxTextureRef t, pxTextureRef mask)
+{
+  this->drawImage(x, y, w, h, t , mask,
+                    /* useTextureDimsAlways = */ true, /*color = */ NULL,      // DEFAULT
+                    /*             stretchX = */ pxConstantsStretch::STRETCH,  // DEFAULT
+                    /*             stretchY = */ pxConstantsStretch::STRETCH,  // DEFAULT
+                    /*      downscaleSmooth = */ false,                        // DEFAULT
+                                                 maskOp                        // PARAMETER
+                    );
+};
+
+void pxContext::drawImage(float x, float y, float w, float h,
+                          pxTextureRef t, pxTextureRef mask,
+                          bool useTextureDimsAlways               /* = true */,
+                          float* color,                           /* = NULL */
+                          pxConstantsStretch::constants stretchX, /* = pxConstantsStretch::STRETCH, */
+                          pxConstantsStretch::constants stretchY, /* = pxConstantsStretch::STRETCH, */
+                          bool downscaleSmooth                    /* = false */,
+                          pxConstantsMaskOperation::constants maskOp     /* = pxConstantsMaskOperation::NORMAL */ )
+{
+#ifdef DEBUG_SKIP_IMAGE
+#warning "DEBUG_SKIP_IMAGE enabled ... Skipping "
+  return;
+#endif
+
+  // TRANSPARENT / DIMENSIONLESS
+  if(gAlpha == 0.0 || w <= 0.0 || h <= 0.0)
+  {
+    return;
+  }
+
+  // TEXTURELESS
+  if (t.getPtr() == NULL)
+  {
+    return;
+  }
+
+  t->setLastRenderTick(gRenderTick);
+  // there are no mipmaps, smooth downscaling is the same as bilinear filtering
+  t->setDownscaleSmooth(downscaleSmooth);
+
+  if (mask.getPtr() != NULL)
+  {
+    mask->setLastRenderTick(gRenderTick);
+  }
+
+  if (stretchX < pxConstantsStretch::NONE || stretchX > pxConstantsStretch::REPEAT)
+  {
+    stretchX = pxConstantsStretch::NONE;
+  }
+
+  if (stretchY < pxConstantsStretch::NONE || stretchY > pxConstantsStretch::REPEAT)
+  {
+    stretchY = pxConstantsStretch::NONE;
+  }
+
+  float black[4] = {0,0,0,1};
+  drawImageTexture(x, y, w, h, t, mask, useTextureDimsAlways,
+                   color? color : black, stretchX, stretchY, maskOp);
+}
+
+#ifdef PXSCENE_FONT_ATLAS
+// Half a pixel in the units of a distance field that spans twice spread
+// texels, measured on the first quad.  Glyph quads are all drawn at the
+// same scale.
+static float distanceFieldSmoothing(const float* verts, const float* uvs, pxTextureRef t, float spread)
+{
+  const float* m = gMatrix.data();
+  float scale = sqrt(m[0]*m[0] + m[1]*m[1]);
+  float pixels = fabs(verts[2] - verts[0]) * scale;
+  float texels = fabs(uvs[2] - uvs[0]) * t->width();
+  if (pixels <= 0 || texels <= 0)
+  {
+    return 0.5f;
+  }
+  return std::min(0.5f, texels / pixels / (4 * spread));
+}
+
+void pxContext::drawTexturedQuads(int numQuads, const void *verts, const void* uvs,
+                          pxTextureRef t, float* color, float distanceFieldSpread)
+{
+#ifdef DEBUG_SKIP_IMAGE
+#warning "DEBUG_SKIP_IMAGE enabled ... Skipping "
+  return;
+#endif
+
+  // TRANSPARENT
+  if(gAlpha == 0.0)
+  {
+    return;
+  }
+
+  // TEXTURELESS
+  if (t.getPtr() == NULL)
+  {
+    return;
+  }
+
+  t->setLastRenderTick(gRenderTick);
+
+  if (t->bindGLTexture(0) != PX_OK)
+  {
+    return;
+  }
+
+  float colorPM[4];
+  premultiply(colorPM,color);
+
+  pxSWDraw& d = beginDraw(distanceFieldSpread > 0 ? pxSWDraw::DISTANCE_FIELD : pxSWDraw::A_TEXTURE);
+  if (distanceFieldSpread > 0)
+  {
+    float smoothing = distanceFieldSmoothing((const float*)verts, (const float*)uvs, t, distanceFieldSpread);
+    int32_t range = std::max(1, (int32_t)(smoothing * 2 * 255 + 0.5f));
+    d.fieldLow = (int32_t)((0.5f - smoothing) * 255 + 0.5f);
+    d.fieldScale = 65536 / range;
+  }
+  d.color = toPixel(colorPM, gAlpha);
+  d.texture = boundTexture;
+  d.textureRef = t;
+  addVertices(d, (const float*)verts, (const float*)uvs, 6*numQuads, false);
+  endDraw();
+}
+#endif
+
+void pxContext::drawDiagRect(float x, float y, float w, float h, float* color)
+{
+#ifdef DEBUG_SKIP_DIAG_RECT
+#warning "DEBUG_SKIP_DIAG_RECT enabled ... Skipping "
+   return;
+#endif
+
+  if (!mShowOutlines) return;
+
+  // TRANSPARENT / DIMENSIONLESS
+  if(gAlpha == 0.0 || w <= 0.0 || h <= 0.0)
+  {
+    return;
+  }
+
+  // COLORLESS
+  if(color == NULL || color[3] == 0.0)
+  {
+    return;
+  }
+
+  float colorPM[4];
+  premultiply(colorPM,color);
+
+  pxSWDraw& d = beginDraw(pxSWDraw::SOLID);
+  d.color = toPixel(colorPM, gAlpha);
+  addLine(d, x,   y,   x+w, y  );
+  addLine(d, x+w, y,   x+w, y+h);
+  addLine(d, x+w, y+h, x,   y+h);
+  addLine(d, x,   y+h, x,   y  );
+  endDraw();
+}
+
+void pxContext::drawDiagLine(float x1, float y1, float x2, float y2, float* color)
+{
+#ifdef DEBUG_SKIP_DIAG_LINE
+#warning "DEBUG_SKIP_DIAG_LINE enabled ... Skipping "
+   return;
+#endif
+
+  if (!mShowOutlines) return;
+
+  if(gAlpha == 0.0)
+  {
+    return; // TRANSPARENT
+  }
+
+  if(color == NULL || color[3] == 0.0)
+  {
+    return; // COLORLESS
+  }
+
+  float colorPM[4];
+  premultiply(colorPM,color);
+
+  pxSWDraw& d = beginDraw(pxSWDraw::SOLID);
+  d.color = toPixel(colorPM, gAlpha);
+  addLine(d, x1, y1, x2, y2);
+  endDraw();
+}
+
+pxTextureRef pxContext::createTexture()
+{
+  pxTextureNone* noneTexture = new pxTextureNone();
+  return noneTexture;
+}
+
+pxTextureRef pxContext::createTexture(pxOffscreen& o)
+{
+  pxTextureOffscreen* offscreenTexture = new pxTextureOffscreen(o);
+  return offscreenTexture;
+}
+
+pxTextureRef pxContext::createTexture(float w, float h, float iw, float ih, void* buffer)
+{
+  pxTextureAlpha* alphaTexture = new pxTextureAlpha(w,h,iw,ih,buffer);
+  return alphaTexture;
+}
+
+pxSharedContextRef pxContext::createSharedContext()
+{
+  pxSharedContext* sharedContext = new pxSharedContext();
+  return sharedContext;
+}
+
+void pxContext::pushState()
+{
+  pxContextState contextState;
+  contextState.matrix = gMatrix;
+  contextState.alpha = gAlpha;
+
+  currentFramebuffer->pushState(contextState);
+}
+
+void pxContext::popState()
+{
+  pxContextState contextState;
+  if (currentFramebuffer->popState(contextState) == PX_OK)
+  {
+    gAlpha = contextState.alpha;
+    gMatrix = contextState.matrix;
+  }
+}
+
+void pxContext::flush()
+{
+  flushDraws();
+}
+
+// with batching disabled every draw is rasterized as soon as it is made
+void pxContext::enableDrawBatching(bool enable)
+{
+  flushDraws();
+  gDrawBatchingEnabled = enable;
+}
+
+bool pxContext::isDrawBatchingEnabled()
+{
+  return gDrawBatchingEnabled;
+}
+
+void pxContext::snapshot(pxOffscreen& o)
+{
+  flushDraws();
+  o.init(gResW,gResH);
+  memset(o.base(), 0, o.sizeInBytes());
+  int32_t w = std::min(o.width(), boundFramebuffer.width);
+  int32_t h = std::min(o.height(), boundFramebuffer.height);
+  for (int32_t y = 0; y < h; y++)
+  {
+    memcpy((uint8_t*)o.base() + y * o.stride(), boundFramebuffer.base + y * boundFramebuffer.stride, w * 4);
+  }
+
+  o.setUpsideDown(true);
+}
+
+void pxContext::mapToScreenCoordinates(float inX, float inY, int &outX, int &outY)
+{
+  pxVector4f positionVector(inX, inY, 0, 1);
+  pxVector4f positionCoords = gMatrix.multiply(positionVector);
+
+  if (positionCoords.w() == 0)
+  {
+    outX = static_cast<int> (positionCoords.x());
+    outY = static_cast<int> (positionCoords.y());
+  }
+  else
+  {
+    outX = static_cast<int> (positionCoords.x() / positionCoords.w());
+    outY = static_cast<int> (positionCoords.y() / positionCoords.w());
+  }
+}
+
+void pxContext::mapToScreenCoordinates(pxMatrix4f& m, float inX, float inY, int &outX, int &outY)
+{
+  pxVector4f positionVector(inX, inY, 0, 1);
+  pxVector4f positionCoords = m.multiply(positionVector);
+
+  if (positionCoords.w() == 0)
+  {
+    outX = static_cast<int> (positionCoords.x());
+    outY = static_cast<int> (positionCoords.y());
+  }
+  else
+  {
+    outX = static_cast<int> (positionCoords.x() / positionCoords.w());
+    outY = static_cast<int> (positionCoords.y() / positionCoords.w());
+  }
+}
+
+bool pxContext::isObjectOnScreen(float x, float y, float width, float height)
+{
+  // screen aligned bounds of the transformed corners, so rotated and
+  // scaled objects are tested by the area they actually cover
+  const float cornerX[4] = { x, x + width, x, x + width };
+  const float cornerY[4] = { y, y, y + height, y + height };
+  float left = 0, top = 0, right = 0, bottom = 0;
+  for (int i = 0; i < 4; i++)
+  {
+    pxVector4f positionCoords = gMatrix.multiply(pxVector4f(cornerX[i], cornerY[i], 0, 1));
+    if (positionCoords.w() <= 0)
+    {
+      // behind the viewer, don't guess
+      return true;
+    }
+    float screenX = positionCoords.x() / positionCoords.w();
+    float screenY = positionCoords.y() / positionCoords.w();
+    if (i == 0 || screenX < left)   left = screenX;
+    if (i == 0 || screenX > right)  right = screenX;
+    if (i == 0 || screenY < top)    top = screenY;
+    if (i == 0 || screenY > bottom) bottom = screenY;
+  }
+
+  float clipLeft = 0, clipTop = 0;
+  float clipRight = static_cast<float>(gResW), clipBottom = static_cast<float>(gResH);
+  if (currentFramebuffer.getPtr() != NULL && currentFramebuffer->isDirtyRectanglesEnabled())
+  {
+    // see clear(), the dirty rectangle is stored as the scissor box
+    pxRect dirtyRect = currentFramebuffer->dirtyRectangle();
+    clipLeft = pxMax<float>(clipLeft, dirtyRect.left());
+    clipRight = pxMin<float>(clipRight, dirtyRect.left() + dirtyRect.right());
+    clipTop = pxMax<float>(clipTop, gResH - dirtyRect.top() - dirtyRect.bottom());
+    clipBottom = pxMin<float>(clipBottom, gResH - dirtyRect.top());
+  }
+
+  return !(right < clipLeft || left > clipRight || bottom < clipTop || top > clipBottom);
+}
+
+void pxContext::adjustCurrentTextureMemorySize(int64_t changeInBytes, bool allowGarbageCollect)
+{
+  lockContext();
+  mCurrentTextureMemorySizeInBytes += changeInBytes;
+  if (mCurrentTextureMemorySizeInBytes < 0)
+  {
+    mCurrentTextureMemorySizeInBytes = 0;
+  }
+  int64_t currentTextureMemorySize = mCurrentTextureMemorySizeInBytes;
+  int64_t maxTextureMemoryInBytes = mTextureMemoryLimitInBytes;
+
+  unlockContext();
+  if (mEnableTextureMemoryMonitoring && allowGarbageCollect && changeInBytes > 0 && currentTextureMemorySize > maxTextureMemoryInBytes)
+  {
+    double timeSinceGc = pxSeconds() - lastContextGarbageCollectTime;
+    if (timeSinceGc >= garbageCollectThrottleInSeconds)
+    {
+      rtLogDebug("the texture size is too large: %" PRId64 ".  doing a garbage collect!!!\n", currentTextureMemorySize);
+#ifdef RUNINMAIN
+      script.collectGarbage();
+#else
+      uv_async_send(&gcTrigger);
+#endif
+      lastContextGarbageCollectTime = pxSeconds();
+    }
+  }
+}
+
+void pxContext::setTextureMemoryLimit(int64_t textureMemoryLimitInBytes)
+{
+  mTextureMemoryLimitInBytes = textureMemoryLimitInBytes;
+}
+
+bool pxContext::isTextureSpaceAvailable(pxTextureRef texture, bool allowGarbageCollect, int32_t bytesPerPixel)
+{
+  if (!mEnableTextureMemoryMonitoring)
+    return true;
+
+  int64_t textureSize = ((int64_t)(texture->width())*(int64_t)(texture->height())*(int64_t)bytesPerPixel);
+  lockContext();
+  int64_t currentTextureMemorySize = mCurrentTextureMemorySizeInBytes;
+  int64_t maxTextureMemoryInBytes = mTextureMemoryLimitInBytes;
+  unlockContext();
+  if ((textureSize + currentTextureMemorySize) >
+             (maxTextureMemoryInBytes  + mTextureMemoryLimitThresholdPaddingInBytes))
+  {
+    if (allowGarbageCollect)
+    {
+      double timeSinceGc = pxSeconds() - lastContextGarbageCollectTime;
+      if (timeSinceGc >= garbageCollectThrottleInSeconds)
+      {
+#ifdef RUNINMAIN
+        script.collectGarbage();
+#else
+        uv_async_send(&gcTrigger);
+#endif
+        lastContextGarbageCollectTime = pxSeconds();
+        lockContext();
+        currentTextureMemorySize = mCurrentTextureMemorySizeInBytes;
+        unlockContext();
+        return ((textureSize + currentTextureMemorySize) <=
+                (maxTextureMemoryInBytes + mTextureMemoryLimitThresholdPaddingInBytes));
+      }
+    }
+    return false;
+  }
+  else if (allowGarbageCollect && (textureSize + currentTextureMemorySize) > maxTextureMemoryInBytes)
+  {
+    int64_t textureMemoryNeeded = textureMemoryOverflow(texture);
+    context.ejectTextureMemory(textureMemoryNeeded);
+    lockContext();
+    currentTextureMemorySize = mCurrentTextureMemorySizeInBytes;
+    unlockContext();
+    if ((textureSize + currentTextureMemorySize) > maxTextureMemoryInBytes)
+    {
+      double timeSinceGc = pxSeconds() - lastContextGarbageCollectTime;
+      if (timeSinceGc >= garbageCollectThrottleInSeconds)
+      {
+#ifdef RUNINMAIN
+        rtLogInfo("gc for texture memory");
+        script.collectGarbage();
+#else
+        uv_async_send(&gcTrigger);
+#endif
+        lastContextGarbageCollectTime = pxSeconds();
+      }
+    }
+    else
+    {
+      rtLogInfo("texture memory freed by clearing offscreen");
+    }
+  }
+  return true;
+}
+
+bool pxContext::isTextureSpaceAvailable(int64_t sizeInBytes)
+{
+  if (!mEnableTextureMemoryMonitoring)
+    return true;
+
+  lockContext();
+  int64_t currentTextureMemorySize = mCurrentTextureMemorySizeInBytes;
+  unlockContext();
+  return (sizeInBytes + currentTextureMemorySize) <= mTextureMemoryLimitInBytes;
+}
+
+int64_t pxContext::currentTextureMemoryUsageInBytes()
+{
+  return mCurrentTextureMemorySizeInBytes;
+}
+
+int64_t pxContext::textureMemoryOverflow(pxTextureRef texture)
+{
+  int64_t textureSize = (((int64_t)texture->width())*((int64_t)texture->height())*4);
+  int64_t currentTextureMemorySize = 0;
+  lockContext();
+  currentTextureMemorySize = mCurrentTextureMemorySizeInBytes;
+  unlockContext();
+  int64_t availableBytes = mTextureMemoryLimitInBytes - currentTextureMemorySize;
+  if (textureSize > availableBytes)
+  {
+    return (textureSize - availableBytes);
+  }
+  return 0;
+}
+
+int64_t pxContext::ejectTextureMemory(int64_t bytesRequested, bool forceEject)
+{
+#ifdef ENABLE_LRU_TEXTURE_EJECTION
+  if (!mEnableTextureMemoryMonitoring)
+    return 0;
+
+  // pending draws may still use the textures that get ejected
+  flushDraws();
+
+  int64_t beforeTextureMemoryUsage = context.currentTextureMemoryUsageInBytes();
+  if (!forceEject)
+  {
+    ejectNotRecentlyUsedTextureMemory(bytesRequested, mTargetTextureMemoryAfterCleanupInBytes,
+                                      mFreeAllOffscreenTextureMemoryOnCleanup, mEjectTextureAge);
+  }
+  else
+  {
+    ejectNotRecentlyUsedTextureMemory(bytesRequested, mTargetTextureMemoryAfterCleanupInBytes,
+                                      mFreeAllOffscreenTextureMemoryOnCleanup, 0);
+  }
+  int64_t afterTextureMemoryUsage = context.currentTextureMemoryUsageInBytes();
+  return (beforeTextureMemoryUsage-afterTextureMemoryUsage);
+#else
+  (void)bytesRequested;
+  (void)forceEject;
+  return 0;
+#endif //ENABLE_LRU_TEXTURE_EJECTION
+}
+
+pxError pxContext::setEjectTextureAge(uint32_t age)
+{
+  mEjectTextureAge = age;
+  return PX_OK;
+}
+
+void pxContext::updateRenderTick()
+{
+  {
+    rtMutexLockGuard renderTickMutexGuard(gRenderTickMutex);
+    gRenderTick++;
+  }
+}
@@ -0,0 +1,228 @@
+/*
+
+ pxCore Copyright 2005-2018 John Robinson
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+// pxDirtyRegion.cpp
+
+#include "pxDirtyRegion.h"
+
+#include <algorithm>
+
+// merging more rectangles than this to get down to maxRects isn't worth the
+// time, everything is redrawn as one rectangle instead
+#define PX_DIRTY_REGION_MERGE_LIMIT 64
+
+static int64_t rectArea(const pxRect& r)
+{
+  return (int64_t)r.width() * r.height();
+}
+
+static pxRect rectUnion(const pxRect& a, const pxRect& b)
+{
+  return pxRect(std::min(a.left(), b.left()), std::min(a.top(), b.top()),
+                std::max(a.right(), b.right()), std::max(a.bottom(), b.bottom()));
+}
+
+pxDirtyRegion::pxDirtyRegion(int32_t tileSize): mTileSize(tileSize > 0 ? tileSize : PX_DIRTY_REGION_TILE_SIZE),
+  mWidth(0), mHeight(0), mColumns(0), mRows(0), mTiles(), mDirtyTiles(0)
+{
+}
+
+void pxDirtyRegion::setSize(int32_t width, int32_t height)
+{
+  mWidth = std::max(width, 0);
+  mHeight = std::max(height, 0);
+  mColumns = (mWidth + mTileSize - 1) / mTileSize;
+  mRows = (mHeight + mTileSize - 1) / mTileSize;
+  mTiles.assign((size_t)mColumns * mRows, 1);
+  mDirtyTiles = mTiles.size();
+}
+
+void pxDirtyRegion::add(const pxRect& r)
+{
+  if (r.right() < r.left() || r.bottom() < r.top() || mTiles.empty())
+  {
+    return;
+  }
+
+  int32_t left = std::max(r.left(), 0) / mTileSize;
+  int32_t top = std::max(r.top(), 0) / mTileSize;
+  int32_t right = std::min(r.right(), mWidth - 1);
+  int32_t bottom = std::min(r.bottom(), mHeight - 1);
+  if (right < 0 || bottom < 0)
+  {
+    return;
+  }
+  right /= mTileSize;
+  bottom /= mTileSize;
+
+  for (int32_t y = top; y <= bottom; y++)
+  {
+    uint8_t* tile = &mTiles[(size_t)y * mColumns];
+    for (int32_t x = left; x <= right; x++)
+    {
+      if (!tile[x])
+      {
+        tile[x] = 1;
+        mDirtyTiles++;
+      }
+    }
+  }
+}
+
+void pxDirtyRegion::add(const pxDirtyRegion& region)
+{
+  if (region.mTiles.size() != mTiles.size() || region.mColumns != mColumns)
+  {
+    // a region of another size, its tiles don't line up with these
+    if (!region.isEmpty())
+    {
+      addAll();
+    }
+    return;
+  }
+
+  for (size_t i = 0; i < mTiles.size(); i++)
+  {
+    if (region.mTiles[i] && !mTiles[i])
+    {
+      mTiles[i] = 1;
+      mDirtyTiles++;
+    }
+  }
+}
+
+void pxDirtyRegion::addAll()
+{
+  std::fill(mTiles.begin(), mTiles.end(), 1);
+  mDirtyTiles = mTiles.size();
+}
+
+void pxDirtyRegion::clear()
+{
+  std::fill(mTiles.begin(), mTiles.end(), 0);
+  mDirtyTiles = 0;
+}
+
+pxRect pxDirtyRegion::tileRect(int32_t left, int32_t top, int32_t right, int32_t bottom) const
+{
+  return pxRect(left * mTileSize, top * mTileSize,
+                std::min(right * mTileSize, mWidth), std::min(bottom * mTileSize, mHeight));
+}
+
+void pxDirtyRegion::rects(std::vector<pxRect>& r, size_t maxRects) const
+{
+  r.clear();
+  if (isEmpty())
+  {
+    return;
+  }
+  if (isFull())
+  {
+    r.push_back(pxRect(0, 0, mWidth, mHeight));
+    return;
+  }
+
+  // runs of dirty tiles in a row, in tile units, grown downwards while the
+  // next row has a run with the same columns
+  struct block
+  {
+    int32_t left, top, right, bottom;
+  };
+  std::vector<block> blocks;
+  std::vector<size_t> above, current; // blocks reaching the row, in column order
+  for (int32_t y = 0; y < mRows; y++)
+  {
+    const uint8_t* tile = &mTiles[(size_t)y * mColumns];
+    size_t next = 0;
+    current.clear();
+    for (int32_t x = 0; x < mColumns;)
+    {
+      if (!tile[x])
+      {
+        x++;
+        continue;
+      }
+      int32_t start = x;
+      while (x < mColumns && tile[x])
+      {
+        x++;
+      }
+
+      while (next < above.size() && blocks[above[next]].left < start)
+      {
+        next++;
+      }
+      if (next < above.size() && blocks[above[next]].left == start && blocks[above[next]].right == x)
+      {
+        blocks[above[next]].bottom = y + 1;
+        current.push_back(above[next++]);
+      }
+      else
+      {
+        block b = { start, y, x, y + 1 };
+        blocks.push_back(b);
+        current.push_back(blocks.size() - 1);
+      }
+    }
+    above.swap(current);
+  }
+
+  for (size_t i = 0; i < blocks.size(); i++)
+  {
+    r.push_back(tileRect(blocks[i].left, blocks[i].top, blocks[i].right, blocks[i].bottom));
+  }
+
+  if (maxRects == 0 || r.size() <= maxRects)
+  {
+    return;
+  }
+  if (r.size() > PX_DIRTY_REGION_MERGE_LIMIT)
+  {
+    pxRect bounds = r[0];
+    for (size_t i = 1; i < r.size(); i++)
+    {
+      bounds = rectUnion(bounds, r[i]);
+    }
+    r.assign(1, bounds);
+    return;
+  }
+
+  // merge the pair that adds the fewest pixels until few enough are left,
+  // counted as the union's area less both of theirs, which undercounts
+  // once merged rectangles start to overlap others
+  while (r.size() > maxRects)
+  {
+    size_t first = 0, second = 1;
+    int64_t leastAdded = -1;
+    for (size_t i = 0; i < r.size(); i++)
+    {
+      for (size_t j = i + 1; j < r.size(); j++)
+      {
+        int64_t added = rectArea(rectUnion(r[i], r[j])) - rectArea(r[i]) - rectArea(r[j]);
+        if (leastAdded < 0 || added < leastAdded)
+        {
+          leastAdded = added;
+          first = i;
+          second = j;
+        }
+      }
+    }
+    r[first] = rectUnion(r[first], r[second]);
+    r.erase(r.begin() + second);
+  }
+}
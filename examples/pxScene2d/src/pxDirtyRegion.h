@@ -0,0 +1,76 @@
+/*
+
+ pxCore Copyright 2005-2018 John Robinson
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+// pxDirtyRegion.h
+
+#ifndef PX_DIRTY_REGION_H
+#define PX_DIRTY_REGION_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "pxCore.h"
+#include "pxRect.h"
+
+#define PX_DIRTY_REGION_TILE_SIZE 64
+#define PX_DIRTY_REGION_MAX_RECTS 8
+
+// The parts of a scene that need to be redrawn, kept as a grid of tiles.
+//
+// Unlike a single union rectangle, two small changes in opposite corners of
+// the screen only mark the tiles around them.  rects() turns the marked
+// tiles into a few rectangles, the only parts of a frame that are presented.
+class pxDirtyRegion
+{
+public:
+  pxDirtyRegion(int32_t tileSize = PX_DIRTY_REGION_TILE_SIZE);
+
+  // resizes the grid and marks all of it dirty
+  void setSize(int32_t width, int32_t height);
+  int32_t width() const { return mWidth; }
+  int32_t height() const { return mHeight; }
+
+  // marks the tiles r touches, r includes its right and bottom edges like
+  // the screen rectangles pxObject reports
+  void add(const pxRect& r);
+  void add(const pxDirtyRegion& region);
+  void addAll();
+  void clear();
+
+  bool isEmpty() const { return mDirtyTiles == 0; }
+  bool isFull() const { return mDirtyTiles == mTiles.size(); }
+
+  // Rectangles that cover the dirty tiles, with exclusive right and bottom
+  // edges and clipped to the grid.  Neighbouring tiles are merged into rows
+  // and rows with the same extent into blocks.  When that leaves more than
+  // maxRects the closest rectangles are merged further.
+  void rects(std::vector<pxRect>& r, size_t maxRects = PX_DIRTY_REGION_MAX_RECTS) const;
+
+private:
+  pxRect tileRect(int32_t left, int32_t top, int32_t right, int32_t bottom) const;
+
+  int32_t mTileSize;
+  int32_t mWidth;
+  int32_t mHeight;
+  int32_t mColumns;
+  int32_t mRows;
+  std::vector<uint8_t> mTiles;
+  size_t mDirtyTiles;
+};
+
+#endif // PX_DIRTY_REGION_H
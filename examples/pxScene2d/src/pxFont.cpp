@@ -23,42 +23,154 @@
 #include "pxFont.h"
 #include "pxTimer.h"
 #include "pxText.h"
+#include "rtThreadPool.h"
+#include "rtThreadQueue.h"
 
 #include <math.h>
 #include <map>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <stdlib.h>
 
 using namespace std;
 
-struct GlyphKey 
+typedef unordered_map<GlyphKey,GlyphCacheEntry*,GlyphKeyHash> GlyphCache;
+
+struct GlyphTextureCacheEntry
+{
+  GlyphTextureEntry texture;
+  // glyphs with a texture of their own are kept in gGlyphTextureLru
+  bool ownTexture;
+  list<GlyphKey>::iterator lru;
+};
+typedef unordered_map<GlyphKey,GlyphTextureCacheEntry,GlyphKeyHash> GlyphTextureCache;
+
+GlyphCache gGlyphCache;
+GlyphTextureCache gGlyphTextureCache;
+
+// Glyphs that don't fit in the atlas, drawn least recently at the back.
+// Once their textures take more than PXSCENE_GLYPH_TEXTURE_CACHE_LIMIT_IN_BYTES
+// the oldest are dropped from the cache, text that still uses them keeps
+// them until it is rendered again.
+#define PXSCENE_GLYPH_TEXTURE_CACHE_LIMIT_IN_BYTES (4 * 1024 * 1024)
+list<GlyphKey> gGlyphTextureLru;
+int64_t gGlyphTextureBytes = 0;
+
+static void addOwnGlyphTexture(const GlyphKey& key, GlyphTextureCacheEntry& entry)
+{
+  entry.ownTexture = true;
+  gGlyphTextureLru.push_front(key);
+  entry.lru = gGlyphTextureLru.begin();
+  gGlyphTextureBytes += (int64_t)entry.texture.t->width() * entry.texture.t->height();
+
+  while (gGlyphTextureBytes > PXSCENE_GLYPH_TEXTURE_CACHE_LIMIT_IN_BYTES && gGlyphTextureLru.size() > 1)
+  {
+    GlyphTextureCache::iterator it = gGlyphTextureCache.find(gGlyphTextureLru.back());
+    if (it != gGlyphTextureCache.end())
+    {
+      gGlyphTextureBytes -= (int64_t)it->second.texture.t->width() * it->second.texture.t->height();
+      gGlyphTextureCache.erase(it);
+    }
+    gGlyphTextureLru.pop_back();
+  }
+}
+
+#ifdef PXSCENE_FONT_ATLAS
+// taller glyphs get a texture of their own
+#define PXSCENE_FONT_ATLAS_MAX_GLYPH_HEIGHT 128
+#endif
+
+// Shaped text, the runs used least recently at the back.  Text longer than
+// a quarter of the budget is shaped each time it's used.
+#define PXSCENE_TEXT_RUN_CACHE_GLYPHS (64 * 1024)
+
+struct TextRunKey
 {
   uint32_t mFontId;
   uint32_t mPixelSize;
-  uint32_t mCodePoint;
-
-  // Provide a "<" operator that orders keys.
-  // The way it orders them doesn't matter, all that matters is that
-  // it orders them consistently.
-  bool operator<(GlyphKey const& other) const {
-    if (mFontId < other.mFontId) return true; else
-      if (mFontId == other.mFontId) {
-        if (mPixelSize < other.mPixelSize) return true; else
-          if (mPixelSize == other.mPixelSize) {
-            if (mCodePoint < other.mCodePoint) return true;
-          }
-      }
-    return false;
+  string mText;
+
+  bool operator==(TextRunKey const& other) const {
+    return mFontId == other.mFontId && mPixelSize == other.mPixelSize && mText == other.mText;
   }
 };
 
-typedef map<GlyphKey,GlyphCacheEntry*> GlyphCache;
-typedef map<GlyphKey,GlyphTextureEntry> GlyphTextureCache;
+struct TextRunKeyHash
+{
+  size_t operator()(TextRunKey const& k) const {
+    return hash<string>()(k.mText) ^ (k.mPixelSize << 20) ^ (k.mFontId << 26) ^ k.mFontId;
+  }
+};
 
-GlyphCache gGlyphCache;
-GlyphTextureCache gGlyphTextureCache;
+struct TextRunCacheEntry
+{
+  pxTextRunRef run;
+  list<TextRunKey>::iterator lru;
+};
+typedef unordered_map<TextRunKey,TextRunCacheEntry,TextRunKeyHash> TextRunCache;
+
+TextRunCache gTextRunCache;
+list<TextRunKey> gTextRunLru;
+size_t gTextRunGlyphs = 0;
+bool gTextKerningEnabled = true;
+// glyphs are drawn from distance fields, which look the same at any size or
+// scale, rather than from bitmaps of each size.  Needs PXSCENE_FONT_ATLAS.
+bool gTextDistanceFieldEnabled = false;
+
+static void clearTextRuns()
+{
+  gTextRunCache.clear();
+  gTextRunLru.clear();
+  gTextRunGlyphs = 0;
+}
+
+// where a line of text may be broken, after spaces and punctuation, and
+// between CJK characters
+static bool isBreakOpportunity(uint32_t codePoint)
+{
+  switch (codePoint)
+  {
+    case ' ': case '\t': case '/': case ':': case '&': case ',': case ';': case '.': case '?': case '!':
+    case 0x1680: case 0x3000:
+      return true;
+    default:
+      break;
+  }
+  return (codePoint >= 0x2000 && codePoint <= 0x200B && codePoint != 0x2007) ||  // spaces but the figure space
+         (codePoint >= 0x3001 && codePoint <= 0x303F) ||  // CJK punctuation
+         (codePoint >= 0x3040 && codePoint <= 0x30FF) ||  // kana
+         (codePoint >= 0x4E00 && codePoint <= 0x9FFF) ||  // CJK ideographs
+         (codePoint >= 0xFF01 && codePoint <= 0xFF0F);    // fullwidth punctuation
+}
+
+void pxTextRun::measure(size_t first, size_t last, float lineHeight, float& width, float& height) const
+{
+  width = 0;
+  height = lineHeight;
+  float lineWidth = 0;
+  for (size_t i = first; i < last && i < glyphs.size(); i++)
+  {
+    const pxTextRunGlyph& g = glyphs[i];
+    if (g.codePoint == '\n')
+    {
+      height += lineHeight;
+      lineWidth = 0;
+    }
+    else
+    {
+      // kerning with a character that isn't measured doesn't count
+      lineWidth += g.advance + (i == first ? 0 : g.kerning);
+    }
+    width = pxMax<float>(width, lineWidth);
+  }
+}
 
 #include "pxContext.h"
 
 extern pxContext context;
+extern uint32_t gFrameNumber;
 
 #if 1
 // TODO can we eliminate direct utf8.h usage
@@ -122,7 +234,7 @@ pxFont::~pxFont()
   clearDownloadedData();
 }
 
-void pxFont::setFontData(const FT_Byte*  fontData, FT_Long size, const char* n)
+void pxFont::setFontData(char* fontData, FT_Long size, const char* n)
 {
   mFontDataMutex.lock();
   mFontDataUrl = n;
@@ -139,9 +251,8 @@ void pxFont::setFontData(const FT_Byte*  fontData, FT_Long size, const char* n)
   }
   else
   {
-    mFontDownloadedData = new char[size];
+    mFontDownloadedData = fontData;
     mFontDownloadedDataSize = size;
-    memcpy(mFontDownloadedData, fontData, mFontDownloadedDataSize);
   }
   mFontDataMutex.unlock();
 }
@@ -179,9 +290,10 @@ void pxFont::setupResource()
 uint32_t pxFont::loadResourceData(rtFileDownloadRequest* fileDownloadRequest)
 {
       // Load the font data
-    setFontData( (FT_Byte*)fileDownloadRequest->downloadedData(),
-            (FT_Long)fileDownloadRequest->downloadedDataSize(),
-            fileDownloadRequest->fileUrl().cString());
+    char* fontData = NULL;
+    size_t fontDataSize = 0;
+    fileDownloadRequest->takeDownloadedData(fontData, fontDataSize);
+    setFontData(fontData, (FT_Long)fontDataSize, fileDownloadRequest->fileUrl().cString());
             
       return PX_RESOURCE_LOAD_SUCCESS;
 }
@@ -363,9 +475,173 @@ void pxFont::getMetrics(uint32_t size, float& height, float& ascender, float& de
 
 }
 
+#ifdef PXSCENE_FONT_ATLAS
+static inline bool isInside(const uint8_t* bitmap, int32_t w, int32_t h, int32_t x, int32_t y)
+{
+  return x >= 0 && y >= 0 && x < w && y < h && bitmap[y * w + x] >= 128;
+}
+
+void pxDistanceField(const uint8_t* bitmap, uint32_t w, uint32_t h, uint32_t spread, uint8_t* field)
+{
+  int32_t r = (int32_t)spread;
+  int32_t fw = (int32_t)w + 2 * r;
+  int32_t fh = (int32_t)h + 2 * r;
+  for (int32_t fy = 0; fy < fh; fy++)
+  {
+    for (int32_t fx = 0; fx < fw; fx++)
+    {
+      // the nearest pixel within the spread on the other side of the outline
+      // from the pixel under the texel
+      int32_t bx = fx - r;
+      int32_t by = fy - r;
+      bool inside = isInside(bitmap, w, h, bx, by);
+      int32_t nearest = (r + 1) * (r + 1);
+      for (int32_t y = by - r; y <= by + r; y++)
+      {
+        for (int32_t x = bx - r; x <= bx + r; x++)
+        {
+          if (isInside(bitmap, w, h, x, y) != inside)
+          {
+            nearest = std::min(nearest, (x - bx) * (x - bx) + (y - by) * (y - by));
+          }
+        }
+      }
+      // the outline lies halfway between the two pixels
+      float distance = sqrtf((float)nearest) - 0.5f;
+      float v = 127.5f + (inside ? distance : -distance) * 127.5f / r;
+      field[fy * fw + fx] = (uint8_t)std::max(0.0f, std::min(v + 0.5f, 255.0f));
+    }
+  }
+}
+
+// A glyph bitmap whose distance field is made on the thread pool, the
+// field goes into the atlas on the main thread
+struct DistanceFieldRequest
+{
+  GlyphKey key;
+  uint32_t generation;
+  uint32_t w, h;
+  int32_t left, top;
+  vector<uint8_t> bitmap;
+  vector<uint8_t> field;
+};
+
+// glyphs whose distance fields are being made, requests from before the
+// fonts were cleared are dropped
+static unordered_set<GlyphKey,GlyphKeyHash> gDistanceFieldRequests;
+static uint32_t gDistanceFieldGeneration = 0;
+
+static void clearDistanceFieldRequests()
+{
+  gDistanceFieldRequests.clear();
+  gDistanceFieldGeneration++;
+}
+
+static void onDistanceFieldReady(void* /*context*/, void* data)
+{
+  DistanceFieldRequest* request = (DistanceFieldRequest*)data;
+  if (request->generation == gDistanceFieldGeneration)
+  {
+    gDistanceFieldRequests.erase(request->key);
+
+    uint32_t s = PXSCENE_DISTANCE_FIELD_SPREAD;
+    GlyphTextureCacheEntry entry;
+    entry.ownTexture = false;
+    GlyphTextureEntry& e = entry.texture;
+    if (gFontAtlas.addGlyph(request->key, request->w + 2 * s, request->h + 2 * s, &request->field[0], e, true))
+    {
+      e.spread = (float)s;
+      e.left = (float)(request->left - (int32_t)s);
+      e.top = (float)(request->top + (int32_t)s);
+      e.width = (float)(request->w + 2 * s);
+      e.height = (float)(request->h + 2 * s);
+      gGlyphTextureCache[request->key] = entry;
+      // text drawn with the bitmap is built again with the field
+      gFontAtlas.glyphsReplaced();
+    }
+    // otherwise the atlas is full of glyphs drawn this frame, it is asked
+    // for again
+  }
+  delete request;
+}
+
+static void makeDistanceField(void* data)
+{
+  DistanceFieldRequest* request = (DistanceFieldRequest*)data;
+  uint32_t s = PXSCENE_DISTANCE_FIELD_SPREAD;
+  request->field.resize((request->w + 2 * s) * (request->h + 2 * s));
+  pxDistanceField(&request->bitmap[0], request->w, request->h, s, &request->field[0]);
+  gUIThreadQueue->addTask(onDistanceFieldReady, NULL, request);
+}
+
+bool pxFont::getDistanceFieldTexture(uint32_t codePoint, GlyphTextureEntry& e)
+{
+  // one field for every size of the glyph
+  GlyphKey key;
+  key.mFontId = mFontId;
+  key.mPixelSize = 0;
+  key.mCodePoint = codePoint;
+  GlyphTextureCache::iterator it = gGlyphTextureCache.find(key);
+  if (it != gGlyphTextureCache.end())
+  {
+    if (!it->second.texture.t)
+    {
+      return false;
+    }
+    gFontAtlas.textureUsed(it->second.texture.t);
+    e = it->second.texture;
+    return true;
+  }
+  if (gDistanceFieldRequests.find(key) != gDistanceFieldRequests.end())
+  {
+    return false;
+  }
+
+  FT_Set_Pixel_Sizes(mFace, 0, PXSCENE_DISTANCE_FIELD_PIXEL_SIZE);
+  if (!FT_Load_Char(mFace, codePoint, FT_LOAD_RENDER))
+  {
+    FT_GlyphSlot g = mFace->glyph;
+    if (g->bitmap.width == 0 || g->bitmap.rows == 0 ||
+        g->bitmap.rows + 2 * PXSCENE_DISTANCE_FIELD_SPREAD >= PXSCENE_FONT_ATLAS_MAX_GLYPH_HEIGHT)
+    {
+      // nothing to draw, or too big for the atlas, the bitmaps do
+      GlyphTextureCacheEntry entry;
+      entry.ownTexture = false;
+      gGlyphTextureCache.insert(make_pair(key, entry));
+    }
+    else
+    {
+      DistanceFieldRequest* request = new DistanceFieldRequest;
+      request->key = key;
+      request->generation = gDistanceFieldGeneration;
+      request->w = g->bitmap.width;
+      request->h = g->bitmap.rows;
+      request->left = g->bitmap_left;
+      request->top = g->bitmap_top;
+      request->bitmap.resize(request->w * request->h);
+      for (uint32_t row = 0; row < request->h; row++)
+      {
+        memcpy(&request->bitmap[row * request->w], g->bitmap.buffer + row * g->bitmap.pitch, request->w);
+      }
+      gDistanceFieldRequests.insert(key);
+      rtThreadPool::globalInstance()->executeTask(new rtThreadTask(makeDistanceField, request, ""));
+    }
+  }
+  FT_Set_Pixel_Sizes(mFace, 0, mPixelSize);
+  return false;
+}
+#endif
+
 GlyphTextureEntry pxFont::getGlyphTexture(uint32_t codePoint, float sx, float sy)
 {
   GlyphTextureEntry result;
+#ifdef PXSCENE_FONT_ATLAS
+  // until its distance field is ready the glyph is drawn from a bitmap
+  if (gTextDistanceFieldEnabled && getDistanceFieldTexture(codePoint, result))
+  {
+    return result;
+  }
+#endif
   // Select a glyph texture better suited for rendering the glyph
   // taking pixelSize and scale into account
   uint32_t pixelSize=(uint32_t)ceil((sx>sy?sx:sy)*mPixelSize);
@@ -395,7 +671,20 @@ GlyphTextureEntry pxFont::getGlyphTexture(uint32_t codePoint, float sx, float sy
   key.mCodePoint = codePoint;
   GlyphTextureCache::iterator it = gGlyphTextureCache.find(key);
   if (it != gGlyphTextureCache.end())
-    return it->second;
+  {
+    if (it->second.ownTexture)
+    {
+      gGlyphTextureLru.splice(gGlyphTextureLru.begin(), gGlyphTextureLru, it->second.lru);
+    }
+#ifdef PXSCENE_FONT_ATLAS
+    else
+    {
+      // text that is being built this frame is drawn this frame too
+      gFontAtlas.textureUsed(it->second.texture.t);
+    }
+#endif
+    return it->second.texture;
+  }
   else
   {
     // temporarily set pixel size to more optimal size for
@@ -408,11 +697,13 @@ GlyphTextureEntry pxFont::getGlyphTexture(uint32_t codePoint, float sx, float sy
 
       FT_GlyphSlot g = mFace->glyph;
 
+      GlyphTextureCacheEntry entry;
+      entry.ownTexture = false;
 #ifdef PXSCENE_FONT_ATLAS
-      if (!gFontAtlas.addGlyph(g->bitmap.width, g->bitmap.rows, g->bitmap.buffer, result))
+      if (!gFontAtlas.addGlyph(key, g->bitmap.width, g->bitmap.rows, g->bitmap.buffer, result))
       {
+        rtLogDebug("Glyph not in atlas");
 #endif
-        rtLogWarn("Glyph not in atlas");
         result.t = context.createTexture(static_cast<float>(g->bitmap.width), static_cast<float>(g->bitmap.rows), 
                                                 static_cast<float>(g->bitmap.width), static_cast<float>(g->bitmap.rows), 
                                                 g->bitmap.buffer);
@@ -421,11 +712,18 @@ GlyphTextureEntry pxFont::getGlyphTexture(uint32_t codePoint, float sx, float sy
         result.v1 = 1;
         result.u2 = 1;
         result.v2 = 0;
+
+        entry.texture = result;
+        addOwnGlyphTexture(key, entry);
 #ifdef PXSCENE_FONT_ATLAS
       }
+      else
+      {
+        entry.texture = result;
+      }
 #endif
       
-      gGlyphTextureCache.insert(make_pair(key,result));
+      gGlyphTextureCache.insert(make_pair(key,entry));
 
       // restore current pixelSize
       FT_Set_Pixel_Sizes(mFace, 0, mPixelSize);
@@ -464,6 +762,7 @@ const GlyphCacheEntry* pxFont::getGlyph(uint32_t codePoint)
       entry->advancedotx = (int32_t) g->advance.x;
       entry->advancedoty = (int32_t) g->advance.y;
       entry->vertAdvance = (int32_t) g->metrics.vertAdvance; // !CLF: Why vertAdvance? SHould only be valid for vert layout of text.
+      entry->glyphIndex = FT_Get_Char_Index(mFace, codePoint);
 
       gGlyphCache.insert(make_pair(key,entry));
 
@@ -491,34 +790,106 @@ void pxFont::measureTextInternal(const char* text, uint32_t size,  float sx, flo
 
   if (!text) 
     return;
-    
+
+  pxTextRunRef run = shapeText(text, size);
+  w = run->w * sx;
+  h = run->h * sy;
+}
+
+pxTextRunRef pxFont::shapeText(const char* text, uint32_t size)
+{
+  TextRunKey key;
+  key.mFontId = mFontId;
+  key.mPixelSize = size;
+  key.mText = text ? text : "";
+  TextRunCache::iterator it = gTextRunCache.find(key);
+  if (it != gTextRunCache.end())
+  {
+    gTextRunLru.splice(gTextRunLru.begin(), gTextRunLru, it->second.lru);
+    return it->second.run;
+  }
+
+  pxTextRunRef run = new pxTextRun;
+  if (!mInitialized)
+  {
+    rtLogWarn("shapeText called on font before it is initialized\n");
+    return run;
+  }
+
+  setPixelSize(size);
+  FT_Size_Metrics* metrics = &mFace->size->metrics;
+  float lineHeight = static_cast<float>(metrics->height>>6);
+  bool kerning = gTextKerningEnabled && FT_HAS_KERNING(mFace);
+
+  run->h = lineHeight;
+  float lineWidth = 0;
+  uint32_t previousIndex = 0;
   int i = 0;
+  int last = 0;
   u_int32_t codePoint;
-  
-  FT_Size_Metrics* metrics = &mFace->size->metrics;
-  
-  h = static_cast<float>(metrics->height>>6);
-  float lw = 0;
-  while((codePoint = u8_nextchar((char*)text, &i)) != 0) 
+  while((codePoint = u8_nextchar((char*)key.mText.c_str(), &i)) != 0)
   {
-    const GlyphCacheEntry* entry = getGlyph(codePoint);
-    if (!entry) 
-      continue;
-      
-    if (codePoint != '\n')
+    pxTextRunGlyph g;
+    g.codePoint = codePoint;
+    g.offset = last;
+    g.length = i - last;
+    g.kerning = 0;
+    g.advance = 0;
+    g.breakAfter = isBreakOpportunity(codePoint);
+    last = i;
+
+    if (codePoint == '\n')
     {
-      lw += (entry->advancedotx >> 6) * sx;
+      g.x = lineWidth;
+      run->h += lineHeight;
+      lineWidth = 0;
+      previousIndex = 0;
     }
     else
     {
-      h += (metrics->height>>6) *sy;
-      lw = 0;
+      const GlyphCacheEntry* entry = getGlyph(codePoint);
+      if (entry)
+      {
+        g.advance = static_cast<float>(entry->advancedotx >> 6);
+        FT_Vector delta;
+        if (kerning && previousIndex && entry->glyphIndex &&
+            !FT_Get_Kerning(mFace, previousIndex, entry->glyphIndex, FT_KERNING_DEFAULT, &delta))
+        {
+          g.kerning = static_cast<float>(delta.x >> 6);
+        }
+        previousIndex = entry->glyphIndex;
+      }
+      else
+      {
+        previousIndex = 0;
+      }
+      g.x = lineWidth + g.kerning;
+      lineWidth = g.x + g.advance;
     }
-    w = pxMax<float>(w, lw);
-//    h = pxMax<float>((g->advance.y >> 6) * sy, h);
-//    h = pxMax<float>((metrics->height >> 6) * sy, h);
+    run->w = pxMax<float>(run->w, lineWidth);
+    run->glyphs.push_back(g);
   }
-  h *= sy;
+
+  if (run->glyphs.size() <= PXSCENE_TEXT_RUN_CACHE_GLYPHS / 4)
+  {
+    while (gTextRunGlyphs + run->glyphs.size() > PXSCENE_TEXT_RUN_CACHE_GLYPHS && !gTextRunLru.empty())
+    {
+      TextRunCache::iterator oldest = gTextRunCache.find(gTextRunLru.back());
+      if (oldest != gTextRunCache.end())
+      {
+        gTextRunGlyphs -= oldest->second.run->glyphs.size();
+        gTextRunCache.erase(oldest);
+      }
+      gTextRunLru.pop_back();
+    }
+    gTextRunLru.push_front(key);
+    TextRunCacheEntry entry;
+    entry.run = run;
+    entry.lru = gTextRunLru.begin();
+    gTextRunCache.insert(make_pair(key, entry));
+    gTextRunGlyphs += run->glyphs.size();
+  }
+  return run;
 }
 
 #ifndef PXSCENE_FONT_ATLAS
@@ -532,19 +903,19 @@ void pxFont::renderText(const char *text, uint32_t size, float x, float y,
     return;
   }
 
-  int i = 0;
-  u_int32_t codePoint;
-
-  setPixelSize(size);
+  pxTextRunRef run = shapeText(text, size);
   FT_Size_Metrics* metrics = &mFace->size->metrics;
   
-  while((codePoint = u8_nextchar((char*)text, &i)) != 0) 
+  for (size_t i = 0; i < run->glyphs.size(); i++)
   {
+    const pxTextRunGlyph& glyph = run->glyphs[i];
+    u_int32_t codePoint = glyph.codePoint;
     const GlyphCacheEntry* entry = getGlyph(codePoint);
     if (!entry) 
       continue;
 
-    float x2 = x + entry->bitmap_left;
+    float penX = x + glyph.x;
+    float x2 = penX + entry->bitmap_left;
     //float y2 = y - g->bitmap_top;
     float y2 = (y - entry->bitmap_top) + (metrics->ascender>>6);
     float w = static_cast<float>(entry->bitmapdotwidth);
@@ -552,7 +923,7 @@ void pxFont::renderText(const char *text, uint32_t size, float x, float y,
     
     if (codePoint != '\n')
     {
-      if (x == 0) 
+      if (penX == 0) 
       {
         float c[4] = {0, 1, 0, 1};
         context.drawDiagLine(0, y+(metrics->ascender>>6), mw, 
@@ -586,12 +957,11 @@ void pxFont::renderText(const char *text, uint32_t size, float x, float y,
       #else
       context.drawImage(x2,y2, w, h, texture.t, nullImage, false, color);
       #endif
-      
-      x += (entry->advancedotx >> 6);
       // no change to y because we are not moving to next line yet
     }
     else
     {
+      // the run's positions start at 0 on each line
       x = 0;
       // Use height to advance to next line
       y += (metrics->height>>6);
@@ -612,20 +982,19 @@ void pxFont::renderTextToQuads(const char *text, uint32_t size,
     return;
   }
 
-  int i = 0;
-  u_int32_t codePoint;
-
-  setPixelSize(size);
+  pxTextRunRef run = shapeText(text, size);
   FT_Size_Metrics* metrics = &mFace->size->metrics;
   
-  while((codePoint = u8_nextchar((char*)text, &i)) != 0) 
+  for (size_t i = 0; i < run->glyphs.size(); i++)
   {
-    GlyphCacheEntry* entry = (GlyphCacheEntry*)getGlyph(codePoint);
+    const pxTextRunGlyph& glyph = run->glyphs[i];
+    u_int32_t codePoint = glyph.codePoint;
+    const GlyphCacheEntry* entry = getGlyph(codePoint);
 
     if (!entry) 
       continue;
 
-    float x2 = x + entry->bitmap_left;
+    float x2 = x + glyph.x + entry->bitmap_left;
 //    float y2 = y - g->bitmap_top;
     float y2 = (y - entry->bitmap_top) + (metrics->ascender>>6);
     float w = static_cast<float>(entry->bitmapdotwidth);
@@ -633,18 +1002,28 @@ void pxFont::renderTextToQuads(const char *text, uint32_t size,
     
     if (codePoint != '\n')
     {
-      
-      GlyphTextureEntry t = getGlyphTexture(codePoint, nsx, nsy);
-
-      pxTextureRef nullImage;
+      if (entry->bitmapdotwidth == 0 || entry->bitmapdotrows == 0)
+      {
+        // nothing to draw, spaces don't split the quads between textures
+        continue;
+      }
 
-      quads.addQuad(x2,y2,x2+w,y2+h,t.u1,t.v1,t.u2,t.v2,t.t);
+      GlyphTextureEntry t = getGlyphTexture(codePoint, nsx, nsy);
+      if (t.spread > 0)
+      {
+        float k = (float)size / PXSCENE_DISTANCE_FIELD_PIXEL_SIZE;
+        x2 = x + glyph.x + t.left * k;
+        y2 = (y - t.top * k) + (metrics->ascender>>6);
+        w = t.width * k;
+        h = t.height * k;
+      }
 
-      x += (entry->advancedotx >> 6);
+      quads.addQuad(x2,y2,x2+w,y2+h,t.u1,t.v1,t.u2,t.v2,t.t,t.spread);
       // no change to y because we are not moving to next line yet
     }
     else
     {
+      // the run's positions start at 0 on each line
       x = 0;
       // Use height to advance to next line
       y += (metrics->height>>6);
@@ -840,9 +1219,13 @@ void pxFontManager::clearAllFonts()
 
   gGlyphCache.clear();
   gGlyphTextureCache.clear();
+  gGlyphTextureLru.clear();
+  gGlyphTextureBytes = 0;
+  clearTextRuns();
   mFontIdMap.clear();
 #ifdef PXSCENE_FONT_ATLAS
   gFontAtlas.clearTexture();
+  clearDistanceFieldRequests();
 #endif
 }
 
@@ -864,87 +1247,198 @@ rtDefineProperty(pxTextSimpleMeasurements, w);
 rtDefineProperty(pxTextSimpleMeasurements, h);
 
 #ifdef PXSCENE_FONT_ATLAS
-#define PXSCENE_FONT_ATLAS_DIM 2048
-pxFontAtlas::pxFontAtlas(): fence(0)
+#define PXSCENE_FONT_ATLAS_DIM 1024
+#define PXSCENE_FONT_ATLAS_MAX_PAGES 8
+
+pxFontAtlas::pxFontAtlas(): mPages(), mMaxPages(PXSCENE_FONT_ATLAS_MAX_PAGES), mGeneration(0)
 {
-  mTexture = context.createTexture(PXSCENE_FONT_ATLAS_DIM,PXSCENE_FONT_ATLAS_DIM,PXSCENE_FONT_ATLAS_DIM,PXSCENE_FONT_ATLAS_DIM, NULL);
+  char const* s = getenv("SPARK_FONT_ATLAS_PAGES");
+  if (s && atoi(s) > 0)
+  {
+    mMaxPages = atoi(s);
+  }
 }
 
 void pxFontAtlas::clearTexture() 
 {
-  if( mTexture) {
-    mTexture->deleteTexture();
-    mTexture = 0;
+  // batched text may still sample the pages
+  context.flush();
+  for (uint32_t i = 0; i < mPages.size(); i++)
+  {
+    if (mPages[i].texture)
+    {
+      mPages[i].texture->deleteTexture();
+    }
   }
+  mPages.clear();
+  mGeneration++;
 }
-bool pxFontAtlas::addGlyph(uint32_t w, uint32_t h, void* buffer, GlyphTextureEntry& e)
+
+void pxFontAtlas::textureUsed(const pxTextureRef& t)
+{
+  for (uint32_t i = 0; i < mPages.size(); i++)
+  {
+    if (mPages[i].texture.getPtr() == t.getPtr())
+    {
+      mPages[i].lastUsedFrame = gFrameNumber;
+      return;
+    }
+  }
+}
+
+bool pxFontAtlas::addGlyph(const GlyphKey& key, uint32_t w, uint32_t h, void* buffer, GlyphTextureEntry& e,
+                           bool distanceField)
 {
-  if (!mTexture)
+  if (h >= PXSCENE_FONT_ATLAS_MAX_GLYPH_HEIGHT || w >= PXSCENE_FONT_ATLAS_DIM)
   {
-    mTexture = context.createTexture(PXSCENE_FONT_ATLAS_DIM,PXSCENE_FONT_ATLAS_DIM,PXSCENE_FONT_ATLAS_DIM,PXSCENE_FONT_ATLAS_DIM, NULL);
+    return false;
   }
-  //return false;
-  // bail on biggish glyphs
-  if (h < 128)
+
+  for (uint32_t i = 0; i < mPages.size(); i++)
   {
-    uint32_t h2 = (h+8)&~7;
-    // look for a row that fits
-    uint32_t i;
-    for (i = 0; i < mRows.size(); i++)
+    if (mPages[i].distanceField == distanceField && addToPage(mPages[i], key, w, h, buffer, e))
     {
-      row& r = mRows[i];
-      if ((h2 == r.height) && (r.rFence+w < (uint32_t)mTexture->width()))
-      {
-        e.t = mTexture;
-        e.u1 = (float)r.rFence/(float)mTexture->width();
-        e.u2 = (float)(r.rFence+w)/(float)mTexture->width();
-        e.v1 = (float)r.top/(float)mTexture->height();
-        e.v2 = (float)(r.top+h)/(float)mTexture->height();
-        
-        mTexture->updateTexture(r.rFence,r.top,w,h,buffer);
+      return true;
+    }
+  }
 
-        r.rFence += w+1;
+  if (mPages.size() < mMaxPages &&
+      context.isTextureSpaceAvailable(PXSCENE_FONT_ATLAS_DIM * PXSCENE_FONT_ATLAS_DIM))
+  {
+    page p;
+    p.texture = context.createTexture(PXSCENE_FONT_ATLAS_DIM,PXSCENE_FONT_ATLAS_DIM,PXSCENE_FONT_ATLAS_DIM,PXSCENE_FONT_ATLAS_DIM, NULL);
+    p.fence = 0;
+    p.lastUsedFrame = gFrameNumber;
+    p.distanceField = distanceField;
+    mPages.push_back(p);
+    return addToPage(mPages.back(), key, w, h, buffer, e);
+  }
 
-        return true;
-      }
+  // no room for another page, the one drawn least recently is emptied
+  // unless all of them are drawn this frame
+  page* oldest = NULL;
+  for (uint32_t i = 0; i < mPages.size(); i++)
+  {
+    uint32_t age = gFrameNumber - mPages[i].lastUsedFrame;
+    if (age > 0 && (!oldest || age > gFrameNumber - oldest->lastUsedFrame))
+    {
+      oldest = &mPages[i];
     }
+  }
+  if (!oldest)
+  {
+    return false;
+  }
+  emptyPage(*oldest);
+  oldest->distanceField = distanceField;
+  return addToPage(*oldest, key, w, h, buffer, e);
+}
 
-    if ((i >= mRows.size()) && (fence+h < (uint32_t)mTexture->height()))
+bool pxFontAtlas::addToPage(page& p, const GlyphKey& key, uint32_t w, uint32_t h, void* buffer, GlyphTextureEntry& e)
+{
+  // a pixel of space right of and below each glyph, so that filtering
+  // doesn't pick up its neighbours
+  uint32_t paddedWidth = w + 1;
+  uint32_t shelfHeight = (h + 1 + 3) & ~3;
+
+  // the lowest shelf the glyph fits on, shelves much taller than the glyph
+  // are left for taller glyphs
+  shelf* best = NULL;
+  for (uint32_t i = 0; i < p.shelves.size(); i++)
+  {
+    shelf& candidate = p.shelves[i];
+    if (candidate.height >= shelfHeight && candidate.height <= shelfHeight + shelfHeight / 2 &&
+        candidate.fence + paddedWidth <= PXSCENE_FONT_ATLAS_DIM &&
+        (!best || candidate.height < best->height))
     {
-      // Didn't find a row that matched... try adding another row
-      row nr;
-      nr.top = fence;
-      nr.height = h2;
-      nr.rFence = 0;
-      fence += h2;
-
+      best = &candidate;
+    }
+  }
+  if (!best)
+  {
+    if (p.fence + shelfHeight > PXSCENE_FONT_ATLAS_DIM)
+    {
+      return false;
+    }
+    shelf ns;
+    ns.top = p.fence;
+    ns.height = shelfHeight;
+    ns.fence = 0;
+    p.fence += shelfHeight;
+    p.shelves.push_back(ns);
+    best = &p.shelves.back();
+  }
 
-      if ((h2 == nr.height) && (nr.rFence+w < (uint32_t)mTexture->width()))
-      {
-        e.t = mTexture;
-        e.u1 = (float)nr.rFence/(float)mTexture->width();
-        e.u2 = (float)(nr.rFence+w)/(float)mTexture->width();
-        e.v1 = (float)nr.top/(float)mTexture->height();
-        e.v2 = (float)(nr.top+h)/(float)mTexture->height(); 
+  // the padding is written as well, emptied pages still hold old glyphs
+  vector<uint8_t> padded(paddedWidth * (h + 1), 0);
+  for (uint32_t row = 0; row < h; row++)
+  {
+    memcpy(&padded[row * paddedWidth], (uint8_t*)buffer + row * w, w);
+  }
+  p.texture->updateTexture(best->fence, best->top, paddedWidth, h + 1, &padded[0]);
+
+  float dim = (float)PXSCENE_FONT_ATLAS_DIM;
+  e.t = p.texture;
+  e.u1 = (float)best->fence/dim;
+  e.u2 = (float)(best->fence+w)/dim;
+  e.v1 = (float)best->top/dim;
+  e.v2 = (float)(best->top+h)/dim;
+
+  best->fence += paddedWidth;
+  p.lastUsedFrame = gFrameNumber;
+  p.glyphs.push_back(key);
+  return true;
+}
 
-        mTexture->updateTexture(nr.rFence,nr.top,w,h,buffer);
+void pxFontAtlas::emptyPage(page& p)
+{
+  rtLogDebug("emptying font atlas page with %d glyphs", (int)p.glyphs.size());
+  // its glyphs are overwritten, draw batched text that uses them first
+  context.flush();
+  for (uint32_t i = 0; i < p.glyphs.size(); i++)
+  {
+    gGlyphTextureCache.erase(p.glyphs[i]);
+  }
+  p.glyphs.clear();
+  p.shelves.clear();
+  p.fence = 0;
+  // text built from the page has to be built again, its glyphs are packed
+  // again as they are asked for
+  mGeneration++;
+}
 
-        nr.rFence += w+1;
 
-        mRows.push_back(nr);
-        return true;
-      }        
+void pxTexturedQuads::append(const pxTexturedQuads& other)
+{
+  for (uint32_t i = 0; i < other.mQuads.size(); i++)
+  {
+    const quads& o = other.mQuads[i];
+    uint32_t j;
+    for (j = 0; j < mQuads.size(); j++)
+    {
+      if (mQuads[j].t == o.t && mQuads[j].verts.size() + o.verts.size() <= maxVectorSize)
+      {
+        break;
+      }
+    }
+    if (j == mQuads.size())
+    {
+      mQuads.push_back(o);
+    }
+    else
+    {
+      mQuads[j].verts.insert(mQuads[j].verts.end(), o.verts.begin(), o.verts.end());
+      mQuads[j].uvs.insert(mQuads[j].uvs.end(), o.uvs.begin(), o.uvs.end());
     }
   }
-  return false;
 }
 
-
 void pxTexturedQuads::draw(float x, float y, float* color)
 {
   for (uint32_t i = 0; i < mQuads.size(); i++)
   {
     quads& q = mQuads[i];
+    gFontAtlas.textureUsed(q.t);
     vector<float> verts(q.verts);
 
     if (x!= 0 || y != 0)
@@ -958,7 +1452,7 @@ void pxTexturedQuads::draw(float x, float y, float* color)
       }
     }
 
-    context.drawTexturedQuads(q.verts.size()/12, &verts[0], &q.uvs[0], q.t, color);
+    context.drawTexturedQuads(q.verts.size()/12, &verts[0], &q.uvs[0], q.t, color, q.spread);
   }
 }
 #endif
@@ -23,6 +23,7 @@
 
 #include "rtString.h"
 #include "rtRef.h"
+#include "rtAtomic.h"
 #include "rtCORS.h"
 
 // TODO it would be nice to push this back into implemention
@@ -57,42 +58,146 @@ struct GlyphCacheEntry
   int32_t advancedotx;
   int32_t advancedoty;
   int32_t vertAdvance;
+  uint32_t glyphIndex;
 };
 
 struct GlyphTextureEntry
 {
   pxTextureRef t;
   float u1, v1, u2, v2;
-  GlyphTextureEntry(): u1(0),v1(0),u2(0),v2(0){}
+  // distance field glyphs have a spread, they are drawn scaled from
+  // PXSCENE_DISTANCE_FIELD_PIXEL_SIZE and their texture is placed relative
+  // to the pen position and the baseline at that size
+  float spread;
+  float left, top, width, height;
+  GlyphTextureEntry(): u1(0),v1(0),u2(0),v2(0),spread(0),left(0),top(0),width(0),height(0){}
 };
 
+struct GlyphKey 
+{
+  uint32_t mFontId;
+  uint32_t mPixelSize;
+  uint32_t mCodePoint;
+
+  bool operator==(GlyphKey const& other) const {
+    return mFontId == other.mFontId && mPixelSize == other.mPixelSize &&
+           mCodePoint == other.mCodePoint;
+  }
+};
+
+struct GlyphKeyHash
+{
+  size_t operator()(GlyphKey const& k) const {
+    return (size_t)((k.mCodePoint * 2654435761u) ^ (k.mPixelSize << 20) ^ (k.mFontId << 26) ^ k.mFontId);
+  }
+};
+
+// A character of a pxTextRun
+struct pxTextRunGlyph
+{
+  uint32_t codePoint;
+  uint32_t offset;   // of its first byte in the text
+  uint32_t length;   // in bytes
+  float x;           // its pen position on its line, kerning included
+  float kerning;     // between it and the character before
+  float advance;
+  bool breakAfter;   // a line may be broken after it
+};
+
+// Text shaped with one font and pixel size.  pxFont::shapeText keeps the
+// runs it shaped, so laying out the same text again doesn't look up its
+// glyphs again.
+class pxTextRun
+{
+public:
+  pxTextRun(): glyphs(), w(0), h(0), mRef(0) {}
+  virtual ~pxTextRun() {}
+
+  virtual unsigned long AddRef() { return rtAtomicInc(&mRef); }
+  virtual unsigned long Release()
+  {
+    unsigned long l = rtAtomicDec(&mRef);
+    if (l == 0) delete this;
+    return l;
+  }
+
+  // the size of the characters [first, last) measured as a text of their
+  // own, the same as pxFont::measureTextInternal
+  void measure(size_t first, size_t last, float lineHeight, float& width, float& height) const;
+
+  vector<pxTextRunGlyph> glyphs;
+  // the widest line and the height of all lines
+  float w;
+  float h;
+
+private:
+  rtAtomic mRef;
+};
+
+typedef rtRef<pxTextRun> pxTextRunRef;
+
 #ifdef PXSCENE_FONT_ATLAS
+#define PXSCENE_DISTANCE_FIELD_PIXEL_SIZE 48
+#define PXSCENE_DISTANCE_FIELD_SPREAD 6
+
+// Turns the w x h alpha bitmap into a signed distance field of
+// (w + 2 * spread) x (h + 2 * spread) texels.  128 is on the outline,
+// values rise inside the glyph and fall outside of it, reaching 255 and 0
+// spread texels away.
+void pxDistanceField(const uint8_t* bitmap, uint32_t w, uint32_t h, uint32_t spread, uint8_t* field);
+
+// Glyph bitmaps packed into shared alpha textures, pages, so that text
+// draws with few texture binds.  Pages are added as they fill up while
+// the texture memory limit allows it.  After that the page drawn least
+// recently is emptied and its glyphs are packed again the next time they
+// are needed, which bumps generation().  Distance field glyphs are kept in
+// pages of their own.
 class pxFontAtlas
 {
 public:
+  pxFontAtlas();
 
+  // false if the glyph doesn't fit in a page and has to get a texture of
+  // its own
+  bool addGlyph(const GlyphKey& key, uint32_t w, uint32_t h, void* buffer, GlyphTextureEntry& e,
+                bool distanceField = false);
+  // keeps the page t belongs to from being emptied during this frame
+  void textureUsed(const pxTextureRef& t);
+  // glyph coordinates from earlier generations may point at other glyphs
+  uint32_t generation() const { return mGeneration; }
+  // for glyphs that text built earlier should use instead of the ones it has
+  void glyphsReplaced() { mGeneration++; }
+  uint32_t pageCount() const { return (uint32_t)mPages.size(); }
+  void clearTexture();
 
-  struct row
+private:
+  struct shelf
   {
     uint32_t top;
     uint32_t height;
-    uint32_t rFence;
+    uint32_t fence;
   };
 
+  struct page
+  {
+    pxTextureRef texture;
+    vector<shelf> shelves;
+    uint32_t fence;
+    uint32_t lastUsedFrame;
+    vector<GlyphKey> glyphs;
+    bool distanceField;
+  };
 
-  pxFontAtlas();
-
-  bool addGlyph(uint32_t w, uint32_t h, void* buffer, GlyphTextureEntry& e);
-  void clearTexture();
-
-
-  private:
+  bool addToPage(page& p, const GlyphKey& key, uint32_t w, uint32_t h, void* buffer, GlyphTextureEntry& e);
+  void emptyPage(page& p);
 
-  uint32_t fence;
-  pxTextureRef mTexture;
-  vector<row> mRows;
+  vector<page> mPages;
+  uint32_t mMaxPages;
+  uint32_t mGeneration;
 };
 
+extern pxFontAtlas gFontAtlas;
+
 class pxTexturedQuads
 {
   // limit the size of vectors per quad to prevent memory
@@ -105,16 +210,19 @@ class pxTexturedQuads
     vector<float> verts;
     vector<float> uvs;
     pxTextureRef t;
+    float spread; // of distance field textures
   };
 
-  pxTexturedQuads() {}
+  pxTexturedQuads(): mQuads(), mGeneration(gFontAtlas.generation()) {}
 
-  void addQuad(float x1,float y1,float x2,float y2, float u1, float v1, float u2, float v2, pxTextureRef t)
+  void addQuad(float x1,float y1,float x2,float y2, float u1, float v1, float u2, float v2, pxTextureRef t,
+               float spread = 0)
   {
     if (mQuads.empty() || mQuads[mQuads.size()-1].t != t || mQuads[mQuads.size()-1].verts.size() >= maxVectorSize)
     {
       quads q;
       q.t = t;
+      q.spread = spread;
       mQuads.push_back(q);
     }
 
@@ -158,10 +266,20 @@ class pxTexturedQuads
   void clear()
   {
     mQuads.clear();
+    mGeneration = gFontAtlas.generation();
   }
 
+  // adds the quads of other to those with the same texture, so text made of
+  // several pieces is still drawn with a draw per texture
+  void append(const pxTexturedQuads& other);
+
+  // false once glyphs the quads use were moved in the atlas, they have to
+  // be built again
+  bool isCurrent() const { return mGeneration == gFontAtlas.generation(); }
+
 private:
   vector<quads> mQuads;
+  uint32_t mGeneration;
 };
 
 #endif
@@ -264,6 +382,11 @@ public:
   void setPixelSize(uint32_t s);  
   const GlyphCacheEntry* getGlyph(uint32_t codePoint);
   GlyphTextureEntry getGlyphTexture(uint32_t codePoint, float sx, float sy);  
+#ifdef PXSCENE_FONT_ATLAS
+  // the distance field of the glyph, false while it is being made and if it
+  // can't be
+  bool getDistanceFieldTexture(uint32_t codePoint, GlyphTextureEntry& e);
+#endif
   void getMetrics(uint32_t size, float& height, float& ascender, float& descender, float& naturalLeading);
   void getHeight(uint32_t size, float& height);
   void measureText(const char* text, uint32_t size, float& w, float& h);
@@ -271,6 +394,8 @@ public:
                    float& w, float& h);
   void measureTextChar(u_int32_t codePoint, uint32_t size,  float sx, float sy, 
                          float& w, float& h);
+  // the glyphs, kerning and line break opportunities of text
+  pxTextRunRef shapeText(const char* text, uint32_t size);
   #ifndef PXSCENE_FONT_ATLAS
   void renderText(const char *text, uint32_t size, float x, float y, 
                   float sx, float sy, 
@@ -287,7 +412,8 @@ public:
   virtual void init() {}
   bool isFontLoaded() { return mInitialized;}
 
-	void setFontData(const FT_Byte*  fontData, FT_Long size, const char* n);
+	// takes ownership of fontData, which must be allocated with new[]
+	void setFontData(char* fontData, FT_Long size, const char* n);
 	virtual void setupResource();
   void clearDownloadedData();
   uint32_t getFontId() { return mFontId;}
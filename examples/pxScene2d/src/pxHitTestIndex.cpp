@@ -0,0 +1,332 @@
+/*
+
+ pxCore Copyright 2005-2018 John Robinson
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+// pxHitTestIndex.cpp
+
+#include "pxHitTestIndex.h"
+
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+
+#include "pxScene2d.h"
+
+using namespace std;
+
+pxHitTestIndex::pxHitTestIndex(): mNodes(), mInverses(), mAreas(), mCells(), mLarge(), mValid(false),
+  mRebuilds(0), mUpdates(0)
+{
+}
+
+bool pxHitTestIndex::hitTest(pxObject* root, pxPoint2f& pt, rtRef<pxObject>& hit, pxPoint2f& hitPt)
+{
+  if (!root)
+  {
+    return false;
+  }
+
+  if (!mValid || mNodes.empty() || mNodes[0].object != root)
+  {
+    pxMatrix4f m;
+    size_t index = 0;
+    if (mNodes.empty() || !update(root, m, false, index) || index != mNodes.size())
+    {
+      rebuild(root);
+    }
+    mValid = true;
+  }
+
+  static const vector<uint32_t> noNodes;
+  const vector<uint32_t>* cell = &noNodes;
+  if (std::fabs(pt.x) < 1e9 && std::fabs(pt.y) < 1e9)
+  {
+    unordered_map<uint64_t, vector<uint32_t> >::const_iterator it =
+      mCells.find(cellKey((int32_t)std::floor(pt.x / PX_HIT_TEST_CELL_SIZE),
+                          (int32_t)std::floor(pt.y / PX_HIT_TEST_CELL_SIZE)));
+    if (it != mCells.end())
+    {
+      cell = &it->second;
+    }
+  }
+
+  // both lists are in hit test order, the first object hit wins
+  vector<uint32_t>::const_iterator c = cell->begin(), l = mLarge.begin();
+  while (c != cell->end() || l != mLarge.end())
+  {
+    uint32_t i;
+    if (l == mLarge.end() || (c != cell->end() && mAreas[*c].order < mAreas[*l].order))
+    {
+      i = *c++;
+    }
+    else
+    {
+      i = *l++;
+    }
+
+    pxObject* o = mNodes[i].object;
+    pxVector4f v(pt.x, pt.y, 0, 1);
+    v = mInverses[i].multiply(v);
+    pxPoint2f newPt;
+    newPt.x = v.x();
+    newPt.y = v.y();
+    if (o->mInteractive && o->hitTest(newPt))
+    {
+      hit = o;
+      hitPt = newPt;
+      return true;
+    }
+  }
+  return false;
+}
+
+void pxHitTestIndex::clear()
+{
+  mValid = false;
+  mNodes.clear();
+  mInverses.clear();
+  mAreas.clear();
+  mCells.clear();
+  mLarge.clear();
+}
+
+void pxHitTestIndex::rebuild(pxObject* root)
+{
+  clear();
+  mRebuilds++;
+
+  pxMatrix4f m;
+  uint32_t order = 0;
+  build(root, m, order);
+
+  // appending in hit test order keeps the lists sorted
+  vector<uint32_t> byOrder(mNodes.size());
+  for (uint32_t i = 0; i < mNodes.size(); i++)
+  {
+    byOrder[mAreas[i].order] = i;
+  }
+  for (size_t i = 0; i < byOrder.size(); i++)
+  {
+    uint32_t index = byOrder[i];
+    computeArea(index);
+    area& a = mAreas[index];
+    if (a.large)
+    {
+      mLarge.push_back(index);
+      continue;
+    }
+    for (int32_t y = a.top; y <= a.bottom; y++)
+    {
+      for (int32_t x = a.left; x <= a.right; x++)
+      {
+        mCells[cellKey(x, y)].push_back(index);
+      }
+    }
+  }
+}
+
+void pxHitTestIndex::build(pxObject* o, pxMatrix4f& parentInverse, uint32_t& order)
+{
+  size_t i = mNodes.size();
+  mNodes.push_back(node());
+  mInverses.push_back(pxMatrix4f());
+  mAreas.push_back(area());
+  mNodes[i].object = o;
+  mNodes[i].childCount = (uint32_t)o->mChildren.size();
+  getInputs(o, mNodes[i].inputs);
+  computeInverse(o, parentInverse, mInverses[i]);
+
+  // children are hit before their parent, the last child first
+  pxMatrix4f inverse = mInverses[i];
+  for (vector<rtRef<pxObject> >::reverse_iterator it = o->mChildren.rbegin(); it != o->mChildren.rend(); ++it)
+  {
+    build(*it, inverse, order);
+  }
+  mAreas[i].order = order++;
+}
+
+bool pxHitTestIndex::update(pxObject* o, pxMatrix4f& parentInverse, bool parentMoved, size_t& index)
+{
+  if (index >= mNodes.size())
+  {
+    return false;
+  }
+  uint32_t i = (uint32_t)index++;
+  node& n = mNodes[i];
+  if (n.object != o || n.childCount != o->mChildren.size())
+  {
+    return false;
+  }
+
+  float inputs[kInputCount];
+  getInputs(o, inputs);
+  bool moved = parentMoved || memcmp(inputs, n.inputs, sizeof(inputs)) != 0;
+  if (moved)
+  {
+    memcpy(n.inputs, inputs, sizeof(inputs));
+    computeInverse(o, parentInverse, mInverses[i]);
+    remove(i);
+    computeArea(i);
+    insert(i);
+    mUpdates++;
+  }
+
+  for (vector<rtRef<pxObject> >::reverse_iterator it = o->mChildren.rbegin(); it != o->mChildren.rend(); ++it)
+  {
+    if (!update(*it, mInverses[i], moved, index))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+void pxHitTestIndex::getInputs(pxObject* o, float* inputs)
+{
+  inputs[kX] = o->mx;
+  inputs[kY] = o->my;
+  inputs[kW] = o->mw;
+  inputs[kH] = o->mh;
+  inputs[kPX] = o->mpx;
+  inputs[kPY] = o->mpy;
+  inputs[kCX] = o->mcx;
+  inputs[kCY] = o->mcy;
+  inputs[kR] = o->mr;
+  inputs[kSX] = o->msx;
+  inputs[kSY] = o->msy;
+#ifdef ANIMATION_ROTATE_XYZ
+  inputs[kRX] = o->mrx;
+  inputs[kRY] = o->mry;
+  inputs[kRZ] = o->mrz;
+#endif // ANIMATION_ROTATE_XYZ
+}
+
+void pxHitTestIndex::computeInverse(pxObject* o, pxMatrix4f& parentInverse, pxMatrix4f& inverse)
+{
+  // as in pxObject::hitTestInternal
+  inverse.identity();
+  o->applyMatrix(inverse);
+  inverse.invert();
+  inverse.multiply(parentInverse);
+}
+
+void pxHitTestIndex::computeArea(uint32_t index)
+{
+  // hit tests only use x and y of the point mapped by the inverse, so the
+  // scene area that maps into (0, 0, w, h) is the inverse of that 2d map
+  // applied to the corners
+  float* m = mInverses[index].data();
+  float det = m[0] * m[5] - m[4] * m[1];
+  float w = mNodes[index].inputs[kW];
+  float h = mNodes[index].inputs[kH];
+  area& a = mAreas[index];
+  a.large = true;
+  if (det == 0 || !std::isfinite(det))
+  {
+    return;
+  }
+
+  float cx[4] = {0, w, 0, w};
+  float cy[4] = {0, 0, h, h};
+  float left = 0, top = 0, right = 0, bottom = 0;
+  for (int i = 0; i < 4; i++)
+  {
+    float qx = cx[i] - m[12];
+    float qy = cy[i] - m[13];
+    float x = (m[5] * qx - m[4] * qy) / det;
+    float y = (m[0] * qy - m[1] * qx) / det;
+    if (i == 0 || x < left) left = x;
+    if (i == 0 || x > right) right = x;
+    if (i == 0 || y < top) top = y;
+    if (i == 0 || y > bottom) bottom = y;
+  }
+
+  // a scene unit of slack for rounding
+  left = std::floor((left - 1) / PX_HIT_TEST_CELL_SIZE);
+  top = std::floor((top - 1) / PX_HIT_TEST_CELL_SIZE);
+  right = std::floor((right + 1) / PX_HIT_TEST_CELL_SIZE);
+  bottom = std::floor((bottom + 1) / PX_HIT_TEST_CELL_SIZE);
+  if (!(std::fabs(left) < 1e7 && std::fabs(top) < 1e7 && std::fabs(right) < 1e7 && std::fabs(bottom) < 1e7) ||
+      (right - left + 1) * (bottom - top + 1) > PX_HIT_TEST_MAX_CELLS)
+  {
+    return;
+  }
+  a.left = (int32_t)left;
+  a.top = (int32_t)top;
+  a.right = (int32_t)right;
+  a.bottom = (int32_t)bottom;
+  a.large = false;
+}
+
+void pxHitTestIndex::insert(uint32_t index)
+{
+  area& a = mAreas[index];
+  if (a.large)
+  {
+    insertSorted(mLarge, index);
+    return;
+  }
+  for (int32_t y = a.top; y <= a.bottom; y++)
+  {
+    for (int32_t x = a.left; x <= a.right; x++)
+    {
+      insertSorted(mCells[cellKey(x, y)], index);
+    }
+  }
+}
+
+void pxHitTestIndex::remove(uint32_t index)
+{
+  area& a = mAreas[index];
+  if (a.large)
+  {
+    mLarge.erase(std::remove(mLarge.begin(), mLarge.end(), index), mLarge.end());
+    return;
+  }
+  for (int32_t y = a.top; y <= a.bottom; y++)
+  {
+    for (int32_t x = a.left; x <= a.right; x++)
+    {
+      unordered_map<uint64_t, vector<uint32_t> >::iterator it = mCells.find(cellKey(x, y));
+      if (it == mCells.end())
+      {
+        continue;
+      }
+      it->second.erase(std::remove(it->second.begin(), it->second.end(), index), it->second.end());
+      if (it->second.empty())
+      {
+        mCells.erase(it);
+      }
+    }
+  }
+}
+
+void pxHitTestIndex::insertSorted(vector<uint32_t>& v, uint32_t index)
+{
+  uint32_t order = mAreas[index].order;
+  vector<uint32_t>::iterator it = v.begin();
+  while (it != v.end() && mAreas[*it].order < order)
+  {
+    ++it;
+  }
+  v.insert(it, index);
+}
+
+uint64_t pxHitTestIndex::cellKey(int32_t x, int32_t y)
+{
+  return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+}
@@ -0,0 +1,122 @@
+/*
+
+ pxCore Copyright 2005-2018 John Robinson
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+// pxHitTestIndex.h
+
+#ifndef PX_HIT_TEST_INDEX_H
+#define PX_HIT_TEST_INDEX_H
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include "rtRef.h"
+#include "pxObject.h"
+
+// scene units covered by a grid cell
+#define PX_HIT_TEST_CELL_SIZE 64
+// objects covering more cells than this are tested for every point
+#define PX_HIT_TEST_MAX_CELLS 256
+
+// Finds the object under a point the way pxObject::hitTestInternal does,
+// without transforming the point into every object of the scene.
+//
+// The index keeps the scene to object matrix of every object and a grid of
+// the scene areas the objects cover, so only the objects whose area is under
+// the point are tested precisely.  Once invalidated, the next hit test walks
+// the tree and compares each object's position, size and transform with the
+// ones it was indexed with.  Objects that changed are updated in place, the
+// whole index is rebuilt if objects were added, removed or reordered.  The
+// scene invalidates the index whenever it gets dirty, so hit tests on a scene
+// that isn't changing don't look at the tree at all.  Like the default
+// pxObject::hitTest the index assumes objects are only hit within
+// (0, 0, w, h).
+class pxHitTestIndex
+{
+public:
+  pxHitTestIndex();
+
+  // same result as root->hitTestInternal() with an identity matrix
+  bool hitTest(pxObject* root, pxPoint2f& pt, rtRef<pxObject>& hit, pxPoint2f& hitPt);
+  void clear();
+  // objects may have changed, they're compared before the next hit test
+  void invalidate() { mValid = false; }
+
+  size_t count() const { return mNodes.size(); }
+  // times the index was built from scratch and objects updated in place
+  uint32_t rebuilds() const { return mRebuilds; }
+  uint32_t updates() const { return mUpdates; }
+
+private:
+  enum
+  {
+    kX, kY, kW, kH, kPX, kPY, kCX, kCY, kR, kSX, kSY,
+#ifdef ANIMATION_ROTATE_XYZ
+    kRX, kRY, kRZ,
+#endif // ANIMATION_ROTATE_XYZ
+    kInputCount
+  };
+
+  // what's compared for every object when the index is validated
+  struct node
+  {
+    // only compared with the objects in the tree, never dereferenced
+    pxObject* object;
+    uint32_t childCount;
+    float inputs[kInputCount];
+  };
+
+  // where the object is in the grid
+  struct area
+  {
+    // position in hit test order, lower orders are tested first
+    uint32_t order;
+    // cells covered, inclusive, unused for large nodes
+    int32_t left, top, right, bottom;
+    bool large;
+  };
+
+  void rebuild(pxObject* root);
+  void build(pxObject* o, pxMatrix4f& parentInverse, uint32_t& order);
+  // false if the tree under o isn't the one indexed
+  bool update(pxObject* o, pxMatrix4f& parentInverse, bool parentMoved, size_t& index);
+
+  static void getInputs(pxObject* o, float* inputs);
+  static void computeInverse(pxObject* o, pxMatrix4f& parentInverse, pxMatrix4f& inverse);
+  void computeArea(uint32_t index);
+
+  void insert(uint32_t index);
+  void remove(uint32_t index);
+  void insertSorted(std::vector<uint32_t>& v, uint32_t index);
+  static uint64_t cellKey(int32_t x, int32_t y);
+
+  // pre-order, an object before its children in reverse order
+  std::vector<node> mNodes;
+  // by node, maps scene coordinates to object coordinates
+  std::vector<pxMatrix4f> mInverses;
+  std::vector<area> mAreas;
+  // nodes by cell, each list sorted by order
+  std::unordered_map<uint64_t, std::vector<uint32_t> > mCells;
+  // nodes covering too many cells or unbounded, sorted by order
+  std::vector<uint32_t> mLarge;
+  bool mValid;
+  uint32_t mRebuilds;
+  uint32_t mUpdates;
+};
+
+#endif // PX_HIT_TEST_INDEX_H
@@ -203,7 +203,7 @@ void pxImage::createNewPromise()
 
 bool pxImage::needsUpdate()
 {
-  if ((mParent != NULL && mAnimations.size() > 0) || (imageLoaded && !((rtPromise*)mReady.getPtr())->status()))
+  if ((mParent != NULL && hasUnbatchedAnimations()) || (imageLoaded && !((rtPromise*)mReady.getPtr())->status()))
   {
     return true;
   }
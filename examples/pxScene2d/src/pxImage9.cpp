@@ -163,7 +163,7 @@ void pxImage9::createNewPromise()
 
 bool pxImage9::needsUpdate()
 {
-  if ((mParent != NULL && mAnimations.size() > 0) || (imageLoaded && !((rtPromise*)mReady.getPtr())->status()))
+  if ((mParent != NULL && hasUnbatchedAnimations()) || (imageLoaded && !((rtPromise*)mReady.getPtr())->status()))
   {
     return true;
   }
@@ -78,6 +78,11 @@ public:
   
 protected:
   virtual void draw();
+  virtual bool drawBounds(float& x, float& y, float& w, float& h)
+  {
+    x = 0; y = 0; w = getOnscreenWidth(); h = getOnscreenHeight();
+    return true;
+  }
   void loadImage(rtString Url);
   inline rtImageResource* getImageResource() const { return (rtImageResource*)mResource.getPtr(); }
   
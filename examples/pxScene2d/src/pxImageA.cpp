@@ -20,18 +20,256 @@
 
 #include "pxImageA.h"
 #include "pxContext.h"
+#include "rtThreadPool.h"
+#include "rtThreadTask.h"
+#include "rtMutex.h"
+#include "rtAtomic.h"
 #include <algorithm>
+#include <deque>
 
 extern pxContext context;
 
 //TODO UGH!!
 static pxTextureRef nullMaskRef;
 
+// frames decoded ahead of the one being shown
+#define PX_IMAGEA_DECODE_AHEAD_FRAMES 3
+
+#define PX_IMAGEA_NO_FRAME UINT32_MAX
+
+// Decodes the frames of an animated image on the thread pool a few frames
+// ahead of playback.  A decoded frame only holds the area that changed from
+// the frame before it, except after a seek, which produces the whole frame.
+// The decoder is reference counted so a decode task that runs after the
+// image let go of it never touches the frame sequence.
+class pxImageAFrameDecoder
+{
+public:
+  struct frame
+  {
+    frame(): mFrameNum(0), mFull(false), mX(0), mY(0), mW(0), mH(0), mPixels() {}
+
+    uint32_t mFrameNum;
+    bool mFull;
+    int32_t mX, mY, mW, mH;
+    pxOffscreen mPixels;
+  };
+
+  pxImageAFrameDecoder(pxTimedOffscreenSequence* sequence)
+    : mRefCount(1), mDecodeMutex(), mSequence(sequence), mFrame(), mDecodedFrame(PX_IMAGEA_NO_FRAME),
+      mQueueMutex(), mReady(), mFree(), mGeneration(0), mSeekFrame(PX_IMAGEA_NO_FRAME), mDecodeScheduled(false)
+  {
+  }
+
+  ~pxImageAFrameDecoder()
+  {
+    for (std::deque<frame*>::iterator it = mReady.begin(); it != mReady.end(); ++it)
+    {
+      delete *it;
+    }
+    for (std::vector<frame*>::iterator it = mFree.begin(); it != mFree.end(); ++it)
+    {
+      delete *it;
+    }
+  }
+
+  void AddRef()
+  {
+    rtAtomicInc(&mRefCount);
+  }
+
+  void Release()
+  {
+    if (rtAtomicDec(&mRefCount) == 0)
+    {
+      delete this;
+    }
+  }
+
+  // drops the frames decoded so far and continues with the whole frame frameNum
+  void seek(uint32_t frameNum)
+  {
+    rtMutexLockGuard queueGuard(mQueueMutex);
+    mGeneration++;
+    mFree.insert(mFree.end(), mReady.begin(), mReady.end());
+    mReady.clear();
+    mSeekFrame = frameNum;
+    scheduleDecode();
+  }
+
+  // the next decoded frame, NULL while it isn't ready yet
+  frame* frontFrame()
+  {
+    rtMutexLockGuard queueGuard(mQueueMutex);
+    return mReady.empty() ? NULL : mReady.front();
+  }
+
+  void popFrame()
+  {
+    rtMutexLockGuard queueGuard(mQueueMutex);
+    if (!mReady.empty())
+    {
+      mFree.push_back(mReady.front());
+      mReady.pop_front();
+    }
+    scheduleDecode();
+  }
+
+  // waits for a running decode task and lets go of the sequence
+  void detach()
+  {
+    rtMutexLockGuard decodeGuard(mDecodeMutex);
+    rtMutexLockGuard queueGuard(mQueueMutex);
+    mSequence = NULL;
+    mFrame.term();
+  }
+
+private:
+  static void decodeTask(void* data)
+  {
+    pxImageAFrameDecoder* decoder = (pxImageAFrameDecoder*)data;
+    decoder->decodeAhead();
+    decoder->Release();
+  }
+
+  // called with mQueueMutex held
+  void scheduleDecode()
+  {
+    if (!mDecodeScheduled && mSequence != NULL && mReady.size() < PX_IMAGEA_DECODE_AHEAD_FRAMES)
+    {
+      mDecodeScheduled = true;
+      AddRef();
+      rtThreadPool::globalInstance()->executeTask(new rtThreadTask(pxImageAFrameDecoder::decodeTask, this, "",
+                                                                   RT_THREAD_TASK_PRIORITY_VISIBLE));
+    }
+  }
+
+  void decodeAhead()
+  {
+    rtMutexLockGuard decodeGuard(mDecodeMutex);
+    for (;;)
+    {
+      mQueueMutex.lock();
+      if (mSequence == NULL || mReady.size() >= PX_IMAGEA_DECODE_AHEAD_FRAMES)
+      {
+        mDecodeScheduled = false;
+        mQueueMutex.unlock();
+        return;
+      }
+      uint32_t generation = mGeneration;
+      uint32_t seekFrame = mSeekFrame;
+      frame* f = NULL;
+      if (mFree.empty())
+      {
+        f = new frame();
+      }
+      else
+      {
+        f = mFree.back();
+        mFree.pop_back();
+      }
+      mQueueMutex.unlock();
+
+      bool decoded = decodeFrame(f, seekFrame);
+
+      mQueueMutex.lock();
+      if (decoded && generation == mGeneration)
+      {
+        mReady.push_back(f);
+        mSeekFrame = PX_IMAGEA_NO_FRAME;
+      }
+      else
+      {
+        mFree.push_back(f);
+      }
+      if (!decoded)
+      {
+        mDecodeScheduled = false;
+        mQueueMutex.unlock();
+        return;
+      }
+      mQueueMutex.unlock();
+    }
+  }
+
+  bool decodeFrame(frame* f, uint32_t seekFrame)
+  {
+    uint32_t numFrames = mSequence->numFrames();
+    if (numFrames == 0)
+    {
+      return false;
+    }
+
+    pxRect r;
+    if (seekFrame != PX_IMAGEA_NO_FRAME)
+    {
+      seekFrame %= numFrames;
+      uint32_t frameNum = (mDecodedFrame != PX_IMAGEA_NO_FRAME && mDecodedFrame <= seekFrame) ? mDecodedFrame + 1 : 0;
+      for (; frameNum <= seekFrame; frameNum++)
+      {
+        if (mSequence->applyFrame(frameNum, mFrame, r) != RT_OK)
+        {
+          mDecodedFrame = PX_IMAGEA_NO_FRAME;
+          return false;
+        }
+      }
+      mDecodedFrame = seekFrame;
+      r.setLTRB(0, 0, mFrame.width(), mFrame.height());
+      f->mFull = true;
+    }
+    else
+    {
+      uint32_t frameNum = (mDecodedFrame + 1) % numFrames;
+      if (mSequence->applyFrame(frameNum, mFrame, r) != RT_OK)
+      {
+        mDecodedFrame = PX_IMAGEA_NO_FRAME;
+        return false;
+      }
+      mDecodedFrame = frameNum;
+      f->mFull = false;
+    }
+
+    f->mFrameNum = mDecodedFrame;
+    f->mX = r.left();
+    f->mY = r.top();
+    f->mW = r.width();
+    f->mH = r.height();
+    if (f->mW > 0 && f->mH > 0)
+    {
+      if (f->mPixels.base() == NULL || f->mPixels.width() != f->mW || f->mPixels.height() != f->mH)
+      {
+        f->mPixels.init(f->mW, f->mH);
+      }
+      for (int32_t y = 0; y < f->mH; y++)
+      {
+        memcpy(f->mPixels.scanlineInt32(y), mFrame.scanlineInt32(f->mY + y) + f->mX, f->mW * 4);
+      }
+    }
+    return true;
+  }
+
+  rtAtomic mRefCount;
+
+  // owned by the decode task
+  rtMutex mDecodeMutex;
+  pxTimedOffscreenSequence* mSequence;
+  pxOffscreen mFrame;
+  uint32_t mDecodedFrame;
+
+  rtMutex mQueueMutex;
+  std::deque<frame*> mReady;
+  std::vector<frame*> mFree;
+  uint32_t mGeneration;
+  uint32_t mSeekFrame;
+  bool mDecodeScheduled;
+};
+
 pxImageA::pxImageA(pxScene2d *scene) : pxObject(scene), 
                                        mImageWidth(0), mImageHeight(0),
                                        mStretchX(pxConstantsStretch::NONE), mStretchY(pxConstantsStretch::NONE),
                                        mResource(), mImageLoaded(false), mListenerAdded(false)
 {
+  mFrameDecoder = NULL;
   mCurFrame = 0;
   mCachedFrame = UINT32_MAX;
   mFrameTime = -1;
@@ -41,6 +279,7 @@ pxImageA::pxImageA(pxScene2d *scene) : pxObject(scene),
 
 pxImageA::~pxImageA()
 {
+  releaseFrameDecoder();
   removeResourceListener();
   mResource = NULL;
 }
@@ -88,6 +327,7 @@ rtError pxImageA::setUrl(const char *s)
     }
   }
   removeResourceListener();
+  releaseFrameDecoder();
   mResource = pxImageManager::getImageA(s, NULL, mScene ? mScene->cors() : NULL, mScene ? mScene->getArchive(): NULL);
 
   if(getImageAResource() != NULL && getImageAResource()->getUrl().length() > 0 && !mImageLoaded) {
@@ -139,17 +379,63 @@ void pxImageA::update(double t, bool updateChildren)
 
     if (mCachedFrame != mCurFrame)
     {
-      pxOffscreen &o = imageSequence.getFrameBuffer(mCurFrame);
-      mTexture = context.createTexture(o);
-      mCachedFrame = mCurFrame;
-      pxRect r(0, 0, mImageHeight, mImageWidth);
-      mScene->invalidateRect(&r);
-      markDirty();
+      updateFrameTexture(imageSequence);
     }
   }
   pxObject::update(t, updateChildren);
 }
 
+// Catches the texture up with mCurFrame using the frames decoded so far,
+// playback lags behind when decoding can't keep up
+void pxImageA::updateFrameTexture(pxTimedOffscreenSequence& imageSequence)
+{
+  if (mFrameDecoder == NULL)
+  {
+    mFrameDecoder = new pxImageAFrameDecoder(&imageSequence);
+    mFrameDecoder->seek(mCurFrame);
+  }
+
+  bool frameChanged = false;
+  pxImageAFrameDecoder::frame* f = NULL;
+  while (mCachedFrame != mCurFrame && (f = mFrameDecoder->frontFrame()) != NULL)
+  {
+    if (f->mFull)
+    {
+      mTexture = context.createTexture(f->mPixels);
+    }
+    else if (f->mW > 0 && f->mH > 0 &&
+             (mTexture.getPtr() == NULL ||
+              mTexture->updateTexture(f->mX, f->mY, f->mW, f->mH, f->mPixels.base()) != PX_OK))
+    {
+      // the texture was ejected or can't be updated in place
+      mFrameDecoder->seek(mCurFrame);
+      break;
+    }
+    mCachedFrame = f->mFrameNum;
+    mFrameDecoder->popFrame();
+    frameChanged = true;
+  }
+
+  if (frameChanged)
+  {
+    pxRect r(0, 0, mImageHeight, mImageWidth);
+    mScene->invalidateRect(&r);
+    markDirty();
+    // snapshots and layers that hold the old frame
+    repaintParents();
+  }
+}
+
+void pxImageA::releaseFrameDecoder()
+{
+  if (mFrameDecoder != NULL)
+  {
+    mFrameDecoder->detach();
+    mFrameDecoder->Release();
+    mFrameDecoder = NULL;
+  }
+}
+
 void pxImageA::draw()
 {
   if (getImageAResource() != NULL && mImageLoaded && !mSceneSuspended)
@@ -173,6 +459,8 @@ void pxImageA::dispose(bool pumpJavascript)
     mResource = NULL;
     mListenerAdded = false;
   }
+  releaseFrameDecoder();
+  mTexture = NULL;
   pxObject::dispose(pumpJavascript);
 }
 
@@ -236,6 +524,7 @@ rtError pxImageA::setResource(rtObjectRef o)
     if( getImageAResource() != NULL && getImageAResource()->getUrl().compare(o.get<rtString>("url")) )
     {
       removeResourceListener();
+      releaseFrameDecoder();
       mResource = o;
       mImageLoaded = false;
       createNewPromise();
@@ -261,9 +550,8 @@ void pxImageA::loadImageSequence()
     pxTimedOffscreenSequence& imageSequence = getImageAResource()->getTimedOffscreenSequence();
     if (imageSequence.numFrames() > 0)
     {
-      pxOffscreen &o = imageSequence.getFrameBuffer(0);
-      mImageWidth = o.width();
-      mImageHeight = o.height();
+      mImageWidth = imageSequence.width();
+      mImageHeight = imageSequence.height();
       mw = static_cast<float>(mImageWidth);
       mh = static_cast<float>(mImageHeight);
     }
@@ -344,6 +632,9 @@ rtError pxImageA::removeResourceListener()
 
 void pxImageA::releaseData(bool sceneSuspended)
 {
+  releaseFrameDecoder();
+  mTexture = NULL;
+  mCachedFrame = UINT32_MAX;
   pxObject::releaseData(sceneSuspended);
 }
 
@@ -26,6 +26,8 @@
 #include "pxUtil.h"
 #include "pxResource.h"
 
+class pxImageAFrameDecoder;
+
 class pxImageA: public pxObject, pxResourceListener
 {
 public:
@@ -58,6 +60,11 @@ public:
 
   virtual void update(double t, bool updateChildren=true);
   virtual void draw();
+  virtual bool drawBounds(float& x, float& y, float& w, float& h)
+  {
+    x = 0; y = 0; w = mw; h = mh;
+    return true;
+  }
   virtual void dispose(bool pumpJavascript);
 
   virtual void releaseData(bool sceneSuspended);
@@ -70,6 +77,8 @@ protected:
 
   void sendPromise() {} // shortcircuit  TODO...not sure if I like this pattern
   void loadImageSequence();
+  void updateFrameTexture(pxTimedOffscreenSequence& imageSequence);
+  void releaseFrameDecoder();
 
   uint32_t mCurFrame;
   uint32_t mCachedFrame;
@@ -79,6 +88,7 @@ protected:
   uint32_t mImageHeight;
 
   pxTextureRef mTexture;
+  pxImageAFrameDecoder* mFrameDecoder;
 
   double mFrameTime;
   pxConstantsStretch::constants mStretchX;
@@ -0,0 +1,272 @@
+/*
+
+ pxCore Copyright 2005-2018 John Robinson
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+// pxImageCache.cpp
+
+#include "pxImageCache.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "rtLog.h"
+
+pxImageCache* pxImageCache::mInstance = NULL;
+
+pxImageCache::pxImageCache(): mMutex(), mEntries(), mLru(), mMaxSize(PX_IMAGE_CACHE_DEFAULT_SIZE_IN_BYTES),
+  mSize(0), mCompressionEnabled(false), mHits(0), mMisses(0)
+{
+  char const* s = getenv("SPARK_IMAGE_CACHE_SIZE_MB");
+  if (s)
+  {
+    mMaxSize = (int64_t)atoi(s) * 1024 * 1024;
+  }
+  s = getenv("SPARK_IMAGE_CACHE_COMPRESSION");
+  if (s)
+  {
+    mCompressionEnabled = atoi(s) > 0;
+  }
+}
+
+pxImageCache* pxImageCache::instance()
+{
+  if (NULL == mInstance)
+  {
+    mInstance = new pxImageCache();
+  }
+  return mInstance;
+}
+
+void pxImageCache::destroy()
+{
+  delete mInstance;
+  mInstance = NULL;
+}
+
+void pxImageCache::add(const rtString& key, const pxOffscreen& image)
+{
+  if (key.isEmpty() || image.width() <= 0 || image.height() <= 0)
+  {
+    return;
+  }
+  int64_t imageSize = (int64_t)image.width() * image.height() * 4;
+
+  bool compressionEnabled;
+  {
+    rtMutexLockGuard lock(mMutex);
+    if (imageSize > mMaxSize)
+    {
+      std::map<std::string, entry>::iterator it = mEntries.find(key.cString());
+      if (it != mEntries.end())
+      {
+        removeEntry(it);
+      }
+      return;
+    }
+    compressionEnabled = mCompressionEnabled;
+  }
+
+  // copy and deflate the pixels without holding the lock
+  std::vector<uint8_t> pixels(imageSize);
+  for (int32_t y = 0; y < image.height(); y++)
+  {
+    memcpy(&pixels[(size_t)y * image.width() * 4], image.scanlineInt32(y), image.width() * 4);
+  }
+  std::vector<uint8_t> compressed;
+  bool isCompressed = compressionEnabled && compress(pixels, compressed);
+  if (isCompressed)
+  {
+    pixels.swap(compressed);
+  }
+
+  rtMutexLockGuard lock(mMutex);
+  std::map<std::string, entry>::iterator it = mEntries.find(key.cString());
+  if (it != mEntries.end())
+  {
+    removeEntry(it);
+  }
+  if (imageSize > mMaxSize)
+  {
+    return;
+  }
+
+  entry& e = mEntries[key.cString()];
+  e.width = image.width();
+  e.height = image.height();
+  e.compressed = isCompressed;
+  e.data.swap(pixels);
+  e.lru = mLru.insert(mLru.end(), key.cString());
+  mSize += e.data.size();
+  evict(mMaxSize);
+}
+
+bool pxImageCache::get(const rtString& key, pxOffscreen& image)
+{
+  rtMutexLockGuard lock(mMutex);
+  std::map<std::string, entry>::iterator it = mEntries.find(key.cString());
+  if (it == mEntries.end())
+  {
+    if (mMaxSize > 0 && !key.isEmpty())
+    {
+      mMisses++;
+    }
+    return false;
+  }
+  mHits++;
+
+  entry& e = it->second;
+  mLru.splice(mLru.end(), mLru, e.lru);
+  image.init(e.width, e.height);
+  image.setUpsideDown(false);
+  if (e.compressed)
+  {
+    if (!decompress(e.data, image))
+    {
+      rtLogError("corrupt cached image %s", key.cString());
+      removeEntry(it);
+      return false;
+    }
+  }
+  else
+  {
+    for (int32_t y = 0; y < e.height; y++)
+    {
+      memcpy(image.scanlineInt32(y), &e.data[(size_t)y * e.width * 4], e.width * 4);
+    }
+  }
+  return true;
+}
+
+void pxImageCache::remove(const rtString& key)
+{
+  rtMutexLockGuard lock(mMutex);
+  std::map<std::string, entry>::iterator it = mEntries.find(key.cString());
+  if (it != mEntries.end())
+  {
+    removeEntry(it);
+  }
+}
+
+void pxImageCache::clear()
+{
+  rtMutexLockGuard lock(mMutex);
+  mEntries.clear();
+  mLru.clear();
+  mSize = 0;
+}
+
+void pxImageCache::setMaxSize(int64_t bytes)
+{
+  rtMutexLockGuard lock(mMutex);
+  mMaxSize = bytes > 0 ? bytes : 0;
+  evict(mMaxSize);
+}
+
+int64_t pxImageCache::maxSize()
+{
+  rtMutexLockGuard lock(mMutex);
+  return mMaxSize;
+}
+
+void pxImageCache::setCompressionEnabled(bool enabled)
+{
+  rtMutexLockGuard lock(mMutex);
+  mCompressionEnabled = enabled;
+}
+
+int64_t pxImageCache::size()
+{
+  rtMutexLockGuard lock(mMutex);
+  return mSize;
+}
+
+size_t pxImageCache::count()
+{
+  rtMutexLockGuard lock(mMutex);
+  return mEntries.size();
+}
+
+uint32_t pxImageCache::hits()
+{
+  rtMutexLockGuard lock(mMutex);
+  return mHits;
+}
+
+uint32_t pxImageCache::misses()
+{
+  rtMutexLockGuard lock(mMutex);
+  return mMisses;
+}
+
+void pxImageCache::removeEntry(std::map<std::string, entry>::iterator it)
+{
+  mSize -= it->second.data.size();
+  mLru.erase(it->second.lru);
+  mEntries.erase(it);
+}
+
+void pxImageCache::evict(int64_t maxSize)
+{
+  while (mSize > maxSize && !mLru.empty())
+  {
+    removeEntry(mEntries.find(mLru.front()));
+  }
+}
+
+bool pxImageCache::compress(const std::vector<uint8_t>& pixels, std::vector<uint8_t>& compressed)
+{
+  uLongf compressedSize = compressBound(pixels.size());
+  compressed.resize(compressedSize);
+  if (compress2(&compressed[0], &compressedSize, &pixels[0], pixels.size(), Z_BEST_SPEED) != Z_OK ||
+      compressedSize > pixels.size() * 3 / 4)
+  {
+    compressed.clear();
+    return false;
+  }
+  compressed.resize(compressedSize);
+  std::vector<uint8_t>(compressed).swap(compressed);
+  return true;
+}
+
+bool pxImageCache::decompress(const std::vector<uint8_t>& compressed, pxOffscreen& image)
+{
+  // inflated a row at a time straight into the image
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (inflateInit(&stream) != Z_OK)
+  {
+    return false;
+  }
+  stream.next_in = (Bytef*)&compressed[0];
+  stream.avail_in = compressed.size();
+
+  bool result = true;
+  for (int32_t y = 0; y < image.height(); y++)
+  {
+    stream.next_out = (Bytef*)image.scanlineInt32(y);
+    stream.avail_out = image.width() * 4;
+    int status = inflate(&stream, Z_SYNC_FLUSH);
+    if (stream.avail_out != 0 || (status != Z_OK && status != Z_STREAM_END))
+    {
+      result = false;
+      break;
+    }
+  }
+  inflateEnd(&stream);
+  return result;
+}
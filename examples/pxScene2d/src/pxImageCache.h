@@ -0,0 +1,101 @@
+/*
+
+ pxCore Copyright 2005-2018 John Robinson
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+// pxImageCache.h
+
+#ifndef PX_IMAGE_CACHE_H
+#define PX_IMAGE_CACHE_H
+
+#include <stdint.h>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "pxOffscreen.h"
+#include "rtMutex.h"
+#include "rtString.h"
+
+#define PX_IMAGE_CACHE_DEFAULT_SIZE_IN_BYTES (32 * 1024 * 1024)
+
+// Decoded images kept in memory, keyed like pxImageManager's image map.
+//
+// rtImageResource adds every image it decodes and looks here before it
+// downloads, reads or decodes one, so an image that was released, or whose
+// texture was ejected, comes back without going to the network, the file
+// cache or the decoder.  The least recently used images are dropped once
+// the pixels held exceed the maximum size.  With compression enabled the
+// pixels are deflated like pxTimedOffscreenSequence's frames, which mostly
+// pays off for ui artwork with large flat or transparent areas.  All methods
+// may be called from any thread.
+class pxImageCache
+{
+public:
+  static pxImageCache* instance();
+  static void destroy();
+
+  // copies the image in, replacing an image already held under the key
+  void add(const rtString& key, const pxOffscreen& image);
+  // copies the image out, false if there is no image for the key
+  bool get(const rtString& key, pxOffscreen& image);
+  void remove(const rtString& key);
+  void clear();
+
+  // 0 disables the cache
+  void setMaxSize(int64_t bytes);
+  int64_t maxSize();
+  void setCompressionEnabled(bool enabled);
+
+  int64_t size();
+  size_t count();
+  uint32_t hits();
+  uint32_t misses();
+
+private:
+  pxImageCache();
+
+  struct entry
+  {
+    int32_t width;
+    int32_t height;
+    bool compressed;
+    std::vector<uint8_t> data;
+    std::list<std::string>::iterator lru;
+  };
+
+  void removeEntry(std::map<std::string, entry>::iterator it);
+  void evict(int64_t maxSize);
+
+  // false if that doesn't save a quarter of the pixels
+  static bool compress(const std::vector<uint8_t>& pixels, std::vector<uint8_t>& compressed);
+  static bool decompress(const std::vector<uint8_t>& compressed, pxOffscreen& image);
+
+  rtMutex mMutex;
+  std::map<std::string, entry> mEntries;
+  // the least recently used key at the front
+  std::list<std::string> mLru;
+  int64_t mMaxSize;
+  int64_t mSize;
+  bool mCompressionEnabled;
+  uint32_t mHits;
+  uint32_t mMisses;
+
+  static pxImageCache* mInstance;
+};
+
+#endif // PX_IMAGE_CACHE_H
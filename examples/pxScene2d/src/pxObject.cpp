@@ -23,6 +23,7 @@
 
 #include "pxContext.h"
 #include "pxAnimate.h"
+#include "pxAnimationEngine.h"
 #include "pxScene2d.h"
 
 #include "pxRectangle.h"
@@ -40,6 +41,16 @@ class pxObjectChildren; //fwd
 extern pxContext  context;
 extern rtScript   script;
 extern bool gDirtyRectsEnabled;
+extern bool gLayerCachingEnabled;
+extern uint32_t gLayerCachingFrames;
+extern uint32_t gFrameNumber;
+
+// a subtree is only worth a layer if it draws at least this many objects
+#define PX_LAYER_MIN_OBJECTS 4
+
+// true while a layer is being drawn, the objects in it don't get layers of
+// their own
+static bool gDrawingLayer = false;
 
 int pxObjectCount = 0;
 
@@ -120,6 +131,7 @@ pxObject::pxObject(pxScene2d* scene):
     mFocus(false),mClipSnapshotRef(),mCancelInSet(true),mRepaint(true)
     , mIsDirty(true), mRenderMatrix(), mLastRenderMatrix(), mScreenCoordinates(), mDirtyRect(), mScene(NULL)
     ,mDrawableSnapshotForMask(), mMaskSnapshot(), mIsDisposed(false), mSceneSuspended(false)
+    ,mLayerSnapshotRef(), mLayerX(0), mLayerY(0), mUnchangedSinceFrame(0)
   {
     pxObjectCount++;
     mScene = scene;
@@ -146,10 +158,13 @@ pxObject::~pxObject()
     clearSnapshot(mClipSnapshotRef);
     clearSnapshot(mDrawableSnapshotForMask);
     clearSnapshot(mMaskSnapshot);
+    clearSnapshot(mLayerSnapshotRef);
     mSnapshotRef = NULL;
     mClipSnapshotRef = NULL;
     mDrawableSnapshotForMask = NULL;
     mMaskSnapshot = NULL;
+    mLayerSnapshotRef = NULL;
+    clearAnimations();
     pxScene2d::updateObject(this, false);
 }
 
@@ -184,7 +199,7 @@ void pxObject::dispose(bool pumpJavascript)
 
     mReady.send("reject",nullValue);
 
-    mAnimations.clear();
+    clearAnimations();
     mEmit->clearListeners();
     for(vector<rtRef<pxObject> >::iterator it = mChildren.begin(); it != mChildren.end(); ++it)
     {
@@ -196,10 +211,12 @@ void pxObject::dispose(bool pumpJavascript)
     clearSnapshot(mClipSnapshotRef);
     clearSnapshot(mDrawableSnapshotForMask);
     clearSnapshot(mMaskSnapshot);
+    clearSnapshot(mLayerSnapshotRef);
     mSnapshotRef = NULL;
     mClipSnapshotRef = NULL;
     mDrawableSnapshotForMask = NULL;
     mMaskSnapshot = NULL;
+    mLayerSnapshotRef = NULL;
     if (mScene)
     {
       mScene->innerpxObjectDisposed(this);
@@ -390,6 +407,7 @@ void pxObject::setParent(rtRef<pxObject>& parent)
       parent->mChildren.push_back(this);
 
     markDirty();
+    repaintParents();
     if (mScene != NULL)
     {
       mScene->invalidateRect(NULL);
@@ -610,9 +628,9 @@ void pxObject::cancelAnimation(const char* prop, bool fastforward, bool rewind)
 
       // Fastforward or rewind, if specified
       if( fastforward)
-        set(prop, a.to);
+        setAnimatedValue(a, a.to);
       else if( rewind)
-        set(prop, a.from);
+        setAnimatedValue(a, a.from);
 
       // If animation was never-ending, promise was already resolved.
       // If not, send it now.
@@ -640,6 +658,13 @@ void pxObject::cancelAnimation(const char* prop, bool fastforward, bool rewind)
       }
 #endif
       a.cancelled = true;
+      if (a.engineId != 0)
+      {
+        // the record is erased by the next update()
+        pxAnimationEngine::instance()->remove(a.engineId);
+        a.engineId = 0;
+        triggerUpdate();
+      }
 
       if (NULL != pAnimateObj)
       {
@@ -663,6 +688,7 @@ void pxObject::animateToInternal(const char* prop, double to, double duration,
 
   a.cancelled = false;
   a.prop     = prop;
+  a.property = animatedProperty(prop);
   a.from     = get<float>(prop);
   a.to       = static_cast<float>(to);
   a.start    = -1;
@@ -675,8 +701,10 @@ void pxObject::animateToInternal(const char* prop, double to, double duration,
 //  a.ended = onEnd;
   a.promise = promise;
   a.animateObj = animateObj;
+  a.engineId = 0;
 
   mAnimations.push_back(a);
+  mAnimations.back().engineId = pxAnimationEngine::instance()->add(this, a);
   triggerUpdate();
 
   pxAnimate *animObj = (pxAnimate *)a.animateObj.getPtr();
@@ -696,6 +724,68 @@ void pxObject::animateToInternal(const char* prop, double to, double duration,
   }
 }
 
+pxAnimatedProperty pxObject::animatedProperty(const char* prop)
+{
+  static const struct
+  {
+    const char* name;
+    pxAnimatedProperty property;
+  } properties[] =
+  {
+    { "x",  PX_ANIMATED_PROPERTY_X  },
+    { "y",  PX_ANIMATED_PROPERTY_Y  },
+    { "w",  PX_ANIMATED_PROPERTY_W  },
+    { "h",  PX_ANIMATED_PROPERTY_H  },
+    { "sx", PX_ANIMATED_PROPERTY_SX },
+    { "sy", PX_ANIMATED_PROPERTY_SY },
+    { "a",  PX_ANIMATED_PROPERTY_A  },
+    { "r",  PX_ANIMATED_PROPERTY_R  },
+  };
+
+  for (size_t i = 0; i < sizeof(properties) / sizeof(properties[0]); i++)
+  {
+    if (strcmp(prop, properties[i].name) == 0)
+      return properties[i].property;
+  }
+  return PX_ANIMATED_PROPERTY_CUSTOM;
+}
+
+void pxObject::setAnimatedValue(const animation& a, float v)
+{
+  if (a.property == PX_ANIMATED_PROPERTY_CUSTOM)
+  {
+    set(a.prop, v);
+    return;
+  }
+  setAnimatedValue(a.property, v);
+}
+
+void pxObject::setAnimatedValue(pxAnimatedProperty property, float v)
+{
+  // what pxObject::Set does before calling the setter
+  markDirty();
+  if (property != PX_ANIMATED_PROPERTY_X && property != PX_ANIMATED_PROPERTY_Y &&
+      property != PX_ANIMATED_PROPERTY_A)
+  {
+    repaint();
+  }
+  repaintParents();
+  mScene->mDirty = true;
+
+  switch (property)
+  {
+    case PX_ANIMATED_PROPERTY_X:  setX(v);  break;
+    case PX_ANIMATED_PROPERTY_Y:  setY(v);  break;
+    case PX_ANIMATED_PROPERTY_W:  setW(v);  break;
+    case PX_ANIMATED_PROPERTY_H:  setH(v);  break;
+    case PX_ANIMATED_PROPERTY_SX: setSX(v); break;
+    case PX_ANIMATED_PROPERTY_SY: setSY(v); break;
+    case PX_ANIMATED_PROPERTY_A:  setA(v);  break;
+    case PX_ANIMATED_PROPERTY_R:  setR(v);  break;
+    default: break;
+  }
+}
+
 void pxObject::update(double t, bool updateChildren)
 {
 #ifdef DEBUG_SKIP_UPDATE
@@ -710,6 +800,17 @@ void pxObject::update(double t, bool updateChildren)
   {
     animation& a = (*it);
 
+    if (a.engineId != 0)
+    {
+      // already evaluated by the engine for this frame
+      if (pxAnimationEngine::instance()->wasApplied(a.engineId, t))
+      {
+        ++it;
+        continue;
+      }
+      a.start = pxAnimationEngine::instance()->start(a.engineId);
+    }
+
     pxAnimate *animObj = (pxAnimate *)a.animateObj.getPtr();
 
     if (a.start < 0) a.start = t;
@@ -732,7 +833,7 @@ void pxObject::update(double t, bool updateChildren)
 #else
       assert(mCancelInSet);
       mCancelInSet = false;
-      set(a.prop, a.to);
+      setAnimatedValue(a, a.to);
       mCancelInSet = true;
 
       if (a.count != pxConstantsAnimation::COUNT_FOREVER && a.actualCount >= a.count )
@@ -753,7 +854,7 @@ void pxObject::update(double t, bool updateChildren)
         {
           animObj->update(a.prop, &a, pxConstantsAnimation::STATUS_ENDED);
         }
-        it = mAnimations.erase(it);
+        it = eraseAnimation(it);
         continue;
       }
 #endif
@@ -767,7 +868,7 @@ void pxObject::update(double t, bool updateChildren)
         animObj->update(a.prop, &a, pxConstantsAnimation::STATUS_CANCELLED);
       }
 
-      it = mAnimations.erase(it);  // returns next element
+      it = eraseAnimation(it);  // returns next element
       continue;
     }
 
@@ -813,7 +914,7 @@ void pxObject::update(double t, bool updateChildren)
           if (true == justReverseChange)
           {
             mCancelInSet = false;
-            set(a.prop, toVal);
+            setAnimatedValue(a, static_cast<float>(toVal));
             mCancelInSet = true;
           }
 
@@ -828,7 +929,7 @@ void pxObject::update(double t, bool updateChildren)
           animObj->update(a.prop, &a, pxConstantsAnimation::STATUS_ENDED);
         }
 
-        it = mAnimations.erase(it);
+        it = eraseAnimation(it);
         continue;
       }
 
@@ -837,12 +938,16 @@ void pxObject::update(double t, bool updateChildren)
     float v = static_cast<float> (from + (to - from) * d);
     assert(mCancelInSet);
     mCancelInSet = false;
-    set(a.prop, v);
+    setAnimatedValue(a, v);
     mCancelInSet = true;
     if (NULL != animObj)
     {
       animObj->update(a.prop, &a, pxConstantsAnimation::STATUS_INPROGRESS);
     }
+    if (a.engineId != 0)
+    {
+      pxAnimationEngine::instance()->setStart(a.engineId, a.start);
+    }
     ++it;
   }
 
@@ -930,6 +1035,8 @@ void pxObject::releaseData(bool sceneSuspended)
   clearSnapshot(mClipSnapshotRef);
   clearSnapshot(mDrawableSnapshotForMask);
   clearSnapshot(mMaskSnapshot);
+  clearSnapshot(mLayerSnapshotRef);
+  mLayerSnapshotRef = NULL;
   mSceneSuspended = sceneSuspended;
   // Recursively suspend the children
   for(vector<rtRef<pxObject> >::iterator it = mChildren.begin(); it != mChildren.end(); ++it)
@@ -970,6 +1077,10 @@ uint64_t pxObject::textureMemoryUsage(std::vector<rtObject*> &objectsCounted)
     {
       textureMemory += (mMaskSnapshot->width() * mMaskSnapshot->height() * 4);
     }
+    if (mLayerSnapshotRef.getPtr() != NULL)
+    {
+      textureMemory += (mLayerSnapshotRef->width() * mLayerSnapshotRef->height() * 4);
+    }
     objectsCounted.push_back(this);
   }
 
@@ -982,13 +1093,40 @@ uint64_t pxObject::textureMemoryUsage(std::vector<rtObject*> &objectsCounted)
 
 bool pxObject::needsUpdate()
 {
-  if ((mParent != NULL && mAnimations.size() > 0) || !((rtPromise*)mReady.getPtr())->status())
+  if ((mParent != NULL && hasUnbatchedAnimations()) || !((rtPromise*)mReady.getPtr())->status())
   {
     return true;
   }
   return false;
 }
 
+bool pxObject::hasUnbatchedAnimations() const
+{
+  for (vector<animation>::const_iterator it = mAnimations.begin(); it != mAnimations.end(); ++it)
+  {
+    if ((*it).engineId == 0)
+      return true;
+  }
+  return false;
+}
+
+vector<animation>::iterator pxObject::eraseAnimation(vector<animation>::iterator it)
+{
+  if ((*it).engineId != 0)
+    pxAnimationEngine::instance()->remove((*it).engineId);
+  return mAnimations.erase(it);
+}
+
+void pxObject::clearAnimations()
+{
+  for (vector<animation>::iterator it = mAnimations.begin(); it != mAnimations.end(); ++it)
+  {
+    if ((*it).engineId != 0)
+      pxAnimationEngine::instance()->remove((*it).engineId);
+  }
+  mAnimations.clear();
+}
+
 void pxObject::triggerUpdate()
 {
   pxScene2d::updateObject(this, true);
@@ -1187,9 +1325,16 @@ void pxObject::drawInternal(bool maskPass)
 
   context.setMatrix(m);
 
-  if ((mClip && !context.isObjectOnScreen(0,0,w,h)) || mSceneSuspended)
+  if (mSceneSuspended)
+  {
+    return;
+  }
+
+  // a clipped object bounds its whole subtree
+  if (mClip && !context.isObjectOnScreen(0,0,w,h))
   {
     //rtLogInfo("pxObject::drawInternal returning because object is not on screen mw=%f mh=%f\n", mw, mh);
+    context.addCulledObject();
     return;
   }
 
@@ -1260,15 +1405,36 @@ void pxObject::drawInternal(bool maskPass)
         context.drawImage(0, 0, w, h, mClipSnapshotRef->getTexture(), nullMaskRef);
       }
     }
+    // LAYER ? ---------------------------------------------------------------------------------------------------
+    else if (!maskPass && updateLayer(m))
+    {
+      float layerW = static_cast<float>(mLayerSnapshotRef->width());
+      float layerH = static_cast<float>(mLayerSnapshotRef->height());
+      if (context.isObjectOnScreen(mLayerX, mLayerY, layerW, layerH))
+      {
+        static pxTextureRef nullMaskRef;
+        context.drawImage(mLayerX, mLayerY, layerW, layerH, mLayerSnapshotRef->getTexture(), nullMaskRef);
+      }
+      else
+      {
+        context.addCulledObject();
+      }
+    }
     // DRAWING ---------------------------------------------------------------------------------------------------
     else
     {
-      // trivially reject things too small to be seen
-      if ( !mClip || (w>alphaEpsilon && h>alphaEpsilon && context.isObjectOnScreen(0, 0, w, h)))
+      // trivially reject things that are off screen, the children are
+      // not bound by this object and are tested on their own
+      float drawX, drawY, drawW, drawH;
+      if (!drawBounds(drawX, drawY, drawW, drawH) || context.isObjectOnScreen(drawX, drawY, drawW, drawH))
       {
         //rtLogInfo("calling draw() mw=%f mh=%f\n", mw, mh);
         draw();
       }
+      else
+      {
+        context.addCulledObject();
+      }
 
       // CHILDREN -------------------------------------------------------------------------------------
       for(vector<rtRef<pxObject> >::iterator it = mChildren.begin(); it != mChildren.end(); ++it)
@@ -1486,6 +1652,178 @@ void pxObject::createSnapshot(pxContextFramebufferRef& fbo, bool separateContext
   }
 }
 
+bool pxObject::updateLayer(pxMatrix4f& m)
+{
+  if (mRepaint || !gLayerCachingEnabled)
+  {
+    // something in the subtree changed, see repaintParents()
+    mUnchangedSinceFrame = gFrameNumber;
+    if (mLayerSnapshotRef.getPtr() != NULL)
+    {
+      clearSnapshot(mLayerSnapshotRef);
+      mLayerSnapshotRef = NULL;
+    }
+    return false;
+  }
+
+  // a layer blends as one image, the children wouldn't look the same
+  // through a translucent parent
+  if (context.getAlpha() < 1.0f)
+  {
+    return false;
+  }
+
+  if (mLayerSnapshotRef.getPtr() != NULL)
+  {
+    if (!context.isTextureSpaceAvailable(0))
+    {
+      // textures that have to be drawn need the memory
+      clearSnapshot(mLayerSnapshotRef);
+      mLayerSnapshotRef = NULL;
+      mUnchangedSinceFrame = gFrameNumber;
+      return false;
+    }
+    return true;
+  }
+
+  if (gDrawingLayer || mParent == NULL || mChildren.empty() ||
+      gFrameNumber - mUnchangedSinceFrame < gLayerCachingFrames)
+  {
+    return false;
+  }
+  // wait as long again before the next try if there is no layer now
+  mUnchangedSinceFrame = gFrameNumber;
+
+  float left = 0, top = 0, right = getOnscreenWidth(), bottom = getOnscreenHeight();
+  if (drawBounds(left, top, right, bottom))
+  {
+    right += left;
+    bottom += top;
+  }
+  uint32_t objects = 1;
+  pxMatrix4f identity;
+  for (vector<rtRef<pxObject> >::iterator it = mChildren.begin(); it != mChildren.end(); ++it)
+  {
+    (*it)->layerBounds(identity, left, top, right, bottom, objects);
+  }
+  int x = static_cast<int>(floor(left));
+  int y = static_cast<int>(floor(top));
+  int width = static_cast<int>(ceil(right)) - x;
+  int height = static_cast<int>(ceil(bottom)) - y;
+  if (objects < PX_LAYER_MIN_OBJECTS || width <= 0 || height <= 0 ||
+      width > MAX_TEXTURE_WIDTH || height > MAX_TEXTURE_HEIGHT ||
+      !context.isTextureSpaceAvailable(static_cast<int64_t>(width) * height * 4))
+  {
+    return false;
+  }
+
+  pxContextFramebufferRef previousRenderSurface = context.getCurrentFramebuffer();
+  // the scissor of the dirty rectangle being redrawn stays on across
+  // framebuffers, the layer is kept and has to be drawn whole
+  bool clipped = previousRenderSurface.getPtr() != NULL && previousRenderSurface->isDirtyRectanglesEnabled();
+  mLayerSnapshotRef = context.createFramebuffer(width, height);
+  bool drawn = false;
+  if (context.setFramebuffer(mLayerSnapshotRef) == PX_OK)
+  {
+    context.enableClipping(false);
+    context.clear(width, height);
+    pxMatrix4f layerMatrix;
+    layerMatrix.translate(static_cast<float>(-x), static_cast<float>(-y));
+    context.setMatrix(layerMatrix);
+
+    gDrawingLayer = true;
+    draw();
+    for (vector<rtRef<pxObject> >::iterator it = mChildren.begin(); it != mChildren.end(); ++it)
+    {
+      if ((*it)->drawEnabled())
+      {
+        context.pushState();
+        (*it)->drawInternal();
+        context.popState();
+      }
+    }
+    gDrawingLayer = false;
+    drawn = true;
+  }
+  context.setFramebuffer(previousRenderSurface);
+  if (clipped)
+  {
+    context.enableDirtyRectangles(true);
+  }
+  context.setMatrix(m);
+  context.setAlpha(ma);
+
+  if (!drawn)
+  {
+    clearSnapshot(mLayerSnapshotRef);
+    mLayerSnapshotRef = NULL;
+    return false;
+  }
+  rtLogDebug("cached %dx%d layer of %u objects for %s", width, height, objects, mId.cString());
+  mLayerX = static_cast<float>(x);
+  mLayerY = static_cast<float>(y);
+
+  // layers inside of this one aren't drawn anymore
+  for (vector<rtRef<pxObject> >::iterator it = mChildren.begin(); it != mChildren.end(); ++it)
+  {
+    (*it)->releaseLayers();
+  }
+  return true;
+}
+
+void pxObject::layerBounds(pxMatrix4f m, float& left, float& top, float& right, float& bottom,
+                           uint32_t& objects)
+{
+  if (!drawEnabled())
+  {
+    return;
+  }
+  pxMatrix4f local;
+  applyMatrix(local);
+  m.multiply(local);
+  objects++;
+
+  float x = 0, y = 0, w = getOnscreenWidth(), h = getOnscreenHeight();
+  drawBounds(x, y, w, h);
+  float cornersX[4] = { x, x + w, x, x + w };
+  float cornersY[4] = { y, y, y + h, y + h };
+  for (int i = 0; i < 4; i++)
+  {
+    pxVector4f v = m.multiply(pxVector4f(cornersX[i], cornersY[i], 0, 1));
+    left = min(left, v.x());
+    top = min(top, v.y());
+    right = max(right, v.x());
+    bottom = max(bottom, v.y());
+  }
+
+  // clipped and masked children can't paint outside of this object
+  bool bounded = mClip;
+  for (vector<rtRef<pxObject> >::iterator it = mChildren.begin(); it != mChildren.end() && !bounded; ++it)
+  {
+    bounded = (*it)->mask();
+  }
+  if (!bounded)
+  {
+    for (vector<rtRef<pxObject> >::iterator it = mChildren.begin(); it != mChildren.end(); ++it)
+    {
+      (*it)->layerBounds(m, left, top, right, bottom, objects);
+    }
+  }
+}
+
+void pxObject::releaseLayers()
+{
+  if (mLayerSnapshotRef.getPtr() != NULL)
+  {
+    clearSnapshot(mLayerSnapshotRef);
+    mLayerSnapshotRef = NULL;
+  }
+  for (vector<rtRef<pxObject> >::iterator it = mChildren.begin(); it != mChildren.end(); ++it)
+  {
+    (*it)->releaseLayers();
+  }
+}
+
 void pxObject::createSnapshotOfChildren()
 {
   //rtLogInfo("pxObject::createSnapshotOfChildren\n");
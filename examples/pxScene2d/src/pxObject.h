@@ -58,6 +58,21 @@
 struct pxPoint2f; //fwd
 class pxScene2d;  //fwd
 
+// Properties an animation can write without looking the setter up by name
+typedef enum pxAnimatedProperty_
+{
+  PX_ANIMATED_PROPERTY_CUSTOM,  // anything else, set through Set()
+  PX_ANIMATED_PROPERTY_X,
+  PX_ANIMATED_PROPERTY_Y,
+  PX_ANIMATED_PROPERTY_W,
+  PX_ANIMATED_PROPERTY_H,
+  PX_ANIMATED_PROPERTY_SX,
+  PX_ANIMATED_PROPERTY_SY,
+  PX_ANIMATED_PROPERTY_A,
+  PX_ANIMATED_PROPERTY_R,
+}
+pxAnimatedProperty;
+
 class pxObject: public rtObject
 {
 public:
@@ -285,6 +300,10 @@ public:
 
   void drawInternal(bool maskPass=false);
   virtual void draw() {}
+  // Area draw() paints, in object coordinates, so that drawInternal can skip
+  // draw() when it is off screen.  Objects whose draw() has to run anyway or
+  // can paint outside of a known area return false.
+  virtual bool drawBounds(float& /*x*/, float& /*y*/, float& /*w*/, float& /*h*/) { return false; }
   virtual void sendPromise();
 
   bool hitTestInternal(pxMatrix4f m, pxPoint2f& pt, rtRef<pxObject>& hit, pxPoint2f& hitPt);
@@ -310,6 +329,14 @@ public:
 
   void cancelAnimation(const char* prop, bool fastforward = false, bool rewind = false);
 
+  // Resolves which property an animation of prop writes to.  Subclasses
+  // whose Set() reacts to one of the core properties return
+  // PX_ANIMATED_PROPERTY_CUSTOM for it so that it keeps going through Set().
+  virtual pxAnimatedProperty animatedProperty(const char* prop);
+  // same as set(a.prop, v) but without the lookup by name
+  void setAnimatedValue(const animation& a, float v);
+  void setAnimatedValue(pxAnimatedProperty property, float v);
+
   rtError addListener(rtString eventName, const rtFunctionRef& f)
   {
     return mEmit->addListener(eventName, f);
@@ -577,7 +604,16 @@ public:
   rtEmitRef mEmit;
 
 protected:
+  friend class pxAnimationEngine;
+  friend class pxHitTestIndex;
+
   void triggerUpdate();
+  void repaintParents();
+  // true while an animation needs update() every frame, tweens evaluated
+  // by pxAnimationEngine don't
+  bool hasUnbatchedAnimations() const;
+  std::vector<animation>::iterator eraseAnimation(std::vector<animation>::iterator it);
+  void clearAnimations();
   // TODO getting freaking huge...
 //  rtRef<pxObject> mParent;
   pxObject* mParent;
@@ -612,6 +648,16 @@ protected:
 
   void createSnapshotOfChildren();
   void clearSnapshot(pxContextFramebufferRef fbo);
+  // Automatic layer caching, a subtree that hasn't changed for
+  // gLayerCachingFrames frames is drawn into mLayerSnapshotRef once and
+  // after that as a single textured quad, until repaint() is called on it.
+  // Returns true if the layer is to be drawn instead of the subtree.
+  bool updateLayer(pxMatrix4f& m);
+  // grows left, top, right and bottom by the area this object and its
+  // children paint, given m maps from the parent to the layer
+  void layerBounds(pxMatrix4f m, float& left, float& top, float& right, float& bottom,
+                   uint32_t& objects);
+  void releaseLayers();
   // #ifdef PX_DIRTY_RECTANGLES
   void setDirtyRect(pxRect* r);
   void markDirty();
@@ -626,13 +672,15 @@ protected:
   pxContextFramebufferRef mMaskSnapshot;
   bool mIsDisposed;
   bool mSceneSuspended;
+  pxContextFramebufferRef mLayerSnapshotRef;
+  float mLayerX, mLayerY;
+  uint32_t mUnchangedSinceFrame;
 
  private:
   rtError _pxObject(voidPtr& v) const {
     v = (void*)this;
     return RT_OK;
   }
-  void repaintParents();
 };
 
 
@@ -234,6 +234,11 @@ public:
   }
   
   virtual void draw();
+  virtual bool drawBounds(float& x, float& y, float& w, float& h)
+  {
+    x = 0; y = 0; w = mw; h = mh;
+    return true;
+  }
   
 private:
   float mFillColor[4];
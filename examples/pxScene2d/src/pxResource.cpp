@@ -29,6 +29,9 @@
 #include "rtThreadPool.h"
 #include "rtPathUtils.h"
 #include "pxTimer.h"
+#include "rtSettings.h"
+#include "rtAtomic.h"
+#include "pxImageCache.h"
 #include <algorithm>
 
 
@@ -39,6 +42,166 @@ extern pxContext context;
 
 rtThreadPool textureCreateThreadPool(1);
 
+// minimum time between two partial images of the same download
+#define PX_PARTIAL_IMAGE_INTERVAL_MS 100
+
+static bool progressiveImageDecodeEnabled(bool& lowResFirst)
+{
+  static bool checkSettings = true;
+  static bool progressiveDecode = true;
+  static bool lowResFirstJpeg = false;
+  if (checkSettings)
+  {
+    rtValue val;
+    if (RT_OK == rtSettings::instance()->value("enableProgressiveImageDecode", val))
+    {
+      progressiveDecode = val.toString().compare("true") == 0;
+    }
+    if (RT_OK == rtSettings::instance()->value("enableLowResFirstJpeg", val))
+    {
+      lowResFirstJpeg = val.toString().compare("true") == 0;
+    }
+    char const* s = getenv("SPARK_PROGRESSIVE_IMAGE_DECODE");
+    if (s)
+    {
+      progressiveDecode = atoi(s) > 0;
+    }
+    s = getenv("SPARK_LOW_RES_FIRST_JPEG");
+    if (s)
+    {
+      lowResFirstJpeg = atoi(s) > 0;
+    }
+    checkSettings = false;
+  }
+  lowResFirst = lowResFirstJpeg;
+  return progressiveDecode;
+}
+
+// Feeds an image download into a pxProgressiveImageDecoder on the thread
+// pool.  The job is reference counted so a decode task that runs after the
+// resource took the decoder back never touches the resource.
+class pxProgressiveDecodeJob
+{
+public:
+  pxProgressiveDecodeJob(rtImageResource* resource, bool lowResFirst)
+    : mRefCount(1), mDataMutex(), mData(), mDecodeScheduled(false), mDecoderMutex(),
+      mDecoder(new pxProgressiveImageDecoder(lowResFirst, resource->initW(), resource->initH(),
+                                             resource->initSX(), resource->initSY())),
+      mResource(resource), mLastPartialImageTime(0)
+  {
+  }
+
+  ~pxProgressiveDecodeJob()
+  {
+    delete mDecoder;
+  }
+
+  void AddRef()
+  {
+    rtAtomicInc(&mRefCount);
+  }
+
+  void Release()
+  {
+    if (rtAtomicDec(&mRefCount) == 0)
+    {
+      delete this;
+    }
+  }
+
+  // called from the download thread, the decoding itself happens on the pool
+  void write(const char* data, size_t size)
+  {
+    mDataMutex.lock();
+    mData.insert(mData.end(), data, data + size);
+    bool scheduleDecode = !mDecodeScheduled;
+    mDecodeScheduled = true;
+    mDataMutex.unlock();
+    if (scheduleDecode)
+    {
+      AddRef();
+      rtThreadPool::globalInstance()->executeTask(new rtThreadTask(pxProgressiveDecodeJob::decodeTask, this, "",
+                                                                   RT_THREAD_TASK_PRIORITY_VISIBLE));
+    }
+  }
+
+  // waits for a running decode pass and hands the decoder to the caller
+  pxProgressiveImageDecoder* detach()
+  {
+    mDecoderMutex.lock();
+    decodePendingData();
+    pxProgressiveImageDecoder* decoder = mDecoder;
+    mDecoder = NULL;
+    mResource = NULL;
+    mDecoderMutex.unlock();
+    return decoder;
+  }
+
+private:
+  static void decodeTask(void* data)
+  {
+    pxProgressiveDecodeJob* job = (pxProgressiveDecodeJob*)data;
+    job->mDecoderMutex.lock();
+    job->decodePendingData();
+    job->updatePartialImage();
+    job->mDecoderMutex.unlock();
+    job->Release();
+  }
+
+  void decodePendingData()
+  {
+    for (;;)
+    {
+      std::vector<char> data;
+      mDataMutex.lock();
+      data.swap(mData);
+      if (data.empty())
+      {
+        mDecodeScheduled = false;
+      }
+      mDataMutex.unlock();
+      if (data.empty())
+      {
+        break;
+      }
+      if (mDecoder != NULL && mDecoder->write(&data[0], data.size()) != RT_OK)
+      {
+        // not a PNG or JPEG, the complete body is decoded the usual way
+        delete mDecoder;
+        mDecoder = NULL;
+      }
+    }
+  }
+
+  void updatePartialImage()
+  {
+    if (mDecoder == NULL || mResource == NULL || !mDecoder->hasPartialImage() || mDecoder->isComplete())
+    {
+      return;
+    }
+    double now = pxMilliseconds();
+    if (now - mLastPartialImageTime < PX_PARTIAL_IMAGE_INTERVAL_MS)
+    {
+      return;
+    }
+    mLastPartialImageTime = now;
+    pxOffscreen partialImage;
+    if (mDecoder->partialImage(partialImage) == RT_OK)
+    {
+      mResource->setPartialTextureData(partialImage);
+    }
+  }
+
+  rtAtomic mRefCount;
+  rtMutex mDataMutex;
+  std::vector<char> mData;
+  bool mDecodeScheduled;
+  rtMutex mDecoderMutex;
+  pxProgressiveImageDecoder* mDecoder;
+  rtImageResource* mResource;
+  double mLastPartialImageTime;
+};
+
 pxResource::~pxResource()
 {
   //rtLogDebug("pxResource::~pxResource()\n");
@@ -283,7 +446,8 @@ void pxResource::raiseDownloadPriority()
 
 
 rtImageResource::rtImageResource()
-: pxResource(), mTexture(), mDownloadedTexture(), mTextureMutex(), mDownloadComplete(false), init_w(0), init_h(0), init_sx(0.0f), init_sy(0.0f), mData()
+: pxResource(), mTexture(), mDownloadedTexture(), mTextureMutex(), mDownloadComplete(false), init_w(0), init_h(0), init_sx(0.0f), init_sy(0.0f), mData(),
+  mProgressiveDecodeJob(NULL), mProgressiveDecodeMutex()
 {
   // empty
 }
@@ -291,7 +455,7 @@ rtImageResource::rtImageResource()
 rtImageResource::rtImageResource(const char* url, const char* proxy, int32_t iw /* = 0 */,  int32_t ih /* = 0 */,
                                                                        float sx /* = 1.0f*/,  float sy /* = 1.0f*/ )
     : pxResource(), mTexture(), mDownloadedTexture(), mTextureMutex(), mDownloadComplete(false),
-      init_w(iw), init_h(ih), init_sx(sx), init_sy(sy), mData()
+      init_w(iw), init_h(ih), init_sx(sx), init_sy(sy), mData(), mProgressiveDecodeJob(NULL), mProgressiveDecodeMutex()
 {
   setUrl(url, proxy);
 }
@@ -304,6 +468,7 @@ rtImageResource::~rtImageResource()
   {
     mTexture->setTextureListener(NULL);
   }
+  delete takeProgressiveDecoder();
 }
 
 unsigned long rtImageResource::Release()
@@ -358,6 +523,56 @@ void rtImageResource::reloadData()
   pxResource::reloadData();
 }
 
+/**
+ * rtImageResource::loadResource()
+ *
+ * Images decoded before are taken from pxImageCache, only the texture is
+ * created again.  Everything else is loaded by pxResource::loadResource().
+ *
+ * */
+void rtImageResource::loadResource(rtObjectRef archive, bool reloading)
+{
+  pxOffscreen imageOffscreen;
+  if (!pxImageCache::instance()->get(mName, imageOffscreen))
+  {
+    pxResource::loadResource(archive, reloading);
+    return;
+  }
+
+  if(!reloading && ((rtPromise*)mReady.getPtr())->status())
+  {
+    //create a new promise if the old one is complete
+    mReady = new rtPromise();
+  }
+  mArchive = (pxArchive*)archive.getPtr();
+  setLoadStatus("sourceType", "memory");
+  setLoadStatus("loadedFromCache", true);
+  setLoadStatus("decodeTimeMs", 0);
+
+  mTextureMutex.lock();
+  // a texture that was ejected gets its pixels back
+  pxTextureRef texture = mTexture.getPtr() ? mTexture : mDownloadedTexture;
+  if (texture.getPtr())
+  {
+    texture->createTexture(imageOffscreen);
+  }
+  else
+  {
+    mDownloadedTexture = context.createTexture(imageOffscreen);
+  }
+  mDownloadComplete = true;
+  mTextureMutex.unlock();
+
+  setLoadStatus("statusCode", 0);
+  // Since this object can be released before we get a async completion
+  // We need to maintain this object's lifetime
+  AddRef();
+  if (gUIThreadQueue)
+  {
+    gUIThreadQueue->addTask(onDownloadCompleteUI, this, (void *) "resolve");
+  }
+}
+
 uint64_t rtImageResource::textureMemoryUsage(std::vector<rtObject*> &objectsCounted)
 {
   uint64_t textureMemory = 0;
@@ -494,6 +709,82 @@ void rtImageResource::setTextureData(pxOffscreen& imageOffscreen)
 #endif //ENABLE_BACKGROUND_TEXTURE_CREATION
 }
 
+void rtImageResource::setPartialTextureData(pxOffscreen& imageOffscreen)
+{
+  mTextureMutex.lock();
+  if (mDownloadedTexture.getPtr() == NULL)
+  {
+    mDownloadedTexture = context.createTexture(imageOffscreen);
+  }
+  else
+  {
+    mDownloadedTexture->createTexture(imageOffscreen);
+  }
+  mDownloadComplete = true;
+  mTextureMutex.unlock();
+  setLoadStatus("partial", true);
+  if (gUIThreadQueue)
+  {
+    AddRef();
+    gUIThreadQueue->addTask(rtImageResource::onPartialImageUI, this, NULL);
+  }
+}
+
+void rtImageResource::onPartialImageUI(void* context, void* /*data*/)
+{
+  rtImageResource* res = (rtImageResource*)context;
+
+  res->setupResource();
+  res->notifyListenersResourceDirty();
+
+  // Release here since we had to addRef when setting up callback to
+  // this function
+  res->Release();
+}
+
+void rtImageResource::setupDownloadRequest(rtFileDownloadRequest* fileDownloadRequest)
+{
+  bool lowResFirst = false;
+  if (!progressiveImageDecodeEnabled(lowResFirst))
+  {
+    return;
+  }
+  delete takeProgressiveDecoder();
+  mProgressiveDecodeMutex.lock();
+  mProgressiveDecodeJob = new pxProgressiveDecodeJob(this, lowResFirst);
+  mProgressiveDecodeMutex.unlock();
+  fileDownloadRequest->setDownloadProgressCallbackFunction(rtImageResource::onDownloadProgress, this);
+}
+
+// The resource holds a reference while it is downloading so it outlives
+// every progress callback of its request.
+size_t rtImageResource::onDownloadProgress(void* ptr, size_t size, size_t nmemb, void* userData)
+{
+  rtImageResource* res = (rtImageResource*)userData;
+  res->mProgressiveDecodeMutex.lock();
+  if (res->mProgressiveDecodeJob != NULL)
+  {
+    res->mProgressiveDecodeJob->write((const char*)ptr, size * nmemb);
+  }
+  res->mProgressiveDecodeMutex.unlock();
+  return size * nmemb;
+}
+
+pxProgressiveImageDecoder* rtImageResource::takeProgressiveDecoder()
+{
+  mProgressiveDecodeMutex.lock();
+  pxProgressiveDecodeJob* job = mProgressiveDecodeJob;
+  mProgressiveDecodeJob = NULL;
+  mProgressiveDecodeMutex.unlock();
+  if (job == NULL)
+  {
+    return NULL;
+  }
+  pxProgressiveImageDecoder* decoder = job->detach();
+  job->Release();
+  return decoder;
+}
+
 void rtImageResource::createWithOffscreen(pxOffscreen& imageOffscreen)
 {
   mDownloadedTexture = context.createTexture(imageOffscreen);
@@ -566,6 +857,7 @@ void pxResource::loadResource(rtObjectRef archive, bool reloading)
 #ifdef ENABLE_CORS_FOR_RESOURCES
       mDownloadRequest->setCORS(mCORS);
 #endif
+      setupDownloadRequest(mDownloadRequest);
       mDownloadInProgressMutex.lock();
       mDownloadInProgress = true;
       mDownloadInProgressMutex.unlock();
@@ -697,6 +989,7 @@ void rtImageResource::loadResourceFromFile()
   }
   else
   {
+    pxImageCache::instance()->add(mName, imageOffscreen);
     // create offscreen texture for local image
     mTexture = context.createTexture(imageOffscreen);
     mTexture->setTextureListener(this);
@@ -783,6 +1076,7 @@ void rtImageResource::loadResourceFromArchive(rtObjectRef archiveRef)
   }
   else
   {
+    pxImageCache::instance()->add(mName, imageOffscreen);
     // create offscreen texture for local image
     mTexture = context.createTexture(imageOffscreen);
     mTexture->setTextureListener(this);
@@ -821,16 +1115,37 @@ void pxResource::onDownloadComplete(rtFileDownloadRequest* fileDownloadRequest)
 
 uint32_t rtImageResource::loadResourceData(rtFileDownloadRequest* fileDownloadRequest)
 {
-      pxOffscreen imageOffscreen;
       double startDecodeTime = pxMilliseconds();
-      rtError decodeResult = pxLoadImage(fileDownloadRequest->downloadedData(),
-              fileDownloadRequest->downloadedDataSize(),
-              imageOffscreen, init_w, init_h, init_sx, init_sy);
-      double stopDecodeTime = pxMilliseconds();
+      rtError decodeResult = RT_FAIL;
+      // most of the image has usually been decoded while it was downloading
+      pxProgressiveImageDecoder* decoder = takeProgressiveDecoder();
+      if (decoder != NULL && decoder->bytesWritten() == fileDownloadRequest->downloadedDataSize() &&
+          decoder->finish() == RT_OK)
+      {
+        decodeResult = RT_OK;
+        setLoadStatus("partial", false);
+        setLoadStatus("decodeTimeMs", static_cast<int>(pxMilliseconds()-startDecodeTime));
+        pxImageCache::instance()->add(mName, decoder->image());
+        setTextureData(decoder->image());
+      }
+      else
+      {
+        pxOffscreen imageOffscreen;
+        decodeResult = pxLoadImage(fileDownloadRequest->downloadedData(),
+                fileDownloadRequest->downloadedDataSize(),
+                imageOffscreen, init_w, init_h, init_sx, init_sy);
+        double stopDecodeTime = pxMilliseconds();
+        if (decodeResult == RT_OK)
+        {
+          setLoadStatus("partial", false);
+          setLoadStatus("decodeTimeMs", static_cast<int>(stopDecodeTime-startDecodeTime));
+          pxImageCache::instance()->add(mName, imageOffscreen);
+          setTextureData(imageOffscreen);
+        }
+      }
+      delete decoder;
       if (decodeResult == RT_OK)
       {
-        setLoadStatus("decodeTimeMs", static_cast<int>(stopDecodeTime-startDecodeTime));
-        setTextureData(imageOffscreen);
 #ifdef ENABLE_BACKGROUND_TEXTURE_CREATION
         return PX_RESOURCE_LOAD_WAIT;
 #else
@@ -39,6 +39,7 @@
 #include <map>
 class rtFileDownloadRequest;
 class pxArchive;
+class pxProgressiveDecodeJob;
 
 #define PX_RESOURCE_STATUS_OK             0
 #define PX_RESOURCE_STATUS_DOWNLOADING    1
@@ -120,6 +121,7 @@ protected:
   static void onResourceDirtyUI(void* context, void* data);
   virtual void processDownloadedResource(rtFileDownloadRequest* fileDownloadRequest);
   virtual uint32_t loadResourceData(rtFileDownloadRequest* fileDownloadRequest) = 0;
+  virtual void setupDownloadRequest(rtFileDownloadRequest* /*fileDownloadRequest*/) {}
   
   void notifyListeners(rtString readyResolution);
   void notifyListenersResourceDirty();
@@ -184,21 +186,29 @@ public:
   void initUriData(rtData&   d)                        { mData.init(d.data(), d.length());                        };
   void initUriData(rtString& s)                        { mData.init( (const uint8_t* ) s.cString(), s.length() ); };
 
+  virtual void loadResource(rtObjectRef archive = NULL, bool reloading=false);
   virtual void releaseData();
   virtual void reloadData();
   virtual uint64_t textureMemoryUsage(std::vector<rtObject*> &objectsCounted);
   virtual void textureReady();
 
   void createWithOffscreen(pxOffscreen& imageOffscreen);
+  // shows a partially decoded image while the download is still running
+  void setPartialTextureData(pxOffscreen& imageOffscreen);
   
 protected:
   virtual uint32_t loadResourceData(rtFileDownloadRequest* fileDownloadRequest);
+  virtual void setupDownloadRequest(rtFileDownloadRequest* fileDownloadRequest);
 
 private:
 
   void loadResourceFromFile();
   void loadResourceFromArchive(rtObjectRef archiveRef);
 
+  static size_t onDownloadProgress(void* ptr, size_t size, size_t nmemb, void* userData);
+  static void onPartialImageUI(void* context, void* data);
+  pxProgressiveImageDecoder* takeProgressiveDecoder();
+
   pxTextureRef mTexture;
   pxTextureRef mDownloadedTexture;
   rtMutex mTextureMutex;
@@ -209,6 +219,9 @@ private:
   float     init_sx, init_sy;
 
   rtData    mData;
+
+  pxProgressiveDecodeJob* mProgressiveDecodeJob;
+  rtMutex mProgressiveDecodeMutex;
 };
 
 class rtImageAResource : public pxResource
@@ -46,6 +46,8 @@
 #include "pxImage9.h"
 #include "pxImageA.h"
 #include "pxImage9Border.h"
+#include "pxAnimationEngine.h"
+#include "pxImageCache.h"
 
 #if !defined(ENABLE_DFB) && !defined(DISABLE_WAYLAND)
 #include "pxWaylandContainer.h"
@@ -97,6 +99,16 @@ bool gDirtyRectsEnabled = true;
 bool gDirtyRectsEnabled = false;
 #endif //PX_DIRTY_RECTANGLES
 
+#ifdef PX_LAYER_CACHING
+bool gLayerCachingEnabled = true;
+#else
+bool gLayerCachingEnabled = false;
+#endif //PX_LAYER_CACHING
+// frames a subtree has to stay unchanged before it is drawn into a layer
+uint32_t gLayerCachingFrames = 30;
+// frames drawn by top level scenes
+uint32_t gFrameNumber = 0;
+
 extern rtThreadQueue* gUIThreadQueue;
 extern pxContext      context;
 
@@ -118,6 +130,7 @@ uint32_t gFboBindCalls;
 // http://stackoverflow.com/questions/342409/how-do-i-base64-encode-decode-in-c
 
 #include <stdint.h>
+#include <inttypes.h>  // for PRId64
 #include <stdlib.h>
 
 #ifdef ENABLE_RT_NODE
@@ -429,8 +442,8 @@ rtDefineObject(pxRoot,pxObject);
 int gTag = 0;
 
 pxScene2d::pxScene2d(bool top, pxScriptView* scriptView)
-  : mRoot(), mInfo(), mCapabilityVersions(), start(0), sigma_draw(0), sigma_update(0), end2(0), frameCount(0), mWidth(0), mHeight(0), mStopPropagation(false), mContainer(NULL), mReportFps(false), mShowDirtyRectangle(false),
-    mEnableDirtyRectangles(gDirtyRectsEnabled),
+  : mRoot(), mInfo(), mCapabilityVersions(), start(0), sigma_draw(0), sigma_update(0), end2(0), frameCount(0), sigma_pixels(0), mWidth(0), mHeight(0), mStopPropagation(false), mContainer(NULL), mReportFps(false), mShowDirtyRectangle(false),
+    mEnableDirtyRectangles(gDirtyRectsEnabled), mCulledObjects(0), mPixelsRedrawn(0),
     mInnerpxObjects(), mSuspended(false),
 #ifdef PX_DIRTY_RECTANGLES
     mArchive(),mDirtyRect(), mLastFrameDirtyRect(),
@@ -607,6 +620,10 @@ rtError pxScene2d::dispose()
 {
     mDisposed = true;
     mMouseEntered = NULL;
+    mMouseMoveEvent = NULL;
+    mObjectMouseMoveEvent = NULL;
+    mMouseDragEvent = NULL;
+    mHitTestIndex.clear();
     rtObjectRef e = new rtMapObject;
     // pass false to make onClose asynchronous
     mEmit.send("onClose", e);
@@ -898,6 +915,10 @@ rtError pxScene2d::logDebugMetrics()
 #else
       rtLogInfo("texture memory usage is [%ld]",context.currentTextureMemoryUsageInBytes());
 #endif
+    pxImageCache* imageCache = pxImageCache::instance();
+    rtLogInfo("image cache hits is [%u] misses is [%u] images is [%u] bytes is [%" PRId64 "] of [%" PRId64 "]",
+              imageCache->hits(), imageCache->misses(), (uint32_t)imageCache->count(),
+              imageCache->size(), imageCache->maxSize());
 #else
     rtLogWarn("logDebugMetrics is disabled");
 #endif
@@ -1046,18 +1067,69 @@ void pxScene2d::draw()
 
       if (mTop)
       {
-        if (mShowDirtyRectangle || !mEnableDirtyRectangles)
+        if (mDirtyRegion.width() != mWidth || mDirtyRegion.height() != mHeight)
+        {
+          mDirtyRegion.setSize(mWidth, mHeight);
+          mLastFrameDirtyRegion.setSize(mWidth, mHeight);
+        }
+
+        // The scene is drawn once, under a scissor around all of the dirty
+        // rectangles; objects outside of it are culled by
+        // pxObject::drawInternal.  A pass per rectangle would run child
+        // scenes and compositing again for each one.  Only the rectangles
+        // themselves are presented.  The back buffer still holds the frame
+        // before last, so what changed in that frame is drawn again as well.
+        bool fullFrame = mShowDirtyRectangle || !mEnableDirtyRectangles;
+        std::vector<pxRect> dirtyRects;
+        pxRect drawRect(0, 0, mWidth, mHeight);
+        if (fullFrame)
         {
-          context.enableClipping(false);
-          context.clear(mWidth, mHeight);
+          dirtyRects.push_back(drawRect);
         }
         else
         {
-          context.clear(x, y, w, h);
+          pxDirtyRegion dirtyRegion = mDirtyRegion;
+          dirtyRegion.add(mLastFrameDirtyRegion);
+          dirtyRegion.rects(dirtyRects);
+          if (!dirtyRects.empty())
+          {
+            drawRect = dirtyRects[0];
+            for (size_t i = 1; i < dirtyRects.size(); i++)
+            {
+              drawRect.unionRect(dirtyRects[i]);
+            }
+          }
         }
-      }
 
-      if (mRoot)
+        mPixelsRedrawn = 0;
+        if (!dirtyRects.empty())
+        {
+          if (fullFrame)
+          {
+            context.enableClipping(false);
+            context.clear(mWidth, mHeight);
+          }
+          else
+          {
+            context.clear(drawRect.left(), drawRect.top(), drawRect.width(), drawRect.height());
+          }
+
+          if (mRoot)
+          {
+            context.pushState();
+        ENTERSCENELOCK()
+            mRoot->drawInternal(true);
+        EXITSCENELOCK()
+            context.popState();
+          }
+          mPixelsRedrawn = drawRect.width() * drawRect.height();
+        }
+        for (std::vector<pxRect>::iterator it = dirtyRects.begin(); it != dirtyRects.end(); ++it)
+        {
+          context.addDamage(*it);
+        }
+      }
+      else if (mRoot)
       {
         context.pushState();
 
@@ -1065,9 +1137,15 @@ void pxScene2d::draw()
         mRoot->drawInternal(true);
     EXITSCENELOCK()
         context.popState();
+      }
+
+      if (mRoot)
+      {
         mLastFrameDirtyRect.setLTRB(mDirtyRect.left(), mDirtyRect.top(), mDirtyRect.right(), mDirtyRect.bottom());
         mDirtyRect.setEmpty();
       }
+      mLastFrameDirtyRegion = mDirtyRegion;
+      mDirtyRegion.clear();
 
       if (mTop && mShowDirtyRectangle)
       {
@@ -1090,6 +1168,7 @@ void pxScene2d::draw()
       if (mTop)
       {
         context.clear(mWidth, mHeight);
+        mPixelsRedrawn = mWidth * mHeight;
       }
 
       if (mRoot)
@@ -1122,6 +1201,11 @@ void pxScene2d::draw()
   }
 #endif //USE_SCENE_POINTER
 
+  if (mTop)
+  {
+    context.flush();
+  }
+
 double __frameEnd = pxMilliseconds();
 
 static double __frameTotal = 0;
@@ -1217,11 +1301,13 @@ void pxScene2d::onUpdate(double t)
     if (mTop || lastTime != t)
     {
       lastTime = t;
+      pxAnimationEngine::instance()->update(t);
       updateObjects(t);
     }
   }
   else
   {
+    pxAnimationEngine::instance()->update(t);
     update(t);
   }
 
@@ -1230,6 +1316,7 @@ void pxScene2d::onUpdate(double t)
   if (mDirty)
   {
     mDirty = false;
+    mHitTestIndex.invalidate();
     if (mContainer)
       mContainer->invalidateRect(NULL);
   }
@@ -1244,6 +1331,8 @@ void pxScene2d::onUpdate(double t)
       end2 = pxSeconds();
 
     int fps = (int)rint((double)frameCount/(end2-start));
+    uint32_t ppf = static_cast<uint32_t>(sigma_pixels / frameCount); // pixels redrawn per frame
+    sigma_pixels = 0;
 
 #ifdef USE_RENDER_STATS
       double   dpf = rint( (double) gDrawCalls    / (double) frameCount ); // e.g.   glDraw*()           - calls per frame
@@ -1258,7 +1347,7 @@ void pxScene2d::onUpdate(double t)
       // rtLogDebug("%g fps   pxObjects: %d   Draw: %g   Tex: %g   Fbo: %g     draw_ms: %0.04g   update_ms: %0.04g\n",
       //     fps, pxObjectCount, dpf, bpf, fpf, draw_ms, update_ms );
 
-      rtLogDebug("%g fps   pxObjects: %d   Draw: %g   Tex: %g   Fbo: %g \n", fps, pxObjectCount, dpf, bpf, fpf);
+      rtLogDebug("%g fps   pxObjects: %d   Draw: %g   Tex: %g   Fbo: %g   Pixels: %u \n", fps, pxObjectCount, dpf, bpf, fpf, ppf);
 
       gDrawCalls    = 0;
       gTexBindCalls = 0;
@@ -1285,7 +1374,7 @@ void pxScene2d::onUpdate(double t)
       }
     }
     previousFps = fps;
-    rtLogDebug("%d fps   pxObjects: %d\n", fps, pxObjectCount);
+    rtLogDebug("%d fps   pxObjects: %d   pixels redrawn per frame: %u\n", fps, pxObjectCount, ppf);
 #endif //USE_RENDER_STATS
     if (mReportFps)
     {
@@ -1295,6 +1384,7 @@ void pxScene2d::onUpdate(double t)
 
       rtObjectRef e = new rtMapObject;
       e.set("fps", fps);
+      e.set("pixelsRedrawn", ppf);
       mEmit.send("onFPS", e);
     }
 
@@ -1332,6 +1422,8 @@ void pxScene2d::onDraw()
     rtWrapperSceneUpdateEnter();
     #endif //ENABLE_RT_NODE
     context.setSize(mWidth, mHeight);
+    context.clearDamage();
+    gFrameNumber++;
   }
 #if 1
 
@@ -1339,7 +1431,11 @@ void pxScene2d::onDraw()
   double start_draw = pxSeconds(); //##
 #endif //USE_RENDER_STATS
 
+  // includes the objects of scenes drawn inside of this one
+  uint32_t culledObjects = context.culledObjectCount();
   draw();
+  mCulledObjects = context.culledObjectCount() - culledObjects;
+  sigma_pixels += mPixelsRedrawn;
 
 #ifdef USE_RENDER_STATS
   sigma_draw += (pxSeconds() - start_draw); //##
@@ -1442,12 +1538,13 @@ bool pxScene2d::onMouseDown(int32_t x, int32_t y, uint32_t flags)
 #endif
   {
     //Looking for an object
-    pxMatrix4f m;
     pxPoint2f pt(static_cast<float>(x),static_cast<float>(y)), hitPt;
     //    pt.x = x; pt.y = y;
     rtRef<pxObject> hit;
 
-    if (mRoot->hitTestInternal(m, pt, hit, hitPt))
+    // clicks are rare enough to compare the whole scene with the index
+    mHitTestIndex.invalidate();
+    if (hitTestInternal(pt, hit, hitPt))
     {
       mMouseDown = hit;
       // scene coordinates
@@ -1485,7 +1582,6 @@ bool pxScene2d::onMouseUp(int32_t x, int32_t y, uint32_t flags)
 #endif
   {
     //Looking for an object
-    pxMatrix4f m;
     pxPoint2f pt(static_cast<float>(x),static_cast<float>(y)), hitPt;
     rtRef<pxObject> hit;
     rtRef<pxObject> tMouseDown = mMouseDown;
@@ -1493,7 +1589,8 @@ bool pxScene2d::onMouseUp(int32_t x, int32_t y, uint32_t flags)
     mMouseDown = NULL;
 
     // TODO optimization... we really only need to check mMouseDown
-    if (mRoot->hitTestInternal(m, pt, hit, hitPt))
+    mHitTestIndex.invalidate();
+    if (hitTestInternal(pt, hit, hitPt))
     {
       // Only send onMouseUp if this object got an onMouseDown
       if (tMouseDown == hit)
@@ -1651,7 +1748,9 @@ bool pxScene2d::bubbleEvent(rtObjectRef e, rtRef<pxObject> t,
   {
     AddRef();  // TODO refactor? make sure scene stays alive while we bubble since we're using the address of mStopPropagation
 //    e.set("stopPropagation", get<rtFunctionRef>("stopPropagation"));
-    e.set("stopPropagation", new rtFunctionCallback(stopPropagation2, (void*)&mStopPropagation));
+    if (!mStopPropagationCallback)
+      mStopPropagationCallback = new rtFunctionCallback(stopPropagation2, (void*)&mStopPropagation);
+    e.set("stopPropagation", mStopPropagationCallback);
 
     vector<rtRef<pxObject> > l;
     while(t)
@@ -1700,6 +1799,36 @@ bool pxScene2d::bubbleEvent(rtObjectRef e, rtRef<pxObject> t,
   return consumed;
 }
 
+rtObjectRef pxScene2d::reusableEvent(rtRef<rtMapObject>& e)
+{
+  if (!e)
+    e = new rtMapObject;
+  return e.getPtr();
+}
+
+void pxScene2d::releaseEvent(rtRef<rtMapObject>& e)
+{
+  if (!e)
+    return;
+  // Nobody else can see the event if we hold the only reference, it is
+  // emptied so it doesn't keep its target alive until the next move
+  unsigned long refCount = e->AddRef();
+  e->Release();
+  if (refCount == 2)
+    e->clear();
+  else
+    e = NULL;
+}
+
+bool pxScene2d::hitTestInternal(pxPoint2f& pt, rtRef<pxObject>& hit, pxPoint2f& hitPt)
+{
+  if (mDirty)
+  {
+    mHitTestIndex.invalidate();
+  }
+  return mHitTestIndex.hitTest(mRoot, pt, hit, hitPt);
+}
+
 bool pxScene2d::bubbleEventOnBlur(rtObjectRef e, rtRef<pxObject> t, rtRef<pxObject> o)
 {
   bool consumed = false;
@@ -1791,17 +1920,17 @@ bool pxScene2d::onMouseMove(int32_t x, int32_t y)
 #if 1
   {
     // Send to root scene in global window coordinates
-    rtObjectRef e = new rtMapObject;
+    rtObjectRef e = reusableEvent(mMouseMoveEvent);
     e.set("name", "onMouseMove");
     e.set("x", x);
     e.set("y", y);
     mEmit.send("onMouseMove", e);
   }
+  releaseEvent(mMouseMoveEvent);
 #endif
 
 #if 1
   //Looking for an object
-  pxMatrix4f m;
   pxPoint2f pt(static_cast<float>(x),static_cast<float>(y)), hitPt;
   rtRef<pxObject> hit;
 
@@ -1843,15 +1972,16 @@ bool pxScene2d::onMouseMove(int32_t x, int32_t y)
     e.set("y", to.mY);
     mMouseDown->mEmit.send("onMouseMove", e);
 #else
-    rtObjectRef e = new rtMapObject;
+    rtObjectRef e = reusableEvent(mObjectMouseMoveEvent);
     e.set("target", mMouseDown.getPtr());
     e.set("x", to.x());
     e.set("y", to.y());
     bubbleEvent(e, mMouseDown, "onPreMouseMove", "onMouseMove");
 #endif
     }
+    releaseEvent(mObjectMouseMoveEvent);
     {
-    rtObjectRef e = new rtMapObject;
+    rtObjectRef e = reusableEvent(mMouseDragEvent);
     e.set("name", "onMouseDrag");
     e.set("target", mMouseDown.getPtr());
     e.set("x", x);
@@ -1864,16 +1994,18 @@ bool pxScene2d::onMouseMove(int32_t x, int32_t y)
     bubbleEvent(e,mMouseDown,"onPreMouseDrag","onMouseDrag");
 #endif
     }
+    releaseEvent(mMouseDragEvent);
   }
   else // Only send mouse leave/enter events if we're not dragging
   {
-    if (mRoot->hitTestInternal(m, pt, hit, hitPt))
+    if (hitTestInternal(pt, hit, hitPt))
     {
       // This probably won't stay ... we can probably send onMouseMove to the child scene level
       // rather than the object... we can send objects enter/leave events
       // and we can send drag events to objects that are being drug...
 #if 1
-      rtObjectRef e = new rtMapObject;
+      {
+      rtObjectRef e = reusableEvent(mObjectMouseMoveEvent);
 //      e.set("name", "onMouseMove");
       e.set("x", hitPt.x);
       e.set("y", hitPt.y);
@@ -1882,6 +2014,8 @@ bool pxScene2d::onMouseMove(int32_t x, int32_t y)
 #else
       bubbleEvent(e, hit, "onPreMouseMove", "onMouseMove");
 #endif
+      }
+      releaseEvent(mObjectMouseMoveEvent);
 #endif
 
       setMouseEntered(hit);
@@ -1911,10 +2045,10 @@ bool pxScene2d::onMouseMove(int32_t x, int32_t y)
 void pxScene2d::updateMouseEntered()
 {
   #if 1
-    pxMatrix4f m;
     pxPoint2f pt(static_cast<float>(mPointerX),static_cast<float>(mPointerY)), hitPt;
     rtRef<pxObject> hit;
-    if (mRoot->hitTestInternal(m, pt, hit, hitPt))
+    mHitTestIndex.invalidate();
+    if (hitTestInternal(pt, hit, hitPt))
     {
       setMouseEntered(hit);
     }
@@ -1925,11 +2059,10 @@ void pxScene2d::updateMouseEntered()
 
 bool pxScene2d::onDragMove(int32_t x, int32_t y, int32_t type)
 {
-  pxMatrix4f m;
   rtRef<pxObject> hit;
   pxPoint2f pt(static_cast<float>(x),static_cast<float>(y)), hitPt;
   
-  if (mRoot->hitTestInternal(m, pt, hit, hitPt))
+  if (hitTestInternal(pt, hit, hitPt))
   {
     mDragType = (pxConstantsDragType::constants) type;
 
@@ -2140,6 +2273,16 @@ rtError pxScene2d::dirtyRectanglesEnabled(bool& v) const {
     return RT_OK;
 }
 
+rtError pxScene2d::culledObjects(uint32_t& v) const {
+    v = mCulledObjects;
+    return RT_OK;
+}
+
+rtError pxScene2d::pixelsRedrawn(uint32_t& v) const {
+    v = mPixelsRedrawn;
+    return RT_OK;
+}
+
 rtError pxScene2d::dirtyRectangle(rtObjectRef& v) const {
     v = new rtMapObject();
 if (gDirtyRectsEnabled) {
@@ -2529,6 +2672,8 @@ rtDefineProperty(pxScene2d, showDirtyRect);
 rtDefineProperty(pxScene2d, reportFps);
 rtDefineProperty(pxScene2d, dirtyRectangle);
 rtDefineProperty(pxScene2d, dirtyRectanglesEnabled);
+rtDefineProperty(pxScene2d, culledObjects);
+rtDefineProperty(pxScene2d, pixelsRedrawn);
 rtDefineProperty(pxScene2d, enableDirtyRect);
 rtDefineProperty(pxScene2d, customAnimator);
 rtDefineMethod(pxScene2d, create);
@@ -2639,10 +2784,12 @@ void pxViewContainer::invalidateRect(pxRect* r)
 
 void pxScene2d::invalidateRect(pxRect* r)
 {
+  mHitTestIndex.invalidate();
   if (gDirtyRectsEnabled) {
       if (r != NULL)
       {
         mDirtyRect.unionRect(*r);
+        mDirtyRegion.add(*r);
         mDirty = true;
       }
   } else {
@@ -2675,6 +2822,7 @@ bool pxScene2d::isObjectTracked(rtObjectRef ref)
 
 void pxScene2d::innerpxObjectDisposed(rtObjectRef ref)
 {
+  mHitTestIndex.invalidate();
   // this is to make sure, we are not clearing the rtobject references, while it is under process from scene dispose
   if (!mDisposed)
   {
@@ -57,6 +57,8 @@
 #include "pxInterpolators.h"
 #include "pxTexture.h"
 #include "pxContextFramebuffer.h"
+#include "pxDirtyRegion.h"
+#include "pxHitTestIndex.h"
 
 #include "pxArchive.h"
 #include "pxAnimate.h"
@@ -125,6 +127,7 @@ struct animation
   bool reversing;
 
   rtString prop;
+  pxAnimatedProperty property;
 
   float from;
   float to;
@@ -142,6 +145,8 @@ struct animation
   rtFunctionRef ended;
   rtObjectRef promise;
   rtObjectRef animateObj;
+
+  uint32_t engineId; // pxAnimationEngine handle, 0 when not batched
 };
 
 struct pxPoint2f 
@@ -841,6 +846,8 @@ public:
   rtProperty(reportFps, reportFps, setReportFps, bool);
   rtReadOnlyProperty(dirtyRectangle, dirtyRectangle, rtObjectRef);
   rtReadOnlyProperty(dirtyRectanglesEnabled, dirtyRectanglesEnabled, bool);
+  rtReadOnlyProperty(culledObjects, culledObjects, uint32_t);
+  rtReadOnlyProperty(pixelsRedrawn, pixelsRedrawn, uint32_t);
   rtProperty(enableDirtyRect, enableDirtyRect, setEnableDirtyRect, bool);
   rtProperty(customAnimator, customAnimator, setCustomAnimator, rtFunctionRef);
   rtMethod1ArgAndReturn("loadArchive",loadArchive,rtString,rtObjectRef); 
@@ -977,6 +984,10 @@ public:
 
   rtError dirtyRectangle(rtObjectRef& v) const;   
   rtError dirtyRectanglesEnabled(bool& v) const;
+  // objects the last frame skipped since they were off screen
+  rtError culledObjects(uint32_t& v) const;
+  // pixels the last frame cleared and drew again
+  rtError pixelsRedrawn(uint32_t& v) const;
     
   rtError enableDirtyRect(bool& v) const;
   rtError setEnableDirtyRect(bool v);
@@ -1208,6 +1219,14 @@ private:
   
   bool bubbleEventOnBlur(rtObjectRef e, rtRef<pxObject> t, rtRef<pxObject> o);
 
+  // the object under pt in scene coordinates, see pxHitTestIndex
+  bool hitTestInternal(pxPoint2f& pt, rtRef<pxObject>& hit, pxPoint2f& hitPt);
+
+  // The events sent as the pointer moves are taken from these, the event
+  // object is reused unless a listener kept a reference to the last one.
+  rtObjectRef reusableEvent(rtRef<rtMapObject>& e);
+  void releaseEvent(rtRef<rtMapObject>& e);
+
   void draw();
   // Does not draw updates scene to time t
   // t is assumed to be monotonically increasing
@@ -1221,6 +1240,7 @@ private:
   double start, sigma_draw, sigma_update, end2;
 
   int frameCount;
+  uint64_t sigma_pixels; // pixels redrawn since the last fps report
   int mWidth;
   int mHeight;
 
@@ -1230,16 +1250,23 @@ private:
   rtRef<pxObject> mMouseEntered;
   rtRef<pxObject> mMouseDown;
   pxPoint2f mMouseDownPt;
+  pxHitTestIndex mHitTestIndex;
   rtValue mContext;
   rtValue mAPI;
   bool mTop;
   bool mStopPropagation;
+  rtFunctionRef mStopPropagationCallback;
+  rtRef<rtMapObject> mMouseMoveEvent;
+  rtRef<rtMapObject> mObjectMouseMoveEvent;
+  rtRef<rtMapObject> mMouseDragEvent;
   int mTag;
   pxIViewContainer *mContainer;
   pxScriptView *mScriptView;
   bool mReportFps;
   bool mShowDirtyRectangle;
   bool mEnableDirtyRectangles;
+  uint32_t mCulledObjects;
+  uint32_t mPixelsRedrawn;
   int32_t mPointerX;
   int32_t mPointerY;
   double mPointerLastUpdated;
@@ -1270,6 +1297,8 @@ public:
   //#ifdef PX_DIRTY_RECTANGLES
   pxRect mDirtyRect;
   pxRect mLastFrameDirtyRect;
+  pxDirtyRegion mDirtyRegion;
+  pxDirtyRegion mLastFrameDirtyRegion;
   //#endif //PX_DIRTY_RECTANGLES
   bool mDirty;
 
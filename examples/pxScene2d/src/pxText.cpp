@@ -151,7 +151,7 @@ void pxText::draw()
       }
     }
 #ifdef PXSCENE_FONT_ATLAS
-    if (mDirty)
+    if (mDirty || !mQuads.isCurrent())
     {
       getFontResource()->renderTextToQuads(mText,mPixelSize,msx,msy,mQuads);
       mDirty = false;
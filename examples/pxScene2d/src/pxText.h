@@ -154,6 +154,14 @@ public:
     return e;
   }
 
+  // sx and sy mark the text dirty in Set()
+  virtual pxAnimatedProperty animatedProperty(const char* prop) override
+  {
+    if (!strcmp(prop, "sx") || !strcmp(prop, "sy"))
+      return PX_ANIMATED_PROPERTY_CUSTOM;
+    return pxObject::animatedProperty(prop);
+  }
+
   virtual void resourceReady(rtString readyResolution);
   virtual void resourceDirty();
   virtual void sendPromise();
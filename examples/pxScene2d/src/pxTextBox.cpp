@@ -31,7 +31,6 @@ extern pxContext context;
 #include <stdlib.h>
 
 static const char      isNewline_chars[] = "\n\v\f\r";
-static const char isWordBoundary_chars[] = " \t/:&,;.?!";
 static const char    isSpaceChar_chars[] = " \t";
 static const char isDelimeter_chars[] = "\n\v\f\r \t/:&,;.";
 #define ELLIPSIS_STR u8"\u2026"
@@ -136,7 +135,7 @@ void pxTextBox::recalc()
      clearMeasurements();
     
 #ifdef PXSCENE_FONT_ATLAS
-    mQuadsVector.clear();
+    mQuads.clear();
 #endif
     renderText(false);
 
@@ -151,7 +150,7 @@ void pxTextBox::recalc()
     // textBox or its parent has draw=false, the measurements
     // get calculated and the promise gets resolved.
 #ifdef PXSCENE_FONT_ATLAS
-      mQuadsVector.clear();
+      mQuads.clear();
 #endif
       renderText(true);
       mDirty = false;
@@ -229,9 +228,10 @@ rtError pxTextBox::setFont(rtObjectRef o)
 void pxTextBox::draw() 
 {
 #ifdef PXSCENE_FONT_ATLAS
-  if (mDirty)
+  // the font atlas may have moved glyphs the quads use
+  if (mDirty || !mQuads.isCurrent())
   {
-    mQuadsVector.clear();
+    mQuads.clear();
     renderText(true);
     mDirty = false;
   
@@ -242,8 +242,7 @@ void pxTextBox::draw()
     y = roundf(noClipY); 
   }
 
-  for (std::vector<pxTexturedQuads>::iterator it = mQuadsVector.begin() ; it != mQuadsVector.end(); ++it)
-    (*it).draw(x, y, mTextColor);
+  mQuads.draw(x, y, mTextColor);
 
 
 #else
@@ -381,7 +380,7 @@ void pxTextBox::measureTextWithWrapOrNewLine(const char *text, float sx, float s
     u_int32_t charToMeasure;
     float charW=0, charH=0;
 
-    rtString accString = "";
+    std::string accString;
     bool lastLine = false;
     float lineWidth = mw;
 
@@ -415,24 +414,26 @@ void pxTextBox::measureTextWithWrapOrNewLine(const char *text, float sx, float s
     }
     
     // Read char by char to determine full line of text before rendering
-    int i = 0;
-    int lasti = 0;
-    int numbytes = 1;
+    pxFont* font = getFontResource();
+    pxTextRunRef run;
+    float lineHeight = 0;
+    if (font != NULL)
+    {
+      run = font->shapeText(text, size);
+      font->getHeight(size, lineHeight);
+    }
+    size_t glyphCount = run ? run->glyphs.size() : 0;
     bool isNewLineDetected = false;
-    while((charToMeasure = u8_nextchar((char*)text, &i)) != 0)
+    for (size_t g = 0; g < glyphCount; g++)
     {
-      // Determine if the character is multibyte
-      numbytes = i-lasti;
-        
-      std::string tempChar = std::string (&text[lasti], numbytes);
-        
-      lasti = i;
+      const pxTextRunGlyph& glyph = run->glyphs[g];
+      charToMeasure = glyph.codePoint;
+      std::string tempChar(&text[glyph.offset], glyph.length);
+
+      // a character that starts a line isn't kerned
+      charW = glyph.advance + (tempX > 0 ? glyph.kerning : 0);
+      charH = lineHeight;
 
-      if (getFontResource() != NULL)
-      {
-        getFontResource()->measureTextChar(charToMeasure, size, sx, sy, charW, charH);
-      }
-    
       bool isContinuousLine = mWordWrap && !isDelimeter_charsPresent;
       bool isEnd = tempX + charW >= mw;
       lastLine = isContinuousLine && isEnd ? ( mTruncation != pxConstantsTruncation::NONE && tempY + ((mLeading*sy) + (charH*2)) > this->h() && !lastLine) : lastLine;
@@ -444,15 +445,16 @@ void pxTextBox::measureTextWithWrapOrNewLine(const char *text, float sx, float s
         // Render what we had so far in accString; since we are here, it will fit.
         if (mTruncation != pxConstantsTruncation::NONE  && !mWordWrap && tempX + charW > mw)
         {
-            renderTextRowWithTruncation(accString, mw, 0, tempY, sx, sy, size, render);
-            accString = "";
+            rtString line(accString.c_str());
+            renderTextRowWithTruncation(line, mw, 0, tempY, sx, sy, size, render);
+            accString.clear();
         }
         else
         {
             isNewLineDetected = std::strncmp(tempChar.c_str(), "\n", 1) == 0 ? true : false;
-            renderOneLine(accString.cString(), 0, tempY, sx, sy, size, lineWidth, render, isNewLineDetected);
+            renderOneLine(accString.c_str(), 0, tempY, sx, sy, size, lineWidth, render, isNewLineDetected);
 
-            accString = (isContinuousLine && isEnd && !isLast) ? tempChar.c_str() : "";
+            accString = (isContinuousLine && isEnd && !isLast) ? tempChar : std::string();
         }
         tempY += (mLeading*sy) + charH;
 
@@ -464,7 +466,7 @@ void pxTextBox::measureTextWithWrapOrNewLine(const char *text, float sx, float s
       // Check if text still fits on this line, or if wrap needs to occur
       if( (tempX + charW) <= lineWidth || !mWordWrap || (mWordWrap && !isDelimeter_charsPresent && !isLast))
       {
-        accString.append(tempChar.c_str());
+        accString.append(tempChar);
         tempX += charW;
       }
       else
@@ -474,11 +476,12 @@ void pxTextBox::measureTextWithWrapOrNewLine(const char *text, float sx, float s
         // Note: Last line will never be set when truncation is NONE.
         if( lastLine || (mTruncation != pxConstantsTruncation::NONE && (tempY + ((mLeading*sy) + charH) >= this->h())) )
         {
-          //rtLogDebug("LastLine: Calling renderTextRowWithTruncation with mx=%f for string \"%s\"\n",mx,accString.cString());
-          renderTextRowWithTruncation(accString, lineWidth, 0, tempY, sx, sy, size, render);
+          //rtLogDebug("LastLine: Calling renderTextRowWithTruncation with mx=%f for string \"%s\"\n",mx,accString.c_str());
+          rtString line(accString.c_str());
+          renderTextRowWithTruncation(line, lineWidth, 0, tempY, sx, sy, size, render);
           tempY += (mLeading*sy) + charH;
           // Clear accString because we've rendered it
-          accString = "";
+          accString.clear();
           break; // break out of reading mText
 
         }
@@ -488,25 +491,26 @@ void pxTextBox::measureTextWithWrapOrNewLine(const char *text, float sx, float s
           if( !mWordWrap && lineNumber != 0 )
           {
             lastLineNumber = lineNumber;
-            //rtLogDebug("!!!!CLF: calling renderTextRowWithTruncation! %s\n",accString.cString());
+            //rtLogDebug("!!!!CLF: calling renderTextRowWithTruncation! %s\n",accString.c_str());
             if( mTruncation != pxConstantsTruncation::NONE) {
-              renderTextRowWithTruncation(accString, mw, mx, tempY, sx, sy, size, render);
+              rtString line(accString.c_str());
+              renderTextRowWithTruncation(line, mw, mx, tempY, sx, sy, size, render);
               tempY += (mLeading*sy) + charH;
-              accString = "";
+              accString.clear();
               //break;
             }
             else
             {
               if( clip() )
               {
-                renderOneLine(accString, 0, tempY, sx, sy, size, mw, render);
+                renderOneLine(accString.c_str(), 0, tempY, sx, sy, size, mw, render);
                 tempY += (mLeading*sy) + charH;
-                accString = "";
+                accString.clear();
                 break;
               }
               else
               {
-                accString.append(tempChar.c_str());
+                accString.append(tempChar);
                 tempX += charW;
                 continue;
               }
@@ -515,67 +519,42 @@ void pxTextBox::measureTextWithWrapOrNewLine(const char *text, float sx, float s
           // End special case when !wordWrap but newline found
 
           // Out of space on the current line; find and wrap at word boundary
-          char *tempStr = strdup(accString.cString()); // Should give a copy
-          int    length = accString.length();
-          int         n = length-1;
-
-          while(!isWordBoundary(tempStr[n]) && n >= 0)
+          pxTextRunRef lineRun = font->shapeText(accString.c_str(), size);
+          int n = (int)lineRun->glyphs.size() - 1;
+          while(n >= 0 && !lineRun->glyphs[n].breakAfter)
           {
             n--;
           }
-          if( isWordBoundary(tempStr[n]))
+          if( n >= 0)
           {
-            tempStr[n+1] = '\0';
+            size_t lineEnd = lineRun->glyphs[n].offset + lineRun->glyphs[n].length;
             // write out entire string that will fit
             // Use horizonal positioning
             //rtLogDebug("Calling renderOneLine with lineNumber=%d\n",lineNumber);
-            renderOneLine(tempStr, 0, tempY, sx, sy, size, lineWidth, render);
+            renderOneLine(accString.substr(0, lineEnd).c_str(), 0, tempY, sx, sy, size, lineWidth, render);
             tempY += (mLeading*sy) + charH;
-            free(tempStr);
 
-            // Now reset accString to hold remaining text
-            tempStr = strdup(accString.cString());
-            n++;
-
-            if( strlen(tempStr+n) > 0)
-            {
-              if( isSpaceChar(tempStr[n]))
-              {
-                //rtLogDebug("Attempting to move past leading space at %d in string \"%s\"\n",n, tempStr);
-                accString = tempStr+n+1;
-              }
-              else
-              {
-                //rtLogDebug("Is not leading space at %d in string \"%s\"\n",n, tempStr);
-                accString = tempStr+n;
-                //rtLogDebug("So accString is now \"%s\"\n",accString.cString());
-              }
-            }
-            else
+            // Now reset accString to hold remaining text, without a leading space
+            if( lineEnd < accString.length() && isSpaceChar(accString[lineEnd]))
             {
-              accString = "";
+              lineEnd++;
             }
+            accString.erase(0, lineEnd);
 
             if( !isSpaceChar(tempChar[0]) || (isSpaceChar(tempChar[0]) && accString.length() != 0))
             {
-              //rtLogDebug("space char check to add to string: \"%s\"\n",accString.cString());
-              //rtLogDebug("space char check: \"%s\"\n",tempChar);
-              accString.append(tempChar.c_str());
+              //rtLogDebug("space char check to add to string: \"%s\"\n",accString.c_str());
+              accString.append(tempChar);
             }
             
           }
 
-          // Free tempStr
-          free(tempStr);
           // Now skip to next line
           //tempY += (mLeading*sy) + charH;
           tempX = 0;
           lineNumber++;
 
-          if (getFontResource() != NULL)
-          {
-            getFontResource()->measureTextInternal(accString.cString(), size, sx, sy, charW, charH);
-          }
+          font->measureTextInternal(accString.c_str(), size, sx, sy, charW, charH);
 
           tempX += charW;
 
@@ -597,21 +576,22 @@ void pxTextBox::measureTextWithWrapOrNewLine(const char *text, float sx, float s
       lastLineNumber = lineNumber;
       if( mTruncation == pxConstantsTruncation::NONE && !mWordWrap ) {
         //rtLogDebug("CLF! Sending tempX instead of this->w(): %f\n", tempX);
-        renderOneLine(accString.cString(), 0, tempY, sx, sy, size, lineWidth, render, isNewLineDetected);
+        renderOneLine(accString.c_str(), 0, tempY, sx, sy, size, lineWidth, render, isNewLineDetected);
       } else {
+        rtString line(accString.c_str());
         // check if we need to truncate this last line
         if( !lastLine && mXStopPos != 0 && mAlignHorizontal == pxConstantsAlignHorizontal::LEFT
             && mTruncation != pxConstantsTruncation::NONE && mXStopPos > mXStartPos
             && tempX > mw) {
-          renderTextRowWithTruncation(accString, mXStopPos - mx, mx, tempY, sx, sy, size, render);
+          renderTextRowWithTruncation(line, mXStopPos - mx, mx, tempY, sx, sy, size, render);
         }
         else
         {
             if (mTruncation != pxConstantsTruncation::NONE  && !mWordWrap && tempX + charW > mw)
             {
-                renderTextRowWithTruncation(accString, mw, 0, tempY, sx, sy, size, render);
+                renderTextRowWithTruncation(line, mw, 0, tempY, sx, sy, size, render);
             }
-            else renderOneLine(accString.cString(), 0, tempY, sx, sy, size, this->w(), render);
+            else renderOneLine(accString.c_str(), 0, tempY, sx, sy, size, this->w(), render);
         }
       }
 
@@ -1009,7 +989,7 @@ void pxTextBox::renderOneLine(const char * tempStr, float tempX, float tempY, fl
  #ifdef PXSCENE_FONT_ATLAS
      pxTexturedQuads quads;
      getFontResource()->renderTextToQuads(tempStr, size, sx, sy, quads, roundf(xPos), roundf(tempY));
-     mQuadsVector.push_back(quads);
+     mQuads.append(quads);
  #else
    getFontResource()->renderText(tempStr, size, xPos, tempY, sx, sy, mTextColor,lineWidth);
 #endif
@@ -1234,17 +1214,18 @@ void pxTextBox::renderTextRowWithTruncation(rtString & accString, float lineWidt
   sx = 1.0;
   sy = 1.0;
 
+  pxFont* font = getFontResource();
+  if (font == NULL)
+  {
+    return;
+  }
+
   float charW=0, charH=0;
-  char * tempStr = strdup(accString.cString()); // Should give a copy
-  int length = accString.length();
   float ellipsisW = 0;
   if( mEllipsis)
   {
     // Determine ellipsis width in pixels
-    if (getFontResource() != NULL)
-    {
-      getFontResource()->measureTextInternal(ELLIPSIS_STR, pixelSize, sx, sy, ellipsisW, charH);
-    }
+    font->measureTextInternal(ELLIPSIS_STR, pixelSize, sx, sy, ellipsisW, charH);
     //rtLogDebug("ellipsisW is %f\n",ellipsisW);
   }
 
@@ -1261,22 +1242,21 @@ void pxTextBox::renderTextRowWithTruncation(rtString & accString, float lineWidt
     }
   }
 
- 
-    // TODO this looks pretty inefficient... We should revisit...
-  for(int i = length; i > 0; i--)
+  std::string text(accString.cString());
+  pxTextRunRef run = font->shapeText(text.c_str(), pixelSize);
+  float lineHeight = 0;
+  font->getHeight(pixelSize, lineHeight);
+
+  // Look for the most characters that fit, measured from the shaped run
+  // rather than by measuring each shorter string again
+  for(int i = (int)run->glyphs.size(); i > 0; i--)
   {
-    // eliminate a utf8 character to see if new string width fits
-    tempStr[u8_offset(tempStr,i)] = '\0';
-    charW = 0;
-    charH = 0;
-    if (getFontResource() != NULL)
-    {
-      getFontResource()->measureTextInternal(tempStr, pixelSize, sx, sy, charW, charH);
-    }
+    run->measure(0, i, lineHeight, charW, charH);
 	
     if( (tempX + charW + ellipsisW) <= lineWidth)
     {
       float xPos = tempX;
+      std::string tempStr = text.substr(0, i < (int)run->glyphs.size() ? run->glyphs[i].offset : text.length());
       if( mTruncation == pxConstantsTruncation::TRUNCATE)
       {
         // we're done; just render
@@ -1295,25 +1275,25 @@ void pxTextBox::renderTextRowWithTruncation(rtString & accString, float lineWidt
         setLineMeasurements(false, xPos+charW, tempY);
         if( lineNumber==0) {setLineMeasurements(true, xPos, tempY);}
 
-        if( render && getFontResource() != NULL) {
+        if( render) {
 #ifdef PXSCENE_FONT_ATLAS
           pxTexturedQuads quads;
-          getFontResource()->renderTextToQuads(tempStr, pixelSize, sx, sy, quads, roundf(xPos), roundf(tempY));
-          mQuadsVector.push_back(quads);
+          font->renderTextToQuads(tempStr.c_str(), pixelSize, sx, sy, quads, roundf(xPos), roundf(tempY));
+          mQuads.append(quads);
 #else
-          getFontResource()->renderText(tempStr, pixelSize, xPos, tempY, 1.0, 1.0, mTextColor,lineWidth);
+          font->renderText(tempStr.c_str(), pixelSize, xPos, tempY, 1.0, 1.0, mTextColor,lineWidth);
 #endif       
         }
         if( mEllipsis)
         {
           //rtLogDebug("rendering truncated text with ellipsis\n");
-          if( render && getFontResource() != NULL) {
+          if( render) {
 #ifdef PXSCENE_FONT_ATLAS
             pxTexturedQuads quads;  
-            getFontResource()->renderTextToQuads(ELLIPSIS_STR, pixelSize, sx, sy, quads, roundf(xPos+charW), roundf(tempY));
-            mQuadsVector.push_back(quads);
+            font->renderTextToQuads(ELLIPSIS_STR, pixelSize, sx, sy, quads, roundf(xPos+charW), roundf(tempY));
+            mQuads.append(quads);
 #else
-            getFontResource()->renderText(ELLIPSIS_STR, pixelSize, xPos+charW, tempY, 1.0, 1.0, mTextColor,lineWidth);
+            font->renderText(ELLIPSIS_STR, pixelSize, xPos+charW, tempY, 1.0, 1.0, mTextColor,lineWidth);
 #endif          
           }
           if(!mWordWrap) { setMeasurementBounds(xPos, charW+ellipsisW, tempY, charH); }
@@ -1325,29 +1305,16 @@ void pxTextBox::renderTextRowWithTruncation(rtString & accString, float lineWidt
       else if( mTruncation == pxConstantsTruncation::TRUNCATE_AT_WORD)
       {
         // Look for word boundary on which to break
-        int n = 1;
-        // rtLogDebug("Start looking for wordBoundary at length %d in \"%s\"\n",length,tempStr);
-        // check if we're already at a word boundary in the original string
-        if( mEllipsis && (accString.find(length-1," ")==length || accString.find(length-1,"\t")==length) ) 
-        {
-          //rtLogDebug("Start looking for wordBoundary char= %s in \"%s\"\n",accString.substring(length-1,1).cString(),accString.cString());
-          n = 0;
-        } 
-        else 
+        int n = i - 1;
+        while(n >= 0 && !run->glyphs[n].breakAfter)
         {
-          while(!isWordBoundary(tempStr[i-n]) && n <= i)
-          {
-            n++;
-          }
+          n--;
         }
 
-        if( isWordBoundary(tempStr[i-n]))
+        if( n >= 0)
         {
-          tempStr[i-n+1] = '\0';
-          if (getFontResource() != NULL)
-          {
-            getFontResource()->measureTextInternal(tempStr, pixelSize, sx, sy, charW, charH);
-          }
+          tempStr = text.substr(0, run->glyphs[n].offset + run->glyphs[n].length);
+          run->measure(0, n + 1, lineHeight, charW, charH);
 
           // Ignore xStartPos and xStopPos if H align is not LEFT
           if( mAlignHorizontal == pxConstantsAlignHorizontal::CENTER)
@@ -1362,27 +1329,27 @@ void pxTextBox::renderTextRowWithTruncation(rtString & accString, float lineWidt
           else { setMeasurementBoundsX(false, charW);}
           setLineMeasurements(false, xPos+charW, tempY);
           if( lineNumber==0) {setLineMeasurements(true, xPos, tempY);  }
-          if( render && getFontResource() != NULL)
+          if( render)
           {
 #ifdef PXSCENE_FONT_ATLAS
             pxTexturedQuads quads;
-            getFontResource()->renderTextToQuads(tempStr, pixelSize, sx, sy, quads, roundf(xPos), roundf(tempY));
-            mQuadsVector.push_back(quads);
+            font->renderTextToQuads(tempStr.c_str(), pixelSize, sx, sy, quads, roundf(xPos), roundf(tempY));
+            mQuads.append(quads);
 #else
-            getFontResource()->renderText(tempStr, pixelSize, xPos, tempY, 1.0, 1.0, mTextColor,lineWidth);
+            font->renderText(tempStr.c_str(), pixelSize, xPos, tempY, 1.0, 1.0, mTextColor,lineWidth);
 #endif          
           }
         }
         if( mEllipsis)
         {
           //rtLogDebug("rendering  text on word boundary with ellipsis\n");
-          if( render && getFontResource() != NULL) {
+          if( render) {
 #ifdef PXSCENE_FONT_ATLAS
             pxTexturedQuads quads;
-            getFontResource()->renderTextToQuads(ELLIPSIS_STR, pixelSize, sx, sy, quads, roundf(xPos+charW), roundf(tempY));
-            mQuadsVector.push_back(quads);
+            font->renderTextToQuads(ELLIPSIS_STR, pixelSize, sx, sy, quads, roundf(xPos+charW), roundf(tempY));
+            mQuads.append(quads);
 #else
-            getFontResource()->renderText(ELLIPSIS_STR, pixelSize, xPos+charW, tempY, 1.0, 1.0, mTextColor,lineWidth);
+            font->renderText(ELLIPSIS_STR, pixelSize, xPos+charW, tempY, 1.0, 1.0, mTextColor,lineWidth);
 #endif         
           }
           if(!mWordWrap) { setMeasurementBounds(xPos, charW+ellipsisW, tempY, charH); }
@@ -1393,16 +1360,8 @@ void pxTextBox::renderTextRowWithTruncation(rtString & accString, float lineWidt
       }
     }
   }//FOR
-
-  if(tempStr)
-    free(tempStr);
-  tempStr = NULL;
 }
 
-bool pxTextBox::isWordBoundary( char ch )
-{
-    return (strchr(isWordBoundary_chars, ch) != NULL);
-}
 bool pxTextBox::isSpaceChar( char ch )
 {
   return (strchr(isSpaceChar_chars, ch) != NULL);
@@ -279,6 +279,14 @@ public:
     return e;
   }
 
+  // w and h mark the text box dirty in Set()
+  virtual pxAnimatedProperty animatedProperty(const char* prop) override
+  {
+    if (!strcmp(prop, "w") || !strcmp(prop, "h"))
+      return PX_ANIMATED_PROPERTY_CUSTOM;
+    return pxText::animatedProperty(prop);
+  }
+
 
  protected:
  
@@ -298,10 +306,6 @@ public:
   bool mInitialized;
   bool mNeedsRecalc;
 
-  #ifdef PXSCENE_FONT_ATLAS
-  std::vector<pxTexturedQuads> mQuadsVector;
-  #endif
-
   rtObjectRef measurements;
   uint32_t lineNumber;
   uint32_t lastLineNumber;
@@ -314,7 +318,6 @@ public:
   virtual float getFBOWidth();
   virtual float getFBOHeight(); 
   bool isNewline( char ch );
-  bool isWordBoundary( char ch );
   bool isSpaceChar( char ch );  
   
   void renderTextRowWithTruncation(rtString & accString, float lineWidth, float tempX, float tempY, float sx, float sy, uint32_t pixelSize, bool render);
@@ -428,6 +428,8 @@ void pxWayland::onDraw()
      context.clear( mWidth, mHeight, mClearColor );
   }
 
+  // the compositor draws straight to GL, so quads still batched go first
+  context.flush();
   WstCompositorComposeEmbedded( mWCtx,
                                 mX,
                                 mY,
@@ -916,6 +918,7 @@ rtError pxWayland::drawToFbo(pxContextFramebufferRef& fbo)
   context.setFramebuffer( fbo );
   context.clear( mWidth, mHeight, mClearColor );
 
+  context.flush();
   WstCompositorComposeEmbedded( mWCtx,
                                 0,
                                 0,
@@ -189,3 +189,32 @@ double pxStop(double x)
 
 	return Pulse_(x);
 }
+
+void pxInterpBatch(pxInterp interp, double* t, uint32_t count)
+{
+  if (interp == pxInterpLinear)
+  {
+    for (uint32_t i = 0; i < count; i++)
+    {
+      double v = t[i];
+      v = v < 0 ? 0 : v;
+      t[i] = v > 1 ? 1 : v;
+    }
+  }
+  else if (interp == pxExp1 || interp == pxInQuad)
+  {
+    for (uint32_t i = 0; i < count; i++)
+      t[i] = t[i] * t[i];
+  }
+  else if (interp == pxInBack)
+  {
+    const double s = 1.70158;
+    for (uint32_t i = 0; i < count; i++)
+      t[i] = t[i] * t[i] * ((s + 1.0) * t[i] - s);
+  }
+  else
+  {
+    for (uint32_t i = 0; i < count; i++)
+      t[i] = interp(t[i]);
+  }
+}
@@ -21,6 +21,8 @@
 #ifndef PX_INTERPOLATORS_H
 #define PX_INTERPOLATORS_H
 
+#include <stdint.h>
+
 typedef double (*pxInterp)(double i);
 
 double pxInterpLinear(double i);
@@ -35,4 +37,9 @@ double pxEaseInElastic(double t);
 double pxEaseOutBounce(double t);
 double pxEaseOutElastic(double t);
 double pxEaseInOutBounce(double t);
+
+// Replaces each of the count values in t with interp(t).  The polynomial
+// interpolators are evaluated in straight loops the compiler can vectorize,
+// the others are called once per value.
+void pxInterpBatch(pxInterp interp, double* t, uint32_t count);
 #endif
@@ -54,6 +54,97 @@ void sincosf(float x, float *s, float *c);
 #endif
 #endif //defined(PX_PLATFORM_GENERIC_EGL) || defined(PX_PLATFORM_GENERIC_DFB)
 
+#ifndef PX_MATRIX4T_NO_SIMD
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define PX_MATRIX4T_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PX_MATRIX4T_NEON
+#include <arm_neon.h>
+#endif
+#endif // PX_MATRIX4T_NO_SIMD
+
+// Column-major 4x4 kernels shared by pxMatrix4T.  The float overloads use
+// SSE or NEON when the compiler targets them, the templates are the scalar
+// versions.
+
+// out = a * b, out may be a or b
+template <typename FloatT>
+inline void pxMatrix4Multiply(const FloatT* a, const FloatT* b, FloatT* out)
+{
+  FloatT a00 = a[0], a01 = a[1], a02 = a[2], a03 = a[3],
+      a10 = a[4], a11 = a[5], a12 = a[6], a13 = a[7],
+      a20 = a[8], a21 = a[9], a22 = a[10], a23 = a[11],
+      a30 = a[12], a31 = a[13], a32 = a[14], a33 = a[15];
+
+  for (int i = 0; i < 16; i += 4)
+  {
+    // Cache only the current line of the second matrix
+    FloatT b0 = b[i], b1 = b[i + 1], b2 = b[i + 2], b3 = b[i + 3];
+    out[i] = b0*a00 + b1*a10 + b2*a20 + b3*a30;
+    out[i + 1] = b0*a01 + b1*a11 + b2*a21 + b3*a31;
+    out[i + 2] = b0*a02 + b1*a12 + b2*a22 + b3*a32;
+    out[i + 3] = b0*a03 + b1*a13 + b2*a23 + b3*a33;
+  }
+}
+
+// out = m * v, out may be v
+template <typename FloatT>
+inline void pxMatrix4Transform(const FloatT* m, const FloatT* v, FloatT* out)
+{
+  FloatT x = v[0], y = v[1], z = v[2], w = v[3];
+  out[0] = m[0] * x + m[4] * y + m[8] * z + m[12] * w;
+  out[1] = m[1] * x + m[5] * y + m[9] * z + m[13] * w;
+  out[2] = m[2] * x + m[6] * y + m[10] * z + m[14] * w;
+  out[3] = m[3] * x + m[7] * y + m[11] * z + m[15] * w;
+}
+
+#if defined(PX_MATRIX4T_SSE)
+inline void pxMatrix4Multiply(const float* a, const float* b, float* out)
+{
+  __m128 a0 = _mm_loadu_ps(a), a1 = _mm_loadu_ps(a + 4), a2 = _mm_loadu_ps(a + 8), a3 = _mm_loadu_ps(a + 12);
+  for (int i = 0; i < 16; i += 4)
+  {
+    __m128 r = _mm_mul_ps(a0, _mm_set1_ps(b[i]));
+    r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(b[i + 1])));
+    r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(b[i + 2])));
+    r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(b[i + 3])));
+    _mm_storeu_ps(out + i, r);
+  }
+}
+
+inline void pxMatrix4Transform(const float* m, const float* v, float* out)
+{
+  __m128 r = _mm_mul_ps(_mm_loadu_ps(m), _mm_set1_ps(v[0]));
+  r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m + 4), _mm_set1_ps(v[1])));
+  r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m + 8), _mm_set1_ps(v[2])));
+  r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m + 12), _mm_set1_ps(v[3])));
+  _mm_storeu_ps(out, r);
+}
+#elif defined(PX_MATRIX4T_NEON)
+inline void pxMatrix4Multiply(const float* a, const float* b, float* out)
+{
+  float32x4_t a0 = vld1q_f32(a), a1 = vld1q_f32(a + 4), a2 = vld1q_f32(a + 8), a3 = vld1q_f32(a + 12);
+  for (int i = 0; i < 16; i += 4)
+  {
+    float32x4_t r = vmulq_n_f32(a0, b[i]);
+    r = vmlaq_n_f32(r, a1, b[i + 1]);
+    r = vmlaq_n_f32(r, a2, b[i + 2]);
+    r = vmlaq_n_f32(r, a3, b[i + 3]);
+    vst1q_f32(out + i, r);
+  }
+}
+
+inline void pxMatrix4Transform(const float* m, const float* v, float* out)
+{
+  float32x4_t r = vmulq_n_f32(vld1q_f32(m), v[0]);
+  r = vmlaq_n_f32(r, vld1q_f32(m + 4), v[1]);
+  r = vmlaq_n_f32(r, vld1q_f32(m + 8), v[2]);
+  r = vmlaq_n_f32(r, vld1q_f32(m + 12), v[3]);
+  vst1q_f32(out, r);
+}
+#endif // PX_MATRIX4T_SSE
+
 template<typename FloatT> class pxMatrix4T;
 
 template <typename FloatT = float>
@@ -62,7 +153,7 @@ class pxVector4T
 friend class pxMatrix4T<FloatT>;
 public:
   pxVector4T(): mX(0), mY(0), mZ(0), mW(1) {}
-  pxVector4T(float x, float y, float z = 0, float w = 1) 
+  pxVector4T(FloatT x, FloatT y, FloatT z = 0, FloatT w = 1) 
   {
     mX = x; mY = y, mZ = z; mW = w;
   }
@@ -87,7 +178,7 @@ public:
   }
 
 private:
-  float mX, mY, mZ, mW;
+  FloatT mX, mY, mZ, mW;
 };
 
 
@@ -113,54 +204,29 @@ public:
   {
     FloatT* a = mValues;
     FloatT* b = mat.mValues;
-    
-    FloatT out[16];
 
-    float a00 = a[0], a01 = a[1], a02 = a[2], a03 = a[3],
-        a10 = a[4], a11 = a[5], a12 = a[6], a13 = a[7],
-        a20 = a[8], a21 = a[9], a22 = a[10], a23 = a[11],
-        a30 = a[12], a31 = a[13], a32 = a[14], a33 = a[15];
+    if (isAffine2D() && mat.isAffine2D())
+    {
+      FloatT a00 = a[0], a01 = a[1], a10 = a[4], a11 = a[5];
+      FloatT b0 = b[0], b1 = b[1];
+      a[0] = b0*a00 + b1*a10;
+      a[1] = b0*a01 + b1*a11;
+      b0 = b[4]; b1 = b[5];
+      a[4] = b0*a00 + b1*a10;
+      a[5] = b0*a01 + b1*a11;
+      b0 = b[12]; b1 = b[13];
+      a[12] = b0*a00 + b1*a10 + a[12];
+      a[13] = b0*a01 + b1*a11 + a[13];
+      return;
+    }
 
-    // Cache only the current line of the second matrix
-    float b0  = b[0], b1 = b[1], b2 = b[2], b3 = b[3];
-    out[0] = b0*a00 + b1*a10 + b2*a20 + b3*a30;
-    out[1] = b0*a01 + b1*a11 + b2*a21 + b3*a31;
-    out[2] = b0*a02 + b1*a12 + b2*a22 + b3*a32;
-    out[3] = b0*a03 + b1*a13 + b2*a23 + b3*a33;
-
-    b0 = b[4]; b1 = b[5]; b2 = b[6]; b3 = b[7];
-    out[4] = b0*a00 + b1*a10 + b2*a20 + b3*a30;
-    out[5] = b0*a01 + b1*a11 + b2*a21 + b3*a31;
-    out[6] = b0*a02 + b1*a12 + b2*a22 + b3*a32;
-    out[7] = b0*a03 + b1*a13 + b2*a23 + b3*a33;
-
-    b0 = b[8]; b1 = b[9]; b2 = b[10]; b3 = b[11];
-    out[8] = b0*a00 + b1*a10 + b2*a20 + b3*a30;
-    out[9] = b0*a01 + b1*a11 + b2*a21 + b3*a31;
-    out[10] = b0*a02 + b1*a12 + b2*a22 + b3*a32;
-    out[11] = b0*a03 + b1*a13 + b2*a23 + b3*a33;
-
-    b0 = b[12]; b1 = b[13]; b2 = b[14]; b3 = b[15];
-    out[12] = b0*a00 + b1*a10 + b2*a20 + b3*a30;
-    out[13] = b0*a01 + b1*a11 + b2*a21 + b3*a31;
-    out[14] = b0*a02 + b1*a12 + b2*a22 + b3*a32;
-    out[15] = b0*a03 + b1*a13 + b2*a23 + b3*a33;
-
-    memcpy(a, &out, sizeof out);
+    pxMatrix4Multiply(a, b, a);
   }
   
   pxVector4T<FloatT> multiply(const pxVector4T<FloatT>& v) 
   {
     pxVector4T<FloatT> out;
-    float x = v.mX;
-    float y = v.mY;
-    float z = v.mZ;
-    float w = v.mW;
-    float* m = mValues;
-    out.mX = m[0] * x + m[4] * y + m[8] * z + m[12] * w;
-    out.mY = m[1] * x + m[5] * y + m[9] * z + m[13] * w;
-    out.mZ = m[2] * x + m[6] * y + m[10] * z + m[14] * w;
-    out.mW = m[3] * x + m[7] * y + m[11] * z + m[15] * w;
+    pxMatrix4Transform(mValues, &v.mX, &out.mX);
     return out;
   }
   
@@ -186,26 +252,19 @@ public:
 
 void multiply(FloatT* m, FloatT* n) 
 {
-  
-  FloatT tmp[16];
-  const FloatT *row, *column;
-  div_t d;
-  int i, j;
-  
-  for (i = 0; i < 16; i++) {
-    tmp[i] = 0;
-    d = div(i, 4);
-    row = n + d.quot * 4;
-    column = m + d.rem;
-    for (j = 0; j < 4; j++)
-      tmp[i] += row[j] * column[j * 4];
-  }
-  memcpy(m, &tmp, sizeof tmp);
+  pxMatrix4Multiply(m, n, m);
 }
 
   void rotateInRadians(FloatT angle, FloatT x, FloatT y, FloatT z) 
   {
 #if 1
+    // turning about z keeps 2d matrices 2d
+    if (x == 0 && y == 0 && z == 1)
+    {
+      rotateZInRadians(angle);
+      return;
+    }
+
     FloatT* m = mValues;
     FloatT s, c;
     
@@ -325,6 +384,17 @@ void multiply(FloatT* m, FloatT* n)
     }
   }
 
+  // true if the matrix only moves, turns, scales or skews x and y, then
+  // multiply and invert skip the z and w terms
+  bool isAffine2D() const
+  {
+    const FloatT* m = mValues;
+
+    return (m[2]  == 0.0 && m[3]  == 0.0 && m[6]  == 0.0 && m[7]  == 0.0 &&
+            m[8]  == 0.0 && m[9]  == 0.0 && m[11] == 0.0 && m[14] == 0.0 &&
+            m[10] == 1.0 && m[15] == 1.0);
+  }
+
   bool isTranslatedOnly()
   {
     FloatT *m = mValues;
@@ -392,9 +462,39 @@ void multiply(FloatT* m, FloatT* n)
    * This function can currently handle only pure translation-rotation matrices.
    * Read http://www.gamedev.net/community/forums/topic.asp?topic_id=425118
    * for an explanation.
+   *
+   * 2d affine matrices, what pxObject::applyMatrix builds unless objects
+   * are turned about x or y, only need their 2x2 part and translation inverted.
    */
 
   void invert() 
+  {
+    if (isAffine2D())
+    {
+      invertAffine2D();
+    }
+    else
+    {
+      invert4x4();
+    }
+  }
+
+  void invertAffine2D()
+  {
+    FloatT* m = mValues;
+
+    FloatT a00 = m[0], a01 = m[1], a10 = m[4], a11 = m[5], a30 = m[12], a31 = m[13];
+    FloatT det = static_cast<FloatT> (1.0 / (a00 * a11 - a01 * a10));
+
+    m[0] = a11 * det;
+    m[1] = -a01 * det;
+    m[4] = -a10 * det;
+    m[5] = a00 * det;
+    m[12] = (a10 * a31 - a11 * a30) * det;
+    m[13] = (a01 * a30 - a00 * a31) * det;
+  }
+
+  void invert4x4()
   {
     float* a = mValues;
     float* out = mValues;
@@ -27,6 +27,7 @@
 #include <string.h>
 #include <stdarg.h>
 #include <png.h>
+#include <zlib.h>
 #ifdef SUPPORT_GIF
 #include <gif_lib.h>
 #endif
@@ -34,9 +35,23 @@
 #include "pxCore.h"
 #include "pxOffscreen.h"
 #include "pxUtil.h"
+#include "rtThreadPool.h"
+#include "rtThreadTask.h"
+#include "rtMutex.h"
+#include "rtAtomic.h"
 
 #include <openssl/md5.h>
 
+#include <math.h>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PX_RESAMPLE_NEON
+#endif
+
 #define SUPPORT_PNG
 #define SUPPORT_JPG
 
@@ -92,19 +107,25 @@ rtError pxLoadImage(const char *imageData, size_t imageDataSize,  pxOffscreen &o
     case PX_IMAGE_PNG:
          {
            retVal = pxLoadPNGImage(imageData, imageDataSize, o);
+           if (retVal == RT_OK)
+           {
+             int32_t targetW, targetH;
+             pxImageTargetSize(o.width(), o.height(), w, h, sx, sy, targetW, targetH);
+             retVal = pxDownscaleImageToTarget(o, targetW, targetH);
+           }
          }
          break;
 
     case PX_IMAGE_JPG:
          {
 #ifdef ENABLE_LIBJPEG_TURBO
-           retVal = pxLoadJPGImageTurbo(imageData, imageDataSize, o);
+           retVal = pxLoadJPGImageTurbo(imageData, imageDataSize, o, w, h, sx, sy);
            if (retVal != RT_OK)
            {
-             retVal = pxLoadJPGImage(imageData, imageDataSize, o);
+             retVal = pxLoadJPGImage(imageData, imageDataSize, o, w, h, sx, sy);
            }
 #else
-        retVal = pxLoadJPGImage(imageData, imageDataSize, o);
+        retVal = pxLoadJPGImage(imageData, imageDataSize, o, w, h, sx, sy);
 #endif //ENABLE_LIBJPEG_TURBO
          }
          break;
@@ -134,6 +155,511 @@ rtError pxLoadImage(const char *imageData, size_t imageDataSize,  pxOffscreen &o
   return retVal;
 }
 
+void pxImageTargetSize(int32_t imageW, int32_t imageH, int32_t w, int32_t h, float sx, float sy,
+                       int32_t& targetW, int32_t& targetH)
+{
+  targetW = imageW;
+  targetH = imageH;
+
+  if (imageW <= 0 || imageH <= 0)
+  {
+    return;
+  }
+
+  if (sx > 0.0f && sy > 0.0f && (sx != 1.0f || sy != 1.0f)) // Scale takes precedence
+  {
+    if (sx < 1.0f)
+    {
+      targetW = (int32_t)(imageW * sx + 0.5f);
+    }
+    if (sy < 1.0f)
+    {
+      targetH = (int32_t)(imageH * sy + 0.5f);
+    }
+  }
+  else if (w > 0 && h > 0)
+  {
+    float ratioW = (float) w / (float) imageW;
+    float ratioH = (float) h / (float) imageH;
+    float ratio  = (ratioW < ratioH) ? ratioW : ratioH; // MIN()
+
+    if (ratio < 1.0f)
+    {
+      targetW = (int32_t)(imageW * ratio + 0.5f);
+      targetH = (int32_t)(imageH * ratio + 0.5f);
+    }
+  }
+
+  if (targetW < 1)
+  {
+    targetW = 1;
+  }
+  if (targetH < 1)
+  {
+    targetH = 1;
+  }
+}
+
+// Adds the channels of every factorX neighbouring pixels of a source row
+// into the per channel sums of the destination row.  The last block may be
+// narrower when the width is not a multiple of factorX.
+static void pxBoxSumRow(const uint8_t* src, int32_t srcW, uint32_t* sums, int32_t factorX)
+{
+  int32_t fullBlocks = srcW / factorX;
+  int32_t x = 0;
+
+#ifdef __SSE2__
+  if (factorX == 2)
+  {
+    const __m128i zero = _mm_setzero_si128();
+
+    // 4 source pixels make 2 destination pixels per iteration
+    for (; x + 2 <= fullBlocks; x += 2)
+    {
+      __m128i pixels = _mm_loadu_si128((const __m128i*)(src + x * 8));
+      __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+      __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+      lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+      hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+      __m128i pairs = _mm_unpacklo_epi64(lo, hi);
+
+      __m128i* s = (__m128i*)(sums + x * 4);
+      _mm_storeu_si128(s,     _mm_add_epi32(_mm_loadu_si128(s),     _mm_unpacklo_epi16(pairs, zero)));
+      _mm_storeu_si128(s + 1, _mm_add_epi32(_mm_loadu_si128(s + 1), _mm_unpackhi_epi16(pairs, zero)));
+    }
+  }
+#endif //__SSE2__
+
+  for (; x < fullBlocks; x++)
+  {
+    const uint8_t* p = src + x * factorX * 4;
+    uint32_t* s = sums + x * 4;
+    for (int32_t i = 0; i < factorX; i++, p += 4)
+    {
+      s[0] += p[0];
+      s[1] += p[1];
+      s[2] += p[2];
+      s[3] += p[3];
+    }
+  }
+
+  const uint8_t* p = src + fullBlocks * factorX * 4;
+  uint32_t* s = sums + fullBlocks * 4;
+  for (int32_t i = fullBlocks * factorX; i < srcW; i++, p += 4)
+  {
+    s[0] += p[0];
+    s[1] += p[1];
+    s[2] += p[2];
+    s[3] += p[3];
+  }
+}
+
+rtError pxBoxDownscaleImage(pxBuffer& src, pxOffscreen& dst, int32_t factorX, int32_t factorY)
+{
+  if (factorX < 1 || factorY < 1 || src.width() < 1 || src.height() < 1)
+  {
+    rtLogError("pxBoxDownscaleImage: bad factor %d x %d", factorX, factorY);
+    return RT_FAIL;
+  }
+
+  int32_t srcW = src.width();
+  int32_t srcH = src.height();
+  int32_t dstW = (srcW + factorX - 1) / factorX;
+  int32_t dstH = (srcH + factorY - 1) / factorY;
+
+  if (dst.init(dstW, dstH) != PX_OK)
+  {
+    return RT_FAIL;
+  }
+  dst.mPixelFormat = src.mPixelFormat;
+
+  // channels are averaged independently so the pixel format does not matter
+  int32_t lastBlockW = srcW - (dstW - 1) * factorX;
+  std::vector<uint32_t> sums(dstW * 4);
+
+  for (int32_t y = 0; y < dstH; y++)
+  {
+    std::fill(sums.begin(), sums.end(), 0);
+
+    int32_t rows = std::min(factorY, srcH - y * factorY);
+    for (int32_t i = 0; i < rows; i++)
+    {
+      pxBoxSumRow((const uint8_t*)src.scanline(y * factorY + i), srcW, &sums[0], factorX);
+    }
+
+    uint8_t* d = (uint8_t*)dst.scanline(y);
+    uint32_t count = factorX * rows;
+    for (int32_t c = 0; c < dstW * 4; c++)
+    {
+      if (c == (dstW - 1) * 4)
+      {
+        count = lastBlockW * rows;
+      }
+      d[c] = (uint8_t)((sums[c] + count / 2) / count);
+    }
+  }
+
+  return RT_OK;
+}
+
+// Largest whole factor that keeps ceil(size / factor) at or above target
+static int32_t pxBoxDownscaleFactor(int32_t size, int32_t target)
+{
+  if (target >= size)
+  {
+    return 1;
+  }
+  if (target <= 1)
+  {
+    return size;
+  }
+  return (size - 1) / (target - 1);
+}
+
+rtError pxDownscaleImageToTarget(pxOffscreen& o, int32_t targetW, int32_t targetH)
+{
+  if (targetW <= 0 || targetH <= 0)
+  {
+    return RT_OK;
+  }
+
+  int32_t factorX = pxBoxDownscaleFactor(o.width(),  targetW);
+  int32_t factorY = pxBoxDownscaleFactor(o.height(), targetH);
+
+  if (factorX == 1 && factorY == 1)
+  {
+    return RT_OK;
+  }
+
+  pxOffscreen scaled;
+  rtError retVal = pxBoxDownscaleImage(o, scaled, factorX, factorY);
+  if (retVal == RT_OK)
+  {
+    o = scaled;
+    o.mPixelFormat = scaled.mPixelFormat;
+  }
+  return retVal;
+}
+
+// images with at least this many source pixels are resampled on the thread pool
+#define PX_RESAMPLE_THREADED_PIXELS (1024 * 1024)
+#define PX_RESAMPLE_MIN_BAND_ROWS 16
+
+// One pixel's four channels as floats, so a tap is a single multiply-add
+#ifdef __SSE2__
+typedef __m128 pxResampleVec;
+
+static inline pxResampleVec pxResampleZero()
+{
+  return _mm_setzero_ps();
+}
+
+static inline pxResampleVec pxResampleLoadPixel(const uint32_t* p)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i v = _mm_cvtsi32_si128((int)*p);
+  v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero);
+  return _mm_cvtepi32_ps(v);
+}
+
+static inline void pxResampleStorePixel(uint32_t* p, pxResampleVec v)
+{
+  __m128i i = _mm_cvtps_epi32(v);
+  i = _mm_packs_epi32(i, i);
+  *p = (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(i, i));
+}
+
+static inline pxResampleVec pxResampleLoad(const float* f)
+{
+  return _mm_loadu_ps(f);
+}
+
+static inline void pxResampleStore(float* f, pxResampleVec v)
+{
+  _mm_storeu_ps(f, v);
+}
+
+static inline pxResampleVec pxResampleMulAdd(pxResampleVec acc, pxResampleVec v, float w)
+{
+  return _mm_add_ps(acc, _mm_mul_ps(v, _mm_set1_ps(w)));
+}
+#elif defined(PX_RESAMPLE_NEON)
+typedef float32x4_t pxResampleVec;
+
+static inline pxResampleVec pxResampleZero()
+{
+  return vdupq_n_f32(0.0f);
+}
+
+static inline pxResampleVec pxResampleLoadPixel(const uint32_t* p)
+{
+  uint8x8_t v = vreinterpret_u8_u32(vld1_dup_u32(p));
+  return vcvtq_f32_u32(vmovl_u16(vget_low_u16(vmovl_u8(v))));
+}
+
+static inline void pxResampleStorePixel(uint32_t* p, pxResampleVec v)
+{
+  uint16x4_t i = vqmovn_u32(vcvtq_u32_f32(vaddq_f32(vmaxq_f32(v, vdupq_n_f32(0.0f)), vdupq_n_f32(0.5f))));
+  uint8x8_t b = vqmovn_u16(vcombine_u16(i, i));
+  vst1_lane_u32(p, vreinterpret_u32_u8(b), 0);
+}
+
+static inline pxResampleVec pxResampleLoad(const float* f)
+{
+  return vld1q_f32(f);
+}
+
+static inline void pxResampleStore(float* f, pxResampleVec v)
+{
+  vst1q_f32(f, v);
+}
+
+static inline pxResampleVec pxResampleMulAdd(pxResampleVec acc, pxResampleVec v, float w)
+{
+  return vmlaq_n_f32(acc, v, w);
+}
+#else
+struct pxResampleVec
+{
+  float c[4];
+};
+
+static inline pxResampleVec pxResampleZero()
+{
+  pxResampleVec v = {{0.0f, 0.0f, 0.0f, 0.0f}};
+  return v;
+}
+
+static inline pxResampleVec pxResampleLoadPixel(const uint32_t* p)
+{
+  const uint8_t* b = (const uint8_t*)p;
+  pxResampleVec v = {{(float)b[0], (float)b[1], (float)b[2], (float)b[3]}};
+  return v;
+}
+
+static inline void pxResampleStorePixel(uint32_t* p, pxResampleVec v)
+{
+  uint8_t* b = (uint8_t*)p;
+  for (int c = 0; c < 4; c++)
+  {
+    float f = v.c[c] + 0.5f;
+    b[c] = f <= 0.0f ? 0 : (f >= 255.0f ? 255 : (uint8_t)f);
+  }
+}
+
+static inline pxResampleVec pxResampleLoad(const float* f)
+{
+  pxResampleVec v = {{f[0], f[1], f[2], f[3]}};
+  return v;
+}
+
+static inline void pxResampleStore(float* f, pxResampleVec v)
+{
+  memcpy(f, v.c, sizeof(v.c));
+}
+
+static inline pxResampleVec pxResampleMulAdd(pxResampleVec acc, pxResampleVec v, float w)
+{
+  for (int c = 0; c < 4; c++)
+  {
+    acc.c[c] += v.c[c] * w;
+  }
+  return acc;
+}
+#endif
+
+// Source pixels and weights that make up each destination pixel along one axis
+struct pxResampleAxis
+{
+  void init(int32_t srcSize, int32_t dstSize, pxResampleFilter filter)
+  {
+    double scale = (double)srcSize / dstSize;
+    if (scale <= 1.0)
+    {
+      // averaging an area smaller than a pixel would just pick pixels
+      filter = PX_RESAMPLE_BILINEAR;
+    }
+    mTaps = (filter == PX_RESAMPLE_AREA) ? (int32_t)ceil(scale) + 1 : 2;
+    mStart.resize(dstSize);
+    mCount.resize(dstSize);
+    mWeights.assign(dstSize * mTaps, 0.0f);
+
+    for (int32_t i = 0; i < dstSize; i++)
+    {
+      float* w = &mWeights[i * mTaps];
+      if (filter == PX_RESAMPLE_AREA)
+      {
+        double l = i * scale;
+        double r = std::min((i + 1) * scale, (double)srcSize);
+        int32_t start = (int32_t)l;
+        int32_t end = std::min((int32_t)ceil(r), srcSize);
+        mStart[i] = start;
+        mCount[i] = end - start;
+        for (int32_t k = start; k < end; k++)
+        {
+          w[k - start] = (float)((std::min(r, k + 1.0) - std::max(l, (double)k)) / scale);
+        }
+      }
+      else
+      {
+        double c = std::min(std::max((i + 0.5) * scale - 0.5, 0.0), srcSize - 1.0);
+        int32_t start = (int32_t)c;
+        float f = (float)(c - start);
+        mStart[i] = start;
+        mCount[i] = (start + 1 < srcSize && f > 0.0f) ? 2 : 1;
+        w[0] = 1.0f - f;
+        w[1] = f;
+        if (mCount[i] == 1)
+        {
+          w[0] = 1.0f;
+        }
+      }
+    }
+  }
+
+  int32_t mTaps;
+  std::vector<int32_t> mStart;
+  std::vector<int32_t> mCount;
+  std::vector<float> mWeights;
+};
+
+// Rows are resampled in bands.  The calling thread takes bands too, so it
+// never waits on a pool that is busy with other work.
+class pxResampleJob
+{
+public:
+  pxResampleJob(pxBuffer& src, pxBuffer& dst, pxResampleFilter filter, int32_t numBands)
+    : mRefCount(1), mSrc(src), mDst(dst), mNumBands(numBands), mNextBand(0), mBandsDone(0),
+      mMutex(), mCondition()
+  {
+    mX.init(src.width(), dst.width(), filter);
+    mY.init(src.height(), dst.height(), filter);
+  }
+
+  void AddRef()
+  {
+    rtAtomicInc(&mRefCount);
+  }
+
+  void Release()
+  {
+    if (rtAtomicDec(&mRefCount) == 0)
+    {
+      delete this;
+    }
+  }
+
+  static void resampleTask(void* data)
+  {
+    pxResampleJob* job = (pxResampleJob*)data;
+    job->resampleBands();
+    job->Release();
+  }
+
+  void resampleBands()
+  {
+    int32_t band;
+    while ((band = rtAtomicInc(&mNextBand) - 1) < mNumBands)
+    {
+      int32_t dstH = mDst.height();
+      resampleRows(band * dstH / mNumBands, (band + 1) * dstH / mNumBands);
+
+      rtMutexLockGuard guard(mMutex);
+      if (++mBandsDone == mNumBands)
+      {
+        mCondition.broadcast();
+      }
+    }
+  }
+
+  void wait()
+  {
+    mMutex.lock();
+    while (mBandsDone < mNumBands)
+    {
+      mCondition.wait(mMutex.getNativeMutexDescription());
+    }
+    mMutex.unlock();
+  }
+
+private:
+  void resampleRows(int32_t top, int32_t bottom)
+  {
+    int32_t dstW = mDst.width();
+    std::vector<float> row(dstW * 4);
+
+    for (int32_t y = top; y < bottom; y++)
+    {
+      std::fill(row.begin(), row.end(), 0.0f);
+      const float* wy = &mY.mWeights[y * mY.mTaps];
+      for (int32_t j = 0; j < mY.mCount[y]; j++)
+      {
+        const uint32_t* s = mSrc.scanlineInt32(mY.mStart[y] + j);
+        float* r = &row[0];
+        for (int32_t x = 0; x < dstW; x++, r += 4)
+        {
+          const uint32_t* p = s + mX.mStart[x];
+          const float* wx = &mX.mWeights[x * mX.mTaps];
+          pxResampleVec sum = pxResampleZero();
+          for (int32_t i = 0; i < mX.mCount[x]; i++)
+          {
+            sum = pxResampleMulAdd(sum, pxResampleLoadPixel(p + i), wx[i]);
+          }
+          pxResampleStore(r, pxResampleMulAdd(pxResampleLoad(r), sum, wy[j]));
+        }
+      }
+
+      uint32_t* d = mDst.scanlineInt32(y);
+      for (int32_t x = 0; x < dstW; x++)
+      {
+        pxResampleStorePixel(d + x, pxResampleLoad(&row[x * 4]));
+      }
+    }
+  }
+
+  rtAtomic mRefCount;
+  pxBuffer& mSrc;
+  pxBuffer& mDst;
+  pxResampleAxis mX;
+  pxResampleAxis mY;
+  int32_t mNumBands;
+  rtAtomic mNextBand;
+  int32_t mBandsDone;
+  rtMutex mMutex;
+  rtThreadCondition mCondition;
+};
+
+rtError pxResampleImage(pxBuffer& src, pxBuffer& dst, pxResampleFilter filter)
+{
+  if (src.base() == NULL || dst.base() == NULL || src.width() < 1 || src.height() < 1 ||
+      dst.width() < 1 || dst.height() < 1)
+  {
+    rtLogError("pxResampleImage: bad image size %d x %d to %d x %d", src.width(), src.height(),
+               dst.width(), dst.height());
+    return RT_FAIL;
+  }
+
+  int32_t numBands = 1;
+  if ((int64_t)src.width() * src.height() >= PX_RESAMPLE_THREADED_PIXELS)
+  {
+    numBands = std::min(rtThreadPool::globalInstance()->numberOfThreadsInPool() + 1,
+                        std::max(dst.height() / PX_RESAMPLE_MIN_BAND_ROWS, 1));
+  }
+
+  pxResampleJob* job = new pxResampleJob(src, dst, filter, numBands);
+  for (int32_t i = 1; i < numBands; i++)
+  {
+    job->AddRef();
+    rtThreadPool::globalInstance()->executeTask(new rtThreadTask(pxResampleJob::resampleTask, job, "",
+                                                                 RT_THREAD_TASK_PRIORITY_VISIBLE));
+  }
+  job->resampleBands();
+  job->wait();
+  job->Release();
+
+  return RT_OK;
+}
+
 // APNG looks like a PNG with extra chunks ... can fallback to display static PNG
 
 rtError pxLoadAImage(const char* imageData, size_t imageDataSize,
@@ -165,6 +691,7 @@ rtError pxLoadAImage(const char* imageData, size_t imageDataSize,
     s.addBuffer(o,0);
 #endif // 0
   }
+  s.finish();
 
   return retVal;
 }
@@ -735,6 +1262,20 @@ my_error_exit(j_common_ptr cinfo)
  * temporary files are deleted if the program is interrupted.  See libjpeg.txt.
  */
 
+// Largest libjpeg IDCT scale (1/1, 1/2, 1/4 or 1/8) whose output still
+// covers targetW x targetH
+static unsigned int pxJPGScaleDenom(int32_t imageW, int32_t imageH, int32_t targetW, int32_t targetH)
+{
+  unsigned int denom = 8;
+  while (denom > 1 &&
+         ((int32_t)((imageW + denom - 1) / denom) < targetW ||
+          (int32_t)((imageH + denom - 1) / denom) < targetH))
+  {
+    denom /= 2;
+  }
+  return denom;
+}
+
 bool pxIsJPGImage(const char *imageData, size_t imageDataSize)
 {
   return (getImageType( (const uint8_t*) imageData, imageDataSize) == PX_IMAGE_JPG);
@@ -768,7 +1309,8 @@ extern "C" {
 #include <turbojpeg.h>
 }
 
-rtError pxLoadJPGImageTurbo(const char *buf, size_t buflen, pxOffscreen &o)
+rtError pxLoadJPGImageTurbo(const char *buf, size_t buflen, pxOffscreen &o,
+                            int32_t w /* = 0 */, int32_t h /* = 0 */, float sx /* = 1.0f */, float sy /* = 1.0f */)
 {
   rtLogDebug("using pxLoadJPGImageTurbo");
   if (!buf)
@@ -800,6 +1342,27 @@ rtError pxLoadJPGImageTurbo(const char *buf, size_t buflen, pxOffscreen &o)
     return RT_FAIL;
   }
 
+  // decode at the smallest IDCT scale that still covers the target size
+  int32_t targetW, targetH;
+  pxImageTargetSize(width, height, w, h, sx, sy, targetW, targetH);
+
+  int numScalingFactors = 0;
+  tjscalingfactor *scalingFactors = tjGetScalingFactors(&numScalingFactors);
+  int scaledWidth = width, scaledHeight = height;
+  for (int i = 0; scalingFactors != NULL && i < numScalingFactors; i++)
+  {
+    int factorWidth  = TJSCALED(width,  scalingFactors[i]);
+    int factorHeight = TJSCALED(height, scalingFactors[i]);
+    if (factorWidth >= targetW && factorHeight >= targetH &&
+        factorWidth <= scaledWidth && factorHeight <= scaledHeight)
+    {
+      scaledWidth  = factorWidth;
+      scaledHeight = factorHeight;
+    }
+  }
+  width  = scaledWidth;
+  height = scaledHeight;
+
   unsigned char *imageBuffer = tjAlloc(width * height * 3);
 
   if (!imageBuffer)
@@ -847,12 +1410,18 @@ rtError pxLoadJPGImageTurbo(const char *buf, size_t buflen, pxOffscreen &o)
   tjFree(imageBuffer);
   tjDestroy(jpegDecompressor);
 
+  if (pxDownscaleImageToTarget(o, targetW, targetH) != RT_OK)
+  {
+    return RT_FAIL;
+  }
+
   /* And we're done! */
   return RT_OK;
 }
 #endif //ENABLE_LIBJPEG_TURBO
 
-rtError pxLoadJPGImage(const char *buf, size_t buflen, pxOffscreen &o)
+rtError pxLoadJPGImage(const char *buf, size_t buflen, pxOffscreen &o,
+                       int32_t w /* = 0 */, int32_t h /* = 0 */, float sx /* = 1.0f */, float sy /* = 1.0f */)
 {
   if (!buf)
   {
@@ -907,6 +1476,12 @@ rtError pxLoadJPGImage(const char *buf, size_t buflen, pxOffscreen &o)
   (void)jpeg_read_header(&cinfo, TRUE);
   cinfo.out_color_space = JCS_RGB;
 
+  // let the IDCT do most of the downscaling, the remainder is box filtered below
+  int32_t targetW, targetH;
+  pxImageTargetSize(cinfo.image_width, cinfo.image_height, w, h, sx, sy, targetW, targetH);
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = pxJPGScaleDenom(cinfo.image_width, cinfo.image_height, targetW, targetH);
+
   /* We can ignore the return value from jpeg_read_header since
    *   (a) suspension is not possible with the stdio data source, and
    *   (b) we passed TRUE to reject a tables-only JPEG file as an error.
@@ -985,6 +1560,11 @@ rtError pxLoadJPGImage(const char *buf, size_t buflen, pxOffscreen &o)
   /* This is an important step since it will release a good deal of memory. */
   jpeg_destroy_decompress(&cinfo);
 
+  if (pxDownscaleImageToTarget(o, targetW, targetH) != RT_OK)
+  {
+    return RT_FAIL;
+  }
+
   /* After finish_decompress, we can close the input file.
    * Here we postpone it until after no more JPEG errors are possible,
    * so as to simplify the setjmp error logic above.  (Actually, I don't
@@ -1258,26 +1838,670 @@ rtError pxLoadPNGImage(const char *imageData, size_t imageDataSize,
   return e;
 }
 
-void pxTimedOffscreenSequence::init()
+//-----------------------------------------------------------------------------
+// pxProgressiveImageDecoder
+
+// getImageType() needs this many bytes before it can tell the type apart
+#define PX_IMAGE_SIGNATURE_SIZE 16
+
+struct pxProgressiveImageDecoder::pxPNGDecodeState
+{
+  pxPNGDecodeState(pxProgressiveImageDecoder* d): decoder(d), png(NULL), info(NULL) {}
+
+  ~pxPNGDecodeState()
+  {
+    if (png != NULL)
+    {
+      png_destroy_read_struct(&png, (info != NULL) ? &info : NULL, NULL);
+    }
+  }
+
+  static void infoCallback(png_structp png, png_infop info)
+  {
+    pxPNGDecodeState* state = (pxPNGDecodeState*)png_get_progressive_ptr(png);
+
+    int width = png_get_image_width(png, info);
+    int height = png_get_image_height(png, info);
+
+    png_byte color_type = png_get_color_type(png, info);
+    png_byte bit_depth = png_get_bit_depth(png, info);
+
+    // same transforms as pxLoadPNGImage so both paths produce identical pixels
+    if (bit_depth == 16)
+    {
+      png_set_strip_16(png);
+    }
+
+    if (color_type == PNG_COLOR_TYPE_PALETTE)
+    {
+      png_set_palette_to_rgb(png);
+    }
+
+    if (color_type == PNG_COLOR_TYPE_GRAY ||
+        color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
+    {
+      png_set_gray_to_rgb(png);
+    }
+
+    if (png_get_valid(png, info, PNG_INFO_tRNS))
+    {
+      png_set_tRNS_to_alpha(png);
+    }
+
+    png_set_add_alpha(png, 0xff, PNG_FILLER_AFTER);
+    png_set_interlace_handling(png);
+    png_read_update_info(png, info);
+
+    if (png_get_rowbytes(png, info) != (png_size_t)width * 4)
+    {
+      png_error(png, "unexpected row size");
+    }
+
+    // rows that have not arrived yet stay transparent
+    if (state->decoder->mImage.initWithColor(width, height, pxClear) != PX_OK)
+    {
+      png_error(png, "could not allocate image");
+    }
+    state->decoder->mImage.mPixelFormat = RT_PIX_RGBA;
+    state->decoder->setImageSize(width, height);
+  }
+
+  static void rowCallback(png_structp png, png_bytep newRow, png_uint_32 rowNumber, int /*pass*/)
+  {
+    pxPNGDecodeState* state = (pxPNGDecodeState*)png_get_progressive_ptr(png);
+    pxOffscreen& image = state->decoder->mImage;
+
+    if (newRow == NULL || rowNumber >= (png_uint_32)image.height())
+    {
+      return;
+    }
+    // merges the rows of interlaced passes, a plain copy otherwise
+    png_progressive_combine_row(png, (png_bytep)image.scanline(rowNumber), newRow);
+    state->decoder->mPartialImageChanged = true;
+  }
+
+  static void endCallback(png_structp png, png_infop /*info*/)
+  {
+    pxPNGDecodeState* state = (pxPNGDecodeState*)png_get_progressive_ptr(png);
+    state->decoder->mComplete = true;
+  }
+
+  pxProgressiveImageDecoder* decoder;
+  png_structp png;
+  png_infop info;
+};
+
+struct pxProgressiveImageDecoder::pxJPGDecodeState
+{
+  enum Stage
+  {
+    READ_HEADER,
+    START_DECOMPRESS,
+    START_OUTPUT_PASS,
+    READ_SCANLINES,
+    FINISH_OUTPUT_PASS,
+    FINISH_DECOMPRESS,
+    DONE
+  };
+
+  pxJPGDecodeState(): created(false), stage(READ_HEADER), bufferedImage(false), finalPass(false),
+                      lastOutputScan(0), skipBytes(0), input(), row(NULL)
+  {
+    memset(&cinfo, 0, sizeof(cinfo));
+    memset(&source, 0, sizeof(source));
+  }
+
+  ~pxJPGDecodeState()
+  {
+    if (created)
+    {
+      jpeg_destroy_decompress(&cinfo);
+    }
+  }
+
+  static void initSource(j_decompress_ptr /*cinfo*/)
+  {
+  }
+
+  // suspend the decoder until write() brings more data
+  static boolean fillInputBuffer(j_decompress_ptr /*cinfo*/)
+  {
+    return FALSE;
+  }
+
+  static void skipInputData(j_decompress_ptr cinfo, long numBytes)
+  {
+    pxJPGDecodeState* state = (pxJPGDecodeState*)cinfo->client_data;
+    if (numBytes <= 0)
+    {
+      return;
+    }
+    if ((size_t)numBytes > cinfo->src->bytes_in_buffer)
+    {
+      // the rest is skipped as it arrives
+      state->skipBytes += (size_t)numBytes - cinfo->src->bytes_in_buffer;
+      cinfo->src->next_input_byte += cinfo->src->bytes_in_buffer;
+      cinfo->src->bytes_in_buffer = 0;
+    }
+    else
+    {
+      cinfo->src->next_input_byte += numBytes;
+      cinfo->src->bytes_in_buffer -= numBytes;
+    }
+  }
+
+  static void termSource(j_decompress_ptr /*cinfo*/)
+  {
+  }
+
+  struct jpeg_decompress_struct cinfo;
+  struct my_error_mgr error;
+  struct jpeg_source_mgr source;
+  bool created;
+  Stage stage;
+  bool bufferedImage;
+  bool finalPass;
+  int lastOutputScan;
+  size_t skipBytes;
+  std::vector<JOCTET> input;
+  JSAMPARRAY row;
+};
+
+pxProgressiveImageDecoder::pxProgressiveImageDecoder(bool lowResFirst, int32_t w, int32_t h, float sx, float sy):
+  mImageType(PX_IMAGE_INVALID), mLowResFirst(lowResFirst), mTargetW(w), mTargetH(h), mTargetSX(sx), mTargetSY(sy),
+  mFitW(0), mFitH(0), mFailed(false), mComplete(false), mPartialImageChanged(false), mBytesWritten(0),
+  mSignature(), mImage(), mPNGState(NULL), mJPGState(NULL)
+{
+}
+
+void pxProgressiveImageDecoder::setImageSize(int32_t width, int32_t height)
+{
+  pxImageTargetSize(width, height, mTargetW, mTargetH, mTargetSX, mTargetSY, mFitW, mFitH);
+}
+
+pxProgressiveImageDecoder::~pxProgressiveImageDecoder()
+{
+  delete mPNGState;
+  delete mJPGState;
+}
+
+rtError pxProgressiveImageDecoder::write(const char* data, size_t size)
+{
+  if (mFailed)
+  {
+    return RT_FAIL;
+  }
+  if (mComplete || data == NULL || size == 0)
+  {
+    return RT_OK;
+  }
+  mBytesWritten += size;
+
+  std::vector<char> signature;
+  if (mImageType == PX_IMAGE_INVALID)
+  {
+    mSignature.insert(mSignature.end(), data, data + size);
+    if (mSignature.size() < PX_IMAGE_SIGNATURE_SIZE)
+    {
+      return RT_OK;
+    }
+    mImageType = getImageType((const uint8_t*)&mSignature[0], mSignature.size());
+    if (mImageType != PX_IMAGE_PNG && mImageType != PX_IMAGE_JPG)
+    {
+      // only PNG and JPEG can be decoded incrementally
+      mFailed = true;
+      return RT_FAIL;
+    }
+    signature.swap(mSignature);
+    data = &signature[0];
+    size = signature.size();
+  }
+
+  rtError e = (mImageType == PX_IMAGE_PNG) ? writePNG(data, size) : writeJPG(data, size);
+  if (e != RT_OK)
+  {
+    mFailed = true;
+  }
+  return mFailed ? RT_FAIL : RT_OK;
+}
+
+rtError pxProgressiveImageDecoder::writePNG(const char* data, size_t size)
+{
+  if (mPNGState == NULL)
+  {
+    mPNGState = new pxPNGDecodeState(this);
+    mPNGState->png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (mPNGState->png == NULL)
+    {
+      rtLogError("FATAL: png_create_read_struct() - failed !");
+      return RT_FAIL;
+    }
+    mPNGState->info = png_create_info_struct(mPNGState->png);
+    if (mPNGState->info == NULL)
+    {
+      rtLogError("FATAL: png_create_info_struct() - failed !");
+      return RT_FAIL;
+    }
+    png_set_progressive_read_fn(mPNGState->png, (png_voidp)mPNGState, pxPNGDecodeState::infoCallback,
+                                pxPNGDecodeState::rowCallback, pxPNGDecodeState::endCallback);
+  }
+
+  if (setjmp(png_jmpbuf(mPNGState->png)))
+  {
+    return RT_FAIL;
+  }
+  png_process_data(mPNGState->png, mPNGState->info, (png_bytep)data, size);
+  return RT_OK;
+}
+
+rtError pxProgressiveImageDecoder::writeJPG(const char* data, size_t size)
+{
+  if (mJPGState == NULL)
+  {
+    mJPGState = new pxJPGDecodeState();
+    mJPGState->cinfo.err = jpeg_std_error(&mJPGState->error.pub);
+    mJPGState->error.pub.error_exit = my_error_exit;
+    if (setjmp(mJPGState->error.setjmp_buffer))
+    {
+      return RT_FAIL;
+    }
+    jpeg_create_decompress(&mJPGState->cinfo);
+    mJPGState->created = true;
+    mJPGState->cinfo.client_data = mJPGState;
+    mJPGState->source.init_source = pxJPGDecodeState::initSource;
+    mJPGState->source.fill_input_buffer = pxJPGDecodeState::fillInputBuffer;
+    mJPGState->source.skip_input_data = pxJPGDecodeState::skipInputData;
+    mJPGState->source.resync_to_restart = jpeg_resync_to_restart;
+    mJPGState->source.term_source = pxJPGDecodeState::termSource;
+    mJPGState->cinfo.src = &mJPGState->source;
+  }
+
+  // drop what the decoder has consumed; after a suspension it resumes from
+  // next_input_byte so only the unread tail has to be kept
+  std::vector<JOCTET>& input = mJPGState->input;
+  input.erase(input.begin(), input.end() - mJPGState->source.bytes_in_buffer);
+  if (mJPGState->skipBytes > 0)
+  {
+    size_t skip = (mJPGState->skipBytes < size) ? mJPGState->skipBytes : size;
+    mJPGState->skipBytes -= skip;
+    data += skip;
+    size -= skip;
+  }
+  input.insert(input.end(), (const JOCTET*)data, (const JOCTET*)data + size);
+  mJPGState->source.next_input_byte = input.empty() ? NULL : &input[0];
+  mJPGState->source.bytes_in_buffer = input.size();
+
+  if (setjmp(mJPGState->error.setjmp_buffer))
+  {
+    return RT_FAIL;
+  }
+  decodeJPG();
+  return RT_OK;
+}
+
+// Runs the libjpeg state machine until it needs more data.  Every libjpeg
+// call below may return early on suspension, in which case the same stage
+// is retried on the next write().
+void pxProgressiveImageDecoder::decodeJPG()
+{
+  pxJPGDecodeState* state = mJPGState;
+  j_decompress_ptr cinfo = &state->cinfo;
+
+  for (;;)
+  {
+    switch (state->stage)
+    {
+      case pxJPGDecodeState::READ_HEADER:
+        if (jpeg_read_header(cinfo, TRUE) == JPEG_SUSPENDED)
+        {
+          return;
+        }
+        cinfo->out_color_space = JCS_RGB;
+        setImageSize(cinfo->image_width, cinfo->image_height);
+        cinfo->scale_num = 1;
+        cinfo->scale_denom = pxJPGScaleDenom(cinfo->image_width, cinfo->image_height, mFitW, mFitH);
+        state->bufferedImage = mLowResFirst && jpeg_has_multiple_scans(cinfo);
+        cinfo->buffered_image = state->bufferedImage ? TRUE : FALSE;
+        state->stage = pxJPGDecodeState::START_DECOMPRESS;
+        break;
+
+      case pxJPGDecodeState::START_DECOMPRESS:
+        if (!jpeg_start_decompress(cinfo))
+        {
+          return;
+        }
+        if (mImage.initWithColor(cinfo->output_width, cinfo->output_height, pxClear) != PX_OK)
+        {
+          mFailed = true;
+          return;
+        }
+        mImage.mPixelFormat = RT_PIX_ARGB;
+        state->row = (*cinfo->mem->alloc_sarray)((j_common_ptr)cinfo, JPOOL_IMAGE,
+                                                 cinfo->output_width * cinfo->output_components, 1);
+        state->stage = state->bufferedImage ? pxJPGDecodeState::START_OUTPUT_PASS :
+                                              pxJPGDecodeState::READ_SCANLINES;
+        break;
+
+      case pxJPGDecodeState::START_OUTPUT_PASS:
+      {
+        int result;
+        do
+        {
+          result = jpeg_consume_input(cinfo);
+        } while (result != JPEG_SUSPENDED && result != JPEG_REACHED_EOI);
+
+        state->finalPass = jpeg_input_complete(cinfo);
+        // show the scans that arrived completely, the current one is still loading
+        int outputScan = state->finalPass ? cinfo->input_scan_number : cinfo->input_scan_number - 1;
+        if (!state->finalPass && outputScan <= state->lastOutputScan)
+        {
+          return;
+        }
+        if (!jpeg_start_output(cinfo, outputScan))
+        {
+          return;
+        }
+        state->lastOutputScan = outputScan;
+        state->stage = pxJPGDecodeState::READ_SCANLINES;
+        break;
+      }
+
+      case pxJPGDecodeState::READ_SCANLINES:
+        while (cinfo->output_scanline < cinfo->output_height)
+        {
+          if (jpeg_read_scanlines(cinfo, state->row, 1) != 1)
+          {
+            return;
+          }
+          pxPixel* p = mImage.scanline(cinfo->output_scanline - 1);
+          JSAMPLE* b = state->row[0];
+          JSAMPLE* bend = b + (cinfo->output_width * cinfo->output_components);
+          while (b < bend)
+          {
+            if (cinfo->output_components >= 3)
+            {
+              p->r = b[0];
+              p->g = b[1];
+              p->b = b[2];
+            }
+            else
+            {
+              p->r = p->g = p->b = b[0];
+            }
+            p->a = 255;
+            b += cinfo->output_components;
+            p++;
+          }
+          if (!state->bufferedImage)
+          {
+            mPartialImageChanged = true;
+          }
+        }
+        state->stage = state->bufferedImage ? pxJPGDecodeState::FINISH_OUTPUT_PASS :
+                                              pxJPGDecodeState::FINISH_DECOMPRESS;
+        break;
+
+      case pxJPGDecodeState::FINISH_OUTPUT_PASS:
+        if (!jpeg_finish_output(cinfo))
+        {
+          return;
+        }
+        // a whole, if blurry, image is ready
+        mPartialImageChanged = true;
+        state->stage = state->finalPass ? pxJPGDecodeState::FINISH_DECOMPRESS :
+                                          pxJPGDecodeState::START_OUTPUT_PASS;
+        break;
+
+      case pxJPGDecodeState::FINISH_DECOMPRESS:
+        if (!jpeg_finish_decompress(cinfo))
+        {
+          return;
+        }
+        mComplete = true;
+        state->stage = pxJPGDecodeState::DONE;
+        return;
+
+      case pxJPGDecodeState::DONE:
+        return;
+    }
+  }
+}
+
+rtError pxProgressiveImageDecoder::partialImage(pxOffscreen& o)
+{
+  if (mFailed || mImage.width() == 0 || mImage.height() == 0)
+  {
+    return RT_FAIL;
+  }
+  if (mFitW < mImage.width() || mFitH < mImage.height())
+  {
+    if (pxBoxDownscaleImage(mImage, o, pxBoxDownscaleFactor(mImage.width(), mFitW),
+                                       pxBoxDownscaleFactor(mImage.height(), mFitH)) != RT_OK)
+    {
+      return RT_FAIL;
+    }
+  }
+  else
+  {
+    o.init(mImage.width(), mImage.height());
+    mImage.blit(o);
+    o.mPixelFormat = mImage.mPixelFormat;
+  }
+  if (o.mPixelFormat != RT_DEFAULT_PIX)
+  {
+    o.swizzleTo(RT_DEFAULT_PIX);
+  }
+  mPartialImageChanged = false;
+  return RT_OK;
+}
+
+rtError pxProgressiveImageDecoder::finish()
+{
+  if (mFailed || !mComplete)
+  {
+    return RT_FAIL;
+  }
+  if (pxDownscaleImageToTarget(mImage, mFitW, mFitH) != RT_OK)
+  {
+    return RT_FAIL;
+  }
+  if (mImage.mPixelFormat != RT_DEFAULT_PIX)
+  {
+    mImage.swizzleTo(RT_DEFAULT_PIX);
+  }
+  mPartialImageChanged = false;
+  return RT_OK;
+}
+
+void pxTimedOffscreenSequence::init()
 {
   mTotalTime = 0;
   mNumPlays = 0;
+  mWidth = 0;
+  mHeight = 0;
+  mSizeInBytes = 0;
   mSequence.clear();
+  mLastFrame.term();
 }
 
 void pxTimedOffscreenSequence::addBuffer(pxBuffer &b, double d)
 {
   entry e;
-  e.mOffscreen.init(b.width(), b.height());
+  e.mDuration = d;
+  e.mKeyFrame = mSequence.empty() || mLastFrame.base() == NULL ||
+                b.width() != mLastFrame.width() || b.height() != mLastFrame.height();
+
+  if (e.mKeyFrame)
+  {
+    e.mRect.setLTRB(0, 0, b.width(), b.height());
+  }
+  else
+  {
+    // bounds of the pixels that differ from the previous frame
+    int32_t l = b.width(), t = b.height(), r = 0, bottom = 0;
+    for (int32_t y = 0; y < b.height(); y++)
+    {
+      uint32_t* s = b.scanlineInt32(y);
+      uint32_t* p = mLastFrame.scanlineInt32(y);
+      int32_t x = 0;
+      while (x < b.width() && s[x] == p[x])
+      {
+        x++;
+      }
+      if (x == b.width())
+      {
+        continue;
+      }
+      int32_t xe = b.width();
+      while (s[xe-1] == p[xe-1])
+      {
+        xe--;
+      }
+      if (x < l) l = x;
+      if (xe > r) r = xe;
+      if (y < t) t = y;
+      bottom = y + 1;
+    }
+    if (r > l)
+    {
+      e.mRect.setLTRB(l, t, r, bottom);
+    }
+  }
 
-  b.blit(e.mOffscreen);
+  int32_t w = e.mRect.width();
+  int32_t h = e.mRect.height();
+  if (w > 0 && h > 0)
+  {
+    std::vector<uint32_t> pixels(w * h);
+    uint32_t* d = &pixels[0];
+    for (int32_t y = e.mRect.top(); y < e.mRect.bottom(); y++, d += w)
+    {
+      uint32_t* s = b.scanlineInt32(y) + e.mRect.left();
+      if (e.mKeyFrame)
+      {
+        memcpy(d, s, w * 4);
+      }
+      else
+      {
+        uint32_t* p = mLastFrame.scanlineInt32(y) + e.mRect.left();
+        for (int32_t x = 0; x < w; x++)
+        {
+          d[x] = s[x] ^ p[x];
+        }
+      }
+    }
+    uLongf compressedSize = compressBound(w * h * 4);
+    e.mData.resize(compressedSize);
+    if (compress2(&e.mData[0], &compressedSize, (const Bytef*)&pixels[0], w * h * 4, Z_BEST_SPEED) != Z_OK)
+    {
+      rtLogError("unable to compress animation frame %u", (uint32_t)mSequence.size());
+      compressedSize = 0;
+      e.mRect.setEmpty();
+    }
+    e.mData.resize(compressedSize);
+    std::vector<uint8_t>(e.mData).swap(e.mData);
+  }
 
-  e.mDuration = d;
+  if (e.mKeyFrame)
+  {
+    mLastFrame.init(b.width(), b.height());
+    if (mSequence.empty())
+    {
+      mWidth = b.width();
+      mHeight = b.height();
+    }
+  }
+  b.blit(mLastFrame);
 
+  mSizeInBytes += e.mData.size();
   mSequence.push_back(e);
   mTotalTime += d;
 }
 
+void pxTimedOffscreenSequence::finish()
+{
+  mLastFrame.term();
+}
+
+rtError pxTimedOffscreenSequence::applyFrame(uint32_t frameNum, pxOffscreen& o, pxRect& r) const
+{
+  if (frameNum >= mSequence.size())
+  {
+    return RT_ERROR;
+  }
+
+  const entry& e = mSequence[frameNum];
+  r = e.mRect;
+  if (e.mKeyFrame && (o.base() == NULL || o.width() != e.mRect.width() || o.height() != e.mRect.height()))
+  {
+    o.init(e.mRect.width(), e.mRect.height());
+  }
+
+  int32_t w = e.mRect.width();
+  int32_t h = e.mRect.height();
+  if (w <= 0 || h <= 0)
+  {
+    return RT_OK;
+  }
+  if (o.base() == NULL || e.mRect.right() > o.width() || e.mRect.bottom() > o.height())
+  {
+    return RT_ERROR;
+  }
+
+  // inflated a row at a time straight into the frame
+  std::vector<uint32_t> row(w);
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (inflateInit(&stream) != Z_OK)
+  {
+    return RT_ERROR;
+  }
+  stream.next_in = (Bytef*)&e.mData[0];
+  stream.avail_in = e.mData.size();
+
+  rtError result = RT_OK;
+  for (int32_t y = e.mRect.top(); y < e.mRect.bottom(); y++)
+  {
+    uint32_t* d = o.scanlineInt32(y) + e.mRect.left();
+    stream.next_out = e.mKeyFrame ? (Bytef*)d : (Bytef*)&row[0];
+    stream.avail_out = w * 4;
+    int status = inflate(&stream, Z_SYNC_FLUSH);
+    if (stream.avail_out != 0 || (status != Z_OK && status != Z_STREAM_END))
+    {
+      rtLogError("corrupt animation frame %u", frameNum);
+      result = RT_ERROR;
+      break;
+    }
+    if (!e.mKeyFrame)
+    {
+      for (int32_t x = 0; x < w; x++)
+      {
+        d[x] ^= row[x];
+      }
+    }
+  }
+  inflateEnd(&stream);
+  return result;
+}
+
+rtError pxTimedOffscreenSequence::getFrame(uint32_t frameNum, pxOffscreen& o) const
+{
+  if (frameNum >= mSequence.size())
+  {
+    return RT_ERROR;
+  }
+
+  pxRect r;
+  for (uint32_t i = 0; i <= frameNum; i++)
+  {
+    if (applyFrame(i, o, r) != RT_OK)
+    {
+      return RT_ERROR;
+    }
+  }
+  return RT_OK;
+}
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -40,14 +40,20 @@ rtError base64_encode(const unsigned char *data, size_t input_length, rtString &
 rtError base64_decode(rtString &s, rtData &d);
 rtError base64_decode(const unsigned char *data, size_t input_length, rtData &d);
 
+// Frames of an animated image.  Each frame is kept as the rectangle that
+// changed from the frame before, XORed with that frame and deflated, so the
+// pixels an animation doesn't change cost next to nothing.  Frames are
+// recreated in order with applyFrame().
 class pxTimedOffscreenSequence
 {
 public:
-  pxTimedOffscreenSequence():mTotalTime(0),mNumPlays(0) {}
+  pxTimedOffscreenSequence():mTotalTime(0),mNumPlays(0),mWidth(0),mHeight(0),mSizeInBytes(0) {}
   ~pxTimedOffscreenSequence() {}
 
   void init();
   void addBuffer(pxBuffer &b, double duration);
+  // drops the copy of the last frame addBuffer() compares the next one with
+  void finish();
 
   uint32_t numFrames()
   {
@@ -64,9 +70,14 @@ public:
     mNumPlays = numPlays;
   }
 
-  pxOffscreen &getFrameBuffer(int frameNum)
+  int32_t width() const
   {
-    return mSequence[frameNum].mOffscreen;
+    return mWidth;
+  }
+
+  int32_t height() const
+  {
+    return mHeight;
   }
 
   double getDuration(int frameNum)
@@ -79,16 +90,35 @@ public:
     return mTotalTime;
   }
 
+  // bytes used by the compressed frames
+  size_t sizeInBytes() const
+  {
+    return mSizeInBytes;
+  }
+
+  // Turns o, which has to hold frame frameNum-1, into frame frameNum and sets
+  // r to the area that changed.  Frame 0 always covers the whole image.
+  rtError applyFrame(uint32_t frameNum, pxOffscreen& o, pxRect& r) const;
+
+  // decodes a single frame by applying every frame up to it
+  rtError getFrame(uint32_t frameNum, pxOffscreen& o) const;
+
 private:
   struct entry
   {
-    pxOffscreen mOffscreen;
+    pxRect mRect;
+    bool mKeyFrame; // mData holds the pixels themselves
+    std::vector<uint8_t> mData;
     double mDuration;
   };
 
   std::vector<entry> mSequence;
+  pxOffscreen mLastFrame;
   double mTotalTime;
   uint32_t mNumPlays;
+  int32_t mWidth;
+  int32_t mHeight;
+  size_t mSizeInBytes;
 
 }; // CLASS - pxTimedOffscreenSequence
 
@@ -138,13 +168,97 @@ bool pxIsJPGImage(const char* imageData, size_t imageDataSize);
 rtError pxStoreJPGImage(const char* filename, pxBuffer& b);
 #endif
 
+// w/h and sx/sy request a smaller decode, see pxImageTargetSize()
 #ifdef ENABLE_LIBJPEG_TURBO
-rtError pxLoadJPGImageTurbo(const char* buf, size_t buflen, pxOffscreen& o);
+rtError pxLoadJPGImageTurbo(const char* buf, size_t buflen, pxOffscreen& o,
+                            int32_t w = 0, int32_t h = 0, float sx = 1.0f, float sy = 1.0f);
 #endif //ENABLE_LIBJPEG_TURBO
 
-rtError pxLoadJPGImage(const char* imageData, size_t imageDataSize, pxOffscreen& o);
+rtError pxLoadJPGImage(const char* imageData, size_t imageDataSize, pxOffscreen& o,
+                       int32_t w = 0, int32_t h = 0, float sx = 1.0f, float sy = 1.0f);
 rtError pxLoadJPGImage(const char* filename, pxOffscreen& o);
 
+// Size a raster image of imageW x imageH is decoded at for the w/h or sx/sy
+// given to pxLoadImage.  Follows pxLoadSVGImage: a scale takes precedence over
+// dimensions and dimensions keep the aspect ratio.  Raster images are only
+// ever made smaller.
+void pxImageTargetSize(int32_t imageW, int32_t imageH, int32_t w, int32_t h, float sx, float sy,
+                       int32_t& targetW, int32_t& targetH);
+
+// Averages factorX x factorY blocks of src into dst, partial blocks at the
+// right and bottom edges are averaged over the pixels they cover
+rtError pxBoxDownscaleImage(pxBuffer& src, pxOffscreen& dst, int32_t factorX, int32_t factorY);
+
+// Box-downscales o by the largest whole factor that still covers targetW x targetH
+rtError pxDownscaleImageToTarget(pxOffscreen& o, int32_t targetW, int32_t targetH);
+
+typedef enum pxResampleFilter_
+{
+  PX_RESAMPLE_AREA,     // averages the source pixels each destination pixel covers
+  PX_RESAMPLE_BILINEAR, // blends the 2 x 2 source pixels nearest each destination pixel
+}
+pxResampleFilter;
+
+// Scales src to the size dst was initialized with.  Either buffer can be
+// upside down.  Large images are split into row bands resampled on the
+// thread pool.  Enlarging always uses bilinear filtering.
+rtError pxResampleImage(pxBuffer& src, pxBuffer& dst, pxResampleFilter filter = PX_RESAMPLE_AREA);
+
+// Decodes a PNG or JPEG image while its bytes are still arriving, e.g. from
+// a download progress callback.  Rows are decoded straight into a single
+// offscreen as soon as their data is available.  With lowResFirst set, a
+// progressive JPEG is shown after every scan instead of only once all of its
+// scans have arrived.  Other image types fail so the caller can fall back to
+// pxLoadImage() once the whole body is available.
+class pxProgressiveImageDecoder
+{
+public:
+  pxProgressiveImageDecoder(bool lowResFirst = false, int32_t w = 0, int32_t h = 0, float sx = 1.0f, float sy = 1.0f);
+  ~pxProgressiveImageDecoder();
+
+  // feeds the next piece of the encoded image
+  rtError write(const char* data, size_t size);
+
+  bool hasFailed() const { return mFailed; }
+  bool isComplete() const { return mComplete; }
+  size_t bytesWritten() const { return mBytesWritten; }
+
+  // true when rows were decoded since the last call to partialImage()
+  bool hasPartialImage() const { return mPartialImageChanged; }
+  rtError partialImage(pxOffscreen& o);
+
+  // converts the decoded image to the default pixel format and the requested
+  // size, only succeeds once the whole image has been decoded
+  rtError finish();
+  pxOffscreen& image() { return mImage; }
+
+  struct pxPNGDecodeState;
+  struct pxJPGDecodeState;
+
+private:
+  pxProgressiveImageDecoder(const pxProgressiveImageDecoder&);
+  pxProgressiveImageDecoder& operator=(const pxProgressiveImageDecoder&);
+
+  rtError writePNG(const char* data, size_t size);
+  rtError writeJPG(const char* data, size_t size);
+  void decodeJPG();
+  void setImageSize(int32_t width, int32_t height);
+
+  pxImageType mImageType;
+  bool mLowResFirst;
+  int32_t mTargetW, mTargetH;
+  float mTargetSX, mTargetSY;
+  int32_t mFitW, mFitH; // size the decoded image is reduced to
+  bool mFailed;
+  bool mComplete;
+  bool mPartialImageChanged;
+  size_t mBytesWritten;
+  std::vector<char> mSignature;
+  pxOffscreen mImage;
+  pxPNGDecodeState* mPNGState;
+  pxJPGDecodeState* mJPGState;
+};
+
 
 rtError pxLoadSVGImage(const char* buf, size_t buflen, pxOffscreen& o, int w = 0, int h = 0, float sx = 1.0f, float sy = 1.0f);
 rtError pxLoadSVGImage(const char* filename,           pxOffscreen& o, int w = 0, int h = 0, float sx = 1.0f, float sy = 1.0f);
@@ -26,10 +26,16 @@
 #define rtAtomic          volatile int32_t
 #define rtAtomicInc(ptr)  (InterlockedIncrement((volatile unsigned int *)ptr))
 #define rtAtomicDec(ptr)  (InterlockedDecrement((volatile unsigned int *)ptr))
+#define rtAtomicCompareAndSwap(ptr, oldval, newval) \
+  (InterlockedCompareExchange((volatile LONG *)ptr, (LONG)(newval), (LONG)(oldval)) == (LONG)(oldval))
+#define rtAtomicCompareAndSwapPtr(ptr, oldval, newval) \
+  (InterlockedCompareExchangePointer((PVOID volatile *)ptr, (PVOID)(newval), (PVOID)(oldval)) == (PVOID)(oldval))
 #else
 #define rtAtomic          volatile int32_t
 #define rtAtomicInc(ptr)  (__sync_add_and_fetch(ptr, 1))
 #define rtAtomicDec(ptr)  (__sync_sub_and_fetch(ptr, 1))
+#define rtAtomicCompareAndSwap(ptr, oldval, newval)    (__sync_bool_compare_and_swap(ptr, oldval, newval))
+#define rtAtomicCompareAndSwapPtr(ptr, oldval, newval) (__sync_bool_compare_and_swap(ptr, oldval, newval))
 #endif
 
 #endif
@@ -135,7 +135,7 @@ rtError rtCORS::updateResponseForAccessControl(rtFileDownloadRequest* request) c
 
   // Disallow access to the resource's contents.
   if (request->downloadedData() != NULL)
-    free(request->downloadedData());
+    delete [] request->downloadedData();
   request->setDownloadedData(NULL, 0);
 
   request->setDownloadStatusCode(RT_ERROR_NOT_ALLOWED);
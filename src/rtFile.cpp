@@ -58,6 +58,20 @@ rtError rtData::init(const uint8_t* data, size_t length) {
   return e;
 }
 
+rtError rtData::attach(uint8_t* data, size_t length) {
+  term();
+  mData = data;
+  mLength = (data != NULL) ? (uint32_t) length : 0;
+  return RT_OK;
+}
+
+uint8_t* rtData::detach() {
+  uint8_t* data = mData;
+  mData = NULL;
+  mLength = 0;
+  return data;
+}
+
 rtError rtData::term() { delete [] mData; mData=NULL; mLength = 0; return RT_OK; }
 uint8_t* rtData::data() { return mData; }
 uint32_t rtData::length() { return mLength; }
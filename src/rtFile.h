@@ -43,6 +43,11 @@ class rtData
   rtError init(size_t length);
   rtError init(const uint8_t* data, size_t length);
 
+  // take ownership of a buffer allocated with new [] without copying it
+  rtError attach(uint8_t* data, size_t length);
+  // give up ownership of the buffer, the caller releases it with delete []
+  uint8_t* detach();
+
   rtError term();
 
   uint8_t* data();
@@ -23,18 +23,83 @@
 #include <pxUtil.h>
 #include <string.h>
 #include <sstream>
+#include <algorithm>
+#include <vector>
 #include <dirent.h>
+#include <errno.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include "rtSettings.h"
+#include "rtThreadPool.h"
 
 #define DEFAULT_MAX_CACHE_SIZE 20971520
 
+// The index is a log of the files added to, used from and removed from the
+// cache, in fixed size records.  Replaying it restores the cache and the
+// order its files were used in without looking at the files.  Once it
+// holds many more records than there are files it is written again with a
+// record per file.
+#define RT_FILE_CACHE_INDEX ".index"
+#define RT_FILE_CACHE_INDEX_VERSION 0x31434652 // "RFC1"
+#define RT_FILE_CACHE_INDEX_SLACK 1024
+// evicted files are renamed with this suffix and deleted in the background
+#define RT_FILE_CACHE_EVICTED_SUFFIX "~"
+
 using namespace std;
 
+enum rtFileCacheIndexOperation
+{
+  INDEX_ADD = 1,    // added or used, with its size
+  INDEX_REMOVE = 2
+};
+
+struct rtFileCacheIndexRecord
+{
+  uint32_t operation;
+  uint32_t check;
+  int64_t size;
+  char name[32];
+};
+
+static uint32_t indexRecordCheck(const rtFileCacheIndexRecord& r)
+{
+  // FNV-1a of the record, a record torn by a crash doesn't match it
+  const uint8_t* p = (const uint8_t*)&r.size;
+  const uint8_t* end = (const uint8_t*)(&r + 1);
+  uint32_t h = 2166136261u ^ r.operation;
+  for (; p < end; p++)
+  {
+    h = (h ^ *p) * 16777619u;
+  }
+  return h;
+}
+
+static bool isCacheFileName(const char* name)
+{
+  size_t length = strlen(name);
+  return strcmp(name, ".") != 0 && strcmp(name, "..") != 0 && strcmp(name, RT_FILE_CACHE_INDEX) != 0 &&
+         length < sizeof(((rtFileCacheIndexRecord*)0)->name) &&
+         (length < strlen(RT_FILE_CACHE_EVICTED_SUFFIX) ||
+          strcmp(name + length - strlen(RT_FILE_CACHE_EVICTED_SUFFIX), RT_FILE_CACHE_EVICTED_SUFFIX) != 0);
+}
+
+static void deleteEvictedFiles(void* data)
+{
+  vector<string>* paths = (vector<string>*)data;
+  for (size_t i = 0; i < paths->size(); i++)
+  {
+    if (0 != unlink((*paths)[i].c_str()) && errno != ENOENT)
+    {
+      rtLogWarn("!!! deletion of evicted cache file(%s) failed", (*paths)[i].c_str());
+    }
+  }
+  delete paths;
+}
+
 rtFileCache* rtFileCache::instance()
 {
   if (NULL == mCache)
@@ -54,7 +119,8 @@ void rtFileCache::destroy()
 }
 
 rtFileCache* rtFileCache::mCache = NULL;
-rtFileCache::rtFileCache():mMaxSize(DEFAULT_MAX_CACHE_SIZE),mCurrentSize(0),mDirectory("/tmp/cache"),mCacheMutex()
+rtFileCache::rtFileCache():mMaxSize(DEFAULT_MAX_CACHE_SIZE),mCurrentSize(0),mDirectory("/tmp/cache"),
+  mEntries(),mLru(),mIndexFile(-1),mIndexRecords(0),mCacheMutex()
 {
   char const *s = getenv("SPARK_CACHE_DIRECTORY");
   if (s)
@@ -71,18 +137,17 @@ rtFileCache::rtFileCache():mMaxSize(DEFAULT_MAX_CACHE_SIZE),mCurrentSize(0),mDir
     mDirectory = cacheDirectory.toString();
   }
   rtLogInfo("The cache directory is set to %s", mDirectory.cString());
-  mFileSizeMap.clear();
-  mFileTimeMap.clear();
   initCache();
 }
 
 rtFileCache::~rtFileCache()
 {
+  closeIndex();
   mMaxSize = 0;
   mCurrentSize = 0;
   mDirectory = "";
-  mFileSizeMap.clear();
-  mFileTimeMap.clear();
+  mEntries.clear();
+  mLru.clear();
 }
 
 void  rtFileCache::initCache()
@@ -93,15 +158,21 @@ void  rtFileCache::initCache()
 #else
   retVal = mkdir(mDirectory.cString(), 0777);
 #endif
-  if (0 != retVal)
+  if (0 != retVal && EEXIST != errno)
     rtLogWarn("creation of cache directory %s failed: %d", mDirectory.cString(), retVal);
-  populateExistingFiles();
+  if (!loadIndex())
+  {
+    rtLogInfo("no usable cache index in %s, reading the cache directory", mDirectory.cString());
+    populateExistingFiles();
+  }
 }
 
 void rtFileCache::populateExistingFiles()
 {
-  mFileTimeMap.clear();
-  mFileSizeMap.clear();
+  closeIndex();
+  mEntries.clear();
+  mLru.clear();
+  mCurrentSize = 0;
   DIR *directory;
   struct dirent *direntry;
   struct stat buf;
@@ -112,9 +183,13 @@ void rtFileCache::populateExistingFiles()
     return;
   }
 
+  // the files in the order they were used, as well as the access times
+  // tell, and files evicted before they could be deleted
+  vector< pair<time_t,string> > files;
+  vector<string> evicted;
   for (direntry = readdir(directory); direntry != NULL; direntry = readdir(directory))
   {
-    if ((strcmp(direntry->d_name,".") !=0 ) && (strcmp(direntry->d_name,"..") != 0))
+    if (isCacheFileName(direntry->d_name))
     {
       rtString filename = mDirectory;
       filename.append("/");
@@ -126,17 +201,210 @@ void rtFileCache::populateExistingFiles()
         continue;
       }
 #if defined(PX_PLATFORM_MAC)
-       mFileTimeMap.insert(make_pair(buf.st_atimespec.tv_sec,direntry->d_name));
-#elif !(defined(WIN32) || defined(_WIN32) || defined (WINDOWS) || defined (_WINDOWS))
-       mFileTimeMap.insert(make_pair(buf.st_atim.tv_sec,direntry->d_name));
+      files.push_back(make_pair(buf.st_atimespec.tv_sec,string(direntry->d_name)));
 #else
-       rtLogWarn("Platform not supported. Cache will not get cleared after cache limit is reached");
+      files.push_back(make_pair(buf.st_atim.tv_sec,string(direntry->d_name)));
 #endif
-      mFileSizeMap[direntry->d_name] = buf.st_size;
-      mCurrentSize += buf.st_size;
+      setEntry(direntry->d_name, buf.st_size);
+    }
+    else if (strcmp(direntry->d_name,".") != 0 && strcmp(direntry->d_name,"..") != 0 &&
+             strcmp(direntry->d_name, RT_FILE_CACHE_INDEX) != 0)
+    {
+      evicted.push_back(string(mDirectory.cString()) + "/" + direntry->d_name);
     }
   }
   closedir(directory);
+
+  stable_sort(files.begin(), files.end());
+  for (size_t i = 0; i < files.size(); i++)
+  {
+    mLru.splice(mLru.end(), mLru, mEntries[files[i].second].lru);
+  }
+  for (size_t i = 0; i < evicted.size(); i++)
+  {
+    if (evicted[i].size() > strlen(RT_FILE_CACHE_EVICTED_SUFFIX) &&
+        evicted[i].compare(evicted[i].size() - strlen(RT_FILE_CACHE_EVICTED_SUFFIX), string::npos, RT_FILE_CACHE_EVICTED_SUFFIX) == 0)
+    {
+      unlink(evicted[i].c_str());
+    }
+  }
+  writeIndex();
+}
+
+bool rtFileCache::loadIndex()
+{
+  closeIndex();
+  mEntries.clear();
+  mLru.clear();
+  mCurrentSize = 0;
+
+  rtString indexName(RT_FILE_CACHE_INDEX);
+  int fd = open(absPath(indexName).cString(), O_RDONLY);
+  if (fd < 0)
+  {
+    return false;
+  }
+  struct stat buf;
+  size_t count = 0;
+  bool tornTail = false;
+  if (fstat(fd, &buf) == 0)
+  {
+    count = buf.st_size / sizeof(rtFileCacheIndexRecord);
+    // a record cut short would leave appends misaligned
+    tornTail = (buf.st_size % sizeof(rtFileCacheIndexRecord)) != 0;
+  }
+  void* map = count > 0 ? mmap(NULL, count * sizeof(rtFileCacheIndexRecord), PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (map == MAP_FAILED)
+  {
+    return false;
+  }
+
+  const rtFileCacheIndexRecord* records = (const rtFileCacheIndexRecord*)map;
+  bool valid = records[0].operation == RT_FILE_CACHE_INDEX_VERSION && records[0].check == indexRecordCheck(records[0]);
+  size_t i = 1;
+  for (; valid && i < count; i++)
+  {
+    const rtFileCacheIndexRecord& r = records[i];
+    if (r.check != indexRecordCheck(r) || r.name[sizeof(r.name) - 1] != 0)
+    {
+      // the rest was being written when the process ended
+      rtLogWarn("cache index ends in a broken record, %d of %d records used", (int)i, (int)count);
+      break;
+    }
+    if (r.operation == INDEX_ADD)
+    {
+      setEntry(r.name, r.size);
+    }
+    else if (r.operation == INDEX_REMOVE)
+    {
+      removeEntry(r.name);
+    }
+  }
+  munmap(map, count * sizeof(rtFileCacheIndexRecord));
+  if (!valid)
+  {
+    mEntries.clear();
+    mLru.clear();
+    mCurrentSize = 0;
+    return false;
+  }
+
+  if (tornTail || i < count || i > 2 * mEntries.size() + RT_FILE_CACHE_INDEX_SLACK)
+  {
+    return writeIndex();
+  }
+  mIndexFile = open(absPath(indexName).cString(), O_WRONLY | O_APPEND);
+  mIndexRecords = i;
+  return mIndexFile >= 0;
+}
+
+bool rtFileCache::writeIndex()
+{
+  closeIndex();
+  rtString indexName(RT_FILE_CACHE_INDEX);
+  rtString tempName(RT_FILE_CACHE_INDEX ".tmp" RT_FILE_CACHE_EVICTED_SUFFIX);
+  rtString indexPath = absPath(indexName);
+  rtString tempPath = absPath(tempName);
+  int fd = open(tempPath.cString(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0)
+  {
+    return false;
+  }
+
+  vector<rtFileCacheIndexRecord> records(mLru.size() + 1);
+  memset(&records[0], 0, records.size() * sizeof(rtFileCacheIndexRecord));
+  records[0].operation = RT_FILE_CACHE_INDEX_VERSION;
+  records[0].check = indexRecordCheck(records[0]);
+  size_t n = 1;
+  for (list<string>::iterator it = mLru.begin(); it != mLru.end(); ++it, n++)
+  {
+    rtFileCacheIndexRecord& r = records[n];
+    r.operation = INDEX_ADD;
+    r.size = mEntries[*it].size;
+    strncpy(r.name, it->c_str(), sizeof(r.name) - 1);
+    r.check = indexRecordCheck(r);
+  }
+  size_t bytes = records.size() * sizeof(rtFileCacheIndexRecord);
+  bool written = write(fd, &records[0], bytes) == (ssize_t)bytes;
+  if (0 != close(fd) || !written || 0 != rename(tempPath.cString(), indexPath.cString()))
+  {
+    rtLogWarn("writing the cache index %s failed", indexPath.cString());
+    unlink(tempPath.cString());
+    return false;
+  }
+  mIndexFile = open(indexPath.cString(), O_WRONLY | O_APPEND);
+  mIndexRecords = records.size();
+  return mIndexFile >= 0;
+}
+
+void rtFileCache::appendIndex(uint32_t operation, const string& filename, int64_t size)
+{
+  if (mIndexFile < 0)
+  {
+    return;
+  }
+  if (mIndexRecords >= 2 * mEntries.size() + RT_FILE_CACHE_INDEX_SLACK)
+  {
+    // the entries have the record just being appended already
+    writeIndex();
+    return;
+  }
+  rtFileCacheIndexRecord r;
+  memset(&r, 0, sizeof(r));
+  r.operation = operation;
+  r.size = size;
+  strncpy(r.name, filename.c_str(), sizeof(r.name) - 1);
+  r.check = indexRecordCheck(r);
+  if (write(mIndexFile, &r, sizeof(r)) != (ssize_t)sizeof(r))
+  {
+    // a partial record would misalign everything appended after it
+    rtLogWarn("appending to the cache index failed, rewriting it");
+    writeIndex();
+    return;
+  }
+  mIndexRecords++;
+}
+
+void rtFileCache::closeIndex()
+{
+  if (mIndexFile >= 0)
+  {
+    close(mIndexFile);
+    mIndexFile = -1;
+  }
+  mIndexRecords = 0;
+}
+
+void rtFileCache::setEntry(const string& filename, int64_t size)
+{
+  unordered_map<string,cacheEntry>::iterator it = mEntries.find(filename);
+  if (it == mEntries.end())
+  {
+    mLru.push_back(filename);
+    cacheEntry entry;
+    entry.size = size;
+    entry.lru = --mLru.end();
+    mEntries[filename] = entry;
+  }
+  else
+  {
+    mCurrentSize -= it->second.size;
+    it->second.size = size;
+    mLru.splice(mLru.end(), mLru, it->second.lru);
+  }
+  mCurrentSize += size;
+}
+
+void rtFileCache::removeEntry(const string& filename)
+{
+  unordered_map<string,cacheEntry>::iterator it = mEntries.find(filename);
+  if (it != mEntries.end())
+  {
+    mCurrentSize -= it->second.size;
+    mLru.erase(it->second.lru);
+    mEntries.erase(it);
+  }
 }
 
 rtError rtFileCache::setMaxCacheSize(int64_t bytes)
@@ -161,17 +429,10 @@ rtError rtFileCache::setCacheDirectory(const char* directory)
   {
     return RT_ERROR;
   }
+  mCacheMutex.lock();
   mDirectory = directory;
-
-  int retVal = -1;
-#ifdef RT_PLATFORM_WINDOWS
-  retVal = mkdir(mDirectory.cString());
-#else
-  retVal = mkdir(mDirectory.cString(), 0777);
-#endif //RT_PLATFORM_WINDOWS
-  if (0 != retVal)
-    rtLogWarn("creation of cache directory(%s) failed", mDirectory.cString());
-  populateExistingFiles();
+  initCache();
+  mCacheMutex.unlock();
   return RT_OK;
 }
 
@@ -188,19 +449,12 @@ void rtFileCache::eraseData(rtString& filename)
   if (! filename.isEmpty())
   {
     mCacheMutex.lock();
-    mCurrentSize = mCurrentSize - mFileSizeMap[filename];
-    mFileSizeMap.erase(filename);
-    multimap<time_t,rtString>::iterator iter = mFileTimeMap.begin();
-    while (iter != mFileTimeMap.end())
+    string name = filename.cString();
+    if (mEntries.find(name) != mEntries.end())
     {
-      if (iter->second == filename.cString())
-      {
-        break;
-      }
-      iter++;
+      removeEntry(name);
+      appendIndex(INDEX_REMOVE, name, 0);
     }
-    if (iter != mFileTimeMap.end())
-      mFileTimeMap.erase(iter);
     mCacheMutex.unlock();
   }
 }
@@ -245,29 +499,22 @@ rtError rtFileCache::addToCache(const rtHttpCacheData& data)
     rtLogWarn("Problem in getting hash from the url(%s) while adding to cache ",url.cString());
     return RT_ERROR;
   }
-  else
-  {
-    // If the file was already cached and got deleted manually, then we should clean up the corresponding data.
-    if(mFileSizeMap[filename])
-    {
-      if ( !mFileTimeMap.empty() )
-      {
-        eraseData(filename);
-      }
-    }
-  }
 
-  bool ret = writeFile(filename,data);
+  int64_t fileSize = 0;
+  bool ret = writeFile(filename,data,fileSize);
   if (true != ret)
-     return RT_ERROR;
-  setFileSizeAndTime(filename);
-
+  {
+    // an earlier version of the file may be gone as well
+    eraseData(filename);
+    return RT_ERROR;
+  }
 
   mCacheMutex.lock();
-  mCurrentSize += mFileSizeMap[filename];
+  setEntry(filename.cString(), fileSize);
+  appendIndex(INDEX_ADD, filename.cString(), fileSize);
   int64_t size = cleanup();
   mCacheMutex.unlock();
-  rtLogDebug("addToCache url(%s) filename(%s) size(%ld) Cache expiration(%s) total cache size (%ld)", url.cString(), filename.cString(), (long) mFileSizeMap[filename], data.expirationDate().cString(), (long) size);
+  rtLogDebug("addToCache url(%s) filename(%s) size(%ld) Cache expiration(%s) total cache size (%ld)", url.cString(), filename.cString(), (long) fileSize, data.expirationDate().cString(), (long) size);
   return RT_OK;
 }
 
@@ -280,8 +527,28 @@ rtError rtFileCache::httpCacheData(const char* url, rtHttpCacheData& cacheData)
     rtLogWarn("Problem in getting hash from the url(%s) while read from cache",url);
     return RT_ERROR;
   }
+
+  // the index knows what is cached without touching the file system
+  mCacheMutex.lock();
+  string name = filename.cString();
+  unordered_map<string,cacheEntry>::iterator it = mEntries.find(name);
+  bool cached = it != mEntries.end();
+  if (cached)
+  {
+    int64_t size = it->second.size;
+    setEntry(name, size);
+    appendIndex(INDEX_ADD, name, size);
+  }
+  mCacheMutex.unlock();
+  if (!cached)
+    return RT_ERROR;
+
   if (false == readFileHeader(filename,cacheData))
+  {
+    // deleted behind the cache's back
+    eraseData(filename);
     return RT_ERROR;
+  }
   return RT_OK;
 }
 
@@ -289,52 +556,68 @@ void rtFileCache::clearCache()
 {
   if (! mDirectory.isEmpty())
   {
-    rtString buff("rm -rf ");
-    buff.append(mDirectory.cString());
-    buff.append("/*");
-    int retVal = system(buff.cString());
-
-    if(retVal == -1)
+    mCacheMutex.lock();
+    closeIndex();
+    DIR* directory = opendir(mDirectory.cString());
+    if (NULL != directory)
     {
-      // The system method failed
+      for (struct dirent* direntry = readdir(directory); direntry != NULL; direntry = readdir(directory))
+      {
+        if ((strcmp(direntry->d_name,".") != 0) && (strcmp(direntry->d_name,"..") != 0))
+        {
+          rtString filename = direntry->d_name;
+          if (0 != unlink(absPath(filename).cString()))
+          {
+            rtLogWarn("removal of cache file(%s) failed", direntry->d_name);
+          }
+        }
+      }
+      closedir(directory);
     }
 
-    mFileSizeMap.clear();
-    mCacheMutex.lock();
+    mEntries.clear();
+    mLru.clear();
     mCurrentSize = 0;
+    writeIndex();
     mCacheMutex.unlock();
   }
 }
 
 int64_t rtFileCache::cleanup()
 {
-  if ( (mCurrentSize > mMaxSize) && !(mFileTimeMap.empty()))
+  if ((mCurrentSize > mMaxSize) && !mLru.empty())
   {
-    multimap<time_t,rtString>::iterator iter = mFileTimeMap.begin();
-    vector <multimap<time_t,rtString>::iterator> timeMapIters;
+    rtLogInfo("Storage capacity exceeded" );
+    // the files are renamed right away, so that a new version can be
+    // written while they are deleted in the background
+    vector<string>* evicted = new vector<string>();
     do
     {
-      rtString filename = iter->second;
-      if (! filename.isEmpty())
+      rtString filename = mLru.front().c_str();
+      rtString path = absPath(filename);
+      rtString evictedPath = path;
+      evictedPath.append(RT_FILE_CACHE_EVICTED_SUFFIX);
+      if (0 == rename(path.cString(), evictedPath.cString()))
       {
-          rtLogInfo("Storage capacity exceeded" );
-          if(false == deleteFile(filename))
-          {
-            rtLogWarn("!!! deletion of cache failed during cleanup for file(%s)",filename.cString());
-          }
-          else
-          {
-            mCurrentSize = mCurrentSize - mFileSizeMap[filename];
-            timeMapIters.push_back(iter);
-            mFileSizeMap.erase(filename);
-          }
+        evicted->push_back(evictedPath.cString());
       }
-      iter++;
-    } while ((mCurrentSize > mMaxSize) && (iter != mFileTimeMap.end()));
+      else if (ENOENT != errno)
+      {
+        rtLogWarn("!!! eviction of cache file(%s) failed", filename.cString());
+      }
+      string name = mLru.front();
+      removeEntry(name);
+      appendIndex(INDEX_REMOVE, name, 0);
+    } while ((mCurrentSize > mMaxSize) && !mLru.empty());
 
-    for (unsigned int count =0; count < timeMapIters.size(); count++)
-      mFileTimeMap.erase(timeMapIters[count]);
-    timeMapIters.clear();
+    if (evicted->empty())
+    {
+      delete evicted;
+    }
+    else
+    {
+      rtThreadPool::globalInstance()->executeTask(new rtThreadTask(deleteEvictedFiles, evicted, ""));
+    }
   }
   return mCurrentSize;
 }
@@ -347,54 +630,35 @@ rtString rtFileCache::hashedFileName(const rtString& url)
   return stream.str().c_str();
 }
 
-void rtFileCache::setFileSizeAndTime(rtString& filename)
-{
-  if (!mDirectory.isEmpty())
-  {
-    struct stat statbuf;
-    rtString absPathString  = absPath(filename);
-    if (stat(absPathString.cString(), &statbuf) == 0)
-    {
-      mCacheMutex.lock();
-      mFileSizeMap[filename] = statbuf.st_size;
-#if defined(PX_PLATFORM_MAC)
-      mFileTimeMap.insert(make_pair(statbuf.st_atimespec.tv_sec,filename));
-#elif !(defined(WIN32) || defined(_WIN32) || defined (WINDOWS) || defined (_WINDOWS))
-      mFileTimeMap.insert(make_pair(statbuf.st_atim.tv_sec,filename));
-#else
-       rtLogWarn("Platform not supported. Cache will not get cleared after cache limit is reached");
-#endif
-      mCacheMutex.unlock();
-    }
-  }
-}
-
-bool rtFileCache::writeFile(rtString& filename,const rtHttpCacheData& constCacheData)
+bool rtFileCache::writeFile(rtString& filename,const rtHttpCacheData& constCacheData, int64_t& size)
 {
   rtHttpCacheData* cacheData = const_cast<rtHttpCacheData*>(&constCacheData);
-  rtData data;
   stringstream stream;
   stream << cacheData->expirationDateUnix();
   string date = stream.str().c_str();
-  data.init(cacheData->headerData().length() + date.length() + 1 + cacheData->contentsData().length() + 1);
-  memcpy(data.data(),cacheData->headerData().data(),cacheData->headerData().length());
-  memset(data.data()+cacheData->headerData().length(),'|',1);
-  memcpy(data.data()+cacheData->headerData().length()+1,date.c_str(), date.length());
-  memset(data.data()+cacheData->headerData().length() + date.length() + 1,'|',1);
-  memcpy(data.data()+cacheData->headerData().length()+1+ date.length() + 1,cacheData->contentsData().data(),cacheData->contentsData().length());
   rtString absPathString  = absPath(filename);
-  if (RT_OK != rtStoreFile(absPathString.cString(),data))
+  // write the pieces straight from the cache data, the body can be several MB
+  FILE* fp = fopen(absPathString.cString(), "wb");
+  if (NULL == fp)
     return false;
-  return true;
+  rtData& header = cacheData->headerData();
+  rtData& contents = cacheData->contentsData();
+  bool written = (fwrite(header.data(), 1, header.length(), fp) == header.length()) &&
+                 (fputc('|', fp) != EOF) &&
+                 (fwrite(date.c_str(), 1, date.length(), fp) == date.length()) &&
+                 (fputc('|', fp) != EOF) &&
+                 (fwrite(contents.data(), 1, contents.length(), fp) == contents.length());
+  if (fclose(fp) != 0)
+    written = false;
+  size = (int64_t)header.length() + 1 + date.length() + 1 + contents.length();
+  return written;
 }
 
 bool rtFileCache::deleteFile(rtString& filename)
 {
-  rtString cmd = "rm -rf ";
   rtString absPathString  = absPath(filename);
-  cmd.append(absPathString);
   rtLogInfo("Deleting the file (%s)", absPathString.cString());
-  if (0 != system(cmd.cString()))
+  if (0 != unlink(absPathString.cString()) && ENOENT != errno)
   {
     rtLogWarn("removal of file failed");
     return false;
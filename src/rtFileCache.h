@@ -28,7 +28,8 @@
 #include "rtHttpCache.h"
 #include "rtMutex.h"
 
-#include <map>
+#include <list>
+#include <unordered_map>
 // TODO elimate std::string from headers and impl
 #include <string>
 
@@ -70,20 +71,23 @@ class rtFileCache
     rtFileCache();
     ~rtFileCache();
 
-    /* initialize the cache */
+    /* initialize the cache from its index, or from the files in the cache directory when there is no index */
     void initCache();
 
-    /* cleans the cache till the size is more than cache data size and return the new size */
+    /* evicts the files used least recently till the size is not more than the maximum, returns the new size */
     int64_t cleanup(); 
 
-    /* set the file size and time associated with the file */
-    void setFileSizeAndTime(rtString& filename);
+    /* adds the file to the cache as the one used most recently, or updates its size and makes it the one used most recently */
+    void setEntry(const std::string& filename, int64_t size);
+
+    /* removes the file from the cache data */
+    void removeEntry(const std::string& filename);
 
     /* calculates and returns the hash value of the url */
     rtString hashedFileName(const rtString& url);
 
-    /* write the cache data to a file. Returns true on success and false on failure */
-    bool writeFile(rtString& filename, const rtHttpCacheData& cacheData);
+    /* write the cache data to a file and return its size. Returns true on success and false on failure */
+    bool writeFile(rtString& filename, const rtHttpCacheData& cacheData, int64_t& size);
 
     /* delete the file from cache */
     bool deleteFile(rtString& filename);
@@ -94,19 +98,39 @@ class rtFileCache
     /* returns the filename in absolute path format */
     rtString absPath(rtString& filename);
 
-    /* populate the existing files in cache along with size in mFileSizeMap */
+    /* populate the existing files in cache from the cache directory and write a new index for them */
     void populateExistingFiles();
 
+    /* replays the index log of the cache directory. Returns false if there is none or it isn't valid */
+    bool loadIndex();
+
+    /* replaces the index log with a record per file in the cache */
+    bool writeIndex();
+
+    /* appends a record to the index log */
+    void appendIndex(uint32_t operation, const std::string& filename, int64_t size);
+
+    void closeIndex();
+
     /* erase the map data of the cached file */
     void eraseData(rtString& filename);
 
+    struct cacheEntry
+    {
+      int64_t size;
+      std::list<std::string>::iterator lru;
+    };
+
     /* member variables */
     int64_t mMaxSize;
     int64_t mCurrentSize;
     rtString mDirectory;
     std::hash<std::string> hashFn;
-    std::multimap<time_t,rtString> mFileTimeMap;
-    std::map<rtString,int64_t> mFileSizeMap;
+    // the files in the cache, the one used least recently at the front of mLru
+    std::unordered_map<std::string,cacheEntry> mEntries;
+    std::list<std::string> mLru;
+    int mIndexFile;
+    size_t mIndexRecords;
     rtMutex mCacheMutex;
     static rtFileCache* mCache;
 };
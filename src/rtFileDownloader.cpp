@@ -30,8 +30,15 @@
 #include <iostream>
 #include <thread>
 #include "rtUrlUtils.h"
+#include <new>
 #ifndef WIN32
 #include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/resource.h>
+#else
+#define strncasecmp _strnicmp
 #endif //!WIN32
 using namespace std;
 
@@ -40,6 +47,9 @@ using namespace std;
 const int kCurlTimeoutInSeconds = 30;
 const double kDefaultDownloadHandleExpiresTime = 5 * 60;
 const int kDownloadHandleTimerIntervalInMilliSeconds = 30 * 1000;
+const unsigned int kDefaultMaxActiveTransfers = 64;
+const int kDownloadLoopWaitTimeInMilliSeconds = 250;
+const double kCancelCheckIntervalInSeconds = 0.25;
 
 std::thread* downloadHandleExpiresCheckThread = NULL;
 bool continueDownloadHandleCheck = true;
@@ -47,18 +57,164 @@ rtMutex downloadHandleMutex;
 
 #define HTTP_DOWNLOAD_CANCELED 499
 
+const size_t kMinDownloadBlockSize = 16 * 1024;
+// Content-Length values above this are treated as unknown so a bogus header
+// cannot make us allocate the whole thing up front
+const size_t kMaxDownloadReserveSize = 256 * 1024 * 1024;
+
+rtFileDownloadBuffer::rtFileDownloadBuffer()
+  : mBlocks(), mSize(0), mCapacity(0), mBytesCopied(0), mPeakBytes(0)
+{
+}
+
+rtFileDownloadBuffer::~rtFileDownloadBuffer()
+{
+  clear();
+}
+
+bool rtFileDownloadBuffer::addBlock(size_t capacity)
+{
+  rtFileDownloadBlock block;
+  // one spare byte so the body can always be null terminated in place
+  block.data = new (std::nothrow) char[capacity + 1];
+  if (block.data == NULL)
+  {
+    return false;
+  }
+  block.size = 0;
+  block.capacity = capacity;
+  mBlocks.push_back(block);
+  mCapacity += capacity + 1;
+  if (mCapacity > mPeakBytes)
+  {
+    mPeakBytes = mCapacity;
+  }
+  return true;
+}
+
+void rtFileDownloadBuffer::reserve(size_t size)
+{
+  // only an empty buffer is resized, data already received is never moved
+  if (mSize != 0 || size == 0 || size > kMaxDownloadReserveSize)
+  {
+    return;
+  }
+  if (mBlocks.size() == 1 && mBlocks[0].capacity >= size)
+  {
+    return;
+  }
+  clear();
+  addBlock(size);
+}
+
+bool rtFileDownloadBuffer::append(const char* data, size_t size)
+{
+  while (size > 0)
+  {
+    if (mBlocks.empty() || mBlocks.back().size == mBlocks.back().capacity)
+    {
+      // grow geometrically so the number of blocks stays logarithmic
+      size_t capacity = mSize > kMinDownloadBlockSize ? mSize : kMinDownloadBlockSize;
+      if (capacity < size)
+      {
+        capacity = size;
+      }
+      if (!addBlock(capacity))
+      {
+        return false;
+      }
+    }
+    rtFileDownloadBlock& block = mBlocks.back();
+    size_t copySize = block.capacity - block.size;
+    if (copySize > size)
+    {
+      copySize = size;
+    }
+    memcpy(block.data + block.size, data, copySize);
+    block.size += copySize;
+    mSize += copySize;
+    mBytesCopied += copySize;
+    data += copySize;
+    size -= copySize;
+  }
+  return true;
+}
+
+char* rtFileDownloadBuffer::release(size_t& size)
+{
+  size = mSize;
+  char* data = NULL;
+  if (mBlocks.size() == 1)
+  {
+    data = mBlocks[0].data;
+    mBlocks.clear();
+  }
+  else
+  {
+    // the body arrived without a usable Content-Length, gather it once
+    data = new (std::nothrow) char[mSize + 1];
+    if (data == NULL)
+    {
+      clear();
+      size = 0;
+      return NULL;
+    }
+    size_t offset = 0;
+    for (size_t i = 0; i < mBlocks.size(); i++)
+    {
+      memcpy(data + offset, mBlocks[i].data, mBlocks[i].size);
+      offset += mBlocks[i].size;
+    }
+    mBytesCopied += mSize;
+    if (mCapacity + mSize + 1 > mPeakBytes)
+    {
+      mPeakBytes = mCapacity + mSize + 1;
+    }
+    clear();
+  }
+  data[size] = 0;
+  mSize = 0;
+  mCapacity = 0;
+  return data;
+}
+
+void rtFileDownloadBuffer::clear()
+{
+  for (size_t i = 0; i < mBlocks.size(); i++)
+  {
+    delete [] mBlocks[i].data;
+  }
+  mBlocks.clear();
+  mSize = 0;
+  mCapacity = 0;
+}
+
+size_t rtFileDownloadBuffer::size() const
+{
+  return mSize;
+}
+
+size_t rtFileDownloadBuffer::bytesCopied() const
+{
+  return mBytesCopied;
+}
+
+size_t rtFileDownloadBuffer::peakBytes() const
+{
+  return mPeakBytes;
+}
+
 struct MemoryStruct
 {
     MemoryStruct()
         : headerSize(0)
         , headerBuffer(NULL)
-        , contentsSize(0)
-        , contentsBuffer(NULL)
+        , contents()
+        , reserveContents(false)
         , downloadRequest(NULL)
         , readSize(0)
     {
         headerBuffer = (char*)malloc(1);
-        contentsBuffer = (char*)malloc(1);
     }
 
     ~MemoryStruct()
@@ -68,17 +224,12 @@ struct MemoryStruct
         free(headerBuffer);
         headerBuffer = NULL;
       }
-      if (contentsBuffer != NULL)
-      {
-        free(contentsBuffer);
-        contentsBuffer = NULL;
-      }
     }
 
   size_t headerSize;
   char* headerBuffer;
-  size_t contentsSize;
-  char* contentsBuffer;
+  rtFileDownloadBuffer contents;
+  bool reserveContents;
   rtFileDownloadRequest *downloadRequest;
   size_t readSize;
 };
@@ -99,6 +250,26 @@ static size_t HeaderCallback(void *contents, size_t size, size_t nmemb, void *us
   mem->headerSize += downloadSize;
   mem->headerBuffer[mem->headerSize] = 0;
 
+  const char* contentLength = "content-length:";
+  size_t contentLengthSize = strlen(contentLength);
+  if (mem->reserveContents && downloadSize > contentLengthSize &&
+      strncasecmp((const char*)contents, contentLength, contentLengthSize) == 0)
+  {
+    char value[32];
+    size_t valueSize = downloadSize - contentLengthSize;
+    if (valueSize >= sizeof(value))
+    {
+      valueSize = sizeof(value) - 1;
+    }
+    memcpy(value, (const char*)contents + contentLengthSize, valueSize);
+    value[valueSize] = 0;
+    long long expectedSize = atoll(value);
+    if (expectedSize > 0)
+    {
+      mem->contents.reserve((size_t)expectedSize);
+    }
+  }
+
   return downloadSize;
 }
 
@@ -110,17 +281,12 @@ static size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb, voi
 
   downloadCallbackSize = mem->downloadRequest->executeDownloadProgressCallback(contents, size, nmemb );
 
-  mem->contentsBuffer = (char*)realloc(mem->contentsBuffer, mem->contentsSize + downloadSize + 1);
-  if(mem->contentsBuffer == NULL) {
+  if (!mem->contents.append((const char*)contents, downloadSize)) {
     /* out of memory! */
     cout << "out of memory when downloading image\n";
     return 0;
   }
 
-  memcpy(&(mem->contentsBuffer[mem->contentsSize]), contents, downloadSize);
-  mem->contentsSize += downloadSize;
-  mem->contentsBuffer[mem->contentsSize] = 0;
-
   if (mem->downloadRequest->useCallbackDataSize() == true)
   {
      return downloadCallbackSize;
@@ -150,10 +316,41 @@ static size_t ReadMemoryCallback(void *contents, size_t size, size_t nmemb, void
 }
 
 
+// state for one network transfer, owned by the calling thread for blocking
+// downloads or by the download thread for transfers driven by curl multi
+struct rtFileDownloadTransfer
+{
+  rtFileDownloadTransfer(rtFileDownloadRequest* request)
+    : downloadRequest(request), curlHandle(NULL), headerList(NULL), chunk(), origin(), expiresTime(0)
+  {
+    memset(errorBuffer, 0, sizeof(errorBuffer));
+  }
+
+  rtFileDownloadRequest* downloadRequest;
+  CURL* curlHandle;
+  struct curl_slist* headerList;
+  MemoryStruct chunk;
+  rtString origin;
+  double expiresTime;
+  char errorBuffer[CURL_ERROR_SIZE];
+};
+
 void startFileDownloadInBackground(void* data)
 {
     rtFileDownloadRequest* downloadRequest = (rtFileDownloadRequest*)data;
-    rtFileDownloader::instance()->downloadFile(downloadRequest);
+    rtFileDownloader::instance()->downloadFileAsync(downloadRequest);
+}
+
+void completeFileDownloadInBackground(void* data)
+{
+    rtFileDownloadRequest* downloadRequest = (rtFileDownloadRequest*)data;
+    rtFileDownloader::instance()->completeNetworkDownload(downloadRequest, downloadRequest->downloadStatusCode() == CURLE_OK);
+}
+
+void onDownloadLoop(rtFileDownloader* downloader)
+{
+  rtLogDebug("inside onDownloadLoop");
+  downloader->runDownloadLoop();
 }
 
 rtFileDownloader* rtFileDownloader::mInstance = NULL;
@@ -201,7 +398,7 @@ rtFileDownloadRequest::~rtFileDownloadRequest()
 {
   if (mDownloadedData  != NULL)
   {
-    free(mDownloadedData);
+    delete [] mDownloadedData;
   }
   mDownloadedData = NULL;
   if (mHeaderData != NULL)
@@ -300,6 +497,14 @@ void rtFileDownloadRequest::downloadedData(char*& data, size_t& size)
   size = mDownloadedDataSize;
 }
 
+void rtFileDownloadRequest::takeDownloadedData(char*& data, size_t& size)
+{
+  data = mDownloadedData;
+  size = mDownloadedDataSize;
+  mDownloadedData = NULL;
+  mDownloadedDataSize = 0;
+}
+
 char* rtFileDownloadRequest::downloadedData()
 {
   return mDownloadedData;
@@ -555,15 +760,37 @@ void rtFileDownloadRequest::setDownloadMetrics(int32_t connectTimeMs, int32_t ss
   mDownloadMetrics.set("downloadSpeedBytesPerSecond", downloadSpeedBytesPerSecond);
 }
 
+void rtFileDownloadRequest::setDownloadBufferMetrics(size_t bytesCopied, size_t peakBufferBytes)
+{
+  mDownloadMetrics.set("bytesCopied", (uint64_t)bytesCopied);
+  mDownloadMetrics.set("peakBufferBytes", (uint64_t)peakBufferBytes);
+#ifndef WIN32
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+  {
+    mDownloadMetrics.set("peakRssKb", (int64_t)usage.ru_maxrss);
+  }
+#endif //!WIN32
+}
+
 rtFileDownloader::rtFileDownloader()
     : mNumberOfCurrentDownloads(0), mDefaultCallbackFunction(NULL), mDownloadHandles(), mReuseDownloadHandles(false),
-      mCaCertFile(CA_CERTIFICATE), mFileCacheMutex()
+      mCaCertFile(CA_CERTIFICATE), mFileCacheMutex(), mDownloadThread(NULL), mMultiHandle(NULL),
+      mPendingTransfers(), mActiveTransfers(), mDownloadQueueMutex(), mDownloadLoopRunning(false),
+      mMaxActiveTransfers(kDefaultMaxActiveTransfers)
 {
   CURLcode rv = curl_global_init(CURL_GLOBAL_ALL);
   if (CURLE_OK != rv)
   {
     rtLogError("curl global init failed (error code: %d)", rv);
   }
+  mWakeupPipe[0] = -1;
+  mWakeupPipe[1] = -1;
+  char const* maxActiveTransfers = getenv("RT_DOWNLOAD_MAX_ACTIVE_TRANSFERS");
+  if (maxActiveTransfers && atoi(maxActiveTransfers) > 0)
+  {
+    mMaxActiveTransfers = (unsigned int)atoi(maxActiveTransfers);
+  }
 #ifdef PX_REUSE_DOWNLOAD_HANDLES
   downloadHandleMutex.lock();
   int numberOfDownloadHandles = rtThreadPool::globalInstance()->numberOfThreadsInPool();
@@ -584,6 +811,7 @@ rtFileDownloader::rtFileDownloader()
 
 rtFileDownloader::~rtFileDownloader()
 {
+  stopDownloadLoop();
 #ifdef PX_REUSE_DOWNLOAD_HANDLES
   downloadHandleMutex.lock();
   for (vector<rtFileDownloadHandle>::iterator it = mDownloadHandles.begin(); it != mDownloadHandles.end(); )
@@ -662,6 +890,19 @@ void rtFileDownloader::raiseDownloadPriority(rtFileDownloadRequest* downloadRequ
   {
     rtThreadPool *mainThreadPool = rtThreadPool::globalInstance();
     mainThreadPool->raisePriority(downloadRequest->fileUrl());
+
+    // move the request ahead of the other transfers waiting for a connection
+    mDownloadQueueMutex.lock();
+    for (std::deque<rtFileDownloadRequest*>::iterator it = mPendingTransfers.begin(); it != mPendingTransfers.end(); ++it)
+    {
+      if ((*it) == downloadRequest)
+      {
+        mPendingTransfers.erase(it);
+        mPendingTransfers.push_front(downloadRequest);
+        break;
+      }
+    }
+    mDownloadQueueMutex.unlock();
   }
 }
 
@@ -677,6 +918,25 @@ void rtFileDownloader::clearFileCache()
 }
 
 void rtFileDownloader::downloadFile(rtFileDownloadRequest* downloadRequest)
+{
+  if (completeCanceledOrCachedDownload(downloadRequest))
+  {
+    return;
+  }
+  bool nwDownloadSuccess = downloadFromNetwork(downloadRequest);
+  completeNetworkDownload(downloadRequest, nwDownloadSuccess);
+}
+
+void rtFileDownloader::downloadFileAsync(rtFileDownloadRequest* downloadRequest)
+{
+  if (completeCanceledOrCachedDownload(downloadRequest))
+  {
+    return;
+  }
+  queueNetworkDownload(downloadRequest);
+}
+
+bool rtFileDownloader::completeCanceledOrCachedDownload(rtFileDownloadRequest* downloadRequest)
 {
   bool isRequestCanceled = downloadRequest->isCanceled();
   if (isRequestCanceled)
@@ -693,15 +953,11 @@ void rtFileDownloader::downloadFile(rtFileDownloadRequest* downloadRequest)
       }
     }
     clearFileDownloadRequest(downloadRequest);
-    return;
+    return true;
   }
 
 #ifdef ENABLE_HTTP_CACHE
     bool isDataInCache = false;
-#endif
-    bool nwDownloadSuccess = false;
-
-#ifdef ENABLE_HTTP_CACHE
     rtHttpCacheData cachedData(downloadRequest->fileUrl().cString());
     if (true == downloadRequest->cacheEnabled())
     {
@@ -712,48 +968,50 @@ void rtFileDownloader::downloadFile(rtFileDownloadRequest* downloadRequest)
       }
     }
 
-    if (isDataInCache)
+    if (!isDataInCache)
     {
-        if(downloadRequest->deferCacheRead())
+      return false;
+    }
+
+    if(downloadRequest->deferCacheRead())
+    {
+        rtLogInfo("Reading from cache Start for %s\n", downloadRequest->fileUrl().cString());
+        FILE *fp = downloadRequest->cacheFilePointer();
+
+        if(fp != NULL)
         {
-            rtLogInfo("Reading from cache Start for %s\n", downloadRequest->fileUrl().cString());
-            FILE *fp = downloadRequest->cacheFilePointer();
+            char* buffer = new char[downloadRequest->getCachedFileReadSize()];
+            size_t bytesCount = 0;
+            size_t dataSize = 0;                
 
-            if(fp != NULL)
+            // The cahced file has expiration value ends with | delimeter.
+            while ( !feof(fp) )
+            {
+                dataSize++;
+                if (fgetc(fp) == '|')
+                    break;
+            }
+            while (!feof(fp))
             {
-                char* buffer = new char[downloadRequest->getCachedFileReadSize()];
-                size_t bytesCount = 0;
-                size_t dataSize = 0;                
-				char invalidData[8] = "Invalid";
-
-                // The cahced file has expiration value ends with | delimeter.
-                while ( !feof(fp) )
-                {
-                    dataSize++;
-                    if (fgetc(fp) == '|')
-                        break;
-                }
-                while (!feof(fp))
-                {
-                    memset(buffer, 0, downloadRequest->getCachedFileReadSize());
-                    bytesCount = fread(buffer, 1, downloadRequest->getCachedFileReadSize(), fp);
-                    dataSize += bytesCount;
-                    downloadRequest->executeDownloadProgressCallback((unsigned char*)buffer, bytesCount, 1 );
-                }
-                // For deferCacheRead, the user requires the downloadedDataSize but not the data.
-                downloadRequest->setDownloadedData( invalidData, dataSize);
-                delete [] buffer;
-                fclose(fp);
+                memset(buffer, 0, downloadRequest->getCachedFileReadSize());
+                bytesCount = fread(buffer, 1, downloadRequest->getCachedFileReadSize(), fp);
+                dataSize += bytesCount;
+                downloadRequest->executeDownloadProgressCallback((unsigned char*)buffer, bytesCount, 1 );
             }
-            rtLogInfo("Reading from cache End for %s\n", downloadRequest->fileUrl().cString());
+            // For deferCacheRead, the user requires the downloadedDataSize but not the data.
+            char* invalidData = NULL;
+            size_t invalidDataSize = 0;
+            downloadRequest->takeDownloadedData(invalidData, invalidDataSize);
+            delete [] invalidData;
+            invalidData = new char[8];
+            strcpy(invalidData, "Invalid");
+            downloadRequest->setDownloadedData( invalidData, dataSize);
+            delete [] buffer;
+            fclose(fp);
         }
+        rtLogInfo("Reading from cache End for %s\n", downloadRequest->fileUrl().cString());
     }
-    else
-#endif
-    {
-      nwDownloadSuccess = downloadFromNetwork(downloadRequest);
-    }    
-    
+
     if (!downloadRequest->executeCallback(downloadRequest->downloadStatusCode()))
     {
       if (mDefaultCallbackFunction != NULL)
@@ -762,18 +1020,62 @@ void rtFileDownloader::downloadFile(rtFileDownloadRequest* downloadRequest)
       }
     }
 
+    // Store the updated data in cache
+    if (cachedData.isUpdated())
+    {
+      rtString url;
+      cachedData.url(url);
+
+      mFileCacheMutex.lock();
+      if (NULL == rtFileCache::instance())
+          rtLogWarn("Adding url to cache failed (%s) due to in-process memory issues", url.cString());
+      rtFileCache::instance()->removeData(url);
+      mFileCacheMutex.unlock();
+      if (cachedData.isWritableToCache())
+      {
+        mFileCacheMutex.lock();
+        rtError err = rtFileCache::instance()->addToCache(cachedData);
+        if (RT_OK != err)
+          rtLogWarn("Adding url to cache failed (%s)", url.cString());
+        
+        mFileCacheMutex.unlock();
+      }
+    }
+
+    // free whatever the callbacks didn't take
+    char* contentsBuffer = NULL;
+    size_t contentsSize = 0;
+    downloadRequest->takeDownloadedData(contentsBuffer, contentsSize);
+    delete [] contentsBuffer;
+    downloadRequest->setHeaderData(NULL,0);
+    clearFileDownloadRequest(downloadRequest);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void rtFileDownloader::completeNetworkDownload(rtFileDownloadRequest* downloadRequest, bool nwDownloadSuccess)
+{
 #ifdef ENABLE_HTTP_CACHE
-    // Store the network data in cache
+    // Store the network data in cache.  This happens before the callback since
+    // the callback may take ownership of the downloaded data.
     if ((true == nwDownloadSuccess) &&
         (true == downloadRequest->cacheEnabled())  &&
+        (downloadRequest->downloadedData() != NULL) &&
         (downloadRequest->httpStatusCode() != 206) &&
         (downloadRequest->httpStatusCode() != 302) &&
         (downloadRequest->httpStatusCode() != 307))
     {
+      // lend the body to the cache entry instead of copying it
+      char* contentsBuffer = NULL;
+      size_t contentsSize = 0;
+      downloadRequest->takeDownloadedData(contentsBuffer, contentsSize);
+      rtData contents;
+      contents.attach((uint8_t*)contentsBuffer, contentsSize);
       rtHttpCacheData downloadedData(downloadRequest->fileUrl(),
                                      downloadRequest->headerData(),
-                                     downloadRequest->downloadedData(),
-                                     downloadRequest->downloadedDataSize());
+                                     contents);
 
       if (downloadedData.isWritableToCache())
       {
@@ -786,56 +1088,51 @@ void rtFileDownloader::downloadFile(rtFileDownloadRequest* downloadRequest)
         }
         mFileCacheMutex.unlock();
       }
+      contentsSize = downloadedData.contentsData().length();
+      contentsBuffer = (char*)downloadedData.contentsData().detach();
+      downloadRequest->setDownloadedData(contentsBuffer, contentsSize);
     }
+#else
+    (void)nwDownloadSuccess;
+#endif
 
-    // Store the updated data in cache
-    if ((true == isDataInCache) && (cachedData.isUpdated()))
+    if (!downloadRequest->executeCallback(downloadRequest->downloadStatusCode()))
     {
-      rtString url;
-      cachedData.url(url);
-
-      mFileCacheMutex.lock();
-      if (NULL == rtFileCache::instance())
-          rtLogWarn("Adding url to cache failed (%s) due to in-process memory issues", url.cString());
-      rtFileCache::instance()->removeData(url);
-      mFileCacheMutex.unlock();
-      if (cachedData.isWritableToCache())
+      if (mDefaultCallbackFunction != NULL)
       {
-        mFileCacheMutex.lock();
-        rtError err = rtFileCache::instance()->addToCache(cachedData);
-        if (RT_OK != err)
-          rtLogWarn("Adding url to cache failed (%s)", url.cString());
-        
-        mFileCacheMutex.unlock();
+        (*mDefaultCallbackFunction)(downloadRequest);
       }
     }
-
-    if (true == isDataInCache)
-    {
-      downloadRequest->setHeaderData(NULL,0);
-      downloadRequest->setDownloadedData(NULL,0);
-    }
-#endif
     clearFileDownloadRequest(downloadRequest);
 }
 
 bool rtFileDownloader::downloadFromNetwork(rtFileDownloadRequest* downloadRequest)
 {
+    rtFileDownloadTransfer transfer(downloadRequest);
+    prepareTransfer(transfer);
+
+    /* get it! */
+    CURLcode res = curl_easy_perform(transfer.curlHandle);
+    return finishTransfer(transfer, res);
+}
+
+void rtFileDownloader::prepareTransfer(rtFileDownloadTransfer& transfer)
+{
+    rtFileDownloadRequest* downloadRequest = transfer.downloadRequest;
     CURL *curl_handle = NULL;
-    CURLcode res = CURLE_OK;
-    char errorBuffer[CURL_ERROR_SIZE];
 
     bool useProxy = !downloadRequest->proxy().isEmpty();
     rtString proxyServer = downloadRequest->proxy();
     bool headerOnly = downloadRequest->headerOnly();
-    MemoryStruct chunk;
+    MemoryStruct& chunk = transfer.chunk;
 
     rtString method = downloadRequest->method();
     size_t readDataSize = downloadRequest->readDataSize();
 
-    rtString origin = rtUrlGetOrigin(downloadRequest->fileUrl());
+    transfer.origin = rtUrlGetOrigin(downloadRequest->fileUrl());
 
-    curl_handle = rtFileDownloader::instance()->retrieveDownloadHandle(origin);
+    curl_handle = retrieveDownloadHandle(transfer.origin);
+    transfer.curlHandle = curl_handle;
     curl_easy_reset(curl_handle);
     /* specify URL to get */
     curl_easy_setopt(curl_handle, CURLOPT_URL, downloadRequest->fileUrl().cString());
@@ -845,6 +1142,7 @@ bool rtFileDownloader::downloadFromNetwork(rtFileDownloadRequest* downloadReques
     if (false == headerOnly)
     {
       chunk.downloadRequest = downloadRequest;
+      chunk.reserveContents = true;
       curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
       curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&chunk);
     }
@@ -860,10 +1158,9 @@ bool rtFileDownloader::downloadFromNetwork(rtFileDownloadRequest* downloadReques
 
     if(downloadRequest->isHTTPFailOnError())
     {
-        memset(errorBuffer, 0, sizeof(errorBuffer));
         curl_easy_setopt(curl_handle, CURLOPT_FAILONERROR, 1);
         curl_easy_setopt(curl_handle, CURLOPT_VERBOSE, 1);
-        curl_easy_setopt(curl_handle, CURLOPT_ERRORBUFFER, errorBuffer);
+        curl_easy_setopt(curl_handle, CURLOPT_ERRORBUFFER, transfer.errorBuffer);
     }
 #if !defined(PX_PLATFORM_GENERIC_DFB) && !defined(PX_PLATFORM_DFB_NON_X11)
     curl_easy_setopt(curl_handle, CURLOPT_TCP_KEEPALIVE, 1);
@@ -871,7 +1168,7 @@ bool rtFileDownloader::downloadFromNetwork(rtFileDownloadRequest* downloadReques
     curl_easy_setopt(curl_handle, CURLOPT_TCP_KEEPINTVL, 30);
 #endif //!PX_PLATFORM_GENERIC_DFB && !PX_PLATFORM_DFB_NON_X11
 
-    double downloadHandleExpiresTime = downloadRequest->downloadHandleExpiresTime();
+    transfer.expiresTime = downloadRequest->downloadHandleExpiresTime();
 
     vector<rtString>& additionalHttpHeaders = downloadRequest->additionalHttpHeaders();
     struct curl_slist *list = NULL;
@@ -886,6 +1183,7 @@ bool rtFileDownloader::downloadFromNetwork(rtFileDownloadRequest* downloadReques
       list = curl_slist_append(list, "Expect:");
     }
     curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, list);
+    transfer.headerList = list;
     //CA certificates
     // !CLF: Use system CA Cert rather than CA_CERTIFICATE fo now.  Revisit!
     //curl_easy_setopt(curl_handle,CURLOPT_CAINFO,mCaCertFile.cString());
@@ -929,14 +1227,23 @@ bool rtFileDownloader::downloadFromNetwork(rtFileDownloadRequest* downloadReques
       curl_easy_setopt(curl_handle, CURLOPT_READDATA, (void *)&chunk);
       curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDSIZE, readDataSize);
     }
+}
 
-    /* get it! */
-    res = curl_easy_perform(curl_handle);
-    curl_slist_free_all(list);
+bool rtFileDownloader::finishTransfer(rtFileDownloadTransfer& transfer, CURLcode res)
+{
+    rtFileDownloadRequest* downloadRequest = transfer.downloadRequest;
+    CURL *curl_handle = transfer.curlHandle;
+    bool useProxy = !downloadRequest->proxy().isEmpty();
+    rtString proxyServer = downloadRequest->proxy();
+    bool headerOnly = downloadRequest->headerOnly();
+    MemoryStruct& chunk = transfer.chunk;
+
+    curl_slist_free_all(transfer.headerList);
+    transfer.headerList = NULL;
 
     downloadRequest->setDownloadStatusCode(res);
     if(downloadRequest->isHTTPFailOnError())
-        downloadRequest->setHTTPError(errorBuffer);
+        downloadRequest->setHTTPError(transfer.errorBuffer);
 
     /* check for errors */
     if (res != CURLE_OK)
@@ -955,14 +1262,11 @@ bool rtFileDownloader::downloadFromNetwork(rtFileDownloadRequest* downloadReques
         memset(errorMessage, 0, sizeof(errorMessage));
         sprintf(errorMessage, "Download error for:%s. Error code:%d. %s",downloadRequest->fileUrl().cString(), res, proxyMessage.cString());
         downloadRequest->setErrorString(errorMessage);
-        rtFileDownloader::instance()->releaseDownloadHandle(curl_handle, downloadHandleExpiresTime, origin);
+        releaseDownloadHandle(curl_handle, transfer.expiresTime, transfer.origin);
+        transfer.curlHandle = NULL;
 
         //clean up contents on error
-        if (chunk.contentsBuffer != NULL)
-        {
-            free(chunk.contentsBuffer);
-            chunk.contentsBuffer = NULL;
-        }
+        chunk.contents.clear();
 
         if (chunk.headerBuffer != NULL)
         {
@@ -1000,7 +1304,8 @@ bool rtFileDownloader::downloadFromNetwork(rtFileDownloadRequest* downloadReques
     {
         downloadRequest->setHttpStatusCode(httpCode);
     }
-    rtFileDownloader::instance()->releaseDownloadHandle(curl_handle, downloadHandleExpiresTime, origin);
+    releaseDownloadHandle(curl_handle, transfer.expiresTime, transfer.origin);
+    transfer.curlHandle = NULL;
 
     //todo read the header information before closing
     if (chunk.headerBuffer != NULL)
@@ -1008,23 +1313,255 @@ bool rtFileDownloader::downloadFromNetwork(rtFileDownloadRequest* downloadReques
         downloadRequest->setHeaderData(chunk.headerBuffer, chunk.headerSize);
     }
 
-    //don't free the downloaded data (contentsBuffer) because it will be used later
+    //the request takes ownership of the downloaded data because it will be used later
     if (false == headerOnly)
     {
-      downloadRequest->setDownloadedData(chunk.contentsBuffer, chunk.contentsSize);
+      size_t contentsSize = 0;
+      char* contentsBuffer = chunk.contents.release(contentsSize);
+      downloadRequest->setDownloadedData(contentsBuffer, contentsSize);
     }
-    else if (chunk.contentsBuffer != NULL)
+    else
     {
-        free(chunk.contentsBuffer);
-        chunk.contentsBuffer = NULL;
+      chunk.contents.clear();
     }
+    downloadRequest->setDownloadBufferMetrics(chunk.contents.bytesCopied(), chunk.contents.peakBytes());
     chunk.headerBuffer = NULL;
-    chunk.contentsBuffer = NULL;
     if (downloadRequest->cors() != NULL)
       downloadRequest->cors()->updateResponseForAccessControl(downloadRequest);
     return true;
 }
 
+void rtFileDownloader::queueNetworkDownload(rtFileDownloadRequest* downloadRequest)
+{
+  mDownloadQueueMutex.lock();
+  if (mDownloadThread == NULL)
+  {
+    startDownloadLoop();
+  }
+  mPendingTransfers.push_back(downloadRequest);
+  mDownloadQueueMutex.unlock();
+  wakeDownloadLoop();
+}
+
+void rtFileDownloader::startDownloadLoop()
+{
+  mMultiHandle = curl_multi_init();
+#ifndef WIN32
+  if (pipe(mWakeupPipe) == 0)
+  {
+    fcntl(mWakeupPipe[0], F_SETFL, fcntl(mWakeupPipe[0], F_GETFL) | O_NONBLOCK);
+    fcntl(mWakeupPipe[1], F_SETFL, fcntl(mWakeupPipe[1], F_GETFL) | O_NONBLOCK);
+  }
+  else
+  {
+    rtLogWarn("unable to create download loop wakeup pipe, falling back to polling");
+    mWakeupPipe[0] = -1;
+    mWakeupPipe[1] = -1;
+  }
+#endif //!WIN32
+  mDownloadLoopRunning = true;
+  mDownloadThread = new std::thread(onDownloadLoop, this);
+}
+
+void rtFileDownloader::stopDownloadLoop()
+{
+  mDownloadQueueMutex.lock();
+  std::thread* downloadThread = mDownloadThread;
+  mDownloadLoopRunning = false;
+  mDownloadQueueMutex.unlock();
+  if (downloadThread == NULL)
+  {
+    return;
+  }
+  wakeDownloadLoop();
+  downloadThread->join();
+  delete downloadThread;
+  mDownloadThread = NULL;
+
+  std::vector<rtFileDownloadRequest*> unfinishedRequests(mPendingTransfers.begin(), mPendingTransfers.end());
+  for (std::set<rtFileDownloadTransfer*>::iterator it = mActiveTransfers.begin(); it != mActiveTransfers.end(); ++it)
+  {
+    rtFileDownloadTransfer* transfer = *it;
+    curl_multi_remove_handle(mMultiHandle, transfer->curlHandle);
+    curl_easy_cleanup(transfer->curlHandle);
+    curl_slist_free_all(transfer->headerList);
+    unfinishedRequests.push_back(transfer->downloadRequest);
+    delete transfer;
+  }
+  mActiveTransfers.clear();
+  mPendingTransfers.clear();
+  curl_multi_cleanup(mMultiHandle);
+  mMultiHandle = NULL;
+#ifndef WIN32
+  if (mWakeupPipe[0] >= 0)
+  {
+    close(mWakeupPipe[0]);
+    close(mWakeupPipe[1]);
+  }
+  mWakeupPipe[0] = -1;
+  mWakeupPipe[1] = -1;
+#endif //!WIN32
+
+  // the owners get the regular cancel notification so they release what
+  // they hold for the requests, and the requests are freed
+  for (std::vector<rtFileDownloadRequest*>::iterator it = unfinishedRequests.begin(); it != unfinishedRequests.end(); ++it)
+  {
+    (*it)->cancelRequest();
+    completeCanceledOrCachedDownload(*it);
+  }
+}
+
+void rtFileDownloader::wakeDownloadLoop()
+{
+#ifndef WIN32
+  if (mWakeupPipe[1] >= 0)
+  {
+    char wakeup = 1;
+    // a full pipe already guarantees a pending wakeup
+    if (write(mWakeupPipe[1], &wakeup, 1) < 0)
+    {
+      rtLogDebug("download loop wakeup already pending");
+    }
+  }
+#endif //!WIN32
+}
+
+void rtFileDownloader::startTransfer(rtFileDownloadRequest* downloadRequest)
+{
+  rtThreadPool* mainThreadPool = rtThreadPool::globalInstance();
+  if (downloadRequest->isCanceled())
+  {
+    // let a pool thread run the regular cancel notification
+    mainThreadPool->executeTask(new rtThreadTask(startFileDownloadInBackground, (void*)downloadRequest,
+                                                 downloadRequest->fileUrl(), RT_THREAD_TASK_PRIORITY_BACKGROUND));
+    return;
+  }
+  rtFileDownloadTransfer* transfer = new rtFileDownloadTransfer(downloadRequest);
+  prepareTransfer(*transfer);
+  curl_easy_setopt(transfer->curlHandle, CURLOPT_PRIVATE, (void*)transfer);
+  CURLMcode rc = curl_multi_add_handle(mMultiHandle, transfer->curlHandle);
+  if (rc != CURLM_OK)
+  {
+    rtLogError("unable to add download to the transfer loop (error code: %d)", rc);
+    finishTransfer(*transfer, CURLE_FAILED_INIT);
+    delete transfer;
+    mainThreadPool->executeTask(new rtThreadTask(completeFileDownloadInBackground, (void*)downloadRequest,
+                                                 downloadRequest->fileUrl(), RT_THREAD_TASK_PRIORITY_PREFETCH));
+    return;
+  }
+  mActiveTransfers.insert(transfer);
+}
+
+void rtFileDownloader::cancelActiveTransfers()
+{
+  rtThreadPool* mainThreadPool = rtThreadPool::globalInstance();
+  for (std::set<rtFileDownloadTransfer*>::iterator it = mActiveTransfers.begin(); it != mActiveTransfers.end(); )
+  {
+    rtFileDownloadTransfer* transfer = *it;
+    rtFileDownloadRequest* downloadRequest = transfer->downloadRequest;
+    if (!downloadRequest->isCanceled())
+    {
+      ++it;
+      continue;
+    }
+    mActiveTransfers.erase(it++);
+    curl_multi_remove_handle(mMultiHandle, transfer->curlHandle);
+    curl_slist_free_all(transfer->headerList);
+    // the connection was dropped mid-transfer so the handle is not reused
+    releaseDownloadHandle(transfer->curlHandle, 0, transfer->origin);
+    delete transfer;
+    mainThreadPool->executeTask(new rtThreadTask(startFileDownloadInBackground, (void*)downloadRequest,
+                                                 downloadRequest->fileUrl(), RT_THREAD_TASK_PRIORITY_BACKGROUND));
+  }
+}
+
+void rtFileDownloader::runDownloadLoop()
+{
+  rtThreadPool* mainThreadPool = rtThreadPool::globalInstance();
+  double lastCancelCheck = pxSeconds();
+  while (true)
+  {
+    std::vector<rtFileDownloadRequest*> startRequests;
+    mDownloadQueueMutex.lock();
+    if (!mDownloadLoopRunning)
+    {
+      mDownloadQueueMutex.unlock();
+      break;
+    }
+    while (!mPendingTransfers.empty() && (mActiveTransfers.size() + startRequests.size()) < mMaxActiveTransfers)
+    {
+      startRequests.push_back(mPendingTransfers.front());
+      mPendingTransfers.pop_front();
+    }
+    mDownloadQueueMutex.unlock();
+
+    for (std::vector<rtFileDownloadRequest*>::iterator it = startRequests.begin(); it != startRequests.end(); ++it)
+    {
+      startTransfer(*it);
+    }
+
+    int runningTransfers = 0;
+    curl_multi_perform(mMultiHandle, &runningTransfers);
+
+    CURLMsg* message = NULL;
+    int messagesLeft = 0;
+    while ((message = curl_multi_info_read(mMultiHandle, &messagesLeft)) != NULL)
+    {
+      if (message->msg != CURLMSG_DONE)
+      {
+        continue;
+      }
+      CURL* curlHandle = message->easy_handle;
+      CURLcode result = message->data.result;
+      rtFileDownloadTransfer* transfer = NULL;
+      curl_easy_getinfo(curlHandle, CURLINFO_PRIVATE, (char**)&transfer);
+      curl_multi_remove_handle(mMultiHandle, curlHandle);
+      if (transfer == NULL)
+      {
+        continue;
+      }
+      mActiveTransfers.erase(transfer);
+      rtFileDownloadRequest* downloadRequest = transfer->downloadRequest;
+      finishTransfer(*transfer, result);
+      delete transfer;
+      // only the completed payload goes to the pool for the callback and decode
+      mainThreadPool->executeTask(new rtThreadTask(completeFileDownloadInBackground, (void*)downloadRequest,
+                                                   downloadRequest->fileUrl(), RT_THREAD_TASK_PRIORITY_PREFETCH));
+    }
+
+    if (pxSeconds() - lastCancelCheck > kCancelCheckIntervalInSeconds)
+    {
+      cancelActiveTransfers();
+      lastCancelCheck = pxSeconds();
+    }
+
+    int numberOfFds = 0;
+#ifndef WIN32
+    struct curl_waitfd wakeupFd;
+    wakeupFd.fd = mWakeupPipe[0];
+    wakeupFd.events = CURL_WAIT_POLLIN;
+    wakeupFd.revents = 0;
+    curl_multi_wait(mMultiHandle, &wakeupFd, (mWakeupPipe[0] >= 0) ? 1 : 0, kDownloadLoopWaitTimeInMilliSeconds, &numberOfFds);
+    if (wakeupFd.revents != 0)
+    {
+      char buffer[64];
+      while (read(mWakeupPipe[0], buffer, sizeof(buffer)) > 0);
+    }
+    if (mWakeupPipe[0] < 0 && numberOfFds == 0)
+    {
+      pxSleepMS(10);
+    }
+#else
+    curl_multi_wait(mMultiHandle, NULL, 0, kDownloadLoopWaitTimeInMilliSeconds, &numberOfFds);
+    if (numberOfFds == 0)
+    {
+      // curl returns immediately when it has nothing to wait on
+      pxSleepMS(10);
+    }
+#endif //!WIN32
+  }
+}
+
 #ifdef ENABLE_HTTP_CACHE
 bool rtFileDownloader::checkAndDownloadFromCache(rtFileDownloadRequest* downloadRequest,rtHttpCacheData& cachedData)
 {
@@ -1043,8 +1580,23 @@ bool rtFileDownloader::checkAndDownloadFromCache(rtFileDownloadRequest* download
       return false;
     }
 
+    // the request owns its body, callbacks may take it
+    rtData& contents = cachedData.contentsData();
+    size_t contentsSize = contents.length();
+    char* contentsBuffer = NULL;
+    if (cachedData.isUpdated())
+    {
+      // still written back to the cache after the callbacks
+      contentsBuffer = new char[contentsSize + 1];
+      memcpy(contentsBuffer, contents.data(), contentsSize);
+      contentsBuffer[contentsSize] = '\0';
+    }
+    else
+    {
+      contentsBuffer = (char*)contents.detach();
+    }
     downloadRequest->setHeaderData((char *)cachedData.headerData().data(),cachedData.headerData().length());
-    downloadRequest->setDownloadedData((char *)cachedData.contentsData().data(),cachedData.contentsData().length());
+    downloadRequest->setDownloadedData(contentsBuffer, contentsSize);
     downloadRequest->setDownloadStatusCode(0);
     downloadRequest->setHttpStatusCode(200);
     mFileCacheMutex.unlock();
@@ -1064,7 +1616,19 @@ void rtFileDownloader::downloadFileInBackground(rtFileDownloadRequest* downloadR
       downloadRequest->setDownloadHandleExpiresTime(kDefaultDownloadHandleExpiresTime);
     }
 
-    rtThreadTask* task = new rtThreadTask(startFileDownloadInBackground, (void*)downloadRequest, downloadRequest->fileUrl());
+#ifdef ENABLE_HTTP_CACHE
+    if (!downloadRequest->cacheEnabled())
+#endif
+    {
+      // nothing to read from disk, hand the request straight to the download thread
+      queueNetworkDownload(downloadRequest);
+      return;
+    }
+
+    // the cache lookup runs as prefetch work on the pool; raiseDownloadPriority()
+    // promotes a request to the visible class once something on screen is waiting on it
+    rtThreadTask* task = new rtThreadTask(startFileDownloadInBackground, (void*)downloadRequest, downloadRequest->fileUrl(),
+                                          RT_THREAD_TASK_PRIORITY_PREFETCH);
 
     mainThreadPool->executeTask(task);
 }
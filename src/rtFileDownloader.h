@@ -31,6 +31,9 @@
 // TODO Eliminate std::string
 #include <string.h>
 #include <vector>
+#include <deque>
+#include <set>
+#include <thread>
 
 #if !defined(WIN32) && !defined(ENABLE_DFB)
 #pragma GCC diagnostic push
@@ -43,6 +46,41 @@
 #pragma GCC diagnostic pop
 #endif
 
+// Receive buffer for a download body.  The buffer is sized once from the
+// Content-Length header when the server sends one; otherwise incoming data is
+// appended to a chain of blocks so earlier bytes are never moved while the
+// transfer is running.  release() hands the body out as one new [] allocation.
+class rtFileDownloadBuffer
+{
+public:
+  rtFileDownloadBuffer();
+  ~rtFileDownloadBuffer();
+
+  void reserve(size_t size);
+  bool append(const char* data, size_t size);
+  char* release(size_t& size);
+  void clear();
+  size_t size() const;
+  size_t bytesCopied() const;
+  size_t peakBytes() const;
+
+private:
+  struct rtFileDownloadBlock
+  {
+    char* data;
+    size_t size;
+    size_t capacity;
+  };
+
+  bool addBlock(size_t capacity);
+
+  std::vector<rtFileDownloadBlock> mBlocks;
+  size_t mSize;
+  size_t mCapacity;
+  size_t mBytesCopied;
+  size_t mPeakBytes;
+};
+
 class rtFileDownloadRequest
 {
 public:
@@ -64,6 +102,7 @@ public:
   size_t executeDownloadProgressCallback(void *ptr, size_t size, size_t nmemb);
   void setDownloadedData(char* data, size_t size);
   void downloadedData(char*& data, size_t& size);
+  void takeDownloadedData(char*& data, size_t& size);
   char* downloadedData();
   size_t downloadedDataSize();
   void setHeaderData(char* data, size_t size);
@@ -111,6 +150,7 @@ public:
   size_t readDataSize() const;
   rtObjectRef downloadMetrics() const;
   void setDownloadMetrics(int32_t connectTimeMs, int32_t sslConnectTimeMs, int32_t totalTimeMs, int32_t downloadSpeedBytesPerSecond);
+  void setDownloadBufferMetrics(size_t bytesCopied, size_t peakBufferBytes);
 
 private:
   rtString mFileUrl;
@@ -159,6 +199,8 @@ struct rtFileDownloadHandle
   rtString origin;
 };
 
+struct rtFileDownloadTransfer;
+
 class rtFileDownloader
 {
 public:
@@ -176,9 +218,12 @@ public:
 
     void clearFileCache();
     void downloadFile(rtFileDownloadRequest* downloadRequest);
+    void downloadFileAsync(rtFileDownloadRequest* downloadRequest);
+    void completeNetworkDownload(rtFileDownloadRequest* downloadRequest, bool nwDownloadSuccess);
     void setDefaultCallbackFunction(void (*callbackFunction)(rtFileDownloadRequest*));
     bool downloadFromNetwork(rtFileDownloadRequest* downloadRequest);
     void checkForExpiredHandles();
+    void runDownloadLoop();
 
 private:
     rtFileDownloader();
@@ -188,6 +233,15 @@ private:
     rtFileDownloadRequest* nextDownloadRequest();
     void startNextDownloadInBackground();
     void downloadFileInBackground(rtFileDownloadRequest* downloadRequest);
+    bool completeCanceledOrCachedDownload(rtFileDownloadRequest* downloadRequest);
+    void prepareTransfer(rtFileDownloadTransfer& transfer);
+    bool finishTransfer(rtFileDownloadTransfer& transfer, CURLcode res);
+    void queueNetworkDownload(rtFileDownloadRequest* downloadRequest);
+    void startDownloadLoop();
+    void stopDownloadLoop();
+    void wakeDownloadLoop();
+    void startTransfer(rtFileDownloadRequest* downloadRequest);
+    void cancelActiveTransfers();
 #ifdef ENABLE_HTTP_CACHE
     bool checkAndDownloadFromCache(rtFileDownloadRequest* downloadRequest,rtHttpCacheData& cachedData);
 #endif
@@ -205,6 +259,16 @@ private:
     bool mReuseDownloadHandles;
     rtString mCaCertFile;
     rtMutex mFileCacheMutex;
+    // network transfers are driven by one curl multi loop on mDownloadThread;
+    // mActiveTransfers is only touched from that thread
+    std::thread* mDownloadThread;
+    CURLM* mMultiHandle;
+    std::deque<rtFileDownloadRequest*> mPendingTransfers;
+    std::set<rtFileDownloadTransfer*> mActiveTransfers;
+    rtMutex mDownloadQueueMutex;
+    bool mDownloadLoopRunning;
+    unsigned int mMaxActiveTransfers;
+    int mWakeupPipe[2];
     static rtFileDownloader* mInstance;
     static std::vector<rtFileDownloadRequest*>* mDownloadRequestVector;
     static rtMutex* mDownloadRequestVectorMutex;
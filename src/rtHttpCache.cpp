@@ -20,6 +20,7 @@
 
 #include <rtHttpCache.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sstream>
 #include "rtLog.h"
 #include <rtFileDownloader.h>
@@ -97,6 +98,20 @@ rtHttpCacheData::rtHttpCacheData(const char* url, const char* headerMetadata, co
   fp = NULL;
 }
 
+rtHttpCacheData::rtHttpCacheData(const char* url, const char* headerMetadata, rtData& contents) :
+     mUrl(url), mExpirationDate(0), mUpdated(false), mFileName()
+{
+  if (NULL != headerMetadata)
+  {
+    mHeaderMetaData.init((uint8_t *)headerMetadata,strlen(headerMetadata));
+    populateHeaderMap();
+    setExpirationDate();
+  }
+  size_t contentsLength = contents.length();
+  mData.attach(contents.detach(), contentsLength);
+  fp = NULL;
+}
+
 rtHttpCacheData::~rtHttpCacheData()
 {
   fp = NULL;
@@ -506,43 +521,34 @@ bool rtHttpCacheData::handleDownloadRequest(vector<rtString>& headers,bool downl
 
 bool rtHttpCacheData::readFileData()
 {
-  char *contentsData = NULL;
-  char* tmp = NULL;
-  char buffer[100];
-  size_t bytesCount = 0;
-  uint32_t totalBytes = 0;
-  while (!feof(fp))
+  // the body is the rest of the file, read in one piece into mData
+  long offset = ftell(fp);
+  struct stat buf;
+  if (offset < 0 || fstat(fileno(fp), &buf) != 0 || buf.st_size < offset)
   {
-    bytesCount = fread(buffer,1,100,fp);
-    if (NULL == contentsData)
-      tmp = (char *)malloc(bytesCount);
-    else
+    rtLogError("reading the cache data failed, the cache file can't be measured");
+    fclose(fp);
+    return false;
+  }
+  size_t totalBytes = (size_t)(buf.st_size - offset);
+  if (totalBytes > 0)
+  {
+    if (RT_OK != mData.init(totalBytes))
     {
-      tmp = (char *)realloc(contentsData,totalBytes+bytesCount);
+      rtLogError("reading the cache data failed due to memory lack \n");
+      fclose(fp);
+      return false;
     }
-    if (NULL == tmp)
+    size_t bytesCount = fread(mData.data(), 1, totalBytes, fp);
+    if (bytesCount != totalBytes)
     {
-      rtLogError("reading the cache data failed due to memory lack \n");
-      fflush(stdout);
+      rtLogError("reading the cache data failed, %ld of %ld bytes read", (long)bytesCount, (long)totalBytes);
+      mData.term();
       fclose(fp);
-      if (NULL != contentsData)
-        free(contentsData);
-      contentsData = NULL;
       return false;
     }
-    contentsData = tmp;
-    memcpy(contentsData+totalBytes,buffer,bytesCount);
-    totalBytes += bytesCount;
-    memset(buffer,0,100);
   }
   fclose(fp);
-  if (NULL != contentsData)
-  {
-    mData.init((uint8_t*)contentsData,totalBytes);
-    free(contentsData);
-    contentsData = NULL;
-    tmp = NULL;
-  }
   return true;
 }
 
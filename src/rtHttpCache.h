@@ -35,6 +35,8 @@ class rtHttpCacheData
     rtHttpCacheData();
     rtHttpCacheData(const char* url);
     rtHttpCacheData(const char* url, const char* headerMetadata, const char* data, size_t size=0);
+    /* takes over the buffer held by contents instead of copying it */
+    rtHttpCacheData(const char* url, const char* headerMetadata, rtData& contents);
 
     ~rtHttpCacheData();
     /* returns the expiration date of the cache data in localtime */
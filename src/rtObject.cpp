@@ -19,10 +19,75 @@
 // rtObject.cpp
 
 #include "rtObject.h"
+#include "rtMutex.h"
 #include <errno.h>
 
 using namespace std;
 
+// rtAtom
+namespace
+{
+  struct rtAtomHash
+  {
+    size_t operator()(const char* s) const
+    {
+      // FNV-1a
+      size_t h = 2166136261u;
+      for (; *s; s++)
+      {
+        h = (h ^ (unsigned char)*s) * 16777619u;
+      }
+      return h;
+    }
+  };
+
+  struct rtAtomEqual
+  {
+    bool operator()(const char* a, const char* b) const
+    {
+      return strcmp(a, b) == 0;
+    }
+  };
+
+  typedef std::unordered_map<const char*, rtAtom, rtAtomHash, rtAtomEqual> rtAtomTable;
+
+  rtMutex& atomMutex()
+  {
+    static rtMutex m;
+    return m;
+  }
+
+  rtAtomTable& atomTable()
+  {
+    static rtAtomTable t;
+    return t;
+  }
+}
+
+rtAtom rtInternAtom(const char* name)
+{
+  if (!name)
+    return NULL;
+  rtMutexLockGuard lock(atomMutex());
+  rtAtomTable& t = atomTable();
+  rtAtomTable::const_iterator it = t.find(name);
+  if (it != t.end())
+    return it->second;
+  rtAtom atom = strdup(name);
+  t[atom] = atom;
+  return atom;
+}
+
+rtAtom rtFindAtom(const char* name)
+{
+  if (!name)
+    return NULL;
+  rtMutexLockGuard lock(atomMutex());
+  rtAtomTable& t = atomTable();
+  rtAtomTable::const_iterator it = t.find(name);
+  return it != t.end() ? it->second : NULL;
+}
+
 // rtEmit
 unsigned long rtEmit::AddRef() 
 {
@@ -35,15 +100,30 @@ unsigned long rtEmit::Release() {
   return l;
 }
 
+void rtEmit::addEntry(const _rtEmitEntry& e)
+{
+  mEntries.push_back(e);
+  mListenerCounts[e.n]++;
+}
+
+vector<rtEmit::_rtEmitEntry>::iterator rtEmit::eraseEntry(vector<_rtEmitEntry>::iterator it)
+{
+  unordered_map<rtAtom, uint32_t>::iterator count = mListenerCounts.find(it->n);
+  if (count != mListenerCounts.end() && --count->second == 0)
+    mListenerCounts.erase(count);
+  return mEntries.erase(it);
+}
+
 rtError rtEmit::setListener(const char* eventName, rtIFunction* f)
 {
+  rtAtom atom = rtInternAtom(eventName);
   for (vector<_rtEmitEntry>::iterator it = mEntries.begin();
        it != mEntries.end(); it++)
   {
     _rtEmitEntry& e = (*it);
-    if (e.n == eventName && e.isProp)
+    if (e.n == atom && e.isProp)
     {
-      mEntries.erase(it);
+      eraseEntry(it);
       // There can only be one
       break;
     }
@@ -51,13 +131,13 @@ rtError rtEmit::setListener(const char* eventName, rtIFunction* f)
   if (f)
   {
     _rtEmitEntry e;
-    e.n = eventName;
+    e.n = atom;
     e.f = f;
     e.isProp = true;
     e.markForDelete = false;
     e.fnHash = f->hash();
     e.emitOnce = false;
-    mEntries.push_back(e);
+    addEntry(e);
   }
   
   return RT_OK;
@@ -72,6 +152,7 @@ rtError rtEmit::addListener(const char* eventName, rtIFunction* f, bool emitOnce
 {
   if (!eventName || !f)
     return RT_ERROR;
+  rtAtom atom = rtInternAtom(eventName);
   // Only allow unique entries
   bool found = false;
   for (vector<_rtEmitEntry>::iterator it = mEntries.begin(); 
@@ -80,7 +161,7 @@ rtError rtEmit::addListener(const char* eventName, rtIFunction* f, bool emitOnce
     _rtEmitEntry& e = (*it);
     // mHash check for javscript events callback 
     // markForDelete check is added to handle scenario where same handler is deleted and added immediately in same handler
-    if (e.n == eventName && ((e.f.getPtr() == f) || ((f->hash() != (size_t)-1) && (e.fnHash == f->hash()) && (false == e.markForDelete))) && !e.isProp)
+    if (e.n == atom && ((e.f.getPtr() == f) || ((f->hash() != (size_t)-1) && (e.fnHash == f->hash()) && (false == e.markForDelete))) && !e.isProp)
     {
       found = true;
       break;
@@ -89,7 +170,7 @@ rtError rtEmit::addListener(const char* eventName, rtIFunction* f, bool emitOnce
   if (!found)
   {
     _rtEmitEntry e;
-    e.n = eventName;
+    e.n = atom;
     e.f = f;
     e.isProp = false;
     e.markForDelete = false;
@@ -97,7 +178,7 @@ rtError rtEmit::addListener(const char* eventName, rtIFunction* f, bool emitOnce
     e.emitOnce = emitOnce;
     if (!mProcessingEvents)
     {
-      mEntries.push_back(e);
+      addEntry(e);
     }
     else
     {
@@ -114,15 +195,19 @@ rtError rtEmit::delListener(const char* eventName, rtIFunction* f)
   if (!eventName || !f)
     return RT_ERROR;
 
+  rtAtom atom = rtFindAtom(eventName);
+  if (!atom)
+    return RT_OK;
+
   for (vector<_rtEmitEntry>::iterator it = mEntries.begin(); 
        it != mEntries.end(); it++)
   {
     _rtEmitEntry& e = (*it);
-    if (e.n == eventName && ((e.f.getPtr() == f) || (((size_t)-1 != e.fnHash) && (e.fnHash == f->hash()))) && !e.isProp)
+    if (e.n == atom && ((e.f.getPtr() == f) || (((size_t)-1 != e.fnHash) && (e.fnHash == f->hash()))) && !e.isProp)
     {
       // if no events is being processed currently, remove the event entries
       if (!mProcessingEvents)
-      	mEntries.erase(it);
+      	eraseEntry(it);
       else
         it->markForDelete = true;
       // There can only be one
@@ -137,16 +222,22 @@ rtError rtEmit::Send(int numArgs, const rtValue* args, rtValue* result)
   (void)result;
   if (numArgs > 0)
   {
+    // short names are held inline and long ones shared, so neither the
+    // conversion nor the lookup allocates
     rtString eventName = args[0].toString();
     rtLogDebug("rtEmit::Send %s", eventName.cString());
 
+    rtAtom atom = mListenerCounts.empty() ? NULL : rtFindAtom(eventName.cString());
+    if (!atom || mListenerCounts.find(atom) == mListenerCounts.end())
+      return RT_OK;
+
     vector<_rtEmitEntry>::iterator it = mEntries.begin();
     
     mProcessingEvents = true;
     while (it != mEntries.end())
     {
       _rtEmitEntry& e = (*it);
-      if (e.n == eventName)
+      if (e.n == atom)
       {
         // Do this here to make interop synchronous
         rtError err;
@@ -171,11 +262,11 @@ rtError rtEmit::Send(int numArgs, const rtValue* args, rtValue* result)
         if (err == rtErrorFromErrno(EPIPE) || err == RT_ERROR_STREAM_CLOSED)
         {
           rtLogInfo("removing entry from remote client");
-          it = mEntries.erase(it);
+          it = eraseEntry(it);
         }
         else if (e.emitOnce)
         {
-          it = mEntries.erase(it);
+          it = eraseEntry(it);
         }
         else
         {
@@ -201,12 +292,17 @@ rtError rtEmit::SendAsync(int numArgs, const rtValue* args)
   {
     rtString eventName = args[0].toString();
     rtLogDebug("rtEmit::SendAsync %s", eventName.cString());
+
+    rtAtom atom = mListenerCounts.empty() ? NULL : rtFindAtom(eventName.cString());
+    if (!atom || mListenerCounts.find(atom) == mListenerCounts.end())
+      return RT_OK;
+
     vector<_rtEmitEntry>::iterator it = mEntries.begin();
 
     while (it != mEntries.end())
     {
       _rtEmitEntry& e = (*it);
-      if (e.n == eventName)
+      if (e.n == atom)
       {
         rtError err;
         err = e.f->Send(numArgs-1, args+1, NULL);
@@ -217,11 +313,11 @@ rtError rtEmit::SendAsync(int numArgs, const rtValue* args)
         if (err == rtErrorFromErrno(EPIPE) || err == RT_ERROR_STREAM_CLOSED)
         {
           rtLogInfo("removing entry from remote client");
-          it = mEntries.erase(it);
+          it = eraseEntry(it);
         }
         else if (e.emitOnce)
         {
-          it = mEntries.erase(it);
+          it = eraseEntry(it);
         }
         else
         {
@@ -246,7 +342,7 @@ void rtEmit::processPendingEvents()
   {
     if (true == it->markForDelete)
     {
-      it = mEntries.erase(it);
+      it = eraseEntry(it);
     }
     else
     {
@@ -257,16 +353,7 @@ void rtEmit::processPendingEvents()
   vector<_rtEmitEntry>::iterator pendingit = mPendingEntriesToAdd.begin();
   while (pendingit != mPendingEntriesToAdd.end())
   {
-    _rtEmitEntry& src = (*pendingit);
-    _rtEmitEntry dest;
-    dest.n = src.n;
-    dest.f = src.f;
-    dest.isProp = src.isProp;
-    dest.markForDelete = src.markForDelete;
-    dest.fnHash = src.fnHash;
-    dest.emitOnce = src.emitOnce;
-
-    mEntries.push_back(dest);
+    addEntry(*pendingit);
     ++pendingit;
   }
   mPendingEntriesToAdd.clear();
@@ -277,15 +364,19 @@ rtError rtEmit::clearListeners(const char* eventName)
   if (!eventName)
     return RT_ERROR;
 
+  rtAtom atom = rtFindAtom(eventName);
+  if (!atom)
+    return RT_OK;
+
   vector<_rtEmitEntry>::iterator it = mEntries.begin();
   while (it != mEntries.end())
   {
     _rtEmitEntry& e = (*it);
-    if (e.n == eventName)
+    if (e.n == atom)
     {
       // if no events is being processed currently, remove the event entries
       if (!mProcessingEvents)
-        it = mEntries.erase(it);
+        it = eraseEntry(it);
       else
       {
         it->markForDelete = true;
@@ -474,53 +565,194 @@ rtError rtObject::Get(uint32_t /*i*/, rtValue* /*value*/) const
   return RT_PROP_NOT_FOUND;
 }
 
-rtError rtObject::Get(const char* name, rtValue* value) const
+// Open addressed table over the property and method names of a class and
+// its parents.  Properties shadow methods of the same name and a class
+// shadows its parents, the same precedence the linked list walk had.
+struct rtMethodMapLookup
 {
-  rtError hr = RT_PROP_NOT_FOUND;
-  rtMethodMap* m = getMap();
-  
-  while(m) 
+  struct entry
   {
-    rtPropertyEntry* e = m->getFirstProperty();
-    while(e) 
+    uint32_t hash;
+    const char* name;
+    rtPropertyEntry* property;
+    rtMethodEntry* method;
+    int32_t methodIndex;
+  };
+
+  rtMethodMapLookup(rtMethodMap* map): mEntries(), mMask(0), mMethodCount(0)
+  {
+    size_t count = 0;
+    for (rtMethodMap* m = map; m; m = m->parentsMap)
     {
-      if (strcmp(name, e->mPropertyName) == 0) 
+      for (rtPropertyEntry* e = m->getFirstProperty(); e; e = e->mNext)
+        count++;
+      for (rtMethodEntry* e = m->getFirstMethod(); e; e = e->mNext)
+        count++;
+    }
+
+    size_t size = 8;
+    while (size < count * 2)
+      size *= 2;
+    entry empty = { 0, NULL, NULL, NULL, -1 };
+    mEntries.assign(size, empty);
+    mMask = (uint32_t)(size - 1);
+
+    for (rtMethodMap* m = map; m; m = m->parentsMap)
+    {
+      for (rtPropertyEntry* e = m->getFirstProperty(); e; e = e->mNext)
       {
-        rtGetPropertyThunk t = e->mGetThunk;
-        hr = (*this.*t)(*value);
-        return hr;
+        entry& slot = insert(e->mPropertyName);
+        if (slot.property == NULL)
+          slot.property = e;
       }
-      e = e->mNext;
     }
-    m = m->parentsMap;
-  }
-  rtLogDebug("key: %s not found", name);
-  
-  {
-    rtLogDebug("Looking for function as property: %s", name);
-    
-    rtMethodMap* m;
-    m = getMap();
-    
-    while(m)
+    for (rtMethodMap* m = map; m; m = m->parentsMap)
     {
-      rtMethodEntry* e = m->getFirstMethod();
-      while(e)
+      for (rtMethodEntry* e = m->getFirstMethod(); e; e = e->mNext)
       {
-        if (strcmp(name, e->mMethodName) == 0)
+        entry& slot = insert(e->mMethodName);
+        if (slot.method == NULL)
         {
-          rtLogDebug("found method: %s", name);
-          value->setFunction(new rtObjectFunction(this, e->mThunk));
-          hr = RT_OK;
-          return hr;
+          slot.method = e;
+          slot.methodIndex = mMethodCount++;
         }
-        e = e->mNext;
       }
-      
-      m = m->parentsMap;
     }
   }
-  return hr;
+
+  static uint32_t hashName(const char* name)
+  {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)name; *p; p++)
+    {
+      h ^= *p;
+      h *= 16777619u;
+    }
+    return h;
+  }
+
+  const entry* find(const char* name) const
+  {
+    uint32_t h = hashName(name);
+    for (uint32_t i = h & mMask; mEntries[i].name; i = (i + 1) & mMask)
+    {
+      const entry& e = mEntries[i];
+      if (e.hash == h && (e.name == name || strcmp(e.name, name) == 0))
+        return &e;
+    }
+    return NULL;
+  }
+
+  entry& insert(const char* name)
+  {
+    uint32_t h = hashName(name);
+    uint32_t i = h & mMask;
+    for (; mEntries[i].name; i = (i + 1) & mMask)
+    {
+      if (mEntries[i].hash == h && strcmp(mEntries[i].name, name) == 0)
+        return mEntries[i];
+    }
+    mEntries[i].hash = h;
+    mEntries[i].name = name;
+    return mEntries[i];
+  }
+
+  std::vector<entry> mEntries;
+  uint32_t mMask;
+  int32_t mMethodCount;
+};
+
+// The entry lists are complete once static initialization is done, so the
+// table is built once per class.  Racing builders keep the first one.
+static const rtMethodMapLookup* rtGetMethodMapLookup(rtMethodMap* map)
+{
+  if (!map)
+    return NULL;
+
+  rtMethodMapLookup* lookup = map->lookup;
+  if (lookup == NULL)
+  {
+    rtMethodMapLookup* built = new rtMethodMapLookup(map);
+    if (rtAtomicCompareAndSwapPtr(&map->lookup, (rtMethodMapLookup*)NULL, built))
+    {
+      lookup = built;
+    }
+    else
+    {
+      delete built;
+      lookup = map->lookup;
+    }
+  }
+  return lookup;
+}
+
+// guards rtObject::mMethodFunctions of every object
+static rtMutex sMethodFunctionsMutex;
+
+rtError rtObject::Get(const char* name, rtValue* value) const
+{
+  const rtMethodMapLookup* lookup = rtGetMethodMapLookup(getMap());
+  const rtMethodMapLookup::entry* e = lookup ? lookup->find(name) : NULL;
+
+  if (e && e->property)
+  {
+    rtGetPropertyThunk t = e->property->mGetThunk;
+    return (*this.*t)(*value);
+  }
+  rtLogDebug("key: %s not found", name);
+
+  if (e && e->method)
+  {
+    rtLogDebug("found method: %s", name);
+    value->setFunction(methodFunction(e->method->mThunk, e->methodIndex, lookup->mMethodCount));
+    return RT_OK;
+  }
+  return RT_PROP_NOT_FOUND;
+}
+
+// Hands out the same function object for a method for as long as anybody
+// holds on to it.  The object only keeps a plain pointer since the function
+// keeps the object alive; the function clears it again when it goes away.
+rtFunctionRef rtObject::methodFunction(rtMethodThunk thunk, int32_t index, int32_t methodCount) const
+{
+  rtMutexLockGuard lock(sMethodFunctionsMutex);
+
+  if (mMethodFunctions == NULL)
+    mMethodFunctions = new std::vector<rtObjectFunction*>(methodCount, (rtObjectFunction*)NULL);
+
+  rtObjectFunction* f = (*mMethodFunctions)[index];
+  if (f != NULL && f->tryAddRef())
+  {
+    rtFunctionRef ref = f;
+    f->Release();
+    return ref;
+  }
+
+  f = new rtObjectFunction(this, thunk, index);
+  (*mMethodFunctions)[index] = f;
+  return f;
+}
+
+void rtObject::forgetMethodFunction(rtObjectFunction* f, int32_t index) const
+{
+  rtMutexLockGuard lock(sMethodFunctionsMutex);
+  if (mMethodFunctions != NULL && (*mMethodFunctions)[index] == f)
+    (*mMethodFunctions)[index] = NULL;
+}
+
+const rtPropertyEntry* rtObject::findProperty(const char* name) const
+{
+  const rtMethodMapLookup* lookup = rtGetMethodMapLookup(getMap());
+  const rtMethodMapLookup::entry* e = lookup ? lookup->find(name) : NULL;
+  return e ? e->property : NULL;
+}
+
+const rtMethodEntry* rtObject::findMethod(const char* name) const
+{
+  const rtMethodMapLookup* lookup = rtGetMethodMapLookup(getMap());
+  const rtMethodMapLookup::entry* e = lookup ? lookup->find(name) : NULL;
+  return e ? e->method : NULL;
 }
 
 rtError rtObject::Set(uint32_t /*i*/, const rtValue* /*value*/)
@@ -530,37 +762,18 @@ rtError rtObject::Set(uint32_t /*i*/, const rtValue* /*value*/)
 
 rtError rtObject::Set(const char* name, const rtValue* value) 
 {
-  rtError hr = RT_PROP_NOT_FOUND;
-  
-  rtMethodMap* m;
-  m = getMap();
-  
-  while(m) 
+  const rtPropertyEntry* e = findProperty(name);
+  if (e == NULL)
+    return RT_PROP_NOT_FOUND;
+
+  if (e->mSetThunk) 
   {
-    rtPropertyEntry* e = m->getFirstProperty();
-    while(e) 
-    {
-      if (strcmp(name, e->mPropertyName) == 0) 
-      {
-        if (e->mSetThunk) 
-        {
-          rtSetPropertyThunk t = e->mSetThunk;
-          hr = (*this.*t)(*value);
-        }
-        else
-        {
-          hr = RT_FAIL;
-          rtLogError("setter for %s is missing thunk.", name);
-        }
-        return hr;
-      }
-      e = e->mNext;
-    }
-    
-    m = m->parentsMap;
+    rtSetPropertyThunk t = e->mSetThunk;
+    return (*this.*t)(*value);
   }
-  
-  return hr;
+
+  rtLogError("setter for %s is missing thunk.", name);
+  return RT_FAIL;
 }
 
 // rtObjectBase
@@ -740,7 +953,16 @@ rtError rtObjectFunction::Send(int numArgs, const rtValue* args, rtValue* result
   return (*mObject.*mThunk)(numArgs, args, *result);
 }
 
-rtObject::~rtObject() {}
+rtObjectFunction::~rtObjectFunction()
+{
+  if (mCacheIndex >= 0 && mObject)
+    mObject->forgetMethodFunction(this, mCacheIndex);
+}
+
+rtObject::~rtObject()
+{
+  delete mMethodFunctions;
+}
 
 rtError rtObject::description(rtString& d) const
 {
@@ -32,6 +32,7 @@
 #include <string.h>
 #include <vector>
 #include <string>
+#include <unordered_map>
 
 // rtIObject and rtIFunction are designed to be an
 // Abstract Binary Interface(ABI)
@@ -266,12 +267,14 @@ class rtFunctionRef: public rtRef<rtIFunction>, public rtFunctionBase
 
 class rtObjectFunction: public rtIFunction, public rtFunctionBase {
 public:
-  rtObjectFunction(const rtObject* o, rtMethodThunk t): mRefCount(0) 
+  // cacheIndex >= 0 marks the function as the one rtObject::Get hands out
+  // for that method of o, see rtObject::methodFunction()
+  rtObjectFunction(const rtObject* o, rtMethodThunk t, int32_t cacheIndex = -1): mRefCount(0), mCacheIndex(cacheIndex)
   {
     mObject = o;
     mThunk = t;
   }
-  virtual ~rtObjectFunction() {}
+  virtual ~rtObjectFunction();
   
   virtual unsigned long AddRef() { return rtAtomicInc(&mRefCount); }
   virtual unsigned long Release() 
@@ -281,6 +284,19 @@ public:
     return l;
   }
 
+  // AddRef unless the function is already being destroyed
+  bool tryAddRef()
+  {
+    unsigned long count;
+    do
+    {
+      count = mRefCount;
+      if (count == 0)
+        return false;
+    } while (!rtAtomicCompareAndSwap(&mRefCount, count, count + 1));
+    return true;
+  }
+
   virtual size_t hash()
   {
     return -1;
@@ -297,6 +313,7 @@ public:
   rtRef<rtObject> mObject;
   rtMethodThunk mThunk;
   unsigned long mRefCount;
+  int32_t mCacheIndex;
 };
 
 class rtObject: public rtIObject, public rtObjectBase  
@@ -310,7 +327,7 @@ public:
   rtMethodNoArgAndReturn("description", description, rtString);
   rtReadOnlyProperty(allKeys, allKeys, rtObjectRef);
   
-  rtObject(): mInitialized(false), mRefCount(0) { }
+  rtObject(): mInitialized(false), mRefCount(0), mMethodFunctions(NULL) { }
   virtual ~rtObject();
   
   virtual unsigned long /*__stdcall*/ AddRef();
@@ -331,9 +348,23 @@ public:
   virtual rtError Set(uint32_t i, const rtValue* value);
   virtual rtError Set(const char* name, const rtValue* value);
 
+  // Property and method entries of the object's class and its parents.
+  // The returned entries live as long as the class does, so callers may
+  // resolve a name once and call the thunks directly afterwards.
+  const rtPropertyEntry* findProperty(const char* name) const;
+  const rtMethodEntry* findMethod(const char* name) const;
+
 protected:
   bool mInitialized;
   rtAtomic mRefCount;
+
+private:
+  friend class rtObjectFunction;
+  rtFunctionRef methodFunction(rtMethodThunk thunk, int32_t index, int32_t methodCount) const;
+  void forgetMethodFunction(rtObjectFunction* f, int32_t index) const;
+
+  // functions handed out by Get for each method, these don't hold a reference
+  mutable std::vector<rtObjectFunction*>* mMethodFunctions;
 };
 
 #if 0
@@ -655,6 +686,14 @@ private:
 
 
 
+// Event names are interned so listeners can be matched against an event by
+// comparing pointers.  Interning a name always returns the same pointer and
+// interned names live as long as the process.
+typedef const char* rtAtom;
+rtAtom rtInternAtom(const char* name);
+// the atom of a name that was interned before, NULL if it never was
+rtAtom rtFindAtom(const char* name);
+
 class rtEmit: public rtIFunction 
 {
 
@@ -670,7 +709,7 @@ public:
   rtError addListener(const char* eventName, rtIFunction* f, bool emitOnce);
   rtError delListener(const char* eventName, rtIFunction* f);
 
-  rtError clearListeners() {mEntries.clear(); return RT_OK;}
+  rtError clearListeners() {mEntries.clear(); mListenerCounts.clear(); return RT_OK;}
   rtError clearListeners(const char* eventName);
 
   virtual rtError Send(int numArgs,const rtValue* args,rtValue* result);
@@ -687,13 +726,10 @@ public:
   }
 
 
-private:
-  void processPendingEvents();
-
 protected:
   struct _rtEmitEntry
   {
-    rtString n;
+    rtAtom n;
     rtFunctionRef f;
     bool isProp;
     bool markForDelete;
@@ -702,9 +738,17 @@ protected:
   };
   
   std::vector<_rtEmitEntry> mEntries;
+  // number of entries in mEntries for each event, so events nobody listens
+  // to are dropped without looking at the entries
+  std::unordered_map<rtAtom, uint32_t> mListenerCounts;
   rtAtomic mRefCount;
   bool mProcessingEvents;
   std::vector<_rtEmitEntry> mPendingEntriesToAdd;
+
+private:
+  void processPendingEvents();
+  void addEntry(const _rtEmitEntry& e);
+  std::vector<_rtEmitEntry>::iterator eraseEntry(std::vector<_rtEmitEntry>::iterator it);
 };
 
 class rtEmitRef: public rtRef<rtEmit>, public rtFunctionBase
@@ -766,6 +810,9 @@ public:
   virtual rtError Set(const char* name, const rtValue* value);
   virtual rtError Set(uint32_t /*i*/, const rtValue* /*value*/);
 
+  // removes all properties, keeping the storage for the next ones
+  void clear() { mProps.clear(); }
+
 private:
   std::vector<rtNamedValue>::iterator find(const char* name);
   std::vector<rtNamedValue> mProps;
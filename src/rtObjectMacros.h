@@ -61,6 +61,8 @@ typedef struct rtPropertyEntry
 typedef rtMethodEntry* (*fnhead)(rtMethodEntry* p);
 typedef rtPropertyEntry* (*fnPropHead)(rtPropertyEntry* p);
 
+struct rtMethodMapLookup;
+
 typedef struct rtMethodMap
 {
   const char* className;
@@ -69,6 +71,10 @@ typedef struct rtMethodMap
   
   //unsigned long numEntries;
   rtMethodMap* parentsMap;
+
+  // name lookup over this class and its parents, built on first use by
+  // rtObject::Get/Set
+  rtMethodMapLookup* lookup;
   
   rtMethodEntry* getFirstMethod()
   {
@@ -139,7 +145,7 @@ int class::rtPropertyCount = sizeof(class::rtPropertyEntries)/sizeof(rtPropertyE
 	typedef rtObject PARENTTYPE__
 
 #define rtDefineObjectPtr(CLASSNAME__, PTR__)                           \
-    rtMethodMap CLASSNAME__::map = {"" #CLASSNAME__ "", CLASSNAME__::head, CLASSNAME__::headProperty, PTR__};
+    rtMethodMap CLASSNAME__::map = {"" #CLASSNAME__ "", CLASSNAME__::head, CLASSNAME__::headProperty, PTR__, NULL};
 
 #define rtDefineObject(CLASSNAME__, PARENT__)                           \
     rtDefineObjectPtr(CLASSNAME__, &PARENT__::map)
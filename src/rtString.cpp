@@ -19,8 +19,11 @@
 // rtString.h
 
 #include "rtString.h"
+#include "rtAtomic.h"
+#include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
+#include <utility>
 
 #include <stdio.h>
 #include "rtLog.h"
@@ -29,16 +32,21 @@ extern "C"
 #include "utf8.h"
 }
 
-rtString::rtString(): mData(NULL) {}
+rtString::rtString(): mData(mInline), mLength(0)
+{
+  mInline[0] = 0;
+}
 
-rtString::rtString(const char* s): mData(NULL)
+rtString::rtString(const char* s): mData(mInline), mLength(0)
 {
+  mInline[0] = 0;
   if (s)
-    mData = strdup(s);
+    assign(s, (uint32_t)strlen(s));
 }
 
-rtString::rtString(const char* s, uint32_t byteLen): mData(NULL)
+rtString::rtString(const char* s, uint32_t byteLen): mData(mInline), mLength(0)
 {
+  mInline[0] = 0;
   if (s)
   {
     init(s, byteLen);
@@ -47,73 +55,219 @@ rtString::rtString(const char* s, uint32_t byteLen): mData(NULL)
 
 rtString& rtString::init(const char* s, size_t byteLen)
 {
-  mData = NULL;
-  
   if (s)
   {
-    mData = (char*)malloc(byteLen+1);
-    memcpy(mData, s, byteLen);
-    mData[byteLen] = 0; // null terminate
+    // the string ends at a null within byteLen, like it always did
+    const char* end = (const char*)memchr(s, 0, byteLen);
+    assign(s, (uint32_t)(end ? end - s : byteLen));
+  }
+  else
+  {
+    term();
   }
 
   return *this;
 }
 
-rtString::rtString(const rtString& s): mData(NULL)
+rtString::rtString(const rtString& s): mData(mInline), mLength(0)
+{
+  mInline[0] = 0;
+  copy(s);
+}
+
+#if __cplusplus >= 201103L
+rtString::rtString(rtString&& s): mData(mInline), mLength(0)
 {
-  if (s.mData)
-    mData = strdup(s.mData);
+  mInline[0] = 0;
+  *this = std::move(s);
 }
+#endif
 
 rtString& rtString::operator=(const rtString& s) 
 {
-  if (this != &s)
+  if (this != &s && mData != s.mData)
   {
     term();
-    if (s.mData)
-      mData = strdup(s.mData);
+    copy(s);
   }
   return *this;
 }
 
+#if __cplusplus >= 201103L
+rtString& rtString::operator=(rtString&& s)
+{
+  if (this != &s)
+  {
+    if (s.isInline())
+    {
+      assign(s.mData, s.mLength);
+    }
+    else
+    {
+      term();
+      mData = s.mData;
+      mLength = s.mLength;
+      s.mData = s.mInline;
+      s.mLength = 0;
+      s.mInline[0] = 0;
+    }
+  }
+  return *this;
+}
+#endif
+
 rtString& rtString::operator=(const char* s) 
 {
   if (s != mData)
   {
-    term();
     if (s)
-      mData = strdup(s);
+      assign(s, (uint32_t)strlen(s));
+    else
+      term();
   }
   return *this;
 }
 
 bool rtString::isEmpty() const
 {
-  return (!mData || !(*mData));
+  return mLength == 0;
 }
 
 rtString::~rtString() { term(); }
 
 void rtString::term() 
 {
-  if (mData)
-    free(mData);
-  mData = 0;
+  if (!isInline())
+  {
+    buffer* b = sharedBuffer();
+    if (rtAtomicDec(&b->refCount) == 0)
+      free(b);
+  }
+  mData = mInline;
+  mLength = 0;
+  mInline[0] = 0;
+}
+
+rtString::buffer* rtString::sharedBuffer() const
+{
+  return (buffer*)(mData - offsetof(buffer, data));
+}
+
+void rtString::copy(const rtString& s)
+{
+  if (s.isInline())
+  {
+    memcpy(mInline, s.mInline, s.mLength + 1);
+  }
+  else
+  {
+    rtAtomicInc(&s.sharedBuffer()->refCount);
+    mData = s.mData;
+  }
+  mLength = s.mLength;
+}
+
+void rtString::assign(const char* s, uint32_t byteLen)
+{
+  if (byteLen < RT_STRING_INLINE_SIZE)
+  {
+    // s may be part of this string, it's moved before the buffer goes
+    memmove(mInline, s, byteLen);
+    mInline[byteLen] = 0;
+    if (!isInline())
+    {
+      buffer* b = sharedBuffer();
+      if (rtAtomicDec(&b->refCount) == 0)
+        free(b);
+      mData = mInline;
+    }
+    mLength = byteLen;
+    return;
+  }
+
+  if (!isInline() && sharedBuffer()->refCount == 1 && sharedBuffer()->capacity > byteLen)
+  {
+    memmove(mData, s, byteLen);
+  }
+  else
+  {
+    buffer* b = (buffer*)malloc(offsetof(buffer, data) + byteLen + 1);
+    b->refCount = 1;
+    b->capacity = byteLen + 1;
+    memcpy(b->data, s, byteLen);
+    term();
+    mData = b->data;
+  }
+  mData[byteLen] = 0;
+  mLength = byteLen;
+}
+
+void rtString::reserve(uint32_t byteLen)
+{
+  if (byteLen < RT_STRING_INLINE_SIZE && isInline())
+  {
+    return;
+  }
+  if (!isInline() && sharedBuffer()->refCount == 1 && sharedBuffer()->capacity > byteLen)
+  {
+    return;
+  }
+
+  // grown by half again so appending one piece at a time stays linear
+  uint32_t capacity = byteLen + 1;
+  if (byteLen > mLength)
+  {
+    capacity += byteLen / 2;
+  }
+  buffer* b = (buffer*)malloc(offsetof(buffer, data) + capacity);
+  b->refCount = 1;
+  b->capacity = capacity;
+  memcpy(b->data, mData, mLength + 1);
+  uint32_t length = mLength;
+  term();
+  mData = b->data;
+  mLength = length;
 }
 
 rtString& rtString::append(const char* s)
 {
-  size_t sl = s?strlen(s):0;
-  size_t dl = mData?strlen(mData):0;
-  mData = (char*)realloc((void*)mData, dl+sl+1);
-  strcpy(mData+dl, s?s:"");
+  return append(s, s ? (uint32_t)strlen(s) : 0);
+}
+
+rtString& rtString::append(const char* s, uint32_t byteLen)
+{
+  if (!s || byteLen == 0)
+  {
+    return *this;
+  }
+
+  if (s >= mData && s <= mData + mLength)
+  {
+    // appending part of this string to itself, reserve() could free it
+    rtString copy(s, byteLen);
+    return append(copy.mData, copy.mLength);
+  }
+
+  reserve(mLength + byteLen);
+  memcpy(mData + mLength, s, byteLen);
+  mLength += byteLen;
+  mData[mLength] = 0;
   
   return *this;
 }
 
+void rtString::toLowerAscii()
+{
+  reserve(mLength);
+  for (char* p = mData; *p; p++)
+  {
+    *p = tolower(*p);
+  }
+}
+
 int rtString::compare(const char* s) const 
 {
-  const char *d = mData?mData:"";
+  const char *d = mData;
   s = s?s:"";
  
   u_int32_t c1, c2;
@@ -129,19 +283,14 @@ int rtString::compare(const char* s) const
 }
 
 
-const char* rtString::cString() const 
-{
-  return mData?mData:"";
-}
-
 int32_t rtString::length() const 
 {
-  return mData?u8_strlen(mData):0;
+  return u8_strlen(mData);
 }
 
 int32_t rtString::byteLength() const 
 {
-  return (int32_t)(mData?strlen(mData):0);
+  return (int32_t)mLength;
 }
 
 bool rtString::beginsWith(const char* s) const
@@ -153,7 +302,7 @@ bool rtString::beginsWith(const char* s) const
 bool rtString::endsWith(const char* s) const
 {
   s = s?s:"";
-  const char* t = mData?mData:"";
+  const char* t = mData;
   int sl = u8_strlen((char*)s);
   int tl = u8_strlen((char*)t);
 
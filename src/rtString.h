@@ -30,9 +30,15 @@
 #define finline
 #endif
 
+// strings shorter than this are stored in the rtString itself
+#define RT_STRING_INLINE_SIZE 20
 
 /**
   A lightweight utf-8 string class.
+
+  Strings of fewer than RT_STRING_INLINE_SIZE bytes are kept inline, longer
+  ones in a reference counted buffer that copies share until one of them is
+  changed.  The byte length is kept with the string.
 */
 class rtString 
 {
@@ -48,11 +54,17 @@ public:
   rtString(const char* s, uint32_t byteLen);
 
   rtString(const rtString& s);
+#if __cplusplus >= 201103L
+  rtString(rtString&& s);
+#endif
   
   ~rtString();
 
   rtString& operator=(const rtString& s);
   rtString& operator=(const char* s);
+#if __cplusplus >= 201103L
+  rtString& operator=(rtString&& s);
+#endif
 
   friend
   rtString operator+(const rtString& lhs, const char *rhs)
@@ -63,9 +75,9 @@ public:
   }
 
   rtString& operator +(const char* s)     { return append(s);           };
-  rtString& operator +(const rtString& s) { return append(s.cString()); };
+  rtString& operator +(const rtString& s) { return append(s.cString(), s.mLength); };
   rtString& operator+=(const char* s)     { return append(s);           };
-  rtString& operator+=(const rtString& s) { return append(s.cString()); };
+  rtString& operator+=(const rtString& s) { return append(s.cString(), s.mLength); };
   
   /**
    * Determines if the string is empty.
@@ -78,6 +90,7 @@ public:
   void term();
 
   rtString&  append(const char* s);
+  rtString&  append(const char* s, uint32_t byteLen);
 
   int compare(const char* s) const;
 
@@ -99,8 +112,8 @@ public:
   }
 #endif
 
-  const char* cString() const;
-  operator const char* () const { return mData?mData:""; }
+  const char* cString() const { return mData; }
+  operator const char* () const { return mData; }
 
   //uint32_t operator[](uint32_t i) const {}
 
@@ -116,7 +129,7 @@ public:
 
   rtString substring(size_t pos, size_t len = 0) const;
 
-  void toLowerAscii() { char *p = mData; while(*p) { *p = tolower(*p); p++; } };
+  void toLowerAscii();
 
 #if 0
   pos_t find(size_t pos, const char* s, size_t n) const;
@@ -126,7 +139,25 @@ public:
   int32_t find(size_t pos, uint32_t codePoint) const;
 
 private:
+  // the characters of a string too long to be inline, shared by copies
+  struct buffer
+  {
+    volatile int32_t refCount;
+    uint32_t capacity; // bytes, including the null terminator
+    char data[1];
+  };
+
+  bool isInline() const { return mData == mInline; }
+  buffer* sharedBuffer() const;
+  void assign(const char* s, uint32_t byteLen);
+  void copy(const rtString& s);
+  // makes mData writable for byteLen bytes, keeping the current contents
+  void reserve(uint32_t byteLen);
+
+  // points at mInline or at the data of a buffer, never NULL
   char* mData;
+  uint32_t mLength;
+  char mInline[RT_STRING_INLINE_SIZE];
 };
 
 #endif
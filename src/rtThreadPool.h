@@ -30,10 +30,6 @@ public:
     static rtThreadPool* globalInstance();
 
 	  int numberOfThreadsInPool();
-
-	void raisePriority(const rtString & /*url*/) {
-		//TODO
-	};
     
 private:
     
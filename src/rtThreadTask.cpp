@@ -20,8 +20,9 @@
 
 #include <stddef.h>
 
-rtThreadTask::rtThreadTask(void (*functionPointer)(void*), void* data, rtString key) :
-    mFunctionPointer(functionPointer), mData(data), mKey(key)
+rtThreadTask::rtThreadTask(void (*functionPointer)(void*), void* data, rtString key,
+                           rtThreadTaskPriority priority) :
+    mFunctionPointer(functionPointer), mData(data), mKey(key), mPriority(priority)
 {
 }
 
@@ -43,3 +44,13 @@ rtString rtThreadTask::getKey()
 {
     return mKey;
 }
+
+rtThreadTaskPriority rtThreadTask::priority() const
+{
+    return mPriority;
+}
+
+void rtThreadTask::setPriority(rtThreadTaskPriority priority)
+{
+    mPriority = priority;
+}
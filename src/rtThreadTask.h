@@ -21,18 +21,31 @@
 
 #include "rtString.h"
 
+// Scheduling classes understood by rtThreadPool.  Lower values are run first.
+enum rtThreadTaskPriority
+{
+    RT_THREAD_TASK_PRIORITY_VISIBLE = 0,
+    RT_THREAD_TASK_PRIORITY_PREFETCH,
+    RT_THREAD_TASK_PRIORITY_BACKGROUND,
+    RT_THREAD_TASK_PRIORITY_COUNT
+};
+
 class rtThreadTask
 {  
 public:
-    rtThreadTask(void (*functionPointer)(void*), void* data, rtString key);
+    rtThreadTask(void (*functionPointer)(void*), void* data, rtString key,
+                 rtThreadTaskPriority priority = RT_THREAD_TASK_PRIORITY_PREFETCH);
     ~rtThreadTask();
     void execute();
     rtString getKey();
+    rtThreadTaskPriority priority() const;
+    void setPriority(rtThreadTaskPriority priority);
     
 private:
     void (*mFunctionPointer)(void*);
     void* mData;
     rtString mKey;
+    rtThreadTaskPriority mPriority;
 };
 
 #endif //RT_THREAD_TASK_H
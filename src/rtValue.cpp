@@ -121,11 +121,8 @@ void rtValue::setEmpty()
   }
   else if (mType == RT_stringType)
   {
-    if (mValue.stringValue)
-    {
-      delete mValue.stringValue;
-      mValue.stringValue = NULL;
-    }
+    mString.term();
+    mValue.stringValue = NULL;
   }
 
   // TODO setting this to '0' makes node wrappers unhappy
@@ -228,8 +225,13 @@ void rtValue::setDouble(double v)
 
 void rtValue::setString(const rtString& v)
 {
-  setEmpty();
-  mType    = RT_stringType; mValue.stringValue = new rtString(v);
+  // v may be this value's own string
+  if (mType != RT_stringType)
+  {
+    setEmpty();
+  }
+  mString  = v;
+  mType    = RT_stringType; mValue.stringValue = &mString;
   mIsEmpty = false;
 }
 
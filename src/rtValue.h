@@ -249,6 +249,8 @@ class rtValue
 
   rtType   mType;
   rtValue_ mValue;
+  // a string value, mValue.stringValue points at it
+  rtString mString;
 
   bool     mIsEmpty;
 };
@@ -23,12 +23,103 @@
 #include "rtZip.h"
 #include "string.h"
 
+#include "rtAtomic.h"
+#include "rtThreadPool.h"
+#include "rtThreadTask.h"
+
+#include <algorithm>
+
 extern "C"
 {
 void fill_memory_filefunc64 (zlib_filefunc64_def* pzlib_filefunc_def);
 }
 
-rtZip::rtZip(): mUnzFile(NULL) {}
+#define RT_ZIP_LOCAL_HEADER_SIGNATURE   0x04034b50
+#define RT_ZIP_LOCAL_HEADER_SIZE        30
+#define RT_ZIP_CENTRAL_HEADER_SIGNATURE 0x02014b50
+#define RT_ZIP_CENTRAL_HEADER_SIZE      46
+
+static uint32_t rtZipRead16(const uint8_t* p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+static uint32_t rtZipRead32(const uint8_t* p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Files of a getFilesData call, taken in turn by the calling thread and the
+// thread pool workers helping it
+class rtZipReadJob
+{
+public:
+  rtZipReadJob(const rtZip& zip, const rtString* filePaths, int32_t count, rtData* data, rtError* results)
+    : mRefCount(1), mZip(zip), mFilePaths(filePaths), mCount(count), mData(data), mResults(results),
+      mNextFile(0), mFilesDone(0), mMutex(), mCondition()
+  {
+  }
+
+  void AddRef()
+  {
+    rtAtomicInc(&mRefCount);
+  }
+
+  void Release()
+  {
+    if (rtAtomicDec(&mRefCount) == 0)
+    {
+      delete this;
+    }
+  }
+
+  static void readTask(void* data)
+  {
+    rtZipReadJob* job = (rtZipReadJob*)data;
+    job->readFiles();
+    job->Release();
+  }
+
+  void readFiles()
+  {
+    int32_t i;
+    while ((i = rtAtomicInc(&mNextFile) - 1) < mCount)
+    {
+      mResults[i] = mZip.getFileData(mFilePaths[i].cString(), mData[i]);
+
+      rtMutexLockGuard guard(mMutex);
+      if (++mFilesDone == mCount)
+      {
+        mCondition.broadcast();
+      }
+    }
+  }
+
+  void wait()
+  {
+    mMutex.lock();
+    while (mFilesDone < mCount)
+    {
+      mCondition.wait(mMutex.getNativeMutexDescription());
+    }
+    mMutex.unlock();
+  }
+
+private:
+  rtAtomic mRefCount;
+  const rtZip& mZip;
+  const rtString* mFilePaths;
+  int32_t mCount;
+  rtData* mData;
+  rtError* mResults;
+  rtAtomic mNextFile;
+  int32_t mFilesDone;
+  rtMutex mMutex;
+  rtThreadCondition mCondition;
+};
+
+rtZip::rtZip(): mUnzFile(NULL), mData(), mBuffer(NULL), mBufferSize(0), mEntries(), mFilePaths(), mIndex(),
+  mUnzMutex() {}
 rtZip::~rtZip() { term(); }
 
 rtError rtZip::initFromBuffer(const void* buffer, size_t bufferSize)
@@ -36,22 +127,29 @@ rtError rtZip::initFromBuffer(const void* buffer, size_t bufferSize)
   char path[64] = {0};
   zlib_filefunc64_def memory_file;
 
+  term();
   mData.init((uint8_t*)buffer, (uint32_t)bufferSize);
   
   sprintf(path, "%p+%x", mData.data(), mData.length());
   
   fill_memory_filefunc64(&memory_file);
   mUnzFile = unzOpen2_64(path, &memory_file);
+  if (mUnzFile)
+  {
+    mBuffer = mData.data();
+    mBufferSize = mData.length();
+  }
 
-  mFilePaths.clear();
+  buildIndex();
 
   return mUnzFile?RT_OK:RT_FAIL;
 } 
 
 rtError rtZip::initFromFile(const char* fileName)
 {
+  term();
   mUnzFile = unzOpen64(fileName);
-  mFilePaths.clear();
+  buildIndex();
   return mUnzFile?RT_OK:RT_FAIL;
 }
 
@@ -60,7 +158,13 @@ rtError rtZip::term()
   if (mUnzFile)
   {
     unzClose(mUnzFile);
+    mUnzFile = NULL;
   }
+  mBuffer = NULL;
+  mBufferSize = 0;
+  mEntries.clear();
+  mFilePaths.clear();
+  mIndex.clear();
   return RT_OK;
 }
 
@@ -68,7 +172,7 @@ uint32_t rtZip::fileCount() const
 {
   uint32_t count = 0;
   unz_global_info64 info;
-  if (unzGetGlobalInfo64(mUnzFile, &info) == UNZ_OK)
+  if (mUnzFile && unzGetGlobalInfo64(mUnzFile, &info) == UNZ_OK)
   {
     count = (uint32_t)info.number_entry;
   }
@@ -79,60 +183,242 @@ rtError rtZip::getFilePathAtIndex(uint32_t i,rtString& filePath) const
 {
   rtError e = RT_FAIL;
  
-  if (mFilePaths.size() == 0)
+  if (i < mFilePaths.size())
   {
-    int u = unzGoToFirstFile(mUnzFile);
-    while (u == UNZ_OK)
+    filePath = mFilePaths[i];
+    e = RT_OK;
+  }
+
+  return e;
+}
+
+rtError rtZip::getFileData(const char* filePath, rtData& d) const
+{
+  const entry* e = findEntry(filePath);
+  return e ? readEntry(*e, d) : RT_FAIL;
+}
+
+rtError rtZip::getStoredFileData(const char* filePath, const uint8_t*& data, uint32_t& length) const
+{
+  const entry* e = findEntry(filePath);
+  if (!e || e->method != 0 || e->dataOffset < 0)
+  {
+    return RT_FAIL;
+  }
+  data = mBuffer + e->dataOffset;
+  length = (uint32_t)e->uncompressedSize;
+  return RT_OK;
+}
+
+rtError rtZip::getFilesData(const rtString* filePaths, uint32_t count, rtData* data, rtError* results) const
+{
+  if (count == 0)
+  {
+    return RT_OK;
+  }
+
+  std::vector<rtError> localResults;
+  if (!results)
+  {
+    localResults.resize(count);
+    results = &localResults[0];
+  }
+
+  // only files read from the buffer are inflated in parallel
+  uint64_t threadedBytes = 0;
+  for (uint32_t i = 0; i < count; i++)
+  {
+    const entry* e = findEntry(filePaths[i].cString());
+    if (e && e->dataOffset >= 0 && e->method == Z_DEFLATED)
     {
-      char buffer[1024];
-      if (unzGetCurrentFileInfo64(mUnzFile,NULL,buffer,sizeof(buffer)-1,
-                                  NULL,0,NULL,0) == UNZ_OK)
-      {
-        mFilePaths.push_back(buffer);
-      }
+      threadedBytes += e->compressedSize;
+    }
+  }
+  int32_t numThreads = 0;
+  if (threadedBytes >= RT_ZIP_THREADED_BYTES)
+  {
+    numThreads = std::min(rtThreadPool::globalInstance()->numberOfThreadsInPool(), (int32_t)count - 1);
+  }
 
-      u = unzGoToNextFile(mUnzFile);
+  rtZipReadJob* job = new rtZipReadJob(*this, filePaths, (int32_t)count, data, results);
+  for (int32_t i = 0; i < numThreads; i++)
+  {
+    job->AddRef();
+    rtThreadPool::globalInstance()->executeTask(new rtThreadTask(rtZipReadJob::readTask, job, "",
+                                                                 RT_THREAD_TASK_PRIORITY_VISIBLE));
+  }
+  job->readFiles();
+  job->wait();
+  job->Release();
+
+  for (uint32_t i = 0; i < count; i++)
+  {
+    if (results[i] != RT_OK)
+    {
+      return RT_FAIL;
     }
   }
+  return RT_OK;
+}
 
-  if (i < mFilePaths.size())
+void rtZip::buildIndex()
+{
+  mEntries.clear();
+  mFilePaths.clear();
+  mIndex.clear();
+  if (!mUnzFile)
   {
-    filePath = mFilePaths[i];
-    e = RT_OK;
+    return;
   }
 
-  return e;
+  int u = unzGoToFirstFile(mUnzFile);
+  while (u == UNZ_OK)
+  {
+    char buffer[1024];
+    unz_file_info64 info;
+    entry e;
+    if (unzGetCurrentFileInfo64(mUnzFile,&info,buffer,sizeof(buffer)-1,
+                                NULL,0,NULL,0) == UNZ_OK &&
+        unzGetFilePos64(mUnzFile, &e.pos) == UNZ_OK)
+    {
+      e.method = (uint32_t)info.compression_method;
+      e.compressedSize = info.compressed_size;
+      e.uncompressedSize = info.uncompressed_size;
+      e.dataOffset = findDataOffset(e.pos, info);
+      // like unzLocateFile the first of several files with a path wins
+      mIndex.insert(std::make_pair(std::string(buffer), (uint32_t)mEntries.size()));
+      mEntries.push_back(e);
+      mFilePaths.push_back(buffer);
+    }
+
+    u = unzGoToNextFile(mUnzFile);
+  }
 }
 
-rtError rtZip::getFileData(const char* filePath, rtData& d) const
+int64_t rtZip::findDataOffset(const unz64_file_pos& pos, const unz_file_info64& info) const
 {
-  rtError e = RT_FAIL;
-  int err = UNZ_OK;
-  if (unzLocateFile(mUnzFile, filePath, 0)==UNZ_OK)
-  {
-    unz_file_info64 fileInfo;
-    char filename[256];
-    err = unzGetCurrentFileInfo64(mUnzFile, &fileInfo, filename, 
-                                  sizeof(filename),NULL,0,NULL,0);
-    if (err == UNZ_OK)
+  // the file's bytes follow its local header, which the central directory
+  // record points to.  Anything unusual, encrypted files, other methods,
+  // zip64 offsets or data before the zip, is left to minizip
+  if (!mBuffer || (info.flag & 1) || (info.compression_method != 0 && info.compression_method != Z_DEFLATED) ||
+      info.uncompressed_size > UINT32_MAX || (info.compression_method == 0 && info.compressed_size != info.uncompressed_size))
+  {
+    return -1;
+  }
+
+  uint64_t central = pos.pos_in_zip_directory;
+  if (central + RT_ZIP_CENTRAL_HEADER_SIZE > mBufferSize ||
+      rtZipRead32(mBuffer + central) != RT_ZIP_CENTRAL_HEADER_SIGNATURE)
+  {
+    return -1;
+  }
+  uint64_t local = rtZipRead32(mBuffer + central + 42);
+  if (local == 0xffffffff || local + RT_ZIP_LOCAL_HEADER_SIZE > mBufferSize ||
+      rtZipRead32(mBuffer + local) != RT_ZIP_LOCAL_HEADER_SIGNATURE)
+  {
+    return -1;
+  }
+  uint64_t offset = local + RT_ZIP_LOCAL_HEADER_SIZE + rtZipRead16(mBuffer + local + 26) +
+    rtZipRead16(mBuffer + local + 28);
+  if (offset + info.compressed_size > mBufferSize)
+  {
+    return -1;
+  }
+  return (int64_t)offset;
+}
+
+const rtZip::entry* rtZip::findEntry(const char* filePath) const
+{
+  if (!filePath)
+  {
+    return NULL;
+  }
+  std::unordered_map<std::string, uint32_t>::const_iterator it = mIndex.find(filePath);
+  if (it != mIndex.end())
+  {
+    return &mEntries[it->second];
+  }
+#if !defined(unix) && !defined(CASESENSITIVITYDEFAULT_YES)
+  // where minizip looks up paths ignoring case by default
+  for (size_t i = 0; i < mFilePaths.size(); i++)
+  {
+    if (unzStringFileNameCompare(mFilePaths[i].cString(), filePath, 0) == 0)
+    {
+      return &mEntries[i];
+    }
+  }
+#endif
+  return NULL;
+}
+
+rtError rtZip::readEntry(const entry& e, rtData& d) const
+{
+  if (e.uncompressedSize > UINT32_MAX)
+  {
+    return RT_FAIL;
+  }
+  uint32_t length = (uint32_t)e.uncompressedSize;
+
+  // like rtData::init, one more byte so text can be used as a string
+  uint8_t* data = new uint8_t[length + 1];
+  data[length] = 0;
+  rtError result = RT_FAIL;
+
+  if (e.dataOffset >= 0)
+  {
+    const uint8_t* source = mBuffer + e.dataOffset;
+    if (e.method == 0)
     {
-      // TODO warning truncating size
-      if (d.init((uint32_t)fileInfo.uncompressed_size) == RT_OK)
+      memcpy(data, source, length);
+      result = RT_OK;
+    }
+    else if (length == 0)
+    {
+      result = RT_OK;
+    }
+    else
+    {
+      z_stream stream;
+      memset(&stream, 0, sizeof(stream));
+      if (inflateInit2(&stream, -MAX_WBITS) == Z_OK)
       {
-        err = unzOpenCurrentFilePassword(mUnzFile, NULL);
-        if (err == UNZ_OK)
+        stream.next_in = (Bytef*)source;
+        stream.avail_in = (uInt)e.compressedSize;
+        stream.next_out = data;
+        stream.avail_out = length;
+        if (inflate(&stream, Z_FINISH) == Z_STREAM_END && stream.total_out == length)
         {
-          int amount = unzReadCurrentFile(mUnzFile,d.data(),d.length());
-          if ((uint32_t)amount == d.length())
-          {
-            e = RT_OK;
-          }
-          err = unzCloseCurrentFile(mUnzFile);
+          result = RT_OK;
         }
+        inflateEnd(&stream);
       }
     }
   }
-  return e;
+  else
+  {
+    rtMutexLockGuard lock(mUnzMutex);
+    unz64_file_pos pos = e.pos;
+    if (unzGoToFilePos64(mUnzFile, &pos) == UNZ_OK &&
+        unzOpenCurrentFilePassword(mUnzFile, NULL) == UNZ_OK)
+    {
+      int amount = unzReadCurrentFile(mUnzFile,data,length);
+      if ((uint32_t)amount == length)
+      {
+        result = RT_OK;
+      }
+      unzCloseCurrentFile(mUnzFile);
+    }
+  }
+
+  if (result == RT_OK)
+  {
+    d.attach(data, length);
+  }
+  else
+  {
+    delete [] data;
+  }
+  return result;
 }
 
 bool rtZip::isZip(const void* buffer, size_t bufferSize)
@@ -23,6 +23,7 @@
 
 #include "rtError.h"
 #include "rtFile.h"
+#include "rtMutex.h"
 #include "rtString.h"
 
 extern "C"
@@ -31,8 +32,19 @@ extern "C"
 #include "unzip.h"
 }
 
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+// compressed bytes a getFilesData call needs before it inflates on the thread pool
+#define RT_ZIP_THREADED_BYTES (64 * 1024)
+
+// The entries of the central directory are indexed by path when the zip is
+// opened.  Files of a zip initialized from a buffer are read straight from
+// the buffer, so getFileData, getStoredFileData and getFilesData may be
+// called from several threads at once.  Files of a zip initialized from a
+// file are read through minizip one at a time.
 class rtZip
 {
 public:
@@ -47,14 +59,43 @@ public:
   rtError getFilePathAtIndex(uint32_t i,rtString& filePath) const;
 
   rtError getFileData(const char* filePath,rtData& d) const;
+  // the bytes of a file stored uncompressed, without copying them out of the
+  // buffer, valid until the zip is terminated.  RT_FAIL for files that are
+  // compressed or in a zip initialized from a file
+  rtError getStoredFileData(const char* filePath,const uint8_t*& data,uint32_t& length) const;
+  // reads count files into data, inflating them on the thread pool, results
+  // gets what getFileData returned for each file if it isn't NULL.  RT_OK
+  // if all files were read
+  rtError getFilesData(const rtString* filePaths,uint32_t count,rtData* data,rtError* results = NULL) const;
 
   static bool isZip(const void* buffer, size_t bufferSize);
 
 private:
+  struct entry
+  {
+    unz64_file_pos pos;
+    uint32_t method;
+    uint64_t compressedSize;
+    uint64_t uncompressedSize;
+    // of the file's bytes in the buffer, -1 if it's read through minizip
+    int64_t dataOffset;
+  };
+
+  void buildIndex();
+  int64_t findDataOffset(const unz64_file_pos& pos, const unz_file_info64& info) const;
+  const entry* findEntry(const char* filePath) const;
+  rtError readEntry(const entry& e, rtData& d) const;
+
   unzFile mUnzFile;
   rtData mData;
-
-  mutable std::vector<rtString> mFilePaths;
+  const uint8_t* mBuffer;
+  size_t mBufferSize;
+
+  std::vector<entry> mEntries;
+  std::vector<rtString> mFilePaths;
+  std::unordered_map<std::string, uint32_t> mIndex;
+  // minizip keeps the current file in mUnzFile
+  mutable rtMutex mUnzMutex;
 };
 
 #endif
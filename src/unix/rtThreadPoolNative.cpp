@@ -30,8 +30,15 @@ void* launchThread(void* threadPool)
 
 rtThreadPoolNative::rtThreadPoolNative(int numberOfThreads) : 
     mNumberOfThreads(numberOfThreads), mRunning(false), mThreadTaskMutex(),
-    mThreadTaskCondition(), mThreads(), mThreadTasks()
+    mThreadTaskCondition(), mThreads(), mWorkerQueues(), mPendingTasks(0),
+    mIdleThreads(0), mNextWorkerQueue(0), mNextWorkerIndex(0)
 {
+    // always keep at least one queue so tasks can be accepted by an empty pool
+    int numberOfQueues = (numberOfThreads > 0) ? numberOfThreads : 1;
+    for (int i = 0; i < numberOfQueues; i++)
+    {
+        mWorkerQueues.push_back(new rtThreadWorkerQueue());
+    }
     initialize();
 }
 
@@ -42,6 +49,20 @@ rtThreadPoolNative::~rtThreadPoolNative()
         destroy();
     }
     mThreads.clear();
+    for (size_t i = 0; i < mWorkerQueues.size(); i++)
+    {
+        rtThreadWorkerQueue* workerQueue = mWorkerQueues[i];
+        for (int priority = 0; priority < RT_THREAD_TASK_PRIORITY_COUNT; priority++)
+        {
+            for (std::deque<rtThreadTask*>::iterator it = workerQueue->mTasks[priority].begin();
+                 it != workerQueue->mTasks[priority].end(); ++it)
+            {
+                delete (*it);
+            }
+        }
+        delete workerQueue;
+    }
+    mWorkerQueues.clear();
 }
 
 bool rtThreadPoolNative::initialize()
@@ -66,9 +87,31 @@ void rtThreadPoolNative::destroy()
     mThreadTaskMutex.lock();
     mRunning = false; //mRunning is accessed by other threads
     mThreadTaskMutex.unlock();
+    //drop the queued tasks so the workers go idle and see the shutdown
+    int canceledTasks = 0;
+    for (size_t i = 0; i < mWorkerQueues.size(); i++)
+    {
+        rtThreadWorkerQueue* workerQueue = mWorkerQueues[i];
+        workerQueue->mMutex.lock();
+        for (int priority = 0; priority < RT_THREAD_TASK_PRIORITY_COUNT; priority++)
+        {
+            for (std::deque<rtThreadTask*>::iterator it = workerQueue->mTasks[priority].begin();
+                 it != workerQueue->mTasks[priority].end(); ++it)
+            {
+                delete (*it);
+                canceledTasks++;
+            }
+            workerQueue->mTasks[priority].clear();
+        }
+        workerQueue->mMutex.unlock();
+    }
+    for (int i = 0; i < canceledTasks; i++)
+    {
+        rtAtomicDec(&mPendingTasks);
+    }
     //broadcast to all the threads that we are shutting down
     mThreadTaskCondition.broadcast();
-    for (int i = 0; i < mNumberOfThreads; i++)
+    for (int i = 0; i < (int)mThreads.size(); i++)
     {
         void* result;
         int returnValue = pthread_join(mThreads[i], &result);
@@ -81,59 +124,171 @@ void rtThreadPoolNative::destroy()
     }
 }
 
+rtThreadTask* rtThreadPoolNative::nextTask(int workerIndex)
+{
+    if (mPendingTasks <= 0)
+    {
+        return NULL;
+    }
+    int numberOfQueues = (int)mWorkerQueues.size();
+    for (int priority = 0; priority < RT_THREAD_TASK_PRIORITY_COUNT; priority++)
+    {
+        // own queue first, then steal from the other workers
+        for (int i = 0; i < numberOfQueues; i++)
+        {
+            rtThreadWorkerQueue* workerQueue = mWorkerQueues[(workerIndex + i) % numberOfQueues];
+            rtThreadTask* threadTask = NULL;
+            workerQueue->mMutex.lock();
+            std::deque<rtThreadTask*>& tasks = workerQueue->mTasks[priority];
+            if (!tasks.empty())
+            {
+                if (i == 0)
+                {
+                    threadTask = tasks.front();
+                    tasks.pop_front();
+                }
+                else
+                {
+                    threadTask = tasks.back();
+                    tasks.pop_back();
+                }
+            }
+            workerQueue->mMutex.unlock();
+            if (threadTask != NULL)
+            {
+                rtAtomicDec(&mPendingTasks);
+                return threadTask;
+            }
+        }
+    }
+    return NULL;
+}
+
 void rtThreadPoolNative::startThread()
 {
+    int workerIndex = (rtAtomicInc(&mNextWorkerIndex) - 1) % (int)mWorkerQueues.size();
     rtThreadTask* threadTask = NULL;
     while(true)
     {
+        threadTask = nextTask(workerIndex);
+        if (threadTask != NULL)
+        {
+            threadTask->execute();
+            delete threadTask;
+            threadTask = NULL;
+            continue;
+        }
+
         mThreadTaskMutex.lock();
-        while (mRunning && (mThreadTasks.empty()))
+        rtAtomicInc(&mIdleThreads);
+        while (mRunning && (mPendingTasks <= 0))
         {
             mThreadTaskCondition.wait(mThreadTaskMutex.getNativeMutexDescription());
         }
+        rtAtomicDec(&mIdleThreads);
         if (!mRunning)
         {
             mThreadTaskMutex.unlock();
             pthread_exit(NULL);
         }
-        threadTask = mThreadTasks.front();
-        mThreadTasks.pop_front();
         mThreadTaskMutex.unlock();
-        
-        if (threadTask != NULL)
-        {
-            threadTask->execute();
-            delete threadTask;
-            threadTask = NULL;
-        }
     }
 }
 
-void rtThreadPoolNative::executeTask(rtThreadTask* threadTask)
+void rtThreadPoolNative::wakeWorker()
 {
     mThreadTaskMutex.lock();
-    mThreadTasks.push_back(threadTask);
     mThreadTaskCondition.signal();
     mThreadTaskMutex.unlock();
 }
 
-void rtThreadPoolNative::raisePriority(rtString key)
+void rtThreadPoolNative::executeTask(rtThreadTask* threadTask)
 {
-    mThreadTaskMutex.lock();
-    rtThreadTask* threadTask = NULL;
-    for (std::deque<rtThreadTask*>::iterator it = mThreadTasks.begin(); it!=mThreadTasks.end(); ++it)
+    if (threadTask == NULL)
+    {
+        return;
+    }
+    int priority = threadTask->priority();
+    if (priority < 0 || priority >= RT_THREAD_TASK_PRIORITY_COUNT)
+    {
+        priority = RT_THREAD_TASK_PRIORITY_BACKGROUND;
+        threadTask->setPriority(RT_THREAD_TASK_PRIORITY_BACKGROUND);
+    }
+    unsigned int queueIndex = (unsigned int)rtAtomicInc(&mNextWorkerQueue);
+    rtThreadWorkerQueue* workerQueue = mWorkerQueues[queueIndex % mWorkerQueues.size()];
+    workerQueue->mMutex.lock();
+    workerQueue->mTasks[priority].push_back(threadTask);
+    workerQueue->mMutex.unlock();
+
+    // the pending count is published before the idle count is read so a worker
+    // going to sleep either sees this task or gets signaled
+    rtAtomicInc(&mPendingTasks);
+    if (mIdleThreads > 0)
+    {
+        wakeWorker();
+    }
+}
+
+void rtThreadPoolNative::raisePriority(const rtString& key)
+{
+    for (size_t i = 0; i < mWorkerQueues.size(); i++)
     {
-        if ((*it)->getKey().compare(key) == 0)
+        rtThreadWorkerQueue* workerQueue = mWorkerQueues[i];
+        bool found = false;
+        workerQueue->mMutex.lock();
+        for (int priority = RT_THREAD_TASK_PRIORITY_VISIBLE + 1; priority < RT_THREAD_TASK_PRIORITY_COUNT && !found; priority++)
+        {
+            std::deque<rtThreadTask*>& tasks = workerQueue->mTasks[priority];
+            for (std::deque<rtThreadTask*>::iterator it = tasks.begin(); it != tasks.end(); ++it)
+            {
+                if ((*it)->getKey().compare(key) == 0)
+                {
+                    rtThreadTask* threadTask = *it;
+                    tasks.erase(it);
+                    threadTask->setPriority(RT_THREAD_TASK_PRIORITY_VISIBLE);
+                    workerQueue->mTasks[RT_THREAD_TASK_PRIORITY_VISIBLE].push_front(threadTask);
+                    found = true;
+                    break;
+                }
+            }
+        }
+        workerQueue->mMutex.unlock();
+        if (found)
         {
-            threadTask = *it;
-            it = mThreadTasks.erase(it);
             break;
         }
     }
-    if (threadTask != NULL)
+}
+
+int rtThreadPoolNative::cancelTask(const rtString& key)
+{
+    int canceledTasks = 0;
+    for (size_t i = 0; i < mWorkerQueues.size(); i++)
     {
-        mThreadTasks.push_front(threadTask);
+        rtThreadWorkerQueue* workerQueue = mWorkerQueues[i];
+        workerQueue->mMutex.lock();
+        for (int priority = 0; priority < RT_THREAD_TASK_PRIORITY_COUNT; priority++)
+        {
+            std::deque<rtThreadTask*>& tasks = workerQueue->mTasks[priority];
+            for (std::deque<rtThreadTask*>::iterator it = tasks.begin(); it != tasks.end(); )
+            {
+                if ((*it)->getKey().compare(key) == 0)
+                {
+                    delete (*it);
+                    it = tasks.erase(it);
+                    canceledTasks++;
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+        }
+        workerQueue->mMutex.unlock();
     }
-    mThreadTaskCondition.signal();
-    mThreadTaskMutex.unlock();
+    for (int i = 0; i < canceledTasks; i++)
+    {
+        rtAtomicDec(&mPendingTasks);
+    }
+    return canceledTasks;
 }
@@ -22,12 +22,24 @@ limitations under the License.
 #include "../rtMutex.h"
 #include "../rtThreadTask.h"
 #include "../rtString.h"
+#include "../rtAtomic.h"
 
 #include <pthread.h>
 
 #include <vector>
 #include <deque>
 
+// Per worker task queues, one deque per rtThreadTaskPriority.  Tasks are
+// pushed to the back and taken from the front by the owning worker; idle
+// workers steal from the back of the other workers' queues.
+struct rtThreadWorkerQueue
+{
+    rtThreadWorkerQueue() : mMutex() {}
+
+    rtMutex mMutex;
+    std::deque<rtThreadTask*> mTasks[RT_THREAD_TASK_PRIORITY_COUNT];
+};
+
 class rtThreadPoolNative
 {
 public:
@@ -35,13 +47,16 @@ public:
     ~rtThreadPoolNative();
     
     void executeTask(rtThreadTask* threadTask);
-    void raisePriority(rtString key);
+    void raisePriority(const rtString& key);
+    int cancelTask(const rtString& key);
     void startThread();
     void destroy();
     
 protected:
     
     bool initialize();
+    rtThreadTask* nextTask(int workerIndex);
+    void wakeWorker();
 
     
     int mNumberOfThreads;
@@ -49,7 +64,11 @@ protected:
     rtMutex mThreadTaskMutex;
     rtThreadCondition mThreadTaskCondition;
     std::vector<pthread_t> mThreads;
-    std::deque<rtThreadTask*> mThreadTasks;
+    std::vector<rtThreadWorkerQueue*> mWorkerQueues;
+    rtAtomic mPendingTasks;
+    rtAtomic mIdleThreads;
+    rtAtomic mNextWorkerQueue;
+    rtAtomic mNextWorkerIndex;
 };
 
 #endif //RT_THREAD_POOL_H
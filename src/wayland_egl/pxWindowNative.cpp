@@ -396,7 +396,7 @@ bool exitFlag = false;
 pxWindowNative::pxWindowNative(): mTimerFPS(0), mLastWidth(-1), mLastHeight(-1),
     mResizeFlag(false), mLastAnimationTime(0.0), mVisible(false), mDirty(true),
     mWaylandSurface(NULL), mWaylandBuffer(), waylandBufferIndex(0),
-    mEglNativeWindow(NULL), mEglSurface(NULL)
+    mEglNativeWindow(NULL), mEglSurface(NULL), mDamageRects()
 {
 }
 
@@ -907,10 +907,31 @@ void pxWindowNative::drawFrame()
     } else {
         wl_surface_set_opaque_region(waylandSurface, NULL);
     }
-    eglSwapBuffers(wDisplay->egl.dpy, mEglSurface);
+    if (wDisplay->swap_buffers_with_damage && !mDamageRects.empty())
+    {
+        wDisplay->swap_buffers_with_damage(wDisplay->egl.dpy, mEglSurface,
+                                           &mDamageRects[0], mDamageRects.size() / 4);
+    }
+    else
+    {
+        eglSwapBuffers(wDisplay->egl.dpy, mEglSurface);
+    }
+    mDamageRects.clear();
     mDirty = false;
 }
 
+void pxWindowNative::setPresentDamage(const std::vector<pxRect>& rects)
+{
+    mDamageRects.clear();
+    for (std::vector<pxRect>::const_iterator it = rects.begin(); it != rects.end(); ++it)
+    {
+        mDamageRects.push_back(it->left());
+        mDamageRects.push_back(mLastHeight - it->bottom());
+        mDamageRects.push_back(it->width());
+        mDamageRects.push_back(it->height());
+    }
+}
+
 //egl methods
 void pxWindowNative::initializeEgl()
 {
@@ -133,6 +133,11 @@ public:
     void animateAndRender();
     struct wl_egl_window* getWaylandNative();
 
+    // limits the next swap to these rectangles (top left origin, exclusive
+    // right and bottom edges) if eglSwapBuffersWithDamageEXT is available,
+    // an empty list presents the whole frame
+    void setPresentDamage(const std::vector<pxRect>& rects);
+
 protected:
     virtual void onCreate() = 0;
 
@@ -191,6 +196,7 @@ protected:
     void initializeEgl();
     struct wl_egl_window *mEglNativeWindow;
     EGLSurface mEglSurface;
+    std::vector<EGLint> mDamageRects; // x, y, width, height with a bottom left origin
     //end egl content
 
     static void registerWindow(pxWindowNative* p);
@@ -116,7 +116,55 @@ void rtThreadPoolNative::startThread()
 void rtThreadPoolNative::executeTask(rtThreadTask* threadTask)
 {
     mThreadTaskMutex.lock();
-    mThreadTasks.push_back(threadTask);
+    // keep the queue ordered by priority class, fifo within a class
+    std::deque<rtThreadTask*>::iterator it = mThreadTasks.begin();
+    while (it != mThreadTasks.end() && (*it)->priority() <= threadTask->priority())
+    {
+        ++it;
+    }
+    mThreadTasks.insert(it, threadTask);
     mThreadTaskCondition.signal();
     mThreadTaskMutex.unlock();
 }
+
+void rtThreadPoolNative::raisePriority(const rtString& key)
+{
+    mThreadTaskMutex.lock();
+    rtThreadTask* threadTask = NULL;
+    for (std::deque<rtThreadTask*>::iterator it = mThreadTasks.begin(); it != mThreadTasks.end(); ++it)
+    {
+        if ((*it)->getKey().compare(key) == 0)
+        {
+            threadTask = *it;
+            mThreadTasks.erase(it);
+            break;
+        }
+    }
+    if (threadTask != NULL)
+    {
+        threadTask->setPriority(RT_THREAD_TASK_PRIORITY_VISIBLE);
+        mThreadTasks.push_front(threadTask);
+    }
+    mThreadTaskMutex.unlock();
+}
+
+int rtThreadPoolNative::cancelTask(const rtString& key)
+{
+    int canceledTasks = 0;
+    mThreadTaskMutex.lock();
+    for (std::deque<rtThreadTask*>::iterator it = mThreadTasks.begin(); it != mThreadTasks.end(); )
+    {
+        if ((*it)->getKey().compare(key) == 0)
+        {
+            delete (*it);
+            it = mThreadTasks.erase(it);
+            canceledTasks++;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    mThreadTaskMutex.unlock();
+    return canceledTasks;
+}
@@ -32,6 +32,8 @@ public:
   ~rtThreadPoolNative();
 
   void executeTask(rtThreadTask* threadTask);
+  void raisePriority(const rtString& key);
+  int cancelTask(const rtString& key);
   void startThread();
 
   void destroy();
@@ -80,7 +80,7 @@ public:
     downloadedData =
       "data"
     ;
-    char* downloadedData_str = (char*)malloc(downloadedData.byteLength()+1);
+    char* downloadedData_str = new char[downloadedData.byteLength()+1];
     memset(downloadedData_str, 0, downloadedData.byteLength()+1);
     strcpy(downloadedData_str, downloadedData.cString());
     request.setDownloadedData(downloadedData_str, downloadedData.byteLength());
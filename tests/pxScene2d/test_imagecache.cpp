@@ -17,18 +17,21 @@ limitations under the License.
 */
 
 #include <list>
+#include <map>
 #include <sstream>
 
 #define private public
 #define protected public
 
 #include "rtFileCache.h"
+#include "pxImageCache.h"
 #include "rtHttpCache.h"
 #include "pxResource.h"
 #include "pxArchive.h"
 #include "rtFileDownloader.h"
 #include "rtString.h"
 #include "pxScene2d.h"
+#include "pxTimer.h"
 #include <string.h>
 
 #include <unistd.h>
@@ -312,6 +315,167 @@ class pxFileCacheTest : public testing::Test, public commonTestFns
       rtHttpCacheData data;
       EXPECT_FALSE  (rtFileCache::instance()->readFileHeader(fileName,data));
     }
+
+    void indexReloadTest()
+    {
+      rtFileCache::instance()->clearCache();
+      addDataToCache("http://fileserver/a.jpeg","","abcde",5);
+      addDataToCache("http://fileserver/b.jpeg","","abcde",5);
+      rtHttpCacheData data;
+      EXPECT_TRUE (rtFileCache::instance()->httpCacheData("http://fileserver/a.jpeg",data) == RT_OK);
+      fclose(data.filePointer());
+      int64_t size = rtFileCache::instance()->cacheSize();
+
+      // the index brings back the files and the order they were used in
+      rtFileCache::destroy();
+      EXPECT_EQ (size, rtFileCache::instance()->cacheSize());
+      EXPECT_EQ (2u, rtFileCache::instance()->mEntries.size());
+      int64_t oldMaxSize  = rtFileCache::instance()->maxCacheSize();
+      rtFileCache::instance()->setMaxCacheSize(size - 1);
+      rtFileCache::instance()->cleanup();
+      rtFileCache::instance()->setMaxCacheSize(oldMaxSize);
+      rtHttpCacheData a, b;
+      EXPECT_TRUE (rtFileCache::instance()->httpCacheData("http://fileserver/a.jpeg",a) == RT_OK);
+      fclose(a.filePointer());
+      EXPECT_TRUE (rtFileCache::instance()->httpCacheData("http://fileserver/b.jpeg",b) == RT_ERROR);
+
+      // an index that was cut short is used up to where it ends
+      rtFileCache::destroy();
+      bool sysret = system("truncate -s -10 /tmp/cache/.index");
+      UNUSED_PARAM(sysret);
+      EXPECT_EQ (1u, rtFileCache::instance()->mEntries.size());
+
+      // and entries added after that survive the next reload
+      addDataToCache("http://fileserver/c.jpeg","","abcde",5);
+      rtFileCache::destroy();
+      EXPECT_EQ (2u, rtFileCache::instance()->mEntries.size());
+      rtHttpCacheData c;
+      EXPECT_TRUE (rtFileCache::instance()->httpCacheData("http://fileserver/c.jpeg",c) == RT_OK);
+      fclose(c.filePointer());
+    }
+
+    void indexMatchesDirectoryScanTest()
+    {
+      const int entries = 2000;
+      rtFileCache::instance()->clearCache();
+      int64_t oldMaxSize  = rtFileCache::instance()->maxCacheSize();
+      rtFileCache::instance()->setMaxCacheSize(entries * 1024);
+      char url[64];
+      for (int i = 0; i < entries; i++)
+      {
+        sprintf(url, "http://fileserver/%d.jpeg", i);
+        addDataToCache(url,"","abcde",5);
+      }
+      // use some of them out of order so the index has more than adds in it
+      for (int i = 0; i < entries; i += 7)
+      {
+        sprintf(url, "http://fileserver/%d.jpeg", (i * 13) % entries);
+        rtHttpCacheData data;
+        if (rtFileCache::instance()->httpCacheData(url,data) == RT_OK)
+          fclose(data.filePointer());
+      }
+      int64_t size = rtFileCache::instance()->cacheSize();
+      std::list<std::string> lru = rtFileCache::instance()->mLru;
+
+      // the index brings back the same files in the same order
+      rtFileCache::destroy();
+      EXPECT_EQ (size, rtFileCache::instance()->cacheSize());
+      EXPECT_TRUE (lru == rtFileCache::instance()->mLru);
+      std::map<std::string,int64_t> indexed;
+      for (auto it = rtFileCache::instance()->mEntries.begin(); it != rtFileCache::instance()->mEntries.end(); ++it)
+        indexed[it->first] = it->second.size;
+
+      // and the same files and sizes a scan of the directory finds
+      rtFileCache::instance()->populateExistingFiles();
+      EXPECT_EQ (size, rtFileCache::instance()->cacheSize());
+      std::map<std::string,int64_t> scanned;
+      for (auto it = rtFileCache::instance()->mEntries.begin(); it != rtFileCache::instance()->mEntries.end(); ++it)
+        scanned[it->first] = it->second.size;
+      EXPECT_EQ ((size_t)entries, indexed.size());
+      EXPECT_TRUE (indexed == scanned);
+
+      // urls that aren't cached are answered by the index alone
+      int found = 0;
+      for (int i = 0; i < entries; i++)
+      {
+        sprintf(url, "http://otherserver/%d.jpeg", i);
+        rtHttpCacheData data;
+        found += rtFileCache::instance()->httpCacheData(url,data) == RT_OK ? 1 : 0;
+      }
+      EXPECT_EQ (0, found);
+
+      for (int i = 0; i < entries; i++)
+      {
+        sprintf(url, "http://fileserver/%d.jpeg", i);
+        rtHttpCacheData data;
+        if (rtFileCache::instance()->httpCacheData(url,data) == RT_OK)
+        {
+          found++;
+          fclose(data.filePointer());
+        }
+      }
+      EXPECT_EQ (entries, found);
+      rtFileCache::instance()->setMaxCacheSize(oldMaxSize);
+    }
+
+    void indexBenchmarkTest()
+    {
+      const int entries = 50000;
+      rtFileCache::instance()->clearCache();
+      int64_t oldMaxSize  = rtFileCache::instance()->maxCacheSize();
+      rtFileCache::instance()->setMaxCacheSize(entries * 1024);
+      char url[64];
+      double start = pxMilliseconds();
+      for (int i = 0; i < entries; i++)
+      {
+        sprintf(url, "http://fileserver/%d.jpeg", i);
+        addDataToCache(url,"","abcde",5);
+      }
+      double addTime = pxMilliseconds() - start;
+      int64_t size = rtFileCache::instance()->cacheSize();
+
+      start = pxMilliseconds();
+      rtFileCache::instance()->populateExistingFiles();
+      double scanTime = pxMilliseconds() - start;
+      EXPECT_EQ (size, rtFileCache::instance()->cacheSize());
+
+      rtFileCache::destroy();
+      start = pxMilliseconds();
+      rtFileCache::instance();
+      double loadTime = pxMilliseconds() - start;
+      EXPECT_EQ (size, rtFileCache::instance()->cacheSize());
+
+      // lookups of urls that aren't cached are answered by the index alone
+      start = pxMilliseconds();
+      int found = 0;
+      for (int i = 0; i < entries; i++)
+      {
+        sprintf(url, "http://otherserver/%d.jpeg", i);
+        rtHttpCacheData data;
+        found += rtFileCache::instance()->httpCacheData(url,data) == RT_OK ? 1 : 0;
+      }
+      double missTime = pxMilliseconds() - start;
+      EXPECT_EQ (0, found);
+
+      start = pxMilliseconds();
+      for (int i = 0; i < entries; i++)
+      {
+        sprintf(url, "http://fileserver/%d.jpeg", i);
+        rtHttpCacheData data;
+        if (rtFileCache::instance()->httpCacheData(url,data) == RT_OK)
+        {
+          found++;
+          fclose(data.filePointer());
+        }
+      }
+      double hitTime = pxMilliseconds() - start;
+      EXPECT_EQ (entries, found);
+
+      printf("rtFileCache: %d entries added in %.2f ms, directory scan %.2f ms, index load %.2f ms, "
+             "lookup %.2f us per miss and %.2f us per hit\n", entries, addTime, scanTime, loadTime,
+             missTime * 1000 / entries, hitTime * 1000 / entries);
+      rtFileCache::instance()->setMaxCacheSize(oldMaxSize);
+    }
   private:
 
      void resetAndAddCacheData()
@@ -345,6 +509,175 @@ TEST_F(pxFileCacheTest, fileCacheCompleteTest)
   cleanupCacheTest();
   createNewDirectoryCacheTest();
   improperCacheFileFailReadTest();
+  indexReloadTest();
+  indexMatchesDirectoryScanTest();
+}
+
+// only prints timings, run with --gtest_also_run_disabled_tests
+TEST_F(pxFileCacheTest, DISABLED_fileCacheIndexBenchmark)
+{
+  indexBenchmarkTest();
+}
+
+class pxImageCacheTest : public testing::Test
+{
+  public:
+    virtual void SetUp()
+    {
+      mOldMaxSize = pxImageCache::instance()->maxSize();
+      pxImageCache::instance()->clear();
+      pxImageCache::instance()->setMaxSize(10 * 64 * 64 * 4);
+    }
+
+    virtual void TearDown()
+    {
+      pxImageCache::instance()->clear();
+      pxImageCache::instance()->setMaxSize(mOldMaxSize);
+      pxImageCache::instance()->setCompressionEnabled(false);
+    }
+
+    // an image with a transparent border around noise
+    void createImage(pxOffscreen& image, int32_t w, int32_t h, int32_t border)
+    {
+      image.init(w, h);
+      uint32_t noise = 1;
+      for (int32_t y = 0; y < h; y++)
+      {
+        for (int32_t x = 0; x < w; x++)
+        {
+          bool inside = x >= border && x < w - border && y >= border && y < h - border;
+          noise = noise * 1103515245 + 12345;
+          image.scanlineInt32(y)[x] = inside ? noise : 0;
+        }
+      }
+    }
+
+    bool sameImage(const pxOffscreen& a, const pxOffscreen& b)
+    {
+      if (a.width() != b.width() || a.height() != b.height())
+      {
+        return false;
+      }
+      for (int32_t y = 0; y < a.height(); y++)
+      {
+        if (memcmp(a.scanlineInt32(y), b.scanlineInt32(y), a.width() * 4) != 0)
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    void addGetTest()
+    {
+      pxOffscreen image, cached;
+      createImage(image, 64, 32, 0);
+      uint32_t misses = pxImageCache::instance()->misses();
+      EXPECT_FALSE (pxImageCache::instance()->get("a.png", cached));
+      EXPECT_EQ (misses + 1, pxImageCache::instance()->misses());
+      pxImageCache::instance()->add("a.png", image);
+      EXPECT_EQ (64 * 32 * 4, pxImageCache::instance()->size());
+      uint32_t hits = pxImageCache::instance()->hits();
+      EXPECT_TRUE (pxImageCache::instance()->get("a.png", cached));
+      EXPECT_EQ (hits + 1, pxImageCache::instance()->hits());
+      EXPECT_TRUE (sameImage(image, cached));
+
+      // an upside down image comes back the right way up
+      pxOffscreen flipped;
+      flipped.init(64, 32);
+      flipped.setUpsideDown(true);
+      for (int32_t y = 0; y < 32; y++)
+      {
+        memcpy(flipped.scanlineInt32(y), image.scanlineInt32(y), 64 * 4);
+      }
+      pxImageCache::instance()->add("a.png", flipped);
+      EXPECT_EQ (1u, pxImageCache::instance()->count());
+      EXPECT_TRUE (pxImageCache::instance()->get("a.png", cached));
+      EXPECT_TRUE (sameImage(image, cached));
+
+      pxImageCache::instance()->remove("a.png");
+      EXPECT_FALSE (pxImageCache::instance()->get("a.png", cached));
+      EXPECT_EQ (0, pxImageCache::instance()->size());
+    }
+
+    void evictionTest()
+    {
+      pxOffscreen image, cached;
+      createImage(image, 64, 64, 0);
+      char key[32];
+      for (int i = 0; i < 10; i++)
+      {
+        sprintf(key, "%d.png", i);
+        pxImageCache::instance()->add(key, image);
+      }
+      EXPECT_EQ (10u, pxImageCache::instance()->count());
+      EXPECT_TRUE (pxImageCache::instance()->get("0.png", cached));
+      pxImageCache::instance()->add("10.png", image);
+      EXPECT_EQ (10u, pxImageCache::instance()->count());
+      EXPECT_TRUE (pxImageCache::instance()->get("0.png", cached));
+      EXPECT_FALSE (pxImageCache::instance()->get("1.png", cached));
+
+      pxImageCache::instance()->setMaxSize(64 * 64 * 4);
+      EXPECT_EQ (1u, pxImageCache::instance()->count());
+      EXPECT_TRUE (pxImageCache::instance()->get("0.png", cached));
+
+      // images larger than the cache and a disabled cache keep nothing
+      pxOffscreen large;
+      createImage(large, 128, 64, 0);
+      pxImageCache::instance()->add("large.png", large);
+      EXPECT_FALSE (pxImageCache::instance()->get("large.png", cached));
+      pxImageCache::instance()->setMaxSize(0);
+      EXPECT_EQ (0u, pxImageCache::instance()->count());
+      pxImageCache::instance()->add("0.png", image);
+      EXPECT_EQ (0, pxImageCache::instance()->size());
+      pxImageCache::instance()->setMaxSize(10 * 64 * 64 * 4);
+    }
+
+    void compressionTest()
+    {
+      pxImageCache::instance()->setCompressionEnabled(true);
+      pxOffscreen bordered, photo, cached;
+      createImage(bordered, 64, 64, 20);
+      createImage(photo, 64, 64, 0);
+
+      pxImageCache::instance()->add("bordered.png", bordered);
+      EXPECT_TRUE (pxImageCache::instance()->size() < 64 * 64 * 4 / 2);
+      EXPECT_TRUE (pxImageCache::instance()->get("bordered.png", cached));
+      EXPECT_TRUE (sameImage(bordered, cached));
+
+      // pixels that don't compress are kept as they are
+      pxImageCache::instance()->clear();
+      pxImageCache::instance()->add("photo.png", photo);
+      EXPECT_EQ (64 * 64 * 4, pxImageCache::instance()->size());
+      EXPECT_TRUE (pxImageCache::instance()->get("photo.png", cached));
+      EXPECT_TRUE (sameImage(photo, cached));
+    }
+
+    void resourceFromCacheTest()
+    {
+      // there is no such file, the image can only come from the cache
+      pxOffscreen image;
+      createImage(image, 16, 8, 2);
+      pxImageCache::instance()->add("supportfiles/notafile.png", image);
+      rtRef<rtImageResource> resource = pxImageManager::getImage("supportfiles/notafile.png");
+      EXPECT_TRUE (resource->getLoadStatus("sourceType").toString() == "memory");
+      EXPECT_EQ (0, resource->getLoadStatus("statusCode").toInt32());
+      pxTextureRef texture = resource->getTexture(true);
+      EXPECT_TRUE (texture.getPtr() != NULL);
+      EXPECT_EQ (16, texture->width());
+      EXPECT_EQ (8, texture->height());
+    }
+
+  private:
+    int64_t mOldMaxSize;
+};
+
+TEST_F(pxImageCacheTest, imageCacheCompleteTest)
+{
+  addGetTest();
+  evictionTest();
+  compressionTest();
+  resourceFromCacheTest();
 }
 
 class rtHttpCacheTest : public testing::Test, public commonTestFns
@@ -23,14 +23,45 @@ limitations under the License.
 #define protected public
 
 #include "pxAnimate.h"
+#include "pxAnimationEngine.h"
 #include "rtString.h"
 #include "pxScene2d.h"
 #include "pxImage.h"
+#include "pxRectangle.h"
+#include "pxTimer.h"
+#include "rtPromise.h"
 #include <string.h>
 #include <sstream>
 
 #include "test_includes.h" // Needs to be included last
 
+static double pxAnimateTestInterp(double t)
+{
+  return t;
+}
+
+// starts and cancels tweens from its w setter, the way script run by an
+// animated setter can
+class pxAnimateSetterRectangle : public pxRectangle
+{
+  public:
+    pxAnimateSetterRectangle(pxScene2d* scene): pxRectangle(scene), mCancelled(NULL), mStarted(NULL) {}
+
+    virtual rtError setW(float v)
+    {
+      if (v > 0 && mCancelled != NULL)
+      {
+        mCancelled->cancelAnimation("x");
+        mStarted->animateToInternal("y", 100, 1.0, pxAnimateTestInterp, pxConstantsAnimation::OPTION_LOOP, 1, rtObjectRef(), rtObjectRef());
+        mCancelled = NULL;
+      }
+      return pxRectangle::setW(v);
+    }
+
+    pxObject* mCancelled;
+    pxObject* mStarted;
+};
+
 class pxAnimateTest : public testing::Test
 {
   public:
@@ -97,6 +128,300 @@ class pxAnimateTest : public testing::Test
          EXPECT_TRUE (mAnimate->mStatus == pxConstantsAnimation::STATUS_INPROGRESS);
     }
 
+    void animatedPropertyTest ()
+    {
+         pxRectangle* rect = new pxRectangle(mScene);
+         rtObjectRef rectRef = rect;
+         EXPECT_TRUE (rect->animatedProperty("x") == PX_ANIMATED_PROPERTY_X);
+         EXPECT_TRUE (rect->animatedProperty("sy") == PX_ANIMATED_PROPERTY_SY);
+         EXPECT_TRUE (rect->animatedProperty("lineWidth") == PX_ANIMATED_PROPERTY_CUSTOM);
+
+         rect->animateToInternal("x", 100, 1.0, pxInterpLinear, pxConstantsAnimation::OPTION_LOOP, 1, rtObjectRef(), rtObjectRef());
+         rect->animateToInternal("lineWidth", 10, 1.0, pxInterpLinear, pxConstantsAnimation::OPTION_LOOP, 1, rtObjectRef(), rtObjectRef());
+         EXPECT_TRUE (rect->mAnimations[0].property == PX_ANIMATED_PROPERTY_X);
+         EXPECT_TRUE (rect->mAnimations[1].property == PX_ANIMATED_PROPERTY_CUSTOM);
+         rect->update(10.0, false);
+         rect->update(10.5, false);
+         EXPECT_EQ (50.0f, rect->mx);
+         EXPECT_EQ (5.0f, rect->mLineWidth);
+         rect->update(11.0, false);
+         EXPECT_EQ (100.0f, rect->mx);
+         EXPECT_EQ (10.0f, rect->mLineWidth);
+         EXPECT_TRUE (rect->mAnimations.empty());
+    }
+
+    // pairs of rectangles given the same tweens of every bound property,
+    // one applied through the bound setters and one through set() by name
+    void boundSettersMatchSetByNameTest ()
+    {
+         pxAnimationEngine* engine = pxAnimationEngine::instance();
+         const char* props[] = {"x", "y", "w", "h", "sx", "sy", "a", "r"};
+         const int numberOfProps = sizeof(props) / sizeof(props[0]);
+         const int numberOfPairs = 16;
+         rtRef<pxObject> root = mScene->getRoot();
+         std::vector<rtRef<pxObject> > bound, byName;
+         for (int i = 0; i < numberOfPairs; i++)
+         {
+           for (int k = 0; k < 2; k++)
+           {
+             pxRectangle* rect = new pxRectangle(mScene);
+             rect->setParent(root);
+             for (int p = 0; p < numberOfProps; p++)
+               rect->animateToInternal(props[p], 3 * i + p, 0.5 + p * 0.125, pxInQuad, pxConstantsAnimation::OPTION_LOOP,
+                                       1 + i % 3, rtObjectRef(), rtObjectRef());
+             // both go through update() so only the way the value is set differs
+             for (size_t j = 0; j < rect->mAnimations.size(); j++)
+             {
+               animation& a = rect->mAnimations[j];
+               engine->remove(a.engineId);
+               a.engineId = 0;
+               if (k == 1)
+                 a.property = PX_ANIMATED_PROPERTY_CUSTOM;
+             }
+             (k == 0 ? bound : byName).push_back(rect);
+           }
+           EXPECT_TRUE (bound[i]->mAnimations[0].property == PX_ANIMATED_PROPERTY_X);
+         }
+
+         int mismatches = 0;
+         for (int frame = 0; frame < 300; frame++)
+         {
+           double t = 30.0 + frame / 60.0;
+           for (int i = 0; i < numberOfPairs; i++)
+           {
+             pxObject* b = bound[i].getPtr();
+             pxObject* n = byName[i].getPtr();
+             b->update(t, false);
+             n->update(t, false);
+             if (b->mx != n->mx || b->my != n->my || b->mw != n->mw || b->mh != n->mh ||
+                 b->msx != n->msx || b->msy != n->msy || b->ma != n->ma || b->mr != n->mr ||
+                 b->mAnimations.size() != n->mAnimations.size())
+             {
+               mismatches++;
+             }
+           }
+         }
+         EXPECT_EQ (0, mismatches);
+         // every tween has run to its end value
+         EXPECT_TRUE (bound[numberOfPairs - 1]->mAnimations.empty());
+         EXPECT_EQ (3.0f * (numberOfPairs - 1) + 7, bound[numberOfPairs - 1]->mr);
+
+         for (int i = 0; i < numberOfPairs; i++)
+         {
+           bound[i]->remove();
+           byName[i]->remove();
+         }
+    }
+
+    // 10k rectangles each animating x, y and a, once through the bound
+    // setters and once through set() by name
+    void animatedRectanglesBenchmarkTest ()
+    {
+         pxAnimationEngine* engine = pxAnimationEngine::instance();
+         const int numberOfRects = 10000;
+         const int numberOfFrames = 60;
+         std::vector<rtObjectRef> rects;
+         for (int i = 0; i < numberOfRects; i++)
+         {
+           pxRectangle* rect = new pxRectangle(mScene);
+           rects.push_back(rect);
+           rect->animateToInternal("x", 100, 1000.0, pxInterpLinear, pxConstantsAnimation::OPTION_LOOP, 1, rtObjectRef(), rtObjectRef());
+           rect->animateToInternal("y", 100, 1000.0, pxInterpLinear, pxConstantsAnimation::OPTION_LOOP, 1, rtObjectRef(), rtObjectRef());
+           rect->animateToInternal("a", 0, 1000.0, pxInterpLinear, pxConstantsAnimation::OPTION_LOOP, 1, rtObjectRef(), rtObjectRef());
+           // timed through update(), not the engine
+           for (size_t j = 0; j < rect->mAnimations.size(); j++)
+           {
+             engine->remove(rect->mAnimations[j].engineId);
+             rect->mAnimations[j].engineId = 0;
+           }
+         }
+
+         double elapsed[2];
+         for (int pass = 0; pass < 2; pass++)
+         {
+           if (pass == 1)
+           {
+             for (int i = 0; i < numberOfRects; i++)
+             {
+               pxRectangle* rect = (pxRectangle*)rects[i].getPtr();
+               for (size_t j = 0; j < rect->mAnimations.size(); j++)
+                 rect->mAnimations[j].property = PX_ANIMATED_PROPERTY_CUSTOM;
+             }
+           }
+           double start = pxMilliseconds();
+           for (int frame = 0; frame < numberOfFrames; frame++)
+           {
+             for (int i = 0; i < numberOfRects; i++)
+               ((pxRectangle*)rects[i].getPtr())->update(pass * 500.0 + frame / 60.0, false);
+           }
+           elapsed[pass] = pxMilliseconds() - start;
+         }
+
+         pxRectangle* rect = (pxRectangle*)rects[0].getPtr();
+         EXPECT_EQ (3u, rect->mAnimations.size());
+         EXPECT_TRUE (rect->mx > 0.0f && rect->mx < 100.0f);
+         printf("pxAnimate: %d frames of %d rectangles, bound setters %.2f ms, set by name %.2f ms\n",
+                numberOfFrames, numberOfRects, elapsed[0], elapsed[1]);
+    }
+
+    void animationEngineTest ()
+    {
+         pxAnimationEngine* engine = pxAnimationEngine::instance();
+         uint32_t engineSize = engine->size();
+         rtRef<pxObject> root = mScene->getRoot();
+         pxRectangle* rect = new pxRectangle(mScene);
+         rtObjectRef rectRef = rect;
+         rect->setParent(root);
+
+         rtObjectRef promise = new rtPromise;
+         rect->animateToInternal("x", 100, 1.0, pxInterpLinear, pxConstantsAnimation::OPTION_LOOP, 1, promise, rtObjectRef());
+         rect->animateToInternal("a", 0, 1.0, pxExp1, pxConstantsAnimation::OPTION_LOOP, 2, rtObjectRef(), rtObjectRef());
+         rect->animateToInternal("lineWidth", 10, 1.0, pxInterpLinear, pxConstantsAnimation::OPTION_LOOP, 1, rtObjectRef(), rtObjectRef());
+         EXPECT_EQ (engineSize + 2, engine->size());
+         EXPECT_TRUE (rect->mAnimations[2].engineId == 0);
+
+         engine->update(10.0);
+         rect->update(10.0, false);
+         engine->update(10.5);
+         rect->update(10.5, false);
+         EXPECT_EQ (50.0f, rect->mx);
+         EXPECT_EQ (0.75f, rect->ma);
+         EXPECT_EQ (5.0f, rect->mLineWidth);
+         EXPECT_FALSE (((rtPromise*)promise.getPtr())->status());
+
+         // x and lineWidth end, a starts its second run
+         engine->update(11.0);
+         rect->update(11.0, false);
+         EXPECT_EQ (100.0f, rect->mx);
+         EXPECT_EQ (10.0f, rect->mLineWidth);
+         EXPECT_TRUE (((rtPromise*)promise.getPtr())->status());
+         EXPECT_EQ (1u, rect->mAnimations.size());
+         EXPECT_EQ (engineSize + 1, engine->size());
+
+         engine->update(11.25);
+         engine->update(11.75);
+         EXPECT_EQ (0.75f, rect->ma);
+
+         rect->cancelAnimation("a");
+         EXPECT_EQ (engineSize, engine->size());
+         engine->update(12.0);
+         EXPECT_EQ (0.75f, rect->ma);
+         rect->update(12.0, false);
+         EXPECT_TRUE (rect->mAnimations.empty());
+         rect->remove();
+    }
+
+    // pairs of rectangles given the same tweens, one evaluated by the engine
+    // and one by its own update() the way tweens that aren't batched are
+    void animationEngineMatchesObjectsTest ()
+    {
+         pxAnimationEngine* engine = pxAnimationEngine::instance();
+         pxInterp interps[] = {pxInterpLinear, pxExp1, pxInQuad, pxInBack, pxEaseOutBounce, pxEaseOutElastic};
+         const int numberOfInterps = sizeof(interps) / sizeof(interps[0]);
+         const int numberOfPairs = 48;
+         rtRef<pxObject> root = mScene->getRoot();
+         std::vector<rtRef<pxObject> > batched, unbatched;
+         for (int i = 0; i < numberOfPairs; i++)
+         {
+           for (int k = 0; k < 2; k++)
+           {
+             pxRectangle* rect = new pxRectangle(mScene);
+             rect->setParent(root);
+             pxInterp interp = interps[i % numberOfInterps];
+             double duration = 0.5 + (i % 4) * 0.25;
+             int32_t count = (i % 5 == 0) ? pxConstantsAnimation::COUNT_FOREVER : 1 + i % 3;
+             rect->animateToInternal("x", 10 * i, duration, interp, pxConstantsAnimation::OPTION_LOOP, count, rtObjectRef(), rtObjectRef());
+             rect->animateToInternal("y", -5 * i, duration * 1.5, interp, pxConstantsAnimation::OPTION_LOOP, count, rtObjectRef(), rtObjectRef());
+             rect->animateToInternal("a", 0, duration * 0.75, interp, pxConstantsAnimation::OPTION_LOOP, count, rtObjectRef(), rtObjectRef());
+             (k == 0 ? batched : unbatched).push_back(rect);
+           }
+           for (size_t j = 0; j < unbatched[i]->mAnimations.size(); j++)
+           {
+             animation& a = unbatched[i]->mAnimations[j];
+             EXPECT_TRUE (a.engineId != 0);
+             engine->remove(a.engineId);
+             a.engineId = 0;
+           }
+         }
+
+         // the scene updates the engine and then the objects, every frame
+         int mismatches = 0;
+         for (int frame = 0; frame < 300; frame++)
+         {
+           double t = 20.0 + frame / 60.0;
+           engine->update(t);
+           for (int i = 0; i < numberOfPairs; i++)
+           {
+             batched[i]->update(t, false);
+             unbatched[i]->update(t, false);
+             if (batched[i]->mx != unbatched[i]->mx || batched[i]->my != unbatched[i]->my ||
+                 batched[i]->ma != unbatched[i]->ma ||
+                 batched[i]->mAnimations.size() != unbatched[i]->mAnimations.size())
+             {
+               mismatches++;
+             }
+           }
+         }
+         EXPECT_EQ (0, mismatches);
+         // the counted tweens have ended and the endless ones still run
+         EXPECT_EQ (3u, batched[0]->mAnimations.size());
+         EXPECT_TRUE (batched[1]->mAnimations.empty());
+
+         for (int i = 0; i < numberOfPairs; i++)
+         {
+           batched[i]->remove();
+           unbatched[i]->remove();
+         }
+    }
+
+    void animationEngineSetterChangesTweensTest ()
+    {
+         pxAnimationEngine* engine = pxAnimationEngine::instance();
+         uint32_t engineSize = engine->size();
+         rtRef<pxObject> root = mScene->getRoot();
+         rtRef<pxObject> cancelled = new pxRectangle(mScene);
+         rtRef<pxAnimateSetterRectangle> setter = new pxAnimateSetterRectangle(mScene);
+         rtRef<pxObject> second = new pxRectangle(mScene);
+         rtRef<pxObject> last = new pxRectangle(mScene);
+         rtRef<pxObject> started = new pxRectangle(mScene);
+         cancelled->setParent(root);
+         setter->setParent(root);
+         second->setParent(root);
+         last->setParent(root);
+         started->setParent(root);
+         setter->mCancelled = cancelled.getPtr();
+         setter->mStarted = started.getPtr();
+
+         // one lane, the setter runs before the tween that ends up in the
+         // slot of the cancelled one
+         cancelled->animateToInternal("x", 100, 1.0, pxInterpLinear, pxConstantsAnimation::OPTION_LOOP, 1, rtObjectRef(), rtObjectRef());
+         setter->animateToInternal("w", 100, 1.0, pxInterpLinear, pxConstantsAnimation::OPTION_LOOP, 1, rtObjectRef(), rtObjectRef());
+         second->animateToInternal("x", 100, 1.0, pxInterpLinear, pxConstantsAnimation::OPTION_LOOP, 1, rtObjectRef(), rtObjectRef());
+         last->animateToInternal("x", 100, 1.0, pxInterpLinear, pxConstantsAnimation::OPTION_LOOP, 1, rtObjectRef(), rtObjectRef());
+         EXPECT_EQ (engineSize + 4, engine->size());
+
+         engine->update(40.0);
+         engine->update(40.5);
+         EXPECT_EQ (50.0f, setter->mw);
+         EXPECT_EQ (50.0f, second->mx);
+         EXPECT_EQ (50.0f, last->mx);
+         EXPECT_EQ (engineSize + 4, engine->size());
+         EXPECT_EQ (1u, started->mAnimations.size());
+
+         // the cancelled tween is gone, the started one got a lane of its own
+         // that comes after this one, so it started in the same frame
+         engine->update(40.75);
+         EXPECT_EQ (75.0f, last->mx);
+         EXPECT_EQ (50.0f, cancelled->mx);
+         EXPECT_EQ (25.0f, started->my);
+
+         cancelled->remove();
+         setter->remove();
+         second->remove();
+         last->remove();
+         started->remove();
+    }
+
     private:
 
       void validateReadOnlyMembers(rtObjectRef props, uint32_t interp, pxConstantsAnimation::animationOptions type, double duration, int32_t count)
@@ -119,5 +444,15 @@ TEST_F(pxAnimateTest, pxAnimateCompleteTest)
     pxAnimateCancelTest();
     pxAnimatePropsUpdateTest();
     pxAnimateSetStatusTest();
+    animatedPropertyTest();
+    boundSettersMatchSetByNameTest();
+    animationEngineTest();
+    animationEngineMatchesObjectsTest();
+    animationEngineSetterChangesTweensTest();
 }
 
+// only prints timings, run with --gtest_also_run_disabled_tests
+TEST_F(pxAnimateTest, DISABLED_pxAnimateRectanglesBenchmark)
+{
+    animatedRectanglesBenchmarkTest();
+}
@@ -16,13 +16,16 @@ limitations under the License.
 
 */
 
-#include "pxArchive.h"
-
-#include "test_includes.h" // Needs to be included last
+#include <sstream>
+#include <string.h>
 
 #define protected public
 #define private public
 
+#include "pxArchive.h"
+
+#include "test_includes.h" // Needs to be included last
+
 class pxArchiveTest : public testing::Test
 {
 	public:
@@ -223,6 +226,30 @@ class pxArchiveTest : public testing::Test
                     EXPECT_TRUE(d.length() > 0);
                 }
 
+                void pxArchivegetFileDataPreloadedTest()
+                {
+                    pxArchivePtr = new pxArchive();
+                    urlStr = "supportfiles/images.zip";
+                    EXPECT_EQ(RT_OK, pxArchivePtr->initFromUrl(urlStr));
+                    // the png and svg are preloaded, test.html isn't
+                    EXPECT_EQ(2, (int)pxArchivePtr->mPreloaded.size());
+                    rtData file;
+                    EXPECT_EQ(RT_OK, rtLoadFile("supportfiles/status_bg.png", file));
+                    rtData d;
+                    EXPECT_EQ(RT_OK, pxArchivePtr->getFileData("status_bg.png", d));
+                    EXPECT_EQ(1, (int)pxArchivePtr->mPreloaded.size());
+                    EXPECT_EQ(file.length(), d.length());
+                    EXPECT_EQ(0, memcmp(file.data(), d.data(), file.length()));
+                    // asking again reads it from the zip
+                    rtData d2;
+                    EXPECT_EQ(RT_OK, pxArchivePtr->getFileData("status_bg.png", d2));
+                    EXPECT_EQ(file.length(), d2.length());
+                    EXPECT_EQ(0, memcmp(file.data(), d2.data(), file.length()));
+                    rtData html;
+                    EXPECT_EQ(RT_OK, pxArchivePtr->getFileData("test.html", html));
+                    EXPECT_EQ(36, (int)html.length());
+                }
+
                 void pxArchivegetFileDataUnavailableTest()
                 {
                     pxArchivePtr = new pxArchive();
@@ -262,6 +289,7 @@ TEST_F(pxArchiveTest, pxArchiveCompleteTest)
     pxArchiveisFileFalseTest();
     pxArchivegetFileDataNonZipTest();
     pxArchivegetFileDataZipTest();
+    pxArchivegetFileDataPreloadedTest();
     pxArchivegetFileDataUnavailableTest();
 }
 
@@ -0,0 +1,568 @@
+/*
+
+pxCore Copyright 2005-2018 John Robinson
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+// Pixel checks of the software rasterizer in pxContextSW.cpp, only built
+// with BUILD_WITH_SOFTWARE_RENDERER.
+
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+
+#define private public
+#define protected public
+#include <pxCore.h>
+#include <pxScene2d.h>
+#include <pxRectangle.h>
+#include <pxOffscreen.h>
+#include <pxContext.h>
+#include <rtThreadPool.h>
+
+#include "test_includes.h" // Needs to be included last
+
+using namespace std;
+
+extern pxContext context;
+extern bool gLayerCachingEnabled;
+extern uint32_t gLayerCachingFrames;
+extern uint32_t gFrameNumber;
+
+class pxContextSWTest : public testing::Test
+{
+  public:
+    virtual void SetUp()
+    {
+      mContext.init();
+      mContext.getSize(mOldWidth, mOldHeight);
+      mContext.setSize(64, 64);
+      float black[4] = {0, 0, 0, 1};
+      mContext.clear(64, 64, black);
+      mContext.pushState();
+    }
+
+    virtual void TearDown()
+    {
+      mContext.popState();
+      mContext.setSize(mOldWidth, mOldHeight);
+    }
+
+    // y counts from the top of the screen
+    pxPixel pixelAt(int x, int y)
+    {
+      pxOffscreen shot;
+      mContext.snapshot(shot);
+      return *shot.pixel(x, y);
+    }
+
+    void expectPixel(int x, int y, int r, int g, int b, int a)
+    {
+      pxPixel p = pixelAt(x, y);
+      EXPECT_NEAR (r, p.r, 1) << "at " << x << "," << y;
+      EXPECT_NEAR (g, p.g, 1) << "at " << x << "," << y;
+      EXPECT_NEAR (b, p.b, 1) << "at " << x << "," << y;
+      EXPECT_NEAR (a, p.a, 1) << "at " << x << "," << y;
+    }
+
+    // the matrix and alpha given to the context apply on top of the current
+    // ones until the state is popped
+    void pushTranslation(float x, float y, float alpha = 1.0f)
+    {
+      mContext.pushState();
+      pxMatrix4f m;
+      m.translate(x, y);
+      mContext.setMatrix(m);
+      mContext.setAlpha(alpha);
+    }
+
+    // an opaque 16x16 gradient
+    pxTextureRef gradientTexture()
+    {
+      pxOffscreen o;
+      o.init(16, 16);
+      for (int y = 0; y < 16; y++)
+      {
+        for (int x = 0; x < 16; x++)
+        {
+          pxPixel* p = o.pixel(x, y);
+          p->r = x * 16;
+          p->g = y * 16;
+          p->b = 128;
+          p->a = 255;
+        }
+      }
+      return mContext.createTexture(o);
+    }
+
+    void solidRectTest()
+    {
+      float red[4] = {1, 0, 0, 1};
+      pushTranslation(10, 10);
+      mContext.drawRect(20, 10, 0, red, NULL);
+      mContext.popState();
+      pushTranslation(10, 30, 0.5f);
+      mContext.drawRect(20, 10, 0, red, NULL);
+      mContext.popState();
+
+      expectPixel(10, 10, 255, 0, 0, 255);
+      expectPixel(29, 19, 255, 0, 0, 255);
+      expectPixel( 9, 10, 0, 0, 0, 255);
+      expectPixel(30, 19, 0, 0, 0, 255);
+      expectPixel(10, 20, 0, 0, 0, 255);
+      expectPixel(15, 35, 128, 0, 0, 255);
+    }
+
+    void rectOutlineTest()
+    {
+      float green[4] = {0, 1, 0, 1};
+      float white[4] = {1, 1, 1, 1};
+      pushTranslation(10, 10);
+      mContext.drawRect(20, 20, 2, green, white);
+      mContext.popState();
+
+      expectPixel(10, 10, 255, 255, 255, 255);
+      expectPixel(11, 20, 255, 255, 255, 255);
+      expectPixel(12, 20, 0, 255, 0, 255);
+      expectPixel(20, 20, 0, 255, 0, 255);
+      expectPixel(28, 20, 255, 255, 255, 255);
+    }
+
+    void texturedRectTest()
+    {
+      pxTextureRef t = gradientTexture();
+      pushTranslation(8, 8);
+      mContext.drawImage(0, 0, 16, 16, t, pxTextureRef(), false);
+      mContext.popState();
+      pushTranslation(32, 8, 0.5f);
+      mContext.drawImage(0, 0, 16, 16, t, pxTextureRef(), false);
+      mContext.popState();
+
+      // unscaled images copy their texels
+      expectPixel(8, 8, 0, 0, 128, 255);
+      expectPixel(8 + 5, 8 + 3, 80, 48, 128, 255);
+      expectPixel(8 + 15, 8 + 15, 240, 240, 128, 255);
+      expectPixel(32 + 5, 8 + 3, 40, 24, 64, 255);
+    }
+
+    void repeatedTextureTest()
+    {
+      pxTextureRef t = gradientTexture();
+      mContext.drawImage(0, 0, 48, 16, t, pxTextureRef(), false, NULL,
+                         pxConstantsStretch::REPEAT, pxConstantsStretch::REPEAT);
+
+      pxOffscreen shot;
+      mContext.snapshot(shot);
+      for (int x = 1; x < 15; x++)
+      {
+        EXPECT_EQ (shot.pixel(x, 6)->u, shot.pixel(x + 16, 6)->u);
+        EXPECT_EQ (shot.pixel(x, 6)->u, shot.pixel(x + 32, 6)->u);
+      }
+    }
+
+    void maskTest()
+    {
+      pxTextureRef t = gradientTexture();
+      pxOffscreen o;
+      o.init(16, 16);
+      for (int y = 0; y < 16; y++)
+      {
+        for (int x = 0; x < 16; x++)
+        {
+          pxPixel* p = o.pixel(x, y);
+          p->r = p->g = p->b = p->a = x < 8 ? 0 : 255;
+        }
+      }
+      pxTextureRef mask = mContext.createTexture(o);
+      pushTranslation(8, 8);
+      mContext.drawImageMasked(0, 0, 16, 16, pxConstantsMaskOperation::NORMAL, t, mask);
+      mContext.popState();
+      pushTranslation(32, 8);
+      mContext.drawImageMasked(0, 0, 16, 16, pxConstantsMaskOperation::INVERT, t, mask);
+      mContext.popState();
+
+      expectPixel(8 + 2, 8 + 4, 0, 0, 0, 255);
+      expectPixel(8 + 13, 8 + 4, 208, 64, 128, 255);
+      expectPixel(32 + 2, 8 + 4, 32, 64, 128, 255);
+      expectPixel(32 + 13, 8 + 4, 0, 0, 0, 255);
+    }
+
+    // a 12x12 image with red corners, green edges and a blue center
+    pxTextureRef nineSliceTexture()
+    {
+      pxOffscreen o;
+      o.init(12, 12);
+      for (int y = 0; y < 12; y++)
+      {
+        for (int x = 0; x < 12; x++)
+        {
+          bool edgeX = x < 4 || x >= 8;
+          bool edgeY = y < 4 || y >= 8;
+          pxPixel* p = o.pixel(x, y);
+          p->r = edgeX && edgeY ? 255 : 0;
+          p->g = edgeX != edgeY ? 255 : 0;
+          p->b = !edgeX && !edgeY ? 255 : 0;
+          p->a = 255;
+        }
+      }
+      return mContext.createTexture(o);
+    }
+
+    void nineSliceTest()
+    {
+      pxTextureRef t = nineSliceTexture();
+      pushTranslation(4, 4);
+      mContext.drawImage9(40, 30, 4, 4, 4, 4, t);
+      mContext.popState();
+
+      // corners keep their size and the rest stretches
+      expectPixel(4 + 1, 4 + 1, 255, 0, 0, 255);
+      expectPixel(4 + 38, 4 + 28, 255, 0, 0, 255);
+      expectPixel(4 + 20, 4 + 1, 0, 255, 0, 255);
+      expectPixel(4 + 1, 4 + 15, 0, 255, 0, 255);
+      expectPixel(4 + 20, 4 + 15, 0, 0, 255, 255);
+      expectPixel(4 + 41, 4 + 15, 0, 0, 0, 255);
+    }
+
+    void nineSliceBorderTest()
+    {
+      pxTextureRef t = nineSliceTexture();
+      float white[4] = {1, 1, 1, 1};
+      pushTranslation(4, 4);
+      mContext.drawImage9Border(40, 30, 4, 4, 4, 4, 4, 4, 4, 4, false, white, t);
+      mContext.popState();
+
+      expectPixel(4 + 1, 4 + 1, 255, 0, 0, 255);
+      expectPixel(4 + 20, 4 + 1, 0, 255, 0, 255);
+      expectPixel(4 + 20, 4 + 15, 0, 0, 0, 255);
+    }
+
+#ifdef PXSCENE_FONT_ATLAS
+    void glyphQuadTest()
+    {
+      uint8_t coverage[8 * 8];
+      for (int y = 0; y < 8; y++)
+      {
+        for (int x = 0; x < 8; x++)
+        {
+          coverage[y * 8 + x] = x < 4 ? 255 : (y < 4 ? 128 : 0);
+        }
+      }
+      pxTextureRef glyphs = mContext.createTexture(8, 8, 8, 8, coverage);
+      float yellow[4] = {1, 1, 0, 1};
+      float verts[12] = {8,8, 16,8, 8,16, 16,8, 8,16, 16,16};
+      // glyph bitmaps start at v 1 at the top, as pxFont draws them
+      float uvs[12] = {0,1, 1,1, 0,0, 1,1, 0,0, 1,0};
+      mContext.drawTexturedQuads(1, verts, uvs, glyphs, yellow);
+
+      expectPixel(8 + 1, 8 + 1, 255, 255, 0, 255);
+      expectPixel(8 + 6, 8 + 1, 128, 128, 0, 255);
+      expectPixel(8 + 6, 8 + 6, 0, 0, 0, 255);
+      expectPixel(17, 9, 0, 0, 0, 255);
+    }
+#endif
+
+    void framebufferTest()
+    {
+      float red[4] = {1, 0, 0, 1};
+      float blue[4] = {0, 0, 1, 1};
+      mContext.drawRect(32, 32, 0, red, NULL);
+
+      // draws made before switching framebuffers stay on the screen
+      pxContextFramebufferRef fbo = mContext.createFramebuffer(16, 16);
+      pxContextFramebufferRef previous = mContext.getCurrentFramebuffer();
+      EXPECT_TRUE (mContext.setFramebuffer(fbo) == PX_OK);
+      mContext.clear(16, 16);
+      mContext.drawRect(8, 8, 0, blue, NULL);
+      EXPECT_TRUE (mContext.setFramebuffer(previous) == PX_OK);
+
+      pushTranslation(8, 8);
+      mContext.drawImage(0, 0, 16, 16, fbo->getTexture(), pxTextureRef(), false);
+      mContext.popState();
+
+      expectPixel(8 + 2, 8 + 2, 0, 0, 255, 255);
+      expectPixel(8 + 2, 8 + 12, 255, 0, 0, 255);
+      expectPixel(8 + 12, 8 + 2, 255, 0, 0, 255);
+      expectPixel(40, 40, 0, 0, 0, 255);
+    }
+
+    void drawScene(pxTextureRef t)
+    {
+      float red[4] = {1, 0, 0, 1};
+      float green[4] = {0, 1, 0, 0.5f};
+      float white[4] = {1, 1, 1, 1};
+      for (int i = 0; i < 120; i++)
+      {
+        mContext.pushState();
+        pxMatrix4f m;
+        m.translate((i * 37) % 200 + 0.3f, (i * 23) % 200 + 0.6f);
+        if (i % 7 == 3)
+        {
+          m.rotateInDegrees(17.0f);
+        }
+        if (i % 5 == 2)
+        {
+          m.scale(1.5f, 0.75f);
+        }
+        mContext.setMatrix(m);
+        mContext.setAlpha(i % 3 == 0 ? 0.6f : 1.0f);
+        if (i % 4 == 0)
+        {
+          mContext.drawRect(60, 40, 2, red, white);
+        }
+        else if (i % 4 == 1)
+        {
+          mContext.drawRect(50, 50, 0, green, NULL);
+        }
+        else if (i % 4 == 2)
+        {
+          mContext.drawImage(0, 0, 60, 30, t, pxTextureRef(), false, NULL,
+                             pxConstantsStretch::REPEAT, pxConstantsStretch::REPEAT);
+        }
+        else
+        {
+          mContext.drawImage(0, 0, 48, 48, t, pxTextureRef(), false);
+        }
+        mContext.popState();
+      }
+    }
+
+    // one flush covering the screen is split into bands over the thread
+    // pool, unbatched draws are each rasterized on the calling thread
+    void bandedMatchesSingleThreadTest()
+    {
+      EXPECT_TRUE (rtThreadPool::globalInstance()->numberOfThreadsInPool() > 0);
+      pxTextureRef t = gradientTexture();
+      mContext.setSize(256, 256);
+      bool batching = mContext.isDrawBatchingEnabled();
+
+      mContext.enableDrawBatching(true);
+      mContext.clear(256, 256);
+      drawScene(t);
+      pxOffscreen banded;
+      mContext.snapshot(banded);
+
+      mContext.enableDrawBatching(false);
+      mContext.clear(256, 256);
+      drawScene(t);
+      pxOffscreen single;
+      mContext.snapshot(single);
+      mContext.enableDrawBatching(batching);
+
+      int differing = 0;
+      for (int y = 0; y < 256; y++)
+      {
+        differing += memcmp(banded.scanline(y), single.scanline(y), 256 * sizeof(pxPixel)) != 0 ? 1 : 0;
+      }
+      EXPECT_EQ (0, differing);
+      EXPECT_NE (0u, banded.pixel(128, 128)->u);
+    }
+
+    // a frame that redraws o where the columns from left to left+width
+    // changed, the rest of the screen is cleared to black first
+    void drawFrame(pxObject* o, int left, int width)
+    {
+      float black[4] = {0, 0, 0, 1};
+      mContext.enableDirtyRectangles(false);
+      mContext.clear(64, 64, black);
+      if (width < 64)
+      {
+        mContext.clear(left, 0, width, 64);
+      }
+      mContext.pushState();
+      o->drawInternal();
+      mContext.popState();
+      mContext.enableDirtyRectangles(false);
+    }
+
+    void expectStripes(uint32_t whiteStripe)
+    {
+      for (uint32_t i = 0; i < 4; i++)
+      {
+        int g = i == whiteStripe ? 255 : 0;
+        expectPixel(i * 16 + 8, 32, 255, g, g, 255);
+      }
+    }
+
+    void layerTest()
+    {
+      bool layerCaching = gLayerCachingEnabled;
+      gLayerCachingEnabled = true;
+      rtObjectRef sceneRef = new pxScene2d(false);
+      pxScene2d* scene = (pxScene2d*)sceneRef.getPtr();
+      rtRef<pxObject> root = new pxObject(scene);
+      rtRef<pxObject> panel = new pxObject(scene);
+      panel->mw = 64;
+      panel->mh = 64;
+      panel->setParent(root);
+      rtRef<pxRectangle> stripes[4];
+      for (int i = 0; i < 4; i++)
+      {
+        stripes[i] = new pxRectangle(scene);
+        stripes[i]->mx = i * 16;
+        stripes[i]->mw = 16;
+        stripes[i]->mh = 64;
+        stripes[i]->setFillColorInternal(0xff0000ff);
+        stripes[i]->setParent(panel);
+      }
+
+      // not cached while it is changing
+      drawFrame(panel.getPtr(), 0, 64);
+      EXPECT_TRUE (NULL == panel->mLayerSnapshotRef.getPtr());
+      expectStripes(4);
+
+      // cached during a frame that only redraws the first stripe, the
+      // layer still holds all of them
+      gFrameNumber += gLayerCachingFrames;
+      drawFrame(panel.getPtr(), 0, 16);
+      ASSERT_TRUE (NULL != panel->mLayerSnapshotRef.getPtr());
+      EXPECT_EQ (64, panel->mLayerSnapshotRef->width());
+      drawFrame(panel.getPtr(), 0, 64);
+      expectStripes(4);
+
+      // a stripe that changes drops the layer
+      rtValue white((uint32_t)0xffffffff);
+      EXPECT_EQ (RT_OK, stripes[2]->Set("fillColor", &white));
+      drawFrame(panel.getPtr(), 0, 64);
+      EXPECT_TRUE (NULL == panel->mLayerSnapshotRef.getPtr());
+      expectStripes(2);
+
+      // and it is cached again from a frame redrawing another stripe
+      gFrameNumber += gLayerCachingFrames;
+      drawFrame(panel.getPtr(), 48, 16);
+      ASSERT_TRUE (NULL != panel->mLayerSnapshotRef.getPtr());
+      drawFrame(panel.getPtr(), 0, 64);
+      expectStripes(2);
+
+      panel->remove();
+      gLayerCachingEnabled = layerCaching;
+    }
+
+    rtRef<pxRectangle> addRectangle(pxScene2d* scene, pxObject* parent, float x, float y)
+    {
+      rtRef<pxRectangle> r = new pxRectangle(scene);
+      r->mx = x;
+      r->my = y;
+      r->mw = 16;
+      r->mh = 16;
+      r->setFillColorInternal(0xff0000ff);
+      r->setParent(parent);
+      return r;
+    }
+
+    void cullingTest()
+    {
+      rtObjectRef sceneRef = new pxScene2d(false);
+      pxScene2d* scene = (pxScene2d*)sceneRef.getPtr();
+      rtRef<pxObject> root = new pxObject(scene);
+      addRectangle(scene, root.getPtr(), 8, 8);
+      addRectangle(scene, root.getPtr(), 56, 24);
+      addRectangle(scene, root.getPtr(), 80, 40);
+      addRectangle(scene, root.getPtr(), -32, 40);
+      // a clipped object off screen is culled with everything in it
+      rtRef<pxObject> clipped = new pxObject(scene);
+      clipped->mx = 8;
+      clipped->my = 72;
+      clipped->mw = 32;
+      clipped->mh = 32;
+      clipped->mClip = true;
+      clipped->setParent(root);
+      addRectangle(scene, clipped.getPtr(), 0, 0);
+
+      // the partly visible rectangle is drawn, the ones off screen aren't
+      uint32_t culled = context.culledObjectCount();
+      drawFrame(root.getPtr(), 0, 64);
+      EXPECT_EQ (3u, context.culledObjectCount() - culled);
+      expectPixel(16, 16, 255, 0, 0, 255);
+      expectPixel(60, 32, 255, 0, 0, 255);
+      expectPixel(4, 48, 0, 0, 0, 255);
+
+      // outside of the dirty rectangle counts as off screen
+      culled = context.culledObjectCount();
+      drawFrame(root.getPtr(), 0, 32);
+      EXPECT_EQ (4u, context.culledObjectCount() - culled);
+      expectPixel(16, 16, 255, 0, 0, 255);
+      expectPixel(60, 32, 0, 0, 0, 255);
+
+      root->remove();
+    }
+
+  private:
+    pxContext mContext;
+    int mOldWidth;
+    int mOldHeight;
+};
+
+TEST_F(pxContextSWTest, pxContextSWSolidTests)
+{
+  solidRectTest();
+}
+
+TEST_F(pxContextSWTest, pxContextSWOutlineTests)
+{
+  rectOutlineTest();
+}
+
+TEST_F(pxContextSWTest, pxContextSWTextureTests)
+{
+  texturedRectTest();
+}
+
+TEST_F(pxContextSWTest, pxContextSWRepeatTests)
+{
+  repeatedTextureTest();
+}
+
+TEST_F(pxContextSWTest, pxContextSWMaskTests)
+{
+  maskTest();
+}
+
+TEST_F(pxContextSWTest, pxContextSWNineSliceTests)
+{
+  nineSliceTest();
+}
+
+TEST_F(pxContextSWTest, pxContextSWNineSliceBorderTests)
+{
+  nineSliceBorderTest();
+}
+
+#ifdef PXSCENE_FONT_ATLAS
+TEST_F(pxContextSWTest, pxContextSWGlyphTests)
+{
+  glyphQuadTest();
+}
+#endif
+
+TEST_F(pxContextSWTest, pxContextSWFramebufferTests)
+{
+  framebufferTest();
+}
+
+TEST_F(pxContextSWTest, pxContextSWBandTests)
+{
+  bandedMatchesSingleThreadTest();
+}
+
+TEST_F(pxContextSWTest, pxContextSWLayerTests)
+{
+  layerTest();
+}
+
+TEST_F(pxContextSWTest, pxContextSWCullingTests)
+{
+  cullingTest();
+}
@@ -94,3 +94,118 @@ TEST(pxFontTest, loadResourceFromArchiveFailureTest)
       delete scene;
 }
 
+
+TEST(pxFontTest, shapeTextTest)
+{
+      pxScene2d* scene = new pxScene2d();
+      rtObjectRef archive;
+      EXPECT_TRUE(RT_OK == scene->loadArchive("supportfiles/test_arc_resources.jar", archive));
+      rtRef<pxFont> font = new pxFont("", 0, "");
+      font->setUrl("XFINITYSansTTCond-Medium.ttf");
+      font->loadResourceFromArchive(scene->getArchive());
+
+      pxTextRunRef run = font->shapeText("AVA To\nab", 20);
+      EXPECT_EQ(9u, run->glyphs.size());
+      EXPECT_EQ(run.getPtr(), font->shapeText("AVA To\nab", 20).getPtr());
+      EXPECT_TRUE(run->glyphs[3].breakAfter);
+      EXPECT_FALSE(run->glyphs[4].breakAfter);
+      EXPECT_EQ(7u, run->glyphs[7].offset);
+      EXPECT_EQ(0.0f, run->glyphs[7].x);
+
+      float w = 0, h = 0;
+      font->measureTextInternal("AVA To\nab", 20, 1.0, 1.0, w, h);
+      EXPECT_EQ(run->w, w);
+      EXPECT_EQ(run->h, h);
+
+      // part of the run measures like a text of its own
+      float lineHeight = 0;
+      font->getHeight(20, lineHeight);
+      float partW = 0, partH = 0;
+      run->measure(1, 6, lineHeight, partW, partH);
+      font->measureTextInternal("VA To", 20, 1.0, 1.0, w, h);
+      EXPECT_EQ(w, partW);
+      EXPECT_EQ(h, partH);
+      delete scene;
+}
+
+#ifdef PXSCENE_FONT_ATLAS
+extern uint32_t gFrameNumber;
+
+TEST(pxFontTest, fontAtlasPagesTest)
+{
+  pxFontAtlas atlas;
+  atlas.mMaxPages = 2;
+  std::vector<uint8_t> glyph(100*100, 255);
+  GlyphTextureEntry e;
+  GlyphKey key = {1, 100, 0};
+
+  // ten glyphs and their padding on each of nine shelves fill a page
+  for (uint32_t i = 0; i < 90; i++)
+  {
+    key.mCodePoint = i;
+    EXPECT_TRUE(atlas.addGlyph(key, 100, 100, &glyph[0], e));
+  }
+  EXPECT_EQ(1u, atlas.pageCount());
+  pxTextureRef firstPage = e.t;
+  for (uint32_t i = 90; i < 180; i++)
+  {
+    key.mCodePoint = i;
+    EXPECT_TRUE(atlas.addGlyph(key, 100, 100, &glyph[0], e));
+  }
+  EXPECT_EQ(2u, atlas.pageCount());
+  pxTextureRef secondPage = e.t;
+  EXPECT_TRUE(firstPage.getPtr() != secondPage.getPtr());
+
+  // both pages are in use this frame
+  uint32_t generation = atlas.generation();
+  key.mCodePoint = 180;
+  EXPECT_FALSE(atlas.addGlyph(key, 100, 100, &glyph[0], e));
+  EXPECT_EQ(generation, atlas.generation());
+
+  // the page that wasn't drawn in the next frame is emptied for new glyphs
+  gFrameNumber++;
+  atlas.textureUsed(secondPage);
+  EXPECT_TRUE(atlas.addGlyph(key, 100, 100, &glyph[0], e));
+  EXPECT_EQ(firstPage.getPtr(), e.t.getPtr());
+  EXPECT_EQ(0.0f, e.u1);
+  EXPECT_EQ(0.0f, e.v1);
+  EXPECT_EQ(generation + 1, atlas.generation());
+
+  // too tall for a page
+  EXPECT_FALSE(atlas.addGlyph(key, 10, 200, &glyph[0], e));
+
+  atlas.clearTexture();
+  EXPECT_EQ(0u, atlas.pageCount());
+}
+
+TEST(pxFontTest, distanceFieldTest)
+{
+  // a 4x4 square with a spread of 2
+  std::vector<uint8_t> square(4*4, 255);
+  std::vector<uint8_t> field(8*8, 0);
+  pxDistanceField(&square[0], 4, 4, 2, &field[0]);
+
+  // half a texel either side of the outline
+  EXPECT_LT(field[3*8+1], 128);
+  EXPECT_GT(field[3*8+2], 128);
+  EXPECT_NEAR(255, field[3*8+1] + field[3*8+2], 1);
+  // deeper inside and further outside
+  EXPECT_GT(field[3*8+3], field[3*8+2]);
+  EXPECT_LT(field[3*8+0], field[3*8+1]);
+  EXPECT_EQ(0, field[0]);
+  // symmetric
+  EXPECT_EQ(field[3*8+2], field[2*8+3]);
+  EXPECT_EQ(field[3*8+2], field[4*8+5]);
+
+  // distance fields get pages of their own
+  pxFontAtlas atlas;
+  GlyphTextureEntry bitmapEntry, fieldEntry;
+  GlyphKey key = {1, 0, 'a'};
+  EXPECT_TRUE(atlas.addGlyph(key, 8, 8, &field[0], fieldEntry, true));
+  key.mPixelSize = 16;
+  EXPECT_TRUE(atlas.addGlyph(key, 4, 4, &square[0], bitmapEntry));
+  EXPECT_EQ(2u, atlas.pageCount());
+  EXPECT_TRUE(bitmapEntry.t.getPtr() != fieldEntry.t.getPtr());
+  atlas.clearTexture();
+}
+#endif
@@ -17,6 +17,8 @@ limitations under the License.
 */
 
 #include <sstream>
+#include <vector>
+#include <algorithm>
 
 #define _USE_MATH_DEFINES
 #include <cmath>
@@ -24,6 +26,7 @@ limitations under the License.
 #define private public
 #define protected public
 #include "pxMatrix4T.h"
+#include "pxTimer.h"
 
 #define  M_ERR  0.0001
 
@@ -274,6 +277,232 @@ class pxMatrix4Test : public testing::Test
 
       EXPECT_TRUE(  m.isIdentity() );
     }
+
+    void pxMatrix4Taffine2dTest()
+    {
+      pxMatrix4f m;
+
+      EXPECT_TRUE(  m.isAffine2D() );
+
+      // what pxObject::applyMatrix does
+      m.translate(120.0f, 40.0f);
+      m.rotateInRadians(0.5f, 0, 0, 1);
+      m.scale(2.0f, 0.5f);
+      m.translate(-10.0f, -20.0f);
+
+      EXPECT_TRUE(  m.isAffine2D() );
+
+      pxMatrix4f p;
+      p.translate(5.0f, 7.0f);
+      p.rotateInDegrees(-30);
+
+      // the 2d shortcuts give what the 4x4 versions give
+      float product[16];
+      pxMatrix4Multiply<float>(p.data(), m.data(), product);
+      pxMatrix4f pm(p);
+      pm.multiply(m);
+      EXPECT_TRUE(  pm.isAffine2D() );
+      expectNear(product, pm.data());
+
+      pxMatrix4f inverse(m), inverse4x4(m);
+      inverse.invert();
+      inverse4x4.invert4x4();
+      expectNear(inverse4x4.data(), inverse.data());
+
+      pxMatrix4f identity(m);
+      identity.multiply(inverse);
+      pxMatrix4f expected;
+      expectNear(expected.data(), identity.data());
+
+      pxVector4f v(3, 4, 5, 1);
+      pxVector4f out = m.multiply(v);
+      float transformed[4];
+      pxMatrix4Transform<float>(m.data(), &v.mX, transformed);
+      EXPECT_NEAR( transformed[0], out.x(), M_ERR );
+      EXPECT_NEAR( transformed[1], out.y(), M_ERR );
+      EXPECT_NEAR( transformed[2], out.z(), M_ERR );
+      EXPECT_NEAR( transformed[3], out.w(), M_ERR );
+
+      // and for doubles
+      pxMatrix4T<double> md;
+      md.translate(10.0, 20.0);
+      md.scale(2.0, 3.0);
+      pxVector4T<double> outd = md.multiply(pxVector4T<double>(3, 4, 5, 1));
+      EXPECT_NEAR( 16.0, outd.x(), M_ERR );
+      EXPECT_NEAR( 32.0, outd.y(), M_ERR );
+      EXPECT_NEAR( 5.0, outd.z(), M_ERR );
+      EXPECT_NEAR( 1.0, outd.w(), M_ERR );
+
+      // turning about another axis makes it 3d
+      m.rotateInRadians(0.5f, 0, 1, 0);
+
+      EXPECT_FALSE( m.isAffine2D() );
+
+      pxMatrix4Multiply<float>(p.data(), m.data(), product);
+      pxMatrix4f pm3d(p);
+      pm3d.multiply(m);
+      expectNear(product, pm3d.data());
+
+      out = m.multiply(v);
+      pxMatrix4Transform<float>(m.data(), &v.mX, transformed);
+      EXPECT_NEAR( transformed[0], out.x(), M_ERR );
+      EXPECT_NEAR( transformed[1], out.y(), M_ERR );
+      EXPECT_NEAR( transformed[2], out.z(), M_ERR );
+      EXPECT_NEAR( transformed[3], out.w(), M_ERR );
+
+      m.scale(1.0f, 1.0f, 2.0f);
+      pxMatrix4f identity3d(m), inverse3d(m);
+      inverse3d.invert();
+      identity3d.multiply(inverse3d);
+      expectNear(expected.data(), identity3d.data());
+    }
+
+    void pxMatrix4TmanyObjectsTest()
+    {
+      // matrices built like pxObject::applyMatrix builds them, composed with
+      // a parent, inverted and applied the way an update, draw and hit test do
+      const int count = 1000;
+      pxMatrix4f parent;
+      parent.translate(100.0f, 50.0f);
+      parent.rotateInDegrees(10);
+      pxVector4f corner(640, 360, 0, 1);
+      int differences = 0;
+      for (int i = 0; i < count; i++)
+      {
+        pxMatrix4f object;
+        object.translate((float)(i % 640), (float)(i % 360));
+        object.rotateInRadians((float)(i % 7), 0, 0, 1);
+        object.scale(1.0f + (i % 5) * 0.25f, 1.5f);
+        object.translate(-(float)(i % 30), -(float)(i % 20));
+
+        // the 2d shortcuts against the 4x4 versions
+        pxMatrix4f m(parent);
+        m.multiply(object);
+        float product[16];
+        pxMatrix4Multiply<float>(parent.data(), object.data(), product);
+        differences += countDifferent(product, m.data());
+
+        pxMatrix4f inverse(m), inverse4x4(m);
+        inverse.invert();
+        inverse4x4.invert4x4();
+        differences += countDifferent(inverse4x4.data(), inverse.data());
+
+        pxVector4f out = inverse.multiply(corner);
+        float transformed[4];
+        pxMatrix4Transform<float>(inverse4x4.data(), &corner.mX, transformed);
+        differences += countDifferent(transformed, &out.mX, 4);
+
+        // and the simd multiply against the scalar one once it is 3d
+        m.rotateInRadians((float)(i % 3) * 0.25f, 0, 1, 0);
+        float scalar[16], simd[16];
+        pxMatrix4Multiply<float>(m.data(), object.data(), scalar);
+        pxMatrix4Multiply(m.data(), object.data(), simd);
+        differences += countDifferent(scalar, simd);
+      }
+      EXPECT_EQ( 0, differences );
+    }
+
+    void pxMatrix4TbenchmarkTest()
+    {
+      // per object matrix work of an update, draw and hit test, on matrices
+      // built like pxObject::applyMatrix builds them
+      const int count = 1000;
+      const int iterations = 200;
+      std::vector<pxMatrix4f> objects(count);
+      for (int i = 0; i < count; i++)
+      {
+        objects[i].translate((float)(i % 640), (float)(i % 360));
+        objects[i].rotateInRadians((float)(i % 7), 0, 0, 1);
+        objects[i].scale(1.5f, 1.5f);
+      }
+      pxMatrix4f parent;
+      parent.translate(100.0f, 50.0f);
+      pxVector4f corner(640, 360, 0, 1);
+      float sum = 0, sum4x4 = 0;
+
+      double start = pxMilliseconds();
+      for (int j = 0; j < iterations; j++)
+      {
+        for (int i = 0; i < count; i++)
+        {
+          pxMatrix4f m(parent);
+          m.multiply(objects[i]);
+          pxMatrix4f inverse(m);
+          inverse.invert();
+          sum += m.multiply(corner).x() + inverse.multiply(corner).y();
+        }
+      }
+      double time = pxMilliseconds() - start;
+
+      start = pxMilliseconds();
+      for (int j = 0; j < iterations; j++)
+      {
+        for (int i = 0; i < count; i++)
+        {
+          pxMatrix4f m(parent);
+          pxMatrix4Multiply<float>(m.data(), objects[i].data(), m.data());
+          pxMatrix4f inverse(m);
+          inverse.invert4x4();
+          float out[4], inverseOut[4];
+          pxMatrix4Transform<float>(m.data(), &corner.mX, out);
+          pxMatrix4Transform<float>(inverse.data(), &corner.mX, inverseOut);
+          sum4x4 += out[0] + inverseOut[1];
+        }
+      }
+      double time4x4 = pxMilliseconds() - start;
+
+      EXPECT_NEAR( 1.0f, sum / sum4x4, M_ERR );
+      printf("pxMatrix4T: %d object transforms, 4x4 %.2f ms, 2d affine %.2f ms\n",
+             count * iterations, time4x4, time);
+
+      const int multiplies = count * iterations;
+      pxMatrix4f m3d;
+      m3d.rotateInRadians(0.5f, 0, 1, 0);
+      float scalar[16], simd[16];
+      memcpy(scalar, m3d.data(), sizeof(scalar));
+      memcpy(simd, m3d.data(), sizeof(simd));
+
+      start = pxMilliseconds();
+      for (int i = 0; i < multiplies; i++)
+      {
+        pxMatrix4Multiply<float>(scalar, m3d.data(), scalar);
+      }
+      double scalarTime = pxMilliseconds() - start;
+
+      start = pxMilliseconds();
+      for (int i = 0; i < multiplies; i++)
+      {
+        pxMatrix4Multiply(simd, m3d.data(), simd);
+      }
+      double simdTime = pxMilliseconds() - start;
+
+      expectNear(scalar, simd);
+      printf("pxMatrix4T: %d 3d multiplies, scalar %.2f ms, simd %.2f ms\n",
+             multiplies, scalarTime, simdTime);
+    }
+
+  private:
+    void expectNear(const float* expected, const float* actual)
+    {
+      for (int i = 0; i < 16; i++)
+      {
+        EXPECT_NEAR( expected[i], actual[i], M_ERR );
+      }
+    }
+
+    // the number of values further apart than M_ERR relative to their size
+    int countDifferent(const float* expected, const float* actual, int n = 16)
+    {
+      int differences = 0;
+      for (int i = 0; i < n; i++)
+      {
+        if (fabs(expected[i] - actual[i]) > M_ERR * std::max(1.0f, fabsf(expected[i])))
+        {
+          differences++;
+        }
+      }
+      return differences;
+    }
 };
 
 
@@ -293,4 +522,12 @@ TEST_F(pxMatrix4Test, pxMatrix4CompleteTest)
     pxMatrix4Trotate2Test();
     pxMatrix4TtransposeTest();
     pxMatrix4TinvertTest();
+    pxMatrix4Taffine2dTest();
+    pxMatrix4TmanyObjectsTest();
+}
+
+// only prints timings, run with --gtest_also_run_disabled_tests
+TEST_F(pxMatrix4Test, DISABLED_pxMatrix4BenchmarkTest)
+{
+    pxMatrix4TbenchmarkTest();
 }
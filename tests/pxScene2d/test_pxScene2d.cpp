@@ -38,6 +38,9 @@ extern map<string, string> gWaylandAppsMap;
 extern map<string, string> gWaylandRegistryAppsMap;
 extern map<string, string> gPxsceneWaylandAppsMap;
 extern rtScript script;
+extern bool gLayerCachingEnabled;
+extern uint32_t gLayerCachingFrames;
+extern uint32_t gFrameNumber;
 
 class pxScene2dTest : public testing::Test
 {
@@ -348,7 +351,263 @@ class pxScene2dTest : public testing::Test
 
  }
 
+  void pxObjectLayerTest()
+  {
+    rtObjectRef sceneRef = new pxScene2d();
+    pxScene2d* scene = (pxScene2d*) sceneRef.getPtr();
+    rtRef<pxObject> root = new pxObject(scene);
+    rtRef<pxObject> panel = new pxObject(scene);
+    rtRef<pxObject> child = new pxObject(scene);
+    rtRef<pxObject> grandChild = new pxObject(scene);
+    child->mx = -10;
+    child->my = 5;
+    child->mw = 40;
+    child->mh = 30;
+    grandChild->mx = 100;
+    grandChild->mw = 10;
+    grandChild->mh = 10;
+    panel->setParent(root);
+    child->setParent(panel);
+    grandChild->setParent(child);
+
+    float left = 0, top = 0, right = 0, bottom = 0;
+    uint32_t objects = 0;
+    pxMatrix4f m;
+    child->layerBounds(m, left, top, right, bottom, objects);
+    EXPECT_TRUE (2 == objects);
+    EXPECT_TRUE (-10 == left && 0 == top && 100 == right && 35 == bottom);
+
+    // children of a clipped object don't grow the layer
+    child->mClip = true;
+    left = top = right = bottom = 0;
+    objects = 0;
+    child->layerBounds(m, left, top, right, bottom, objects);
+    EXPECT_TRUE (1 == objects);
+    EXPECT_TRUE (30 == right);
+    child->mClip = false;
+
+    bool enabled = gLayerCachingEnabled;
+    gLayerCachingEnabled = true;
+    panel->repaint();
+    EXPECT_FALSE (panel->updateLayer(m));
+    EXPECT_TRUE (gFrameNumber == panel->mUnchangedSinceFrame);
+
+    // unchanged for long enough but too small to be worth a layer
+    panel->mRepaint = false;
+    gFrameNumber += gLayerCachingFrames;
+    EXPECT_FALSE (panel->updateLayer(m));
+    EXPECT_TRUE (NULL == panel->mLayerSnapshotRef.getPtr());
+    EXPECT_TRUE (gFrameNumber == panel->mUnchangedSinceFrame);
+    gLayerCachingEnabled = enabled;
+  }
+
+  void pxDirtyRegionTest()
+  {
+    pxDirtyRegion region(64);
+    std::vector<pxRect> rects;
+    region.setSize(1280, 720);
+    EXPECT_TRUE (region.isFull());
+    region.rects(rects);
+    EXPECT_TRUE (1 == rects.size());
+    EXPECT_TRUE (isRect(rects[0], 0, 0, 1280, 720));
+
+    region.clear();
+    EXPECT_TRUE (region.isEmpty());
+    region.rects(rects);
+    EXPECT_TRUE (rects.empty());
+
+    // changes in opposite corners only redraw the tiles around them
+    region.add(pxRect(10, 10, 19, 19));
+    region.add(pxRect(1270, 700, 1279, 719));
+    region.rects(rects);
+    EXPECT_TRUE (2 == rects.size());
+    EXPECT_TRUE (isRect(rects[0], 0, 0, 64, 64));
+    EXPECT_TRUE (isRect(rects[1], 1216, 640, 1280, 720));
+
+    // tiles with the same columns in neighbouring rows become one block
+    region.clear();
+    region.add(pxRect(100, 100, 200, 300));
+    region.rects(rects);
+    EXPECT_TRUE (1 == rects.size());
+    EXPECT_TRUE (isRect(rects[0], 64, 64, 256, 320));
+
+    // off screen changes are clipped away
+    region.clear();
+    region.add(pxRect(-100, -100, -1, -1));
+    region.add(pxRect(1280, 0, 1400, 100));
+    EXPECT_TRUE (region.isEmpty());
+
+    // too many rectangles are merged down to maxRects
+    for (int i = 0; i < 10; i++)
+    {
+      region.add(pxRect(i * 128, i * 64, i * 128, i * 64));
+    }
+    region.rects(rects, 4);
+    EXPECT_TRUE (4 == rects.size());
+    region.rects(rects, 1);
+    EXPECT_TRUE (1 == rects.size());
+    EXPECT_TRUE (isRect(rects[0], 0, 0, 1216, 640));
+
+    pxDirtyRegion other(64);
+    other.setSize(1280, 720);
+    other.clear();
+    other.add(region);
+    EXPECT_TRUE (10 == countTiles(other));
+    other.setSize(640, 480);
+    other.clear();
+    region.add(other);
+    EXPECT_TRUE (10 == countTiles(region));
+    other.add(region);
+    EXPECT_TRUE (other.isFull());
+  }
+
+  void pxHitTestIndexTest()
+  {
+    rtObjectRef sceneRef = new pxScene2d();
+    pxScene2d* scene = (pxScene2d*) sceneRef.getPtr();
+    rtRef<pxObject> root = new pxObject(scene);
+    rtRef<pxObject> panel = new pxObject(scene);
+    rtRef<pxObject> button = new pxObject(scene);
+    rtRef<pxObject> icon = new pxObject(scene);
+    root->mw = 1280;
+    root->mh = 720;
+    panel->mx = 100;
+    panel->my = 100;
+    panel->mw = 400;
+    panel->mh = 300;
+    panel->mr = 30;
+    button->mx = 50;
+    button->my = 50;
+    button->mw = 100;
+    button->mh = 40;
+    button->msx = 2;
+    icon->mx = 10;
+    icon->my = 10;
+    icon->mw = 20;
+    icon->mh = 20;
+    icon->mInteractive = false;
+    panel->setParent(root);
+    button->setParent(panel);
+    icon->setParent(button);
+
+    pxHitTestIndex index;
+    EXPECT_TRUE (0 == countHitTestMismatches(root, index));
+    EXPECT_TRUE (4 == index.count());
+    EXPECT_TRUE (1 == index.rebuilds());
+
+    // moving an object only updates it and its children
+    button->mx = 150;
+    index.invalidate();
+    EXPECT_TRUE (0 == countHitTestMismatches(root, index));
+    EXPECT_TRUE (1 == index.rebuilds());
+    EXPECT_TRUE (2 == index.updates());
+
+    // adding one rebuilds the index
+    rtRef<pxObject> overlay = new pxObject(scene);
+    overlay->mw = 1280;
+    overlay->mh = 100;
+    overlay->setParent(root);
+    index.invalidate();
+    EXPECT_TRUE (0 == countHitTestMismatches(root, index));
+    EXPECT_TRUE (2 == index.rebuilds());
+
+    // without being invalidated the index isn't compared with the tree
+    overlay->mh = 720;
+    rtRef<pxObject> hit;
+    pxPoint2f pt(640, 600), hitPt;
+    EXPECT_FALSE (index.hitTest(root, pt, hit, hitPt) && hit == overlay);
+    index.invalidate();
+    EXPECT_TRUE (index.hitTest(root, pt, hit, hitPt) && hit == overlay);
+  }
+
+  void pxHitTestIndexLargeSceneTest()
+  {
+    rtObjectRef sceneRef = new pxScene2d();
+    pxScene2d* scene = (pxScene2d*) sceneRef.getPtr();
+    rtRef<pxObject> root = new pxObject(scene);
+    root->mw = 1280;
+    root->mh = 720;
+    // a grid of 500 tiles with 9 children each, some of them turned
+    std::vector<rtRef<pxObject> > tiles;
+    for (int i = 0; i < 500; i++)
+    {
+      rtRef<pxObject> tile = new pxObject(scene);
+      tile->mx = static_cast<float>((i % 25) * 50);
+      tile->my = static_cast<float>((i / 25) * 36);
+      tile->mw = 48;
+      tile->mh = 34;
+      tile->mr = (i % 7 == 3) ? 15.0f : 0.0f;
+      tile->setParent(root);
+      tiles.push_back(tile);
+      for (int j = 0; j < 9; j++)
+      {
+        rtRef<pxObject> child = new pxObject(scene);
+        child->mx = static_cast<float>((j % 3) * 16);
+        child->my = static_cast<float>((j / 3) * 11);
+        child->mw = 15;
+        child->mh = 10;
+        child->mInteractive = (j != 4);
+        child->setParent(tile);
+      }
+    }
+
+    pxHitTestIndex index;
+    EXPECT_TRUE (0 == countHitTestMismatches(root, index, 13));
+    EXPECT_TRUE (5001 == index.count());
+
+    // tiles moved over their neighbours are found where they went, without
+    // rebuilding the index
+    for (int i = 0; i < 500; i += 23)
+    {
+      tiles[i]->mx += 30;
+      tiles[i]->my += 20;
+    }
+    index.invalidate();
+    EXPECT_TRUE (0 == countHitTestMismatches(root, index, 13));
+    EXPECT_TRUE (1 == index.rebuilds());
+    EXPECT_TRUE (22 * 10 == index.updates());
+  }
+
   private:
+    int countHitTestMismatches(rtRef<pxObject> root, pxHitTestIndex& index, int step = 7)
+    {
+      int mismatches = 0;
+      for (int y = -20; y < 740; y += step)
+      {
+        for (int x = -20; x < 1300; x += step)
+        {
+          pxMatrix4f m;
+          pxPoint2f pt(static_cast<float>(x), static_cast<float>(y)), hitPt, indexHitPt;
+          rtRef<pxObject> hit, indexHit;
+          bool found = root->hitTestInternal(m, pt, hit, hitPt);
+          bool indexFound = index.hitTest(root, pt, indexHit, indexHitPt);
+          if (found != indexFound || hit.getPtr() != indexHit.getPtr() ||
+              (found && (hitPt.x != indexHitPt.x || hitPt.y != indexHitPt.y)))
+          {
+            mismatches++;
+          }
+        }
+      }
+      return mismatches;
+    }
+
+    bool isRect(const pxRect& r, int32_t left, int32_t top, int32_t right, int32_t bottom)
+    {
+      return r.left() == left && r.top() == top && r.right() == right && r.bottom() == bottom;
+    }
+
+    size_t countTiles(const pxDirtyRegion& region)
+    {
+      std::vector<pxRect> rects;
+      region.rects(rects, 0);
+      size_t tiles = 0;
+      for (size_t i = 0; i < rects.size(); i++)
+      {
+        tiles += (rects[i].width() / 64) * (rects[i].height() / 64);
+      }
+      return tiles;
+    }
+
     pxObject*     mRoot;
     pxScriptView* mView;
     rtString      mUrl;
@@ -367,4 +626,8 @@ TEST_F(pxScene2dTest, pxScene2dTests)
     pxScene2dClassTest();
     //pxScene2dHdrTest();
     pxScriptViewTest();
+    pxObjectLayerTest();
+    pxDirtyRegionTest();
+    pxHitTestIndexTest();
+    pxHitTestIndexLargeSceneTest();
 }
@@ -34,6 +34,8 @@ limitations under the License.
 #include <pxCore.h>
 #include <dlfcn.h>
 #include <png.h>
+#include <setjmp.h>
+#include <jpeglib.h>
 
 #include "test_includes.h" // Needs to be included last
 
@@ -381,6 +383,392 @@ class pxUtilTest : public testing::Test
       EXPECT_TRUE (ret == false);
     }
 
+    // feeds the image in small pieces the way a slow download would
+    bool decodeProgressively(rtData& d, pxProgressiveImageDecoder& decoder, size_t chunkSize, int& partialImages)
+    {
+      partialImages = 0;
+      for (size_t offset = 0; offset < d.length(); offset += chunkSize)
+      {
+        size_t size = (d.length() - offset < chunkSize) ? d.length() - offset : chunkSize;
+        if (decoder.write((const char*)d.data() + offset, size) != RT_OK)
+        {
+          return false;
+        }
+        if (decoder.hasPartialImage())
+        {
+          pxOffscreen partial;
+          EXPECT_EQ(RT_OK, decoder.partialImage(partial));
+          partialImages++;
+        }
+      }
+      return decoder.finish() == RT_OK;
+    }
+
+    bool sameImage(pxOffscreen& a, pxOffscreen& b)
+    {
+      if (a.width() != b.width() || a.height() != b.height())
+      {
+        return false;
+      }
+      for (int y = 0; y < a.height(); y++)
+      {
+        if (memcmp(a.scanline(y), b.scanline(y), a.width() * sizeof(pxPixel)) != 0)
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    void pxProgressiveImageDecoderPngTest()
+    {
+      rtData d;
+      EXPECT_EQ(RT_OK, rtLoadFile("supportfiles/status_bg.png", d));
+      pxOffscreen expected;
+      EXPECT_EQ(RT_OK, pxLoadImage((const char*)d.data(), d.length(), expected));
+
+      pxProgressiveImageDecoder decoder;
+      int partialImages = 0;
+      EXPECT_TRUE(decodeProgressively(d, decoder, 997, partialImages));
+      EXPECT_TRUE(decoder.isComplete());
+      EXPECT_EQ(d.length(), decoder.bytesWritten());
+      EXPECT_TRUE(partialImages > 1);
+      EXPECT_TRUE(sameImage(expected, decoder.image()));
+    }
+
+    void pxProgressiveImageDecoderJpgTest()
+    {
+      rtData d;
+      EXPECT_EQ(RT_OK, rtLoadFile("sampleimage.jpeg", d));
+      pxOffscreen expected;
+      EXPECT_EQ(RT_OK, pxLoadJPGImage((const char*)d.data(), d.length(), expected));
+
+      pxProgressiveImageDecoder decoder;
+      int partialImages = 0;
+      EXPECT_TRUE(decodeProgressively(d, decoder, 512, partialImages));
+      EXPECT_TRUE(partialImages > 1);
+      EXPECT_TRUE(sameImage(expected, decoder.image()));
+    }
+
+    void storeProgressiveJPG(rtData& d, int width, int height)
+    {
+      struct jpeg_compress_struct cinfo;
+      struct jpeg_error_mgr jerr;
+      cinfo.err = jpeg_std_error(&jerr);
+      jpeg_create_compress(&cinfo);
+      unsigned char* buffer = NULL;
+      unsigned long bufferSize = 0;
+      jpeg_mem_dest(&cinfo, &buffer, &bufferSize);
+      cinfo.image_width = width;
+      cinfo.image_height = height;
+      cinfo.input_components = 3;
+      cinfo.in_color_space = JCS_RGB;
+      jpeg_set_defaults(&cinfo);
+      jpeg_simple_progression(&cinfo);
+      jpeg_start_compress(&cinfo, TRUE);
+      vector<JSAMPLE> row(width * 3);
+      while (cinfo.next_scanline < cinfo.image_height)
+      {
+        for (int x = 0; x < width; x++)
+        {
+          row[x * 3] = (JSAMPLE)(x * 255 / width);
+          row[x * 3 + 1] = (JSAMPLE)(cinfo.next_scanline * 255 / height);
+          row[x * 3 + 2] = (JSAMPLE)((x ^ cinfo.next_scanline) & 0xff);
+        }
+        JSAMPROW rowPointer = &row[0];
+        jpeg_write_scanlines(&cinfo, &rowPointer, 1);
+      }
+      jpeg_finish_compress(&cinfo);
+      d.init(buffer, bufferSize);
+      jpeg_destroy_compress(&cinfo);
+      free(buffer);
+    }
+
+    void pxProgressiveImageDecoderLowResFirstTest()
+    {
+      rtData d;
+      storeProgressiveJPG(d, 256, 192);
+      pxOffscreen expected;
+      EXPECT_EQ(RT_OK, pxLoadJPGImage((const char*)d.data(), d.length(), expected));
+
+      // without low-res-first a progressive image only shows up once complete
+      pxProgressiveImageDecoder decoder;
+      int partialImages = 0;
+      EXPECT_TRUE(decodeProgressively(d, decoder, 256, partialImages));
+      EXPECT_TRUE(partialImages <= 1);
+      EXPECT_TRUE(sameImage(expected, decoder.image()));
+
+      pxProgressiveImageDecoder lowResFirstDecoder(true);
+      EXPECT_TRUE(decodeProgressively(d, lowResFirstDecoder, 256, partialImages));
+      EXPECT_TRUE(partialImages > 1);
+      EXPECT_TRUE(sameImage(expected, lowResFirstDecoder.image()));
+    }
+
+    void pxProgressiveImageDecoderFailureTest()
+    {
+      pxProgressiveImageDecoder decoder;
+      const char* data = "<svg xmlns='http://www.w3.org/2000/svg'></svg>";
+      EXPECT_EQ(RT_FAIL, decoder.write(data, strlen(data)));
+      EXPECT_TRUE(decoder.hasFailed());
+      EXPECT_EQ(RT_FAIL, decoder.finish());
+
+      // a truncated image is never reported as complete
+      rtData d;
+      EXPECT_EQ(RT_OK, rtLoadFile("supportfiles/status_bg.png", d));
+      pxProgressiveImageDecoder truncatedDecoder;
+      EXPECT_EQ(RT_OK, truncatedDecoder.write((const char*)d.data(), d.length() / 2));
+      EXPECT_FALSE(truncatedDecoder.isComplete());
+      EXPECT_EQ(RT_FAIL, truncatedDecoder.finish());
+    }
+
+    void pxImageTargetSizeTest()
+    {
+      int32_t w = 0, h = 0;
+      pxImageTargetSize(1000, 500, 200, 200, 1.0f, 1.0f, w, h);
+      EXPECT_EQ(200, w);
+      EXPECT_EQ(100, h);
+
+      // a scale takes precedence over dimensions
+      pxImageTargetSize(1000, 500, 200, 200, 0.5f, 0.25f, w, h);
+      EXPECT_EQ(500, w);
+      EXPECT_EQ(125, h);
+
+      // raster images are never enlarged
+      pxImageTargetSize(1000, 500, 4000, 4000, 1.0f, 1.0f, w, h);
+      EXPECT_EQ(1000, w);
+      EXPECT_EQ(500, h);
+      pxImageTargetSize(1000, 500, 0, 0, 0.0f, 0.0f, w, h);
+      EXPECT_EQ(1000, w);
+      EXPECT_EQ(500, h);
+    }
+
+    void pxBoxDownscaleImageTest()
+    {
+      // 9x3 so the 2x2 pass covers whole blocks, a partial column and a partial row
+      pxOffscreen o;
+      o.init(9, 3);
+      for (int y = 0; y < o.height(); y++)
+      {
+        for (int x = 0; x < o.width(); x++)
+        {
+          pxPixel* p = o.pixel(x, y);
+          p->r = x * 20;
+          p->g = y * 50;
+          p->b = (x + y) * 10;
+          p->a = 255;
+        }
+      }
+
+      pxOffscreen scaled;
+      EXPECT_EQ(RT_OK, pxBoxDownscaleImage(o, scaled, 2, 2));
+      EXPECT_EQ(5, scaled.width());
+      EXPECT_EQ(2, scaled.height());
+      for (int y = 0; y < scaled.height(); y++)
+      {
+        int rows = (y == 1) ? 1 : 2;
+        for (int x = 0; x < scaled.width(); x++)
+        {
+          int columns = (x == 4) ? 1 : 2;
+          int r = 0, g = 0, b = 0;
+          for (int j = 0; j < rows; j++)
+          {
+            for (int i = 0; i < columns; i++)
+            {
+              r += (x * 2 + i) * 20;
+              g += (y * 2 + j) * 50;
+              b += (x * 2 + i + y * 2 + j) * 10;
+            }
+          }
+          int count = rows * columns;
+          pxPixel* p = scaled.pixel(x, y);
+          EXPECT_EQ((r + count / 2) / count, p->r);
+          EXPECT_EQ((g + count / 2) / count, p->g);
+          EXPECT_EQ((b + count / 2) / count, p->b);
+          EXPECT_EQ(255, p->a);
+        }
+      }
+
+      EXPECT_EQ(RT_FAIL, pxBoxDownscaleImage(o, scaled, 0, 2));
+    }
+
+    void pxLoadImageDownscaleTest()
+    {
+      rtData d;
+      EXPECT_EQ(RT_OK, rtLoadFile("supportfiles/status_bg.png", d));
+      pxOffscreen full;
+      EXPECT_EQ(RT_OK, pxLoadImage((const char*)d.data(), d.length(), full));
+
+      pxOffscreen png;
+      EXPECT_EQ(RT_OK, pxLoadImage((const char*)d.data(), d.length(), png, 0, 0, 0.5f, 0.5f));
+      EXPECT_EQ((full.width() + 1) / 2, png.width());
+      EXPECT_EQ((full.height() + 1) / 2, png.height());
+
+      rtData jpg;
+      storeProgressiveJPG(jpg, 256, 192);
+      pxOffscreen jpgImage;
+      EXPECT_EQ(RT_OK, pxLoadJPGImage((const char*)jpg.data(), jpg.length(), jpgImage, 64, 64));
+      EXPECT_EQ(64, jpgImage.width());
+      EXPECT_EQ(48, jpgImage.height());
+
+      // the IDCT gets to 1/8, the box filter halves the rest
+      EXPECT_EQ(RT_OK, pxLoadJPGImage((const char*)jpg.data(), jpg.length(), jpgImage, 0, 0, 0.06f, 0.06f));
+      EXPECT_EQ(16, jpgImage.width());
+      EXPECT_EQ(12, jpgImage.height());
+
+      pxProgressiveImageDecoder decoder(false, 64, 64);
+      int partialImages = 0;
+      EXPECT_TRUE(decodeProgressively(jpg, decoder, 256, partialImages));
+      EXPECT_EQ(64, decoder.image().width());
+      EXPECT_EQ(48, decoder.image().height());
+
+      pxProgressiveImageDecoder pngDecoder(false, 0, 0, 0.5f, 0.5f);
+      EXPECT_TRUE(decodeProgressively(d, pngDecoder, 997, partialImages));
+      EXPECT_TRUE(sameImage(png, pngDecoder.image()));
+    }
+
+    // every channel within tolerance of the other image's
+    bool similarImage(pxBuffer& a, pxBuffer& b, int tolerance)
+    {
+      if (a.width() != b.width() || a.height() != b.height())
+      {
+        return false;
+      }
+      for (int y = 0; y < a.height(); y++)
+      {
+        const uint8_t* p = (const uint8_t*)a.scanline(y);
+        const uint8_t* q = (const uint8_t*)b.scanline(y);
+        for (int i = 0; i < a.width() * 4; i++)
+        {
+          if (abs(p[i] - q[i]) > tolerance)
+          {
+            return false;
+          }
+        }
+      }
+      return true;
+    }
+
+    void pxResampleImageTest()
+    {
+      pxOffscreen src;
+      src.init(2048, 1024);
+      for (int y = 0; y < src.height(); y++)
+      {
+        pxPixel* p = src.scanline(y);
+        for (int x = 0; x < src.width(); x++)
+        {
+          p[x].r = (x * 3) & 0xff;
+          p[x].g = (y * 5) & 0xff;
+          p[x].b = ((x + y) & 8) ? 255 : 0;
+          p[x].a = 255 - (x & 0x7f);
+        }
+      }
+
+      // a whole factor averages the same pixels as the box filter, this one
+      // is large enough to be split across threads
+      pxOffscreen box;
+      EXPECT_EQ(RT_OK, pxBoxDownscaleImage(src, box, 4, 4));
+      pxOffscreen area;
+      area.init(512, 256);
+      EXPECT_EQ(RT_OK, pxResampleImage(src, area, PX_RESAMPLE_AREA));
+      EXPECT_TRUE(similarImage(box, area, 1));
+
+      // flipped destinations, as used for textures, hold the same image
+      pxOffscreen flipped;
+      flipped.init(512, 256);
+      flipped.setUpsideDown(true);
+      EXPECT_EQ(RT_OK, pxResampleImage(src, flipped, PX_RESAMPLE_AREA));
+      EXPECT_TRUE(similarImage(area, flipped, 0));
+
+      // a flat color stays flat at any size with either filter
+      pxOffscreen flat;
+      flat.init(37, 23);
+      flat.fill(pxColor(10, 200, 30, 128));
+      int sizes[][2] = { {5, 3}, {36, 22}, {37, 23}, {80, 41} };
+      for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+      {
+        for (int filter = PX_RESAMPLE_AREA; filter <= PX_RESAMPLE_BILINEAR; filter++)
+        {
+          pxOffscreen expected;
+          expected.init(sizes[i][0], sizes[i][1]);
+          expected.fill(pxColor(10, 200, 30, 128));
+          pxOffscreen scaled;
+          scaled.init(sizes[i][0], sizes[i][1]);
+          EXPECT_EQ(RT_OK, pxResampleImage(flat, scaled, (pxResampleFilter)filter));
+          EXPECT_TRUE(similarImage(expected, scaled, 0));
+        }
+      }
+
+      pxOffscreen empty;
+      EXPECT_TRUE(pxResampleImage(empty, area) != RT_OK);
+    }
+
+    void pxTimedOffscreenSequenceTest()
+    {
+      // a small sprite moving over a noisy background
+      vector<pxOffscreen*> frames;
+      for (int i = 0; i < 8; i++)
+      {
+        pxOffscreen* o = new pxOffscreen();
+        o->init(160, 120);
+        for (int y = 0; y < o->height(); y++)
+        {
+          pxPixel* p = o->scanline(y);
+          for (int x = 0; x < o->width(); x++)
+          {
+            p[x].r = (x * 7 + y * 13) & 0xff;
+            p[x].g = (x * y) & 0xff;
+            p[x].b = (x ^ y) & 0xff;
+            p[x].a = 255;
+          }
+        }
+        for (int y = 40; y < 60; y++)
+        {
+          for (int x = i * 10; x < i * 10 + 20; x++)
+          {
+            o->scanline(y)[x].u = 0xff0000ff;
+          }
+        }
+        frames.push_back(o);
+      }
+
+      pxTimedOffscreenSequence s;
+      s.init();
+      for (size_t i = 0; i < frames.size(); i++)
+      {
+        s.addBuffer(*frames[i], 0.1);
+      }
+      s.finish();
+      EXPECT_EQ((uint32_t)frames.size(), s.numFrames());
+      EXPECT_EQ(160, s.width());
+      EXPECT_EQ(120, s.height());
+      EXPECT_TRUE(s.sizeInBytes() < frames.size() * 160 * 120 * 4 / 4);
+
+      pxOffscreen o;
+      pxRect r;
+      for (uint32_t i = 0; i < frames.size(); i++)
+      {
+        EXPECT_EQ(RT_OK, s.applyFrame(i, o, r));
+        EXPECT_TRUE(sameImage(*frames[i], o));
+        if (i > 0)
+        {
+          // only the area the sprite moved over changes
+          EXPECT_EQ(30, r.width());
+          EXPECT_EQ(20, r.height());
+        }
+      }
+
+      pxOffscreen frame;
+      EXPECT_EQ(RT_OK, s.getFrame(5, frame));
+      EXPECT_TRUE(sameImage(*frames[5], frame));
+      EXPECT_TRUE(s.getFrame(8, frame) != RT_OK);
+
+      for (size_t i = 0; i < frames.size(); i++)
+      {
+        delete frames[i];
+      }
+    }
+
     private:
       pxOffscreen mSvgData;
       pxOffscreen mPngData;
@@ -437,4 +825,15 @@ TEST_F(pxUtilTest, pxutilsTest)
 
     pxIsPngImageTest();
     pxIsJpgImageTest();
+
+    pxProgressiveImageDecoderPngTest();
+    pxProgressiveImageDecoderJpgTest();
+    pxProgressiveImageDecoderLowResFirstTest();
+    pxProgressiveImageDecoderFailureTest();
+
+    pxImageTargetSizeTest();
+    pxBoxDownscaleImageTest();
+    pxLoadImageDownscaleTest();
+    pxTimedOffscreenSequenceTest();
+    pxResampleImageTest();
 };
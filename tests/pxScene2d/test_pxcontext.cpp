@@ -185,6 +185,38 @@ class pxContextTest : public testing::Test
     void isObjectOnScreenTest()
     {
       EXPECT_TRUE (mContext.isObjectOnScreen(0,0,0,0) == true);
+
+      mContext.enableDirtyRectangles(false);
+      mContext.setSize(1280,720);
+      EXPECT_TRUE (mContext.isObjectOnScreen(100,100,200,200) == true);
+      EXPECT_TRUE (mContext.isObjectOnScreen(-50,-50,100,100) == true);
+      EXPECT_TRUE (mContext.isObjectOnScreen(1300,100,200,40) == false);
+      EXPECT_TRUE (mContext.isObjectOnScreen(0,-300,100,100) == false);
+      EXPECT_TRUE (mContext.isObjectOnScreen(2000,100,100,100) == false);
+
+      // rotated back onto the screen
+      mContext.pushState();
+      pxMatrix4f m;
+      m.translate(1300,100);
+      m.rotateInDegrees(180);
+      mContext.setMatrix(m);
+      EXPECT_TRUE (mContext.isObjectOnScreen(0,0,200,40) == true);
+      mContext.popState();
+
+      // scaled back onto the screen
+      mContext.pushState();
+      pxMatrix4f scaled;
+      scaled.scale(0.5,0.5);
+      mContext.setMatrix(scaled);
+      EXPECT_TRUE (mContext.isObjectOnScreen(2000,100,100,100) == true);
+      mContext.popState();
+
+      // only the dirty rectangle is drawn to
+      mContext.clear(0,0,100,100);
+      EXPECT_TRUE (mContext.isObjectOnScreen(50,50,10,10) == true);
+      EXPECT_TRUE (mContext.isObjectOnScreen(500,500,50,50) == false);
+      mContext.enableDirtyRectangles(false);
+      EXPECT_TRUE (mContext.isObjectOnScreen(500,500,50,50) == true);
     }
 
     void textureMemoryOverflowTrueTest()
@@ -307,6 +339,34 @@ class pxContextTest : public testing::Test
       mContext.drawRect(1024,720,10,fillColor,lineColor);
     }
 
+    void drawBatchTest()
+    {
+      float fillColor[4] = {0.2f,0.4f,0.8f,0.5f};
+      bool drawBatchingEnabled = mContext.isDrawBatchingEnabled();
+      pxOffscreen offscreens[2];
+      for (int i = 0; i < 2; i++)
+      {
+        mContext.enableDrawBatching(i == 0);
+        mContext.clear(0, 0);
+        for (int row = 0; row < 50; row++)
+        {
+          mContext.pushState();
+          pxMatrix4f m;
+          m.translate(3.5f, row*2.25f);
+          m.rotateInDegrees(row*0.5f);
+          mContext.setMatrix(m);
+          mContext.drawRect(200, 1.5f, 0, fillColor, NULL);
+          mContext.popState();
+        }
+        mContext.snapshot(offscreens[i]);
+      }
+      mContext.enableDrawBatching(drawBatchingEnabled);
+      ASSERT_TRUE (offscreens[0].width() == offscreens[1].width());
+      ASSERT_TRUE (offscreens[0].height() == offscreens[1].height());
+      EXPECT_TRUE (memcmp(offscreens[0].base(), offscreens[1].base(),
+                          offscreens[0].width()*offscreens[0].height()*4) == 0);
+    }
+
     void drawDiagLineTest()
     {
       mContext.setShowOutlines(true);
@@ -386,6 +446,7 @@ TEST_F(pxContextTest, pxContextTests)
   mapToScreenCoordinatesInMatrixZeroWidthTest();
   drawDiagRectSuccessTest();
   drawRectTest();
+  drawBatchTest();
   drawDiagLineTest();
   drawImage9Test();
   drawImageTextureDimDefault();
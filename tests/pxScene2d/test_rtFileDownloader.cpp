@@ -0,0 +1,381 @@
+/*
+
+pxCore Copyright 2005-2018 John Robinson
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+
+#define private public
+#define protected public
+
+#include "rtFileDownloader.h"
+#include "rtThreadPool.h"
+#include "rtAtomic.h"
+#include "pxTimer.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "test_includes.h" // Needs to be included last
+
+using namespace std;
+
+// Minimal HTTP/1.1 stand-in that answers every GET with a body derived from
+// the path.  Paths starting with /slow are answered after a delay and paths
+// starting with /large carry a multi-megabyte body.
+class rtTestHttpServer
+{
+public:
+  rtTestHttpServer() : mSocket(-1), mPort(0), mRunning(0), mAcceptThread(NULL), mConnectionThreads() {}
+
+  bool start()
+  {
+    mSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (mSocket < 0)
+      return false;
+    int reuse = 1;
+    setsockopt(mSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    if (bind(mSocket, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(mSocket, 1024) != 0)
+      return false;
+    socklen_t length = sizeof(address);
+    getsockname(mSocket, (struct sockaddr*)&address, &length);
+    mPort = ntohs(address.sin_port);
+    mRunning = 1;
+    mAcceptThread = new thread(&rtTestHttpServer::acceptConnections, this);
+    return true;
+  }
+
+  void stop()
+  {
+    mRunning = 0;
+    if (mAcceptThread)
+    {
+      mAcceptThread->join();
+      delete mAcceptThread;
+      mAcceptThread = NULL;
+    }
+    for (size_t i = 0; i < mConnectionThreads.size(); i++)
+    {
+      mConnectionThreads[i]->join();
+      delete mConnectionThreads[i];
+    }
+    mConnectionThreads.clear();
+    if (mSocket >= 0)
+      close(mSocket);
+    mSocket = -1;
+  }
+
+  string url(const char* path) const
+  {
+    stringstream s;
+    s << "http://127.0.0.1:" << mPort << path;
+    return s.str();
+  }
+
+  static string bodyForPath(const string& path)
+  {
+    if (path.compare(0, 6, "/large") == 0)
+      return string(4 * 1024 * 1024, 'x') + path;
+    return "payload for " + path;
+  }
+
+private:
+  void acceptConnections()
+  {
+    while (mRunning)
+    {
+      struct pollfd listenFd;
+      listenFd.fd = mSocket;
+      listenFd.events = POLLIN;
+      listenFd.revents = 0;
+      if (poll(&listenFd, 1, 50) <= 0)
+        continue;
+      int connection = accept(mSocket, NULL, NULL);
+      if (connection >= 0)
+        mConnectionThreads.push_back(new thread(&rtTestHttpServer::serveConnection, this, connection));
+    }
+  }
+
+  void serveConnection(int connection)
+  {
+    string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == string::npos)
+    {
+      ssize_t bytesRead = read(connection, buffer, sizeof(buffer));
+      if (bytesRead <= 0)
+      {
+        close(connection);
+        return;
+      }
+      request.append(buffer, bytesRead);
+    }
+    size_t pathStart = request.find(' ') + 1;
+    string path = request.substr(pathStart, request.find(' ', pathStart) - pathStart);
+    if (path.compare(0, 5, "/slow") == 0)
+      pxSleepMS(1000);
+    string body = bodyForPath(path);
+    stringstream response;
+    response << "HTTP/1.1 200 OK\r\nContent-Length: " << body.size() << "\r\n";
+    if (path.compare(0, 7, "/cached") == 0)
+      response << "Cache-Control: max-age=3600\r\n";
+    response << "Connection: close\r\n\r\n" << body;
+    string responseData = response.str();
+    ssize_t bytesWritten = send(connection, responseData.c_str(), responseData.size(), MSG_NOSIGNAL);
+    UNUSED_PARAM(bytesWritten);
+    close(connection);
+  }
+
+  int mSocket;
+  int mPort;
+  rtAtomic mRunning;
+  thread* mAcceptThread;
+  vector<thread*> mConnectionThreads;
+};
+
+static rtAtomic gCompletedDownloads = 0;
+static rtAtomic gValidDownloads = 0;
+static rtAtomic gPoolTaskExecuted = 0;
+static rtAtomic gSingleCopyDownloads = 0;
+
+static void downloadCallback(rtFileDownloadRequest* request)
+{
+  string url = request->fileUrl().cString();
+  string expected = rtTestHttpServer::bodyForPath(url.substr(url.find('/', strlen("http://"))));
+  if (request->downloadStatusCode() == 0 && request->httpStatusCode() == 200 &&
+      request->downloadedDataSize() == expected.size() &&
+      memcmp(request->downloadedData(), expected.c_str(), expected.size()) == 0)
+  {
+    rtAtomicInc(&gValidDownloads);
+    rtValue bytesCopied;
+    request->downloadMetrics().get("bytesCopied", bytesCopied);
+    if (bytesCopied.toUInt64() == expected.size())
+      rtAtomicInc(&gSingleCopyDownloads);
+  }
+  rtAtomicInc(&gCompletedDownloads);
+}
+
+static rtAtomic gCachedDownloads = 0;
+static vector<string> gTakenBodies;
+
+// takes the body like pxFont and pxArchive do
+static void takingDownloadCallback(rtFileDownloadRequest* request)
+{
+  char* data = NULL;
+  size_t size = 0;
+  request->takeDownloadedData(data, size);
+  if (request->isDataCached())
+    rtAtomicInc(&gCachedDownloads);
+  if (data != NULL)
+  {
+    gTakenBodies.push_back(string(data, size));
+    delete [] data;
+  }
+  rtAtomicInc(&gCompletedDownloads);
+}
+
+static void poolTask(void* /*data*/)
+{
+  rtAtomicInc(&gPoolTaskExecuted);
+}
+
+static bool waitForValue(rtAtomic* value, int expected, double timeoutInSeconds)
+{
+  double start = pxSeconds();
+  while (*value < expected && (pxSeconds() - start) < timeoutInSeconds)
+  {
+    pxSleepMS(5);
+  }
+  return *value >= expected;
+}
+
+class rtFileDownloaderTest : public testing::Test
+{
+public:
+  virtual void SetUp()
+  {
+    ASSERT_TRUE(mServer.start());
+  }
+
+  virtual void TearDown()
+  {
+    mServer.stop();
+  }
+
+  void resetCounters()
+  {
+    gCompletedDownloads = 0;
+    gValidDownloads = 0;
+    gPoolTaskExecuted = 0;
+    gSingleCopyDownloads = 0;
+  }
+
+  rtFileDownloadRequest* newRequest(const char* path)
+  {
+    string url = mServer.url(path);
+    rtFileDownloadRequest* request = new rtFileDownloadRequest(url.c_str(), this, downloadCallback);
+    request->setCacheEnabled(false);
+    return request;
+  }
+
+  void concurrentDownloadsTest()
+  {
+    resetCounters();
+    const int numberOfDownloads = 1000;
+    for (int i = 0; i < numberOfDownloads; i++)
+    {
+      stringstream path;
+      path << "/image" << i << ".png";
+      rtFileDownloader::instance()->addToDownloadQueue(newRequest(path.str().c_str()));
+    }
+    EXPECT_TRUE(waitForValue(&gCompletedDownloads, numberOfDownloads, 60.0));
+    EXPECT_EQ(numberOfDownloads, gValidDownloads);
+  }
+
+  void slowDownloadsDoNotPinThreadPoolTest()
+  {
+    resetCounters();
+    const int numberOfDownloads = rtThreadPool::globalInstance()->numberOfThreadsInPool() * 2;
+    for (int i = 0; i < numberOfDownloads; i++)
+    {
+      stringstream path;
+      path << "/slow" << i;
+      rtFileDownloader::instance()->addToDownloadQueue(newRequest(path.str().c_str()));
+    }
+    pxSleepMS(100);
+    // every download is still waiting on the server, the pool must stay free
+    EXPECT_EQ(0, gCompletedDownloads);
+    rtThreadPool::globalInstance()->executeTask(new rtThreadTask(poolTask, NULL, "", RT_THREAD_TASK_PRIORITY_VISIBLE));
+    EXPECT_TRUE(waitForValue(&gPoolTaskExecuted, 1, 0.5));
+    EXPECT_TRUE(waitForValue(&gCompletedDownloads, numberOfDownloads, 30.0));
+    EXPECT_EQ(numberOfDownloads, gValidDownloads);
+  }
+
+  void cancelPendingDownloadTest()
+  {
+    resetCounters();
+    rtFileDownloadRequest* request = newRequest("/slow-canceled");
+    rtFileDownloader::instance()->addToDownloadQueue(request);
+    rtFileDownloader::cancelDownloadRequestThreadSafe(request, this);
+    EXPECT_TRUE(waitForValue(&gCompletedDownloads, 1, 5.0));
+    EXPECT_EQ(0, gValidDownloads);
+  }
+
+  void stopWithUnfinishedDownloadsTest()
+  {
+    resetCounters();
+    const int numberOfDownloads = rtFileDownloader::instance()->mMaxActiveTransfers + 4;
+    for (int i = 0; i < numberOfDownloads; i++)
+    {
+      stringstream path;
+      path << "/slow-stopped" << i;
+      rtFileDownloader::instance()->addToDownloadQueue(newRequest(path.str().c_str()));
+    }
+    pxSleepMS(200);
+    EXPECT_EQ(0, gCompletedDownloads);
+    // the active and the still queued transfers are all completed as canceled
+    rtFileDownloader::instance()->stopDownloadLoop();
+    EXPECT_EQ(numberOfDownloads, gCompletedDownloads);
+    EXPECT_EQ(0, gValidDownloads);
+    EXPECT_TRUE(rtFileDownloader::instance()->mDownloadRequestVector->empty());
+
+    // the next download starts the loop again
+    resetCounters();
+    rtFileDownloader::instance()->addToDownloadQueue(newRequest("/after-stop"));
+    EXPECT_TRUE(waitForValue(&gCompletedDownloads, 1, 10.0));
+    EXPECT_EQ(1, gValidDownloads);
+  }
+
+  void largeDownloadCopiedOnceTest()
+  {
+    resetCounters();
+    const int numberOfDownloads = 4;
+    for (int i = 0; i < numberOfDownloads; i++)
+    {
+      stringstream path;
+      path << "/large" << i;
+      rtFileDownloader::instance()->addToDownloadQueue(newRequest(path.str().c_str()));
+    }
+    EXPECT_TRUE(waitForValue(&gCompletedDownloads, numberOfDownloads, 30.0));
+    EXPECT_EQ(numberOfDownloads, gValidDownloads);
+    // the body is sized from Content-Length, so every byte is copied exactly once
+    EXPECT_EQ(numberOfDownloads, gSingleCopyDownloads);
+  }
+
+  void cachedDownloadTakenTest()
+  {
+#ifdef ENABLE_HTTP_CACHE
+    resetCounters();
+    gCachedDownloads = 0;
+    gTakenBodies.clear();
+    string url = mServer.url("/cached-font.ttf");
+    for (int i = 0; i < 2; i++)
+    {
+      // the second one is answered from the cache
+      rtFileDownloadRequest* request = new rtFileDownloadRequest(url.c_str(), this, takingDownloadCallback);
+      rtFileDownloader::instance()->addToDownloadQueue(request);
+      EXPECT_TRUE(waitForValue(&gCompletedDownloads, i + 1, 10.0));
+    }
+    EXPECT_EQ(1, gCachedDownloads);
+    ASSERT_EQ((size_t)2, gTakenBodies.size());
+    EXPECT_EQ(rtTestHttpServer::bodyForPath("/cached-font.ttf"), gTakenBodies[0]);
+    EXPECT_EQ(gTakenBodies[0], gTakenBodies[1]);
+#endif
+  }
+
+  void downloadBufferTest()
+  {
+    rtFileDownloadBuffer buffer;
+    const char* chunk = "0123456789";
+    for (int i = 0; i < 10000; i++)
+      EXPECT_TRUE(buffer.append(chunk, 10));
+    EXPECT_EQ((size_t)100000, buffer.size());
+    size_t size = 0;
+    char* data = buffer.release(size);
+    ASSERT_TRUE(data != NULL);
+    EXPECT_EQ((size_t)100000, size);
+    EXPECT_EQ('\0', data[size]);
+    EXPECT_EQ(0, memcmp(data + 99990, chunk, 10));
+    delete [] data;
+    EXPECT_EQ((size_t)0, buffer.size());
+  }
+
+private:
+  rtTestHttpServer mServer;
+};
+
+TEST_F(rtFileDownloaderTest, rtFileDownloaderTests)
+{
+  concurrentDownloadsTest();
+  slowDownloadsDoNotPinThreadPoolTest();
+  cancelPendingDownloadTest();
+  stopWithUnfinishedDownloadsTest();
+  largeDownloadCopiedOnceTest();
+  cachedDownloadTakenTest();
+  downloadBufferTest();
+}
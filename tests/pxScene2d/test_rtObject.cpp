@@ -27,6 +27,7 @@ limitations under the License.
 #include <unistd.h>
 #include <pxScene2d.h>
 #include <pxImage.h>
+#include <pxTimer.h>
 
 #include "test_includes.h" // Needs to be included last
 
@@ -42,6 +43,15 @@ rtError callbackFn(int numArgs, const rtValue* args, rtValue* result, void* cont
 }
 rtFunctionCallback fnCallback(&callbackFn,NULL);
 
+rtError countingCallbackFn(int numArgs, const rtValue* args, rtValue* result, void* context)
+{
+  UNUSED_PARAM(numArgs);
+  UNUSED_PARAM(args);
+  UNUSED_PARAM(result);
+  (*(int*)context)++;
+  return RT_OK;
+}
+
 class rtEmitTest : public testing::Test
 {
   public:
@@ -92,6 +102,123 @@ class rtEmitTest : public testing::Test
       EXPECT_TRUE (listenerCountBeforeDel - 1 == mEmit->mEntries.size());
     }
 
+    void atomTest()
+    {
+      rtString event("eventatom");
+      rtAtom atom = rtInternAtom(event.cString());
+      EXPECT_TRUE (atom != NULL);
+      EXPECT_TRUE (atom != event.cString());
+      EXPECT_TRUE (atom == rtInternAtom("eventatom"));
+      EXPECT_TRUE (atom == rtFindAtom("eventatom"));
+      EXPECT_TRUE (NULL == rtFindAtom("eventneverinterned"));
+      EXPECT_TRUE (NULL == rtInternAtom(NULL));
+    }
+
+    void sendTest()
+    {
+      int one = 0, two = 0;
+      rtRef<rtEmit> emit = new rtEmit();
+      rtFunctionRef f1 = new rtFunctionCallback(countingCallbackFn, &one);
+      rtFunctionRef f2 = new rtFunctionCallback(countingCallbackFn, &two);
+      EXPECT_TRUE (RT_OK == emit->addListener("eventsendone", f1.getPtr()));
+      EXPECT_TRUE (RT_OK == emit->addListener("eventsendone", f2.getPtr(), true));
+      EXPECT_TRUE (RT_OK == emit->addListener("eventsendtwo", f2.getPtr()));
+      EXPECT_TRUE (2 == emit->mListenerCounts.size());
+      EXPECT_TRUE (2 == emit->mListenerCounts[rtFindAtom("eventsendone")]);
+
+      rtEmitRef e = emit.getPtr();
+      e.send("eventsendone", 1);
+      e.send("eventsendone", 1);
+      e.send("eventsendthree", 1);
+      EXPECT_EQ (2, one);
+      // emitted once and removed
+      EXPECT_EQ (1, two);
+      EXPECT_TRUE (1 == emit->mListenerCounts[rtFindAtom("eventsendone")]);
+
+      e.send("eventsendtwo", 1);
+      EXPECT_EQ (2, two);
+      EXPECT_TRUE (RT_OK == emit->delListener("eventsendtwo", f2.getPtr()));
+      EXPECT_TRUE (emit->mListenerCounts.end() == emit->mListenerCounts.find(rtFindAtom("eventsendtwo")));
+      e.send("eventsendtwo", 1);
+      EXPECT_EQ (2, two);
+
+      EXPECT_TRUE (RT_OK == emit->clearListeners("eventsendone"));
+      EXPECT_TRUE (0 == emit->mEntries.size());
+      EXPECT_TRUE (0 == emit->mListenerCounts.size());
+    }
+
+    void dispatchTest()
+    {
+      // an emitter like a pxObject's, a few listeners for a few events
+      const char* events[] = {"onMouseDown", "onMouseUp", "onMouseEnter", "onMouseLeave",
+                              "onFocus", "onBlur", "onKeyDown", "onKeyUp"};
+      const int numberOfEvents = sizeof(events) / sizeof(events[0]);
+      int counts[numberOfEvents] = {0};
+      rtRef<rtEmit> emit = new rtEmit();
+      vector<rtFunctionRef> functions;
+      for (int i = 0; i < numberOfEvents; i++)
+      {
+        for (int j = 0; j < 2; j++)
+        {
+          functions.push_back(new rtFunctionCallback(countingCallbackFn, &counts[i]));
+          emit->addListener(events[i], functions.back().getPtr());
+        }
+      }
+
+      // each send reaches the listeners of its event and no others
+      rtEmitRef e = emit.getPtr();
+      rtObjectRef event = new rtMapObject;
+      for (int i = 0; i < numberOfEvents; i++)
+      {
+        for (int n = 0; n <= i; n++)
+          e.send(events[i], event);
+        e.send("onMouseMove", event);
+      }
+      for (int i = 0; i < numberOfEvents; i++)
+        EXPECT_EQ ((i + 1) * 2, counts[i]);
+
+      // names are matched whole, not by a shared prefix or case
+      e.send("onMouse", event);
+      e.send("onkeyup", event);
+      e.send("onKeyUpX", event);
+      EXPECT_EQ (numberOfEvents * 2, counts[numberOfEvents - 1]);
+    }
+
+    void dispatchBenchmarkTest()
+    {
+      // an emitter like a pxObject's, a few listeners for a few events
+      int count = 0;
+      rtRef<rtEmit> emit = new rtEmit();
+      const char* events[] = {"onMouseDown", "onMouseUp", "onMouseEnter", "onMouseLeave",
+                              "onFocus", "onBlur", "onKeyDown", "onKeyUp"};
+      vector<rtFunctionRef> functions;
+      for (size_t i = 0; i < sizeof(events) / sizeof(events[0]); i++)
+      {
+        for (int j = 0; j < 2; j++)
+        {
+          functions.push_back(new rtFunctionCallback(countingCallbackFn, &count));
+          emit->addListener(events[i], functions.back().getPtr());
+        }
+      }
+
+      rtEmitRef e = emit.getPtr();
+      rtObjectRef event = new rtMapObject;
+      const int iterations = 200000;
+      double start = pxMilliseconds();
+      for (int i = 0; i < iterations; i++)
+        e.send("onMouseMove", event);
+      double unheardTime = pxMilliseconds() - start;
+
+      start = pxMilliseconds();
+      for (int i = 0; i < iterations; i++)
+        e.send("onKeyUp", event);
+      double heardTime = pxMilliseconds() - start;
+
+      EXPECT_EQ (iterations * 2, count);
+      printf("rtEmit: %d sends to %d listeners, without listeners %.2f ms, with 2 listeners %.2f ms\n",
+             iterations, (int)emit->mEntries.size(), unheardTime, heardTime);
+    }
+
   private:
     rtEmit* mEmit;
 };
@@ -103,6 +230,15 @@ TEST_F(rtEmitTest, rtEmitTests)
   addListenerEmptyFnTest();
   addPendingEventTest();
   delListenerTest();
+  atomTest();
+  sendTest();
+  dispatchTest();
+}
+
+// only prints timings, run with --gtest_also_run_disabled_tests
+TEST_F(rtEmitTest, DISABLED_rtEmitDispatchBenchmark)
+{
+  dispatchBenchmarkTest();
 }
 
 class rtArrayObjectTest : public testing::Test
@@ -247,6 +383,136 @@ class rtObjectTest : public testing::Test
       e = obj.sendReturns("exampleMessage", rtValue(), rtValue(), rtValue(), rtValue(), rtValue(), rtValue(), rtValue(), result);
       EXPECT_TRUE (RT_OK != e);
     }
+
+    // the list walk rtObject::Get used before the per class lookup tables
+    const rtPropertyEntry* walkProperties(const rtObject& obj, const char* name)
+    {
+      for (rtMethodMap* m = obj.getMap(); m; m = m->parentsMap)
+      {
+        for (rtPropertyEntry* e = m->getFirstProperty(); e; e = e->mNext)
+        {
+          if (strcmp(name, e->mPropertyName) == 0)
+            return e;
+        }
+      }
+      return NULL;
+    }
+
+    void propertyLookupTest()
+    {
+      pxImage obj(NULL);
+      rtValue v(10.0f);
+      EXPECT_EQ(RT_OK, obj.Set("x", &v));
+      rtValue x;
+      EXPECT_EQ(RT_OK, obj.Get("x", &x));
+      EXPECT_EQ(10.0f, x.toFloat());
+
+      EXPECT_TRUE(obj.findProperty("x") == walkProperties(obj, "x"));
+      EXPECT_TRUE(obj.findProperty("allKeys") == walkProperties(obj, "allKeys"));
+      EXPECT_TRUE(obj.findProperty("description") == NULL);
+      EXPECT_TRUE(obj.findMethod("description") != NULL);
+      EXPECT_TRUE(obj.findProperty("noSuchProperty") == NULL);
+      EXPECT_EQ(RT_PROP_NOT_FOUND, obj.Get("noSuchProperty", &x));
+      EXPECT_EQ(RT_PROP_NOT_FOUND, obj.Set("noSuchProperty", &v));
+    }
+
+    void methodFunctionCacheTest()
+    {
+      rtObjectRef obj = new rtObject;
+      rtFunctionRef f1 = obj.get<rtFunctionRef>("description");
+      rtFunctionRef f2 = obj.get<rtFunctionRef>("description");
+      EXPECT_TRUE(f1.getPtr() != NULL);
+      EXPECT_TRUE(f1.getPtr() == f2.getPtr());
+      EXPECT_TRUE(f1.getPtr() != obj.get<rtFunctionRef>("init").getPtr());
+
+      rtString d;
+      EXPECT_EQ(RT_OK, f1.sendReturns<rtString>(d));
+      EXPECT_TRUE(d == "rtObject");
+
+      // the object does not keep the function alive
+      int32_t index = ((rtObjectFunction*)f1.getPtr())->mCacheIndex;
+      f1 = NULL;
+      f2 = NULL;
+      EXPECT_TRUE((*((rtObject*)obj.getPtr())->mMethodFunctions)[index] == NULL);
+    }
+
+    const rtMethodEntry* walkMethods(const rtObject& obj, const char* name)
+    {
+      for (rtMethodMap* m = obj.getMap(); m; m = m->parentsMap)
+      {
+        for (rtMethodEntry* e = m->getFirstMethod(); e; e = e->mNext)
+        {
+          if (strcmp(name, e->mMethodName) == 0)
+            return e;
+        }
+      }
+      return NULL;
+    }
+
+    void lookupTableMatchesWalkTest()
+    {
+      rtObjectRef objects[] = {new rtObject, new pxObject(NULL), new pxImage(NULL)};
+      for (size_t i = 0; i < sizeof(objects) / sizeof(objects[0]); i++)
+      {
+        rtObject& obj = *(rtObject*)objects[i].getPtr();
+        vector<string> names;
+        for (rtMethodMap* m = obj.getMap(); m; m = m->parentsMap)
+        {
+          for (rtPropertyEntry* e = m->getFirstProperty(); e; e = e->mNext)
+            names.push_back(e->mPropertyName);
+          for (rtMethodEntry* e = m->getFirstMethod(); e; e = e->mNext)
+            names.push_back(e->mMethodName);
+        }
+        ASSERT_TRUE(names.size() > 0);
+        names.push_back("noSuchName");
+        names.push_back("");
+
+        // the tables find what the walk finds, the most derived entry first
+        size_t mismatches = 0;
+        for (size_t n = 0; n < names.size(); n++)
+        {
+          if (obj.findProperty(names[n].c_str()) != walkProperties(obj, names[n].c_str()))
+            mismatches++;
+          if (obj.findMethod(names[n].c_str()) != walkMethods(obj, names[n].c_str()))
+            mismatches++;
+        }
+        EXPECT_EQ(0u, mismatches);
+      }
+    }
+
+    void lookupBenchmarkTest()
+    {
+      pxImage obj(NULL);
+      vector<string> names;
+      for (rtMethodMap* m = obj.getMap(); m; m = m->parentsMap)
+      {
+        for (rtPropertyEntry* e = m->getFirstProperty(); e; e = e->mNext)
+          names.push_back(e->mPropertyName);
+      }
+      ASSERT_TRUE(names.size() > 0);
+
+      const int iterations = 2000;
+      size_t found = 0;
+      double start = pxMilliseconds();
+      for (int i = 0; i < iterations; i++)
+      {
+        for (size_t n = 0; n < names.size(); n++)
+          found += walkProperties(obj, names[n].c_str()) ? 1 : 0;
+      }
+      double walkTime = pxMilliseconds() - start;
+
+      start = pxMilliseconds();
+      for (int i = 0; i < iterations; i++)
+      {
+        for (size_t n = 0; n < names.size(); n++)
+          found += obj.findProperty(names[n].c_str()) ? 1 : 0;
+      }
+      double lookupTime = pxMilliseconds() - start;
+
+      EXPECT_EQ(names.size() * iterations * 2, found);
+      printf("rtObject: %d lookups of %d names, list walk %.2f ms, lookup table %.2f ms\n",
+             iterations * (int)names.size(), (int)names.size(), walkTime, lookupTime);
+    }
 };
 
 TEST_F(rtObjectTest, rtObjectTests)
@@ -256,6 +522,15 @@ TEST_F(rtObjectTest, rtObjectTests)
   setValWithIdFailedTest();
   sendTests();
   sendReturnsTests();
+  propertyLookupTest();
+  methodFunctionCacheTest();
+  lookupTableMatchesWalkTest();
+}
+
+// only prints timings, run with --gtest_also_run_disabled_tests
+TEST_F(rtObjectTest, DISABLED_rtObjectLookupBenchmark)
+{
+  lookupBenchmarkTest();
 }
 
 class rtMapObjectTest : public testing::Test
@@ -17,12 +17,15 @@ limitations under the License.
 */
 
 #include <sstream>
+#include <string>
+#include <vector>
 
 #define private public
 #define protected public
 
 #include "rtZip.h"
 #include "rtString.h"
+#include "pxTimer.h"
 #include <string.h>
 #include <unistd.h>
 #include <dlfcn.h>
@@ -157,6 +160,197 @@ class rtStringTest : public testing::Test
        EXPECT_TRUE(mData.find(0, 0x34) == -1 );  // Bad !   0x34 = "4"
     }
 
+    void inlineTest()
+    {
+      rtString shortString("short");
+      rtString longString("a string too long to be kept inline");
+
+      EXPECT_TRUE(shortString.isInline());
+      EXPECT_FALSE(longString.isInline());
+      EXPECT_EQ(5, shortString.byteLength());
+      EXPECT_EQ(35, longString.byteLength());
+
+      // a string shrinking back into the inline storage lets go of its buffer
+      longString = "short again";
+      EXPECT_TRUE(longString.isInline());
+      EXPECT_TRUE(longString == "short again");
+
+      rtString embedded("ab\0cd", 5);
+      EXPECT_EQ(2, embedded.byteLength());
+      EXPECT_TRUE(embedded == "ab");
+    }
+
+    void copyOnWriteTest()
+    {
+      rtString original("a string too long to be kept inline");
+      rtString copy(original);
+      rtString assigned;
+      assigned = copy;
+
+      EXPECT_EQ(original.cString(), copy.cString());
+      EXPECT_EQ(original.cString(), assigned.cString());
+      EXPECT_EQ(3, (int32_t)original.sharedBuffer()->refCount);
+
+      copy.append("!");
+      EXPECT_NE(original.cString(), copy.cString());
+      EXPECT_EQ(2, (int32_t)original.sharedBuffer()->refCount);
+      EXPECT_TRUE(original == "a string too long to be kept inline");
+      EXPECT_TRUE(copy == "a string too long to be kept inline!");
+
+      assigned.toLowerAscii();
+      assigned = "A STRING TOO LONG TO BE KEPT INLINE";
+      assigned.toLowerAscii();
+      EXPECT_TRUE(assigned == "a string too long to be kept inline");
+      EXPECT_EQ(1, (int32_t)original.sharedBuffer()->refCount);
+    }
+
+    void moveTest()
+    {
+      rtString longString("a string too long to be kept inline");
+      const char* data = longString.cString();
+      rtString moved(std::move(longString));
+      EXPECT_EQ(data, moved.cString());
+      EXPECT_TRUE(longString.isEmpty());
+
+      rtString assigned("short");
+      assigned = std::move(moved);
+      EXPECT_EQ(data, assigned.cString());
+      EXPECT_TRUE(moved.isEmpty());
+
+      rtString shortString("short");
+      rtString movedShort(std::move(shortString));
+      EXPECT_TRUE(movedShort == "short");
+    }
+
+    void appendSelfTest()
+    {
+      rtString s("0123456789");
+      s.append(s.cString());
+      EXPECT_TRUE(s == "01234567890123456789");
+      s += s;
+      EXPECT_TRUE(s == "0123456789012345678901234567890123456789");
+      EXPECT_EQ(40, s.byteLength());
+      s.append(s.cString() + 30);
+      EXPECT_TRUE(s == "01234567890123456789012345678901234567890123456789");
+      s = s.cString() + 40;
+      EXPECT_TRUE(s == "0123456789");
+    }
+
+    void appendGrowthTest()
+    {
+      // appending a piece at a time only reallocates now and then
+      rtString s;
+      uint32_t reallocations = 0;
+      const char* data = s.cString();
+      for (int i = 0; i < 1000; i++)
+      {
+        s.append("x");
+        if (s.cString() != data)
+        {
+          reallocations++;
+          data = s.cString();
+        }
+      }
+      EXPECT_EQ(1000, s.byteLength());
+      EXPECT_LT(reallocations, 20u);
+    }
+
+    void inlineBoundaryTest()
+    {
+      // the longest string kept inline, and one byte more
+      std::string longest(RT_STRING_INLINE_SIZE - 1, 'a');
+      rtString fits(longest.c_str());
+      rtString spills((longest + "b").c_str());
+      EXPECT_TRUE(fits.isInline());
+      EXPECT_FALSE(spills.isInline());
+      EXPECT_EQ(RT_STRING_INLINE_SIZE - 1, fits.byteLength());
+      EXPECT_EQ(RT_STRING_INLINE_SIZE, spills.byteLength());
+
+      // growing across the boundary a byte at a time keeps the length and text
+      rtString grown;
+      std::string expected;
+      for (int i = 0; i < 2 * RT_STRING_INLINE_SIZE; i++)
+      {
+        char c[2] = {(char)('a' + i % 26), 0};
+        grown.append(c);
+        expected += c;
+        EXPECT_EQ((int32_t)expected.size(), grown.byteLength());
+        EXPECT_EQ((int32_t)strlen(grown.cString()), grown.byteLength());
+        EXPECT_TRUE(grown == expected.c_str());
+        EXPECT_EQ((int)expected.size() < RT_STRING_INLINE_SIZE, grown.isInline());
+      }
+    }
+
+    void sharedCopiesTest()
+    {
+      // copies of a short string are inline, copies of a long one share its buffer
+      rtString shortString("onmousedown");
+      rtString longString("http://www.example.com/images/background.png");
+      {
+        std::vector<rtString> copies(100, shortString);
+        for (size_t i = 0; i < copies.size(); i++)
+        {
+          EXPECT_TRUE(copies[i].isInline());
+          EXPECT_TRUE(copies[i] == shortString);
+        }
+      }
+      {
+        std::vector<rtString> copies(100, longString);
+        EXPECT_EQ(101, (int32_t)longString.sharedBuffer()->refCount);
+        EXPECT_EQ(longString.cString(), copies[99].cString());
+        copies[50].append("?x=1");
+        EXPECT_EQ(100, (int32_t)longString.sharedBuffer()->refCount);
+        EXPECT_EQ(longString.byteLength() + 4, copies[50].byteLength());
+      }
+      EXPECT_EQ(1, (int32_t)longString.sharedBuffer()->refCount);
+      EXPECT_TRUE(longString == "http://www.example.com/images/background.png");
+    }
+
+    void performanceTest()
+    {
+      const int iterations = 1000000;
+      rtString shortString("onmousedown");
+      rtString longString("http://www.example.com/images/background.png");
+
+      double start = pxMilliseconds();
+      for (int i = 0; i < iterations; i++)
+      {
+        rtString copy(shortString);
+        EXPECT_TRUE(copy.isInline());
+      }
+      double shortCopyTime = pxMilliseconds() - start;
+
+      start = pxMilliseconds();
+      for (int i = 0; i < iterations; i++)
+      {
+        rtString copy(longString);
+      }
+      double longCopyTime = pxMilliseconds() - start;
+      // none of those copies allocated
+      EXPECT_EQ(1, (int32_t)longString.sharedBuffer()->refCount);
+
+      start = pxMilliseconds();
+      int32_t length = 0;
+      for (int i = 0; i < iterations; i++)
+      {
+        length += longString.byteLength();
+      }
+      double lengthTime = pxMilliseconds() - start;
+      EXPECT_EQ(iterations * longString.byteLength(), length);
+
+      start = pxMilliseconds();
+      rtString appended;
+      for (int i = 0; i < iterations / 10; i++)
+      {
+        appended.append("0123456789");
+      }
+      double appendTime = pxMilliseconds() - start;
+      EXPECT_EQ(iterations, appended.byteLength());
+
+      printf("rtString: %d copies of a short string %.2f ms, of a long string %.2f ms, byteLength %.2f ms, "
+             "%d appends %.2f ms\n", iterations, shortCopyTime, longCopyTime, lengthTime, iterations / 10, appendTime);
+    }
+
     private:
       rtString mData;
 };
@@ -174,5 +368,19 @@ TEST_F(rtStringTest, rtStringTests)
   beginsTest();
   substringTest();
   findTests();
+
+  inlineTest();
+  copyOnWriteTest();
+  moveTest();
+  appendSelfTest();
+  appendGrowthTest();
+  inlineBoundaryTest();
+  sharedCopiesTest();
+}
+
+// only prints timings, run with --gtest_also_run_disabled_tests
+TEST_F(rtStringTest, DISABLED_rtStringBenchmark)
+{
+  performanceTest();
 }
 
@@ -17,18 +17,81 @@ limitations under the License.
 */
 
 #include <sstream>
+#include <vector>
+#include <thread>
 
 #define private public
 #define protected public
 
 #include "rtThreadPool.h"
 #include "rtString.h"
+#include "rtAtomic.h"
+#include "pxTimer.h"
 #include <string.h>
 
 #include "test_includes.h" // Needs to be included last
 
 using namespace std;
 
+static rtAtomic gTaskGateOpen = 0;
+static rtAtomic gTasksExecuted = 0;
+static rtMutex gTaskOrderMutex;
+static vector<int> gTaskOrder;
+static vector<int32_t> gTaskRuns;
+
+static void gateTask(void* /*data*/)
+{
+  while (gTaskGateOpen == 0)
+  {
+    pxSleepMS(1);
+  }
+}
+
+static void recordOrderTask(void* data)
+{
+  rtMutexLockGuard g(gTaskOrderMutex);
+  gTaskOrder.push_back((int)(intptr_t)data);
+}
+
+static void countTask(void* /*data*/)
+{
+  rtAtomicInc(&gTasksExecuted);
+}
+
+static void markTask(void* data)
+{
+  rtAtomicInc(&gTaskRuns[(intptr_t)data]);
+  rtAtomicInc(&gTasksExecuted);
+}
+
+static bool waitForTasks(int expected, double timeoutInSeconds)
+{
+  double start = pxSeconds();
+  while (gTasksExecuted < expected && (pxSeconds() - start) < timeoutInSeconds)
+  {
+    pxSleepMS(1);
+  }
+  return gTasksExecuted == expected;
+}
+
+static void produceCountTasks(rtThreadPool* pool, int count)
+{
+  for (int i = 0; i < count; i++)
+  {
+    pool->executeTask(new rtThreadTask(countTask, NULL, "",
+                                       (rtThreadTaskPriority)(i % RT_THREAD_TASK_PRIORITY_COUNT)));
+  }
+}
+
+static void produceTasks(rtThreadPool* pool, int first, int count)
+{
+  for (int i = 0; i < count; i++)
+  {
+    pool->executeTask(new rtThreadTask(markTask, (void*)(intptr_t)(first + i), "",
+                                       (rtThreadTaskPriority)(i % RT_THREAD_TASK_PRIORITY_COUNT)));
+  }
+}
+
 class rtThreadPoolTest : public testing::Test
 {
   public:
@@ -72,6 +135,115 @@ class rtThreadPoolTest : public testing::Test
       p.raisePriority(s);
       EXPECT_TRUE(p.mRunning == true);
     }
+
+    void priorityOrderTest()
+    {
+      rtThreadPool p(1);
+      gTaskGateOpen = 0;
+      gTaskOrder.clear();
+      p.executeTask(new rtThreadTask(gateTask, NULL, "gate"));
+      // give the single worker time to pick up the gate task
+      pxSleepMS(50);
+      p.executeTask(new rtThreadTask(recordOrderTask, (void*)1, "background", RT_THREAD_TASK_PRIORITY_BACKGROUND));
+      p.executeTask(new rtThreadTask(recordOrderTask, (void*)2, "prefetch", RT_THREAD_TASK_PRIORITY_PREFETCH));
+      p.executeTask(new rtThreadTask(recordOrderTask, (void*)3, "visible", RT_THREAD_TASK_PRIORITY_VISIBLE));
+      p.executeTask(new rtThreadTask(recordOrderTask, (void*)4, "raised", RT_THREAD_TASK_PRIORITY_BACKGROUND));
+      p.raisePriority("raised");
+      gTaskGateOpen = 1;
+
+      double start = pxSeconds();
+      while ((pxSeconds() - start) < 5.0)
+      {
+        {
+          rtMutexLockGuard g(gTaskOrderMutex);
+          if (gTaskOrder.size() == 4)
+            break;
+        }
+        pxSleepMS(1);
+      }
+      rtMutexLockGuard g(gTaskOrderMutex);
+      ASSERT_EQ(4, (int)gTaskOrder.size());
+      EXPECT_EQ(4, gTaskOrder[0]);
+      EXPECT_EQ(3, gTaskOrder[1]);
+      EXPECT_EQ(2, gTaskOrder[2]);
+      EXPECT_EQ(1, gTaskOrder[3]);
+    }
+
+    void cancelTaskTest()
+    {
+      rtThreadPool p(1);
+      gTaskGateOpen = 0;
+      gTasksExecuted = 0;
+      p.executeTask(new rtThreadTask(gateTask, NULL, "gate"));
+      pxSleepMS(50);
+      p.executeTask(new rtThreadTask(countTask, NULL, "http://localhost/a.png"));
+      p.executeTask(new rtThreadTask(countTask, NULL, "http://localhost/b.png"));
+      p.executeTask(new rtThreadTask(countTask, NULL, "http://localhost/a.png", RT_THREAD_TASK_PRIORITY_VISIBLE));
+      EXPECT_EQ(2, p.cancelTask("http://localhost/a.png"));
+      EXPECT_EQ(0, p.cancelTask("http://localhost/c.png"));
+      gTaskGateOpen = 1;
+      EXPECT_TRUE(waitForTasks(1, 5.0));
+      pxSleepMS(50);
+      EXPECT_EQ(1, gTasksExecuted);
+    }
+
+    void concurrentProducersTest()
+    {
+      // producers racing each other and the workers for the queues, with
+      // every task run exactly once
+      const int numberOfProducers = 4;
+      const int tasksPerProducer = 25000;
+      const int numberOfTasks = numberOfProducers * tasksPerProducer;
+      rtThreadPool p(6);
+      gTasksExecuted = 0;
+      gTaskRuns.assign(numberOfTasks, 0);
+
+      vector<thread*> producers;
+      for (int i = 0; i < numberOfProducers; i++)
+      {
+        producers.push_back(new thread(produceTasks, &p, i * tasksPerProducer, tasksPerProducer));
+      }
+      for (size_t i = 0; i < producers.size(); i++)
+      {
+        producers[i]->join();
+        delete producers[i];
+      }
+      EXPECT_TRUE(waitForTasks(numberOfTasks, 30.0));
+      int missed = 0, repeated = 0;
+      for (int i = 0; i < numberOfTasks; i++)
+      {
+        missed += gTaskRuns[i] == 0 ? 1 : 0;
+        repeated += gTaskRuns[i] > 1 ? 1 : 0;
+      }
+      EXPECT_EQ(0, missed);
+      EXPECT_EQ(0, repeated);
+      EXPECT_EQ(0, p.mPendingTasks);
+    }
+
+    void contentionBenchmarkTest()
+    {
+      const int numberOfProducers = 4;
+      const int tasksPerProducer = 25000;
+      rtThreadPool p(6);
+      gTasksExecuted = 0;
+
+      double start = pxMilliseconds();
+      vector<thread*> producers;
+      for (int i = 0; i < numberOfProducers; i++)
+      {
+        producers.push_back(new thread(produceCountTasks, &p, tasksPerProducer));
+      }
+      for (size_t i = 0; i < producers.size(); i++)
+      {
+        producers[i]->join();
+        delete producers[i];
+      }
+      EXPECT_TRUE(waitForTasks(numberOfProducers * tasksPerProducer, 30.0));
+      double elapsed = pxMilliseconds() - start;
+      printf("rtThreadPool contention benchmark: %d tasks from %d producers on %d workers in %.2f ms\n",
+             numberOfProducers * tasksPerProducer, numberOfProducers, p.numberOfThreadsInPool(), elapsed);
+      EXPECT_EQ(0, p.mPendingTasks);
+    }
 };
 
 TEST_F(rtThreadPoolTest, rtThreadPoolTests)
@@ -80,4 +252,13 @@ TEST_F(rtThreadPoolTest, rtThreadPoolTests)
   destructionNonGlobalTest();
   destructionGlobalTest();
   raisePriorityTest();
+  priorityOrderTest();
+  cancelTaskTest();
+  concurrentProducersTest();
+}
+
+// only prints timings, run with --gtest_also_run_disabled_tests
+TEST_F(rtThreadPoolTest, DISABLED_rtThreadPoolContentionBenchmark)
+{
+  contentionBenchmarkTest();
 }
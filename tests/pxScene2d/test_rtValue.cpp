@@ -22,6 +22,7 @@ limitations under the License.
 #define protected public
 
 #include "rtValue.h"
+#include "pxTimer.h"
 #include <string.h>
 
 #include "test_includes.h" // Needs to be included last
@@ -554,6 +555,73 @@ class rtValueTest : public testing::Test
         // rtValue voidPtrVal.getVALUE(voidPtr v);
     }
 
+    void stringStorageTest()
+    {
+      // strings are held by the value itself and copies share long ones
+      rtValue shortVal("short");
+      EXPECT_TRUE( shortVal.mValue.stringValue == &shortVal.mString );
+      EXPECT_TRUE( shortVal.mString.isInline() );
+
+      rtValue longVal(rtString("a string too long to be kept inline"));
+      rtValue copyVal(longVal);
+      rtString sv;
+      copyVal.getString( sv );
+      EXPECT_TRUE( copyVal.mValue.stringValue == &copyVal.mString );
+      EXPECT_EQ( longVal.mString.cString(), copyVal.mString.cString() );
+      EXPECT_EQ( longVal.mString.cString(), sv.cString() );
+
+      // assigning a value its own string keeps it
+      copyVal.setString( copyVal.mString );
+      EXPECT_TRUE( copyVal.toString() == "a string too long to be kept inline" );
+
+      copyVal = 32;
+      EXPECT_TRUE( copyVal.mString.isEmpty() );
+      EXPECT_TRUE( longVal.toString() == "a string too long to be kept inline" );
+    }
+
+    void stringValueBenchmarkTest()
+    {
+      const int iterations = 1000000;
+      rtString shortString("onmousedown");
+      rtString longString("http://www.example.com/images/background.png");
+
+      double start = pxMilliseconds();
+      for (int i = 0; i < iterations; i++)
+      {
+        rtValue v;
+        v.setString( shortString );
+      }
+      double shortSetTime = pxMilliseconds() - start;
+
+      rtValue shortVal(shortString);
+      start = pxMilliseconds();
+      for (int i = 0; i < iterations; i++)
+      {
+        rtValue copy(shortVal);
+      }
+      double shortCopyTime = pxMilliseconds() - start;
+
+      rtValue longVal(longString);
+      start = pxMilliseconds();
+      for (int i = 0; i < iterations; i++)
+      {
+        rtValue copy(longVal);
+      }
+      double longCopyTime = pxMilliseconds() - start;
+
+      start = pxMilliseconds();
+      int32_t length = 0;
+      for (int i = 0; i < iterations; i++)
+      {
+        length += longVal.toString().byteLength();
+      }
+      double toStringTime = pxMilliseconds() - start;
+      EXPECT_EQ( iterations * longString.byteLength(), length );
+
+      printf("rtValue: %d short string sets %.2f ms, copies of a short string %.2f ms, of a long string %.2f ms, "
+             "toString %.2f ms\n", iterations, shortSetTime, shortCopyTime, longCopyTime, toStringTime);
+    }
+
     void testStringType()
     {
       // Some exceptions from pattern...
@@ -793,8 +861,14 @@ TEST_F(rtValueTest, rtValueTests)
   getDoubleTest();
 
   getStringTest();
+  stringStorageTest();
   testStringType();
   
   compareTest();
 }
 
+// only prints timings, run with --gtest_also_run_disabled_tests
+TEST_F(rtValueTest, DISABLED_rtValueStringBenchmark)
+{
+  stringValueBenchmarkTest();
+}
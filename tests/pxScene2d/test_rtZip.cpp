@@ -24,6 +24,7 @@ limitations under the License.
 #include "rtZip.h"
 #include "rtString.h"
 #include <string.h>
+#include <vector>
 #include <unistd.h>
 #include <dlfcn.h>
 
@@ -137,7 +138,238 @@ class rtZipTest : public testing::Test
       EXPECT_TRUE( rtZip::isZip(buffer.data(), buffer.length()) );
     }
 
+    void indexTest()
+    {
+      rtData  buffer;
+      rtError ret = rtLoadFile("supportfiles/test_arc_resources.jar", buffer);
+      EXPECT_TRUE(ret == RT_OK);
+
+      ret = mData.initFromBuffer(buffer.data(), buffer.length());
+      EXPECT_TRUE(ret == RT_OK);
+      EXPECT_EQ(mData.fileCount(), mData.mEntries.size());
+      EXPECT_EQ(mData.fileCount(), mData.mIndex.size());
+
+      // every file of a buffer is read without minizip
+      for (size_t i = 0; i < mData.mEntries.size(); i++)
+      {
+        EXPECT_TRUE(mData.mEntries[i].dataOffset >= 0);
+      }
+
+      rtData data;
+      ret = mData.getFileData("package.json", data);
+      EXPECT_TRUE(ret == RT_OK);
+      EXPECT_EQ(23u, data.length());
+
+      // the same bytes through minizip
+      rtZip file;
+      ret = file.initFromFile("supportfiles/test_arc_resources.jar");
+      EXPECT_TRUE(ret == RT_OK);
+      EXPECT_TRUE(file.mEntries[0].dataOffset < 0);
+      for (uint32_t i = 0; i < file.fileCount(); i++)
+      {
+        rtString path;
+        EXPECT_TRUE(file.getFilePathAtIndex(i, path) == RT_OK);
+        rtData fromFile, fromBuffer;
+        EXPECT_TRUE(file.getFileData(path.cString(), fromFile) == RT_OK);
+        EXPECT_TRUE(mData.getFileData(path.cString(), fromBuffer) == RT_OK);
+        EXPECT_EQ(fromFile.length(), fromBuffer.length());
+        EXPECT_TRUE(memcmp(fromFile.data(), fromBuffer.data(), fromFile.length()) == 0);
+      }
+
+      // compressed files can't be handed out in place
+      const uint8_t* stored = NULL;
+      uint32_t length = 0;
+      ret = mData.getStoredFileData("package.json", stored, length);
+      EXPECT_TRUE(ret == RT_FAIL);
+    }
+
+    void getStoredFileDataTest()
+    {
+      rtData  buffer;
+      rtError ret = rtLoadFile("supportfiles/ziptest.zip", buffer);
+      EXPECT_TRUE(ret == RT_OK);
+
+      ret = mData.initFromBuffer(buffer.data(), buffer.length());
+      EXPECT_TRUE(ret == RT_OK);
+
+      const uint8_t* stored = NULL;
+      uint32_t length = 0;
+      ret = mData.getStoredFileData("ziptest/file1", stored, length);
+      EXPECT_TRUE(ret == RT_OK);
+      EXPECT_TRUE(stored >= mData.mBuffer && stored + length <= mData.mBuffer + mData.mBufferSize);
+
+      rtData data;
+      ret = mData.getFileData("ziptest/file1", data);
+      EXPECT_TRUE(ret == RT_OK);
+      EXPECT_EQ(data.length(), length);
+      EXPECT_TRUE(memcmp(data.data(), stored, length) == 0);
+
+      ret = mData.getStoredFileData("does_not_exist", stored, length);
+      EXPECT_TRUE(ret == RT_FAIL);
+
+      rtZip file;
+      ret = file.initFromFile("supportfiles/ziptest.zip");
+      EXPECT_TRUE(ret == RT_OK);
+      ret = file.getStoredFileData("ziptest/file1", stored, length);
+      EXPECT_TRUE(ret == RT_FAIL);
+    }
+
+    void getFilesDataTest()
+    {
+      const uint32_t count = 64;
+      rtData buffer;
+      makeZip(count, 16 * 1024, buffer);
+
+      rtError ret = mData.initFromBuffer(buffer.data(), buffer.length());
+      EXPECT_TRUE(ret == RT_OK);
+      EXPECT_EQ(count, mData.fileCount());
+
+      std::vector<rtString> paths(count + 1);
+      for (uint32_t i = 0; i < count; i++)
+      {
+        EXPECT_TRUE(mData.getFilePathAtIndex(i, paths[i]) == RT_OK);
+      }
+      paths[count] = "does_not_exist";
+
+      rtData* data = new rtData[count + 1];
+      std::vector<rtError> results(count + 1);
+      ret = mData.getFilesData(&paths[0], count + 1, data, &results[0]);
+      EXPECT_TRUE(ret == RT_FAIL);
+      EXPECT_TRUE(results[count] == RT_FAIL);
+
+      for (uint32_t i = 0; i < count; i++)
+      {
+        EXPECT_TRUE(results[i] == RT_OK);
+        rtData expected;
+        EXPECT_TRUE(mData.getFileData(paths[i].cString(), expected) == RT_OK);
+        EXPECT_EQ(expected.length(), data[i].length());
+        EXPECT_TRUE(memcmp(expected.data(), data[i].data(), expected.length()) == 0);
+      }
+      delete [] data;
+    }
+
+    void largeArchiveLookupTest()
+    {
+      const uint32_t count = 4000;
+      rtData buffer;
+      makeZip(count, 256, buffer);
+
+      rtError ret = mData.initFromBuffer(buffer.data(), buffer.length());
+      EXPECT_TRUE(ret == RT_OK);
+      EXPECT_EQ(count, mData.mIndex.size());
+
+      // the index finds the entries the central directory scan finds
+      for (uint32_t i = 0; i < count; i += 7)
+      {
+        rtString path;
+        EXPECT_TRUE(mData.getFilePathAtIndex(i, path) == RT_OK);
+        const rtZip::entry* e = mData.findEntry(path.cString());
+        ASSERT_TRUE(e != NULL);
+        EXPECT_EQ(UNZ_OK, unzLocateFile(mData.mUnzFile, path.cString(), 0));
+        unz64_file_pos pos;
+        EXPECT_EQ(UNZ_OK, unzGetFilePos64(mData.mUnzFile, &pos));
+        EXPECT_EQ(pos.pos_in_zip_directory, e->pos.pos_in_zip_directory);
+        EXPECT_EQ(pos.num_of_file, e->pos.num_of_file);
+      }
+      EXPECT_TRUE(mData.findEntry("images/image4000.png") == NULL);
+      EXPECT_TRUE(mData.findEntry("images/image1") == NULL);
+      EXPECT_NE(UNZ_OK, unzLocateFile(mData.mUnzFile, "images/image4000.png", 0));
+    }
+
     private:
+      // a zip of deflated files of text like data, every fourth one stored
+      void makeZip(uint32_t count, uint32_t size, rtData& zip)
+      {
+        std::vector<uint8_t> out, central;
+        std::vector<uint8_t> content(size), compressed(compressBound(size));
+        for (uint32_t i = 0; i < count; i++)
+        {
+          char name[64];
+          sprintf(name, "images/image%u.png", i);
+          for (uint32_t j = 0; j < size; j++)
+          {
+            content[j] = (uint8_t)("spark archive "[(i + j * 7 / 5) % 14] + (j % 97 == 0));
+          }
+
+          uint32_t method = i % 4 == 0 ? 0 : Z_DEFLATED;
+          uint32_t compressedSize = size;
+          const uint8_t* data = &content[0];
+          if (method == Z_DEFLATED)
+          {
+            z_stream stream;
+            memset(&stream, 0, sizeof(stream));
+            deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+            stream.next_in = &content[0];
+            stream.avail_in = size;
+            stream.next_out = &compressed[0];
+            stream.avail_out = compressed.size();
+            deflate(&stream, Z_FINISH);
+            compressedSize = stream.total_out;
+            deflateEnd(&stream);
+            data = &compressed[0];
+          }
+          uint32_t crc = crc32(0, &content[0], size);
+          uint32_t nameLength = strlen(name);
+          uint32_t offset = out.size();
+
+          write32(out, 0x04034b50);
+          write16(out, 20);
+          write16(out, 0);
+          write16(out, method);
+          write32(out, 0);
+          write32(out, crc);
+          write32(out, compressedSize);
+          write32(out, size);
+          write16(out, nameLength);
+          write16(out, 0);
+          out.insert(out.end(), name, name + nameLength);
+          out.insert(out.end(), data, data + compressedSize);
+
+          write32(central, 0x02014b50);
+          write16(central, 20);
+          write16(central, 20);
+          write16(central, 0);
+          write16(central, method);
+          write32(central, 0);
+          write32(central, crc);
+          write32(central, compressedSize);
+          write32(central, size);
+          write16(central, nameLength);
+          write16(central, 0);
+          write16(central, 0);
+          write16(central, 0);
+          write16(central, 0);
+          write32(central, 0);
+          write32(central, offset);
+          central.insert(central.end(), name, name + nameLength);
+        }
+
+        uint32_t centralOffset = out.size();
+        out.insert(out.end(), central.begin(), central.end());
+        write32(out, 0x06054b50);
+        write16(out, 0);
+        write16(out, 0);
+        write16(out, count);
+        write16(out, count);
+        write32(out, central.size());
+        write32(out, centralOffset);
+        write16(out, 0);
+
+        zip.init(&out[0], out.size());
+      }
+
+      void write16(std::vector<uint8_t>& v, uint32_t n)
+      {
+        v.push_back(n & 0xff);
+        v.push_back((n >> 8) & 0xff);
+      }
+
+      void write32(std::vector<uint8_t>& v, uint32_t n)
+      {
+        write16(v, n & 0xffff);
+        write16(v, n >> 16);
+      }
+
       rtZip mData;
 };
 
@@ -153,4 +385,9 @@ TEST_F(rtZipTest, rtZipTests)
   getFileDataTest();
 
   isZipTest();
+
+  indexTest();
+  getStoredFileDataTest();
+  getFilesDataTest();
+  largeArchiveLookupTest();
 }